@@ -0,0 +1,375 @@
+#include "blake3.h"
+#include <algorithm>
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BLAKE3_X86 1
+#endif
+
+namespace {
+
+const uint32_t kIv[8] = {0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+                         0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19};
+
+const uint8_t kMsgPermutation[16] = {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8};
+
+enum : uint32_t {
+    kChunkStart = 1 << 0,
+    kChunkEnd = 1 << 1,
+    kParent = 1 << 2,
+    kRoot = 1 << 3,
+};
+
+inline uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+inline void g(uint32_t* s, int a, int b, int c, int d, uint32_t mx, uint32_t my) {
+    s[a] = s[a] + s[b] + mx;
+    s[d] = rotr(s[d] ^ s[a], 16);
+    s[c] = s[c] + s[d];
+    s[b] = rotr(s[b] ^ s[c], 12);
+    s[a] = s[a] + s[b] + my;
+    s[d] = rotr(s[d] ^ s[a], 8);
+    s[c] = s[c] + s[d];
+    s[b] = rotr(s[b] ^ s[c], 7);
+}
+
+inline void round_fn(uint32_t* s, const uint32_t* m) {
+    // Columns, then diagonals
+    g(s, 0, 4, 8, 12, m[0], m[1]);
+    g(s, 1, 5, 9, 13, m[2], m[3]);
+    g(s, 2, 6, 10, 14, m[4], m[5]);
+    g(s, 3, 7, 11, 15, m[6], m[7]);
+    g(s, 0, 5, 10, 15, m[8], m[9]);
+    g(s, 1, 6, 11, 12, m[10], m[11]);
+    g(s, 2, 7, 8, 13, m[12], m[13]);
+    g(s, 3, 4, 9, 14, m[14], m[15]);
+}
+
+#ifdef BLAKE3_X86
+
+__attribute__((target("avx2"))) inline __m256i rotr8(__m256i x, int n) {
+    return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+}
+
+__attribute__((target("avx2"))) inline void g8(__m256i* s, int a, int b, int c, int d, __m256i mx, __m256i my) {
+    s[a] = _mm256_add_epi32(_mm256_add_epi32(s[a], s[b]), mx);
+    s[d] = rotr8(_mm256_xor_si256(s[d], s[a]), 16);
+    s[c] = _mm256_add_epi32(s[c], s[d]);
+    s[b] = rotr8(_mm256_xor_si256(s[b], s[c]), 12);
+    s[a] = _mm256_add_epi32(_mm256_add_epi32(s[a], s[b]), my);
+    s[d] = rotr8(_mm256_xor_si256(s[d], s[a]), 8);
+    s[c] = _mm256_add_epi32(s[c], s[d]);
+    s[b] = rotr8(_mm256_xor_si256(s[b], s[c]), 7);
+}
+
+/**
+ * @brief One block in each of eight lanes. cv is [word][lane] and is replaced
+ *        by the chaining value; per-lane counter, length and flags.
+ */
+__attribute__((target("avx2")))
+void compress_x8(uint32_t cv[8][8], const uint8_t* const blocks[8], const uint32_t counter_lo[8],
+                 const uint32_t counter_hi[8], const uint32_t block_len[8], const uint32_t flags[8]) {
+    __m256i m[16];
+    // Transpose each half-block so m[i] holds message word i of every lane (little-endian, no swap)
+    for (int half = 0; half < 2; ++half) {
+        __m256i r[8], t[8], u[8];
+        for (int l = 0; l < 8; ++l) {
+            r[l] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(blocks[l] + 32 * half));
+        }
+        for (int p = 0; p < 4; ++p) {
+            t[2 * p] = _mm256_unpacklo_epi32(r[2 * p], r[2 * p + 1]);
+            t[2 * p + 1] = _mm256_unpackhi_epi32(r[2 * p], r[2 * p + 1]);
+        }
+        for (int q = 0; q < 2; ++q) {
+            u[4 * q] = _mm256_unpacklo_epi64(t[4 * q], t[4 * q + 2]);
+            u[4 * q + 1] = _mm256_unpackhi_epi64(t[4 * q], t[4 * q + 2]);
+            u[4 * q + 2] = _mm256_unpacklo_epi64(t[4 * q + 1], t[4 * q + 3]);
+            u[4 * q + 3] = _mm256_unpackhi_epi64(t[4 * q + 1], t[4 * q + 3]);
+        }
+        for (int k = 0; k < 4; ++k) {
+            m[8 * half + k] = _mm256_permute2x128_si256(u[k], u[k + 4], 0x20);
+            m[8 * half + k + 4] = _mm256_permute2x128_si256(u[k], u[k + 4], 0x31);
+        }
+    }
+
+    __m256i s[16];
+    for (int i = 0; i < 8; ++i) s[i] = _mm256_load_si256(reinterpret_cast<const __m256i*>(cv[i]));
+    for (int i = 0; i < 4; ++i) s[8 + i] = _mm256_set1_epi32(int(kIv[i]));
+    s[12] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(counter_lo));
+    s[13] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(counter_hi));
+    s[14] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block_len));
+    s[15] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(flags));
+    for (int r = 0; r < 7; ++r) {
+        g8(s, 0, 4, 8, 12, m[0], m[1]);
+        g8(s, 1, 5, 9, 13, m[2], m[3]);
+        g8(s, 2, 6, 10, 14, m[4], m[5]);
+        g8(s, 3, 7, 11, 15, m[6], m[7]);
+        g8(s, 0, 5, 10, 15, m[8], m[9]);
+        g8(s, 1, 6, 11, 12, m[10], m[11]);
+        g8(s, 2, 7, 8, 13, m[12], m[13]);
+        g8(s, 3, 4, 9, 14, m[14], m[15]);
+        if (r == 6) break;
+        __m256i permuted[16];
+        for (int i = 0; i < 16; ++i) permuted[i] = m[kMsgPermutation[i]];
+        for (int i = 0; i < 16; ++i) m[i] = permuted[i];
+    }
+    for (int i = 0; i < 8; ++i) {
+        _mm256_store_si256(reinterpret_cast<__m256i*>(cv[i]), _mm256_xor_si256(s[i], s[i + 8]));
+    }
+}
+
+#endif // BLAKE3_X86
+
+} // namespace
+
+void Blake3::load_block(const uint8_t* bytes, uint32_t words[16]) {
+    for (int i = 0; i < 16; ++i) {
+        words[i] = uint32_t(bytes[4 * i]) | uint32_t(bytes[4 * i + 1]) << 8 |
+                   uint32_t(bytes[4 * i + 2]) << 16 | uint32_t(bytes[4 * i + 3]) << 24;
+    }
+}
+
+/**
+ * @brief The BLAKE3 compression function: 7 rounds, permuting the message between rounds.
+ */
+void Blake3::compress(const uint32_t cv[8], const uint32_t block[16], uint64_t counter,
+                      uint32_t block_len, uint32_t flags, uint32_t out[16]) {
+    uint32_t s[16] = {cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+                      kIv[0], kIv[1], kIv[2], kIv[3],
+                      uint32_t(counter), uint32_t(counter >> 32), block_len, flags};
+    uint32_t m[16];
+    std::memcpy(m, block, sizeof(m));
+    for (int r = 0; r < 7; ++r) {
+        round_fn(s, m);
+        if (r == 6) break;
+        uint32_t permuted[16];
+        for (int i = 0; i < 16; ++i) permuted[i] = m[kMsgPermutation[i]];
+        std::memcpy(m, permuted, sizeof(m));
+    }
+    for (int i = 0; i < 8; ++i) {
+        out[i] = s[i] ^ s[i + 8];
+        out[i + 8] = s[i + 8] ^ cv[i];
+    }
+}
+
+void Blake3::Output::chaining_value(uint32_t out[8]) const {
+    uint32_t words[16];
+    compress(cv, block, counter, block_len, flags, words);
+    std::memcpy(out, words, 8 * sizeof(uint32_t));
+}
+
+Digest256 Blake3::Output::root() const {
+    uint32_t words[16];
+    compress(cv, block, 0, block_len, flags | kRoot, words);
+    Digest256 d;
+    for (int i = 0; i < 8; ++i) {
+        d.bytes[4 * i] = uint8_t(words[i]);
+        d.bytes[4 * i + 1] = uint8_t(words[i] >> 8);
+        d.bytes[4 * i + 2] = uint8_t(words[i] >> 16);
+        d.bytes[4 * i + 3] = uint8_t(words[i] >> 24);
+    }
+    return d;
+}
+
+Blake3::Blake3() {
+    reset_chunk(0);
+}
+
+void Blake3::reset_chunk(uint64_t counter) {
+    std::memcpy(chunk_cv_, kIv, sizeof(chunk_cv_));
+    chunk_counter_ = counter;
+    std::memset(block_, 0, sizeof(block_));
+    block_len_ = 0;
+    blocks_compressed_ = 0;
+}
+
+uint32_t Blake3::start_flag() const {
+    return blocks_compressed_ == 0 ? uint32_t(kChunkStart) : 0u;
+}
+
+Blake3::Output Blake3::chunk_output() const {
+    Output out;
+    std::memcpy(out.cv, chunk_cv_, sizeof(out.cv));
+    load_block(block_, out.block);
+    out.counter = chunk_counter_;
+    out.block_len = uint32_t(block_len_);
+    out.flags = start_flag() | kChunkEnd;
+    return out;
+}
+
+Blake3::Output Blake3::parent_output(const uint32_t left[8], const uint32_t right[8]) {
+    Output out;
+    std::memcpy(out.cv, kIv, sizeof(out.cv));
+    std::memcpy(out.block, left, 8 * sizeof(uint32_t));
+    std::memcpy(out.block + 8, right, 8 * sizeof(uint32_t));
+    out.counter = 0;
+    out.block_len = kBlockLen;
+    out.flags = kParent;
+    return out;
+}
+
+/**
+ * @brief Merge a finished chunk into the tree: every trailing zero bit of the
+ *        new chunk count completes one subtree on the stack.
+ */
+void Blake3::push_chunk_cv(const uint32_t cv[8], uint64_t total_chunks) {
+    std::array<uint32_t, 8> node;
+    std::memcpy(node.data(), cv, sizeof(uint32_t) * 8);
+    while ((total_chunks & 1) == 0) {
+        parent_output(cv_stack_.back().data(), node.data()).chaining_value(node.data());
+        cv_stack_.pop_back();
+        total_chunks >>= 1;
+    }
+    cv_stack_.push_back(node);
+}
+
+void Blake3::update(const void* data, size_t len) {
+    const uint8_t* in = static_cast<const uint8_t*>(data);
+    while (len > 0) {
+        if (chunk_len() == kChunkLen) {
+            // Only finish a chunk once more input arrives: the last chunk must stay open for the root flag
+            uint32_t cv[8];
+            chunk_output().chaining_value(cv);
+            uint64_t total_chunks = chunk_counter_ + 1;
+            push_chunk_cv(cv, total_chunks);
+            reset_chunk(total_chunks);
+        }
+        if (block_len_ == kBlockLen) {
+            uint32_t words[16];
+            load_block(block_, words);
+            uint32_t out[16];
+            compress(chunk_cv_, words, chunk_counter_, kBlockLen, start_flag(), out);
+            std::memcpy(chunk_cv_, out, sizeof(chunk_cv_));
+            ++blocks_compressed_;
+            std::memset(block_, 0, sizeof(block_));
+            block_len_ = 0;
+        }
+        size_t want = std::min(kBlockLen - block_len_, kChunkLen - chunk_len());
+        size_t take = std::min(want, len);
+        std::memcpy(block_ + block_len_, in, take);
+        block_len_ += take;
+        in += take;
+        len -= take;
+    }
+}
+
+Digest256 Blake3::finalize() const {
+    Output out = chunk_output();
+    for (size_t i = cv_stack_.size(); i-- > 0;) {
+        uint32_t cv[8];
+        out.chaining_value(cv);
+        out = parent_output(cv_stack_[i].data(), cv);
+    }
+    return out.root();
+}
+
+Digest256 Blake3::hash(const void* data, size_t len) {
+    Blake3 hasher;
+    hasher.update(data, len);
+    return hasher.finalize();
+}
+
+/**
+ * @brief Root of a multi-chunk input from its chunk chaining values: the same
+ *        stack merge as update(), with the last chunk folded in by finalize().
+ */
+Digest256 Blake3::root_from_chunk_cvs(const uint32_t (*cvs)[8], size_t n_chunks) {
+    Blake3 tree;
+    for (size_t i = 0; i + 1 < n_chunks; ++i) tree.push_chunk_cv(cvs[i], i + 1);
+    uint32_t node[8];
+    std::memcpy(node, cvs[n_chunks - 1], sizeof(node));
+    Output out;
+    for (size_t i = tree.cv_stack_.size(); i-- > 0;) {
+        out = parent_output(tree.cv_stack_[i].data(), node);
+        if (i > 0) out.chaining_value(node);
+    }
+    return out.root();
+}
+
+void Blake3::hash_many(const HashEngine::Input* inputs, size_t n, Digest256* out, bool avx2) {
+#ifdef BLAKE3_X86
+    if (avx2) {
+        constexpr int kLanes = 8;
+        static const uint8_t kIdleBlock[kBlockLen] = {};
+
+        // Single-chunk inputs carry the root flag on their last block: hash them directly
+        std::vector<size_t> offsets(n + 1, 0); // first chunk of input i in cvs
+        for (size_t i = 0; i < n; ++i) {
+            size_t chunks = inputs[i].len > kChunkLen ? (inputs[i].len + kChunkLen - 1) / kChunkLen : 0;
+            if (chunks == 0) out[i] = hash(inputs[i].data, inputs[i].len);
+            offsets[i + 1] = offsets[i] + chunks;
+        }
+        std::vector<std::array<uint32_t, 8>> cvs(offsets[n]);
+
+        struct Lane {
+            bool active = false;
+            size_t slot = 0;          // index into cvs
+            const uint8_t* data = nullptr;
+            size_t len = 0;           // bytes in this chunk
+            size_t next = 0;          // next block
+            size_t total = 0;         // blocks in this chunk
+            uint64_t counter = 0;     // chunk index within its input
+            uint8_t last[kBlockLen];  // zero-padded final block
+        };
+        Lane lanes[kLanes];
+        alignas(32) uint32_t cv[8][kLanes];
+        size_t input = 0, chunk = 0;
+
+        auto refill = [&](int l) {
+            Lane& lane = lanes[l];
+            while (input < n && chunk >= offsets[input + 1] - offsets[input]) {
+                ++input;
+                chunk = 0;
+            }
+            lane.active = input < n;
+            if (!lane.active) return;
+            const uint8_t* base = static_cast<const uint8_t*>(inputs[input].data);
+            lane.slot = offsets[input] + chunk;
+            lane.data = base + chunk * kChunkLen;
+            lane.len = std::min(kChunkLen, inputs[input].len - chunk * kChunkLen);
+            lane.next = 0;
+            lane.total = (lane.len + kBlockLen - 1) / kBlockLen;
+            lane.counter = chunk;
+            size_t last_len = lane.len - (lane.total - 1) * kBlockLen;
+            std::memset(lane.last, 0, sizeof(lane.last));
+            std::memcpy(lane.last, lane.data + (lane.total - 1) * kBlockLen, last_len);
+            for (int i = 0; i < 8; ++i) cv[i][l] = kIv[i];
+            ++chunk;
+        };
+        for (int l = 0; l < kLanes; ++l) refill(l);
+
+        for (;;) {
+            const uint8_t* blocks[kLanes];
+            uint32_t counter_lo[kLanes], counter_hi[kLanes], block_len[kLanes], flags[kLanes];
+            int active = 0;
+            for (int l = 0; l < kLanes; ++l) {
+                const Lane& lane = lanes[l];
+                active += lane.active;
+                bool last = lane.active && lane.next + 1 == lane.total;
+                blocks[l] = !lane.active ? kIdleBlock : last ? lane.last : lane.data + lane.next * kBlockLen;
+                counter_lo[l] = uint32_t(lane.counter);
+                counter_hi[l] = uint32_t(lane.counter >> 32);
+                block_len[l] = last ? uint32_t(lane.len - lane.next * kBlockLen) : uint32_t(kBlockLen);
+                flags[l] = (lane.next == 0 ? uint32_t(kChunkStart) : 0u) | (last ? uint32_t(kChunkEnd) : 0u);
+            }
+            if (active == 0) break;
+            compress_x8(cv, blocks, counter_lo, counter_hi, block_len, flags);
+            for (int l = 0; l < kLanes; ++l) {
+                Lane& lane = lanes[l];
+                if (!lane.active || ++lane.next < lane.total) continue;
+                for (int i = 0; i < 8; ++i) cvs[lane.slot][i] = cv[i][l];
+                refill(l);
+            }
+        }
+        for (size_t i = 0; i < n; ++i) {
+            size_t chunks = offsets[i + 1] - offsets[i];
+            if (chunks > 0) {
+                out[i] = root_from_chunk_cvs(reinterpret_cast<const uint32_t (*)[8]>(cvs[offsets[i]].data()), chunks);
+            }
+        }
+        return;
+    }
+#endif
+    (void)avx2;
+    for (size_t i = 0; i < n; ++i) out[i] = hash(inputs[i].data, inputs[i].len);
+}
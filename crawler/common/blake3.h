@@ -0,0 +1,73 @@
+#ifndef BLAKE3_H
+#define BLAKE3_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "digest.h"
+#include "hash_engine.h"
+
+/**
+ * @class Blake3
+ * @brief Portable BLAKE3 (unkeyed hash mode, 32-byte output).
+ *
+ * Incremental: update() may be called any number of times before finalize().
+ * Inputs are split into 1 KB chunks whose chaining values are merged into the
+ * BLAKE3 binary tree through a stack, as in the reference implementation.
+ * hash_many() can compress the chunks of many inputs eight at a time with AVX2.
+ */
+class Blake3 {
+public:
+    Blake3();
+
+    void update(const void* data, size_t len);
+    Digest256 finalize() const;
+
+    static Digest256 hash(const void* data, size_t len);
+
+    /**
+     * @brief Hash n inputs into out. With avx2 set (the caller checks CPU
+     *        support), chunks of multi-chunk inputs go through the 8-lane kernel
+     *        and only the few parent nodes are compressed one at a time.
+     */
+    static void hash_many(const HashEngine::Input* inputs, size_t n, Digest256* out, bool avx2);
+
+    static constexpr size_t kChunkLen = 1024;
+    static constexpr size_t kBlockLen = 64;
+
+private:
+    struct Output {
+        uint32_t cv[8];
+        uint32_t block[16];
+        uint64_t counter;
+        uint32_t block_len;
+        uint32_t flags;
+
+        void chaining_value(uint32_t out[8]) const;
+        Digest256 root() const;
+    };
+
+    // Current chunk
+    uint32_t chunk_cv_[8];
+    uint64_t chunk_counter_ = 0;
+    uint8_t block_[kBlockLen];
+    size_t block_len_ = 0;
+    size_t blocks_compressed_ = 0;
+
+    std::vector<std::array<uint32_t, 8>> cv_stack_; ///< Completed subtrees, one per set bit of the chunk count
+
+    size_t chunk_len() const { return kBlockLen * blocks_compressed_ + block_len_; }
+    uint32_t start_flag() const;
+    Output chunk_output() const;
+    void reset_chunk(uint64_t counter);
+    void push_chunk_cv(const uint32_t cv[8], uint64_t total_chunks);
+
+    static Digest256 root_from_chunk_cvs(const uint32_t (*cvs)[8], size_t n_chunks);
+    static Output parent_output(const uint32_t left[8], const uint32_t right[8]);
+    static void compress(const uint32_t cv[8], const uint32_t block[16], uint64_t counter,
+                         uint32_t block_len, uint32_t flags, uint32_t out[16]);
+    static void load_block(const uint8_t* bytes, uint32_t words[16]);
+};
+
+#endif // BLAKE3_H
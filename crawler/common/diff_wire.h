@@ -0,0 +1,130 @@
+#ifndef DIFF_WIRE_H
+#define DIFF_WIRE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "varint.h"
+
+/**
+ * @struct DiffWire
+ * @brief A Merkle diff packet parsed in place. The one decoder for the format:
+ *        the crawler's DiffPacket (merkle_tree/diff_packet.h) wraps it, and
+ *        the indexer reads it as PageDiff. Header-only, so the indexer links
+ *        nothing from the crawler.
+ *
+ * Version 1 layout (integers are varints unless sized):
+ *   u8 version, u8 hash algorithm, url length, url,
+ *   old root (32 bytes), new root (32 bytes), old leaf count, new leaf count,
+ *   hunk count, then per hunk:
+ *     gap (old_begin minus the end of the previous hunk), old count, new count,
+ *     and per new leaf: hash (32 bytes), inline length + 1 (0: not inline),
+ *     inline block bytes.
+ * A hunk's new_begin follows from the hunks before it. Leaf counts above
+ * kMaxLeaves are rejected, which keeps the hunk arithmetic within int64_t.
+ * Only the URL is copied: roots, hashes and inline blocks point into the
+ * packet, which must outlive the DiffWire.
+ */
+struct DiffWire {
+    static constexpr uint8_t kVersion = 1;
+    static constexpr size_t kHashSize = 32;
+    static constexpr uint64_t kMaxLeaves = uint64_t(1) << 48;
+
+    struct Hunk {
+        uint64_t old_begin = 0;
+        uint64_t old_count = 0;
+        uint64_t new_begin = 0;
+        uint64_t new_count = 0;
+        size_t first_leaf = 0;   ///< Index of the hunk's first new leaf in leaves
+    };
+
+    struct Leaf {
+        const uint8_t* hash = nullptr;
+        const char* block = nullptr; ///< Inline block, or null if it was sent by hash only
+        size_t block_len = 0;
+    };
+
+    uint8_t algorithm = 0;       ///< HashAlgorithm value; not checked here
+    std::string url;
+    const uint8_t* old_root = nullptr;
+    const uint8_t* new_root = nullptr;
+    uint64_t old_leaf_count = 0;
+    uint64_t new_leaf_count = 0;
+    std::vector<Hunk> hunks;
+    std::vector<Leaf> leaves;    ///< New leaves of every hunk, in order
+
+    /**
+     * @brief Parse a packet, checking every hunk against the leaf counts.
+     * @return False if the packet is truncated, malformed, of another version,
+     *         or its hunks do not fit the leaf counts.
+     */
+    static bool decode(const uint8_t* data, size_t len, DiffWire& out) {
+        const uint8_t* p = data;
+        const uint8_t* end = data + len;
+        if (len < 2 || data[0] != kVersion) return false;
+        DiffWire packet;
+        packet.algorithm = data[1];
+        p += 2;
+        uint64_t url_len, hunk_count;
+        if (!get_varint(p, end, url_len) || url_len > uint64_t(end - p)) return false;
+        packet.url.assign(reinterpret_cast<const char*>(p), size_t(url_len));
+        p += url_len;
+        if (!get_hash(p, end, packet.old_root) || !get_hash(p, end, packet.new_root) ||
+            !get_varint(p, end, packet.old_leaf_count) || !get_varint(p, end, packet.new_leaf_count) ||
+            packet.old_leaf_count > kMaxLeaves || packet.new_leaf_count > kMaxLeaves ||
+            !get_varint(p, end, hunk_count) || hunk_count > uint64_t(end - p) / 3) {
+            return false;
+        }
+        packet.hunks.resize(size_t(hunk_count));
+        uint64_t old_end = 0;
+        int64_t shift = 0; // new_begin - old_begin so far
+        for (Hunk& hunk : packet.hunks) {
+            uint64_t gap;
+            if (!get_varint(p, end, gap) || !get_varint(p, end, hunk.old_count) ||
+                !get_varint(p, end, hunk.new_count)) {
+                return false;
+            }
+            hunk.old_begin = old_end + gap;
+            if (hunk.old_begin < old_end || hunk.old_count > packet.old_leaf_count ||
+                hunk.old_begin > packet.old_leaf_count - hunk.old_count) {
+                return false;
+            }
+            // Both terms are within kMaxLeaves of zero, so this cannot overflow
+            hunk.new_begin = uint64_t(int64_t(hunk.old_begin) + shift);
+            if (hunk.new_count > packet.new_leaf_count || hunk.new_begin > packet.new_leaf_count - hunk.new_count ||
+                hunk.new_count > uint64_t(end - p) / (kHashSize + 1)) {
+                return false;
+            }
+            old_end = hunk.old_begin + hunk.old_count;
+            shift += int64_t(hunk.new_count) - int64_t(hunk.old_count);
+            hunk.first_leaf = packet.leaves.size();
+            for (uint64_t k = 0; k < hunk.new_count; ++k) {
+                Leaf leaf;
+                uint64_t inline_len;
+                if (!get_hash(p, end, leaf.hash) || !get_varint(p, end, inline_len)) return false;
+                if (inline_len > 0) {
+                    if (inline_len - 1 > uint64_t(end - p)) return false;
+                    leaf.block = reinterpret_cast<const char*>(p);
+                    leaf.block_len = size_t(inline_len - 1);
+                    p += leaf.block_len;
+                }
+                packet.leaves.push_back(leaf);
+            }
+        }
+        if (p != end || int64_t(packet.new_leaf_count) - int64_t(packet.old_leaf_count) != shift) return false;
+        out = std::move(packet);
+        return true;
+    }
+
+private:
+    static bool get_hash(const uint8_t*& p, const uint8_t* end, const uint8_t*& out) {
+        if (size_t(end - p) < kHashSize) return false;
+        out = p;
+        p += kHashSize;
+        return true;
+    }
+};
+
+#endif // DIFF_WIRE_H
@@ -0,0 +1,53 @@
+#include "digest.h"
+#include "hash_engine.h"
+
+namespace {
+
+int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+} // namespace
+
+/**
+ * @brief SHA-256 of a byte range on the process-wide engine.
+ */
+Digest256 Digest256::of(const void* data, size_t len) {
+    return HashEngine::get(HashAlgorithm::kSha256).hash(data, len);
+}
+
+/**
+ * @brief Parse 64 hex digits.
+ */
+bool Digest256::from_hex(const std::string& hex, Digest256& out) {
+    if (hex.size() != 2 * kSize) return false;
+    Digest256 d;
+    for (size_t i = 0; i < kSize; ++i) {
+        int hi = hex_value(hex[2 * i]);
+        int lo = hex_value(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0) return false;
+        d.bytes[i] = static_cast<uint8_t>(hi << 4 | lo);
+    }
+    out = d;
+    return true;
+}
+
+/**
+ * @brief Lowercase hex encoding through a nibble table.
+ */
+void Digest256::hex(char* out) const {
+    static const char kDigits[] = "0123456789abcdef";
+    for (size_t i = 0; i < kSize; ++i) {
+        out[2 * i] = kDigits[bytes[i] >> 4];
+        out[2 * i + 1] = kDigits[bytes[i] & 0x0F];
+    }
+}
+
+std::string Digest256::hex() const {
+    std::string out(2 * kSize, '0');
+    hex(&out[0]);
+    return out;
+}
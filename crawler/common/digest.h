@@ -0,0 +1,94 @@
+#ifndef DIGEST_H
+#define DIGEST_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <type_traits>
+
+/**
+ * @brief A SHA-256 digest held by value (32 bytes).
+ *
+ * Trivially copyable and allocation-free: content-store keys, Merkle nodes
+ * and manifests carry digests in binary, and hex is produced only for logs
+ * and external APIs.
+ */
+struct Digest256 {
+    static constexpr size_t kSize = 32;
+
+    std::array<uint8_t, kSize> bytes{};
+
+    /**
+     * @brief SHA-256 of a byte range.
+     */
+    static Digest256 of(const void* data, size_t len);
+    static Digest256 of(const std::string& data) { return of(data.data(), data.size()); }
+
+    /**
+     * @brief Reinterpret 32 raw bytes (e.g. a LevelDB key) as a digest.
+     */
+    static Digest256 from_bytes(const char* data) {
+        Digest256 d;
+        std::memcpy(d.bytes.data(), data, kSize);
+        return d;
+    }
+
+    /**
+     * @brief Parse 64 hex digits (either case).
+     * @return False (and out unchanged) if hex is not a well-formed digest.
+     */
+    static bool from_hex(const std::string& hex, Digest256& out);
+
+    /**
+     * @brief Lowercase hex, for logs and external APIs.
+     */
+    std::string hex() const;
+
+    /**
+     * @brief Write the 64 lowercase hex digits to out (no terminator).
+     */
+    void hex(char* out) const;
+
+    /**
+     * @brief The 32 raw bytes as a string (storage keys, serialized manifests).
+     */
+    std::string to_bytes() const { return std::string(data(), kSize); }
+    const char* data() const { return reinterpret_cast<const char*>(bytes.data()); }
+
+    bool is_zero() const {
+        for (uint8_t b : bytes) {
+            if (b) return false;
+        }
+        return true;
+    }
+
+    friend bool operator==(const Digest256& a, const Digest256& b) {
+        return std::memcmp(a.bytes.data(), b.bytes.data(), kSize) == 0;
+    }
+    friend bool operator!=(const Digest256& a, const Digest256& b) { return !(a == b); }
+    friend bool operator<(const Digest256& a, const Digest256& b) {
+        return std::memcmp(a.bytes.data(), b.bytes.data(), kSize) < 0;
+    }
+};
+
+static_assert(std::is_trivially_copyable<Digest256>::value, "Digest256 must stay a plain value");
+static_assert(sizeof(Digest256) == Digest256::kSize, "Digest256 must have no padding");
+
+namespace std {
+/**
+ * @brief Digests are uniformly distributed already: the first word is the hash.
+ */
+template <>
+struct hash<Digest256> {
+    size_t operator()(const Digest256& d) const noexcept {
+        size_t h;
+        std::memcpy(&h, d.bytes.data(), sizeof(h));
+        return h;
+    }
+};
+} // namespace std
+
+#endif // DIGEST_H
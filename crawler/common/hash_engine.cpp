@@ -0,0 +1,478 @@
+#include "hash_engine.h"
+#include "blake3.h"
+#include <cstring>
+#include <stdexcept>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define HASH_ENGINE_X86 1
+#endif
+
+namespace {
+
+const uint32_t kInit[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                           0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+alignas(16) const uint32_t kK[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+constexpr size_t kBlock = 64;
+
+/// Compresses nblocks consecutive 64-byte blocks into state
+using CompressFn = void (*)(uint32_t state[8], const uint8_t* data, size_t nblocks);
+
+inline uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+inline uint32_t load_be32(const uint8_t* p) {
+    return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | uint32_t(p[3]);
+}
+
+void compress_generic(uint32_t state[8], const uint8_t* data, size_t nblocks) {
+    for (; nblocks > 0; --nblocks, data += kBlock) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i) w[i] = load_be32(data + 4 * i);
+        for (int i = 16; i < 64; ++i) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; ++i) {
+            uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + kK[i] + w[i];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & (b ^ c)) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#ifdef HASH_ENGINE_X86
+
+/**
+ * @brief SHA-NI: two rounds per sha256rnds2, message schedule in msg1/msg2.
+ *        State is kept as ABEF / CDGH, the layout the instructions expect.
+ */
+__attribute__((target("sha,sse4.1")))
+void compress_shani(uint32_t state[8], const uint8_t* data, size_t nblocks) {
+    const __m128i kByteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0]));
+    __m128i state1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4]));
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);              // CDAB
+    state1 = _mm_shuffle_epi32(state1, 0x1B);        // EFGH
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8); // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);     // CDGH
+
+    for (; nblocks > 0; --nblocks, data += kBlock) {
+        const __m128i abef_save = state0;
+        const __m128i cdgh_save = state1;
+        __m128i w[4];
+#pragma GCC unroll 16
+        for (int i = 0; i < 16; ++i) {
+            if (i < 4) {
+                w[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * i)), kByteSwap);
+            }
+            __m128i msg = _mm_add_epi32(w[i & 3], _mm_load_si128(reinterpret_cast<const __m128i*>(kK + 4 * i)));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            if (i >= 3 && i <= 14) {
+                // W[i+1] (mod 4 it replaces W[i-3], already through msg1)
+                __m128i carry = _mm_alignr_epi8(w[i & 3], w[(i - 1) & 3], 4);
+                w[(i + 1) & 3] = _mm_sha256msg2_epu32(_mm_add_epi32(w[(i + 1) & 3], carry), w[i & 3]);
+            }
+            msg = _mm_shuffle_epi32(msg, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+            if (i >= 1 && i <= 12) w[(i - 1) & 3] = _mm_sha256msg1_epu32(w[(i - 1) & 3], w[i & 3]);
+        }
+        state0 = _mm_add_epi32(state0, abef_save);
+        state1 = _mm_add_epi32(state1, cdgh_save);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);           // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xB1);        // DCHG
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);     // DCBA
+    state1 = _mm_alignr_epi8(state1, tmp, 8);        // ABEF
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+}
+
+__attribute__((target("avx2"))) inline __m256i rotr8(__m256i x, int n) {
+    return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+}
+
+/**
+ * @brief One block of eight independent messages. state is [word][lane];
+ *        blocks[l] is lane l's next 64-byte block.
+ */
+__attribute__((target("avx2")))
+void compress_avx2_x8(uint32_t state[8][8], const uint8_t* const blocks[8]) {
+    const __m256i kByteSwap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                               3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    __m256i w[16];
+    // Transpose each half-block (8 words x 8 lanes) so w[i] holds word i of every lane
+    for (int half = 0; half < 2; ++half) {
+        __m256i r[8];
+        for (int l = 0; l < 8; ++l) {
+            r[l] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(blocks[l] + 32 * half));
+        }
+        __m256i t[8], u[8];
+        for (int p = 0; p < 4; ++p) {
+            t[2 * p] = _mm256_unpacklo_epi32(r[2 * p], r[2 * p + 1]);
+            t[2 * p + 1] = _mm256_unpackhi_epi32(r[2 * p], r[2 * p + 1]);
+        }
+        for (int q = 0; q < 2; ++q) {
+            u[4 * q] = _mm256_unpacklo_epi64(t[4 * q], t[4 * q + 2]);
+            u[4 * q + 1] = _mm256_unpackhi_epi64(t[4 * q], t[4 * q + 2]);
+            u[4 * q + 2] = _mm256_unpacklo_epi64(t[4 * q + 1], t[4 * q + 3]);
+            u[4 * q + 3] = _mm256_unpackhi_epi64(t[4 * q + 1], t[4 * q + 3]);
+        }
+        for (int k = 0; k < 4; ++k) {
+            w[8 * half + k] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u[k], u[k + 4], 0x20), kByteSwap);
+            w[8 * half + k + 4] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u[k], u[k + 4], 0x31), kByteSwap);
+        }
+    }
+
+    __m256i v[8];
+    for (int i = 0; i < 8; ++i) v[i] = _mm256_load_si256(reinterpret_cast<const __m256i*>(state[i]));
+    __m256i a = v[0], b = v[1], c = v[2], d = v[3], e = v[4], f = v[5], g = v[6], h = v[7];
+#pragma GCC unroll 8
+    for (int i = 0; i < 64; ++i) {
+        if (i >= 16) {
+            __m256i w15 = w[(i - 15) & 15], w2 = w[(i - 2) & 15];
+            __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotr8(w15, 7), rotr8(w15, 18)), _mm256_srli_epi32(w15, 3));
+            __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotr8(w2, 17), rotr8(w2, 19)), _mm256_srli_epi32(w2, 10));
+            w[i & 15] = _mm256_add_epi32(_mm256_add_epi32(w[i & 15], s0), _mm256_add_epi32(w[(i - 7) & 15], s1));
+        }
+        __m256i big_s1 = _mm256_xor_si256(_mm256_xor_si256(rotr8(e, 6), rotr8(e, 11)), rotr8(e, 25));
+        __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+        __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, big_s1),
+                                      _mm256_add_epi32(_mm256_add_epi32(ch, _mm256_set1_epi32(int(kK[i]))), w[i & 15]));
+        __m256i big_s0 = _mm256_xor_si256(_mm256_xor_si256(rotr8(a, 2), rotr8(a, 13)), rotr8(a, 22));
+        __m256i maj = _mm256_xor_si256(_mm256_and_si256(a, _mm256_xor_si256(b, c)), _mm256_and_si256(b, c));
+        h = g;
+        g = f;
+        f = e;
+        e = _mm256_add_epi32(d, t1);
+        d = c;
+        c = b;
+        b = a;
+        a = _mm256_add_epi32(t1, _mm256_add_epi32(big_s0, maj));
+    }
+    const __m256i out[8] = {a, b, c, d, e, f, g, h};
+    for (int i = 0; i < 8; ++i) {
+        _mm256_store_si256(reinterpret_cast<__m256i*>(state[i]), _mm256_add_epi32(v[i], out[i]));
+    }
+}
+
+struct CpuFeatures {
+    bool sha_ni = false;
+    bool avx2 = false;
+
+    CpuFeatures() {
+        unsigned eax, ebx, ecx, edx;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return;
+        bool ssse3 = ecx & (1u << 9);
+        bool sse41 = ecx & (1u << 19);
+        bool osxsave = ecx & (1u << 27);
+        bool avx = ecx & (1u << 28);
+        // The OS must save the YMM registers for AVX2 to be usable
+        bool ymm_enabled = false;
+        if (osxsave && avx) {
+            unsigned xcr0_lo, xcr0_hi;
+            __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+            ymm_enabled = (xcr0_lo & 0x6) == 0x6;
+        }
+        if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return;
+        sha_ni = ssse3 && sse41 && (ebx & (1u << 29));
+        avx2 = ymm_enabled && (ebx & (1u << 5));
+    }
+};
+
+const CpuFeatures& cpu_features() {
+    static const CpuFeatures features;
+    return features;
+}
+
+#endif // HASH_ENGINE_X86
+
+/**
+ * @brief Final one or two blocks of a message: its last len % 64 bytes, the
+ *        0x80 terminator and the big-endian bit length.
+ * @return Number of tail blocks written to tail.
+ */
+size_t pad_tail(const uint8_t* data, size_t len, uint8_t tail[2 * kBlock]) {
+    size_t rem = len % kBlock;
+    size_t nblocks = rem + 9 <= kBlock ? 1 : 2;
+    std::memset(tail, 0, nblocks * kBlock);
+    std::memcpy(tail, data + (len - rem), rem);
+    tail[rem] = 0x80;
+    uint64_t bits = uint64_t(len) * 8;
+    for (int i = 0; i < 8; ++i) tail[nblocks * kBlock - 1 - i] = uint8_t(bits >> (8 * i));
+    return nblocks;
+}
+
+void store_digest(const uint32_t state[8], Digest256& out) {
+    for (int i = 0; i < 8; ++i) {
+        out.bytes[4 * i] = uint8_t(state[i] >> 24);
+        out.bytes[4 * i + 1] = uint8_t(state[i] >> 16);
+        out.bytes[4 * i + 2] = uint8_t(state[i] >> 8);
+        out.bytes[4 * i + 3] = uint8_t(state[i]);
+    }
+}
+
+Digest256 sha256_one(CompressFn compress, const void* data, size_t len) {
+    const uint8_t* in = static_cast<const uint8_t*>(data);
+    uint32_t state[8];
+    std::memcpy(state, kInit, sizeof(state));
+    compress(state, in, len / kBlock);
+    uint8_t tail[2 * kBlock];
+    compress(state, tail, pad_tail(in, len, tail));
+    Digest256 d;
+    store_digest(state, d);
+    return d;
+}
+
+#ifdef HASH_ENGINE_X86
+
+/**
+ * @brief Multi-buffer driver: eight lanes each work through one message, and a
+ *        lane takes the next pending message as soon as its own is finished.
+ *        When only a couple of lanes are left, they finish on the scalar path.
+ */
+void sha256_many_avx2(const HashEngine::Input* inputs, size_t n, Digest256* out) {
+    constexpr int kLanes = 8;
+    constexpr int kMinActiveLanes = 3;
+    static const uint8_t kIdleBlock[kBlock] = {};
+
+    struct Lane {
+        size_t msg = 0;
+        const uint8_t* data = nullptr;
+        size_t next = 0;   // next block
+        size_t full = 0;   // blocks read straight from data
+        size_t total = 0;  // full + tail blocks
+        bool active = false;
+        uint8_t tail[2 * kBlock];
+
+        const uint8_t* block(size_t j) const { return j < full ? data + j * kBlock : tail + (j - full) * kBlock; }
+    };
+    Lane lanes[kLanes];
+    alignas(32) uint32_t state[8][kLanes];
+    size_t pending = 0;
+
+    auto refill = [&](int l) {
+        Lane& lane = lanes[l];
+        lane.active = pending < n;
+        if (!lane.active) return;
+        lane.msg = pending++;
+        lane.data = static_cast<const uint8_t*>(inputs[lane.msg].data);
+        size_t len = inputs[lane.msg].len;
+        lane.next = 0;
+        lane.full = len / kBlock;
+        lane.total = lane.full + pad_tail(lane.data, len, lane.tail);
+        for (int i = 0; i < 8; ++i) state[i][l] = kInit[i];
+    };
+    for (int l = 0; l < kLanes; ++l) refill(l);
+
+    for (;;) {
+        int active = 0;
+        const uint8_t* blocks[kLanes];
+        for (int l = 0; l < kLanes; ++l) {
+            blocks[l] = lanes[l].active ? lanes[l].block(lanes[l].next) : kIdleBlock;
+            active += lanes[l].active;
+        }
+        if (active < kMinActiveLanes) break;
+        compress_avx2_x8(state, blocks);
+        for (int l = 0; l < kLanes; ++l) {
+            Lane& lane = lanes[l];
+            if (!lane.active || ++lane.next < lane.total) continue;
+            uint32_t s[8];
+            for (int i = 0; i < 8; ++i) s[i] = state[i][l];
+            store_digest(s, out[lane.msg]);
+            refill(l);
+        }
+    }
+
+    // Stragglers: resume each lane's state on the scalar path
+    for (int l = 0; l < kLanes; ++l) {
+        Lane& lane = lanes[l];
+        if (!lane.active) continue;
+        uint32_t s[8];
+        for (int i = 0; i < 8; ++i) s[i] = state[i][l];
+        for (; lane.next < lane.total; ++lane.next) compress_generic(s, lane.block(lane.next), 1);
+        store_digest(s, out[lane.msg]);
+    }
+}
+
+#endif // HASH_ENGINE_X86
+
+CompressFn scalar_compress(HashEngine::Backend backend) {
+#ifdef HASH_ENGINE_X86
+    if (backend == HashEngine::Backend::kShaNi) return compress_shani;
+#endif
+    (void)backend;
+    return compress_generic;
+}
+
+} // namespace
+
+bool HashEngine::supported(Backend backend) {
+    switch (backend) {
+    case Backend::kGeneric:
+        return true;
+#ifdef HASH_ENGINE_X86
+    case Backend::kAvx2:
+        return cpu_features().avx2;
+    case Backend::kShaNi:
+        return cpu_features().sha_ni;
+#endif
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief SHA-NI retires a block in fewer cycles than eight AVX2 lanes do per
+ *        lane, so it wins whenever present; AVX2 is the fallback for CPUs
+ *        without the SHA extensions.
+ */
+HashEngine::Backend HashEngine::best_backend() {
+    if (supported(Backend::kShaNi)) return Backend::kShaNi;
+    if (supported(Backend::kAvx2)) return Backend::kAvx2;
+    return Backend::kGeneric;
+}
+
+const char* HashEngine::backend_name(Backend backend) {
+    switch (backend) {
+    case Backend::kAvx2: return "avx2-x8";
+    case Backend::kShaNi: return "sha-ni";
+    default: return "generic";
+    }
+}
+
+const char* HashEngine::algorithm_name(HashAlgorithm algorithm) {
+    return algorithm == HashAlgorithm::kBlake3 ? "blake3" : "sha256";
+}
+
+HashAlgorithm HashEngine::parse_algorithm(const std::string& name) {
+    if (name == "sha256") return HashAlgorithm::kSha256;
+    if (name == "blake3") return HashAlgorithm::kBlake3;
+    throw std::runtime_error("Unknown hash algorithm: " + name);
+}
+
+HashEngine::HashEngine(HashAlgorithm algorithm)
+    : algorithm_(algorithm), backend_(best_backend()) {
+    // BLAKE3 has no SHA-NI kernel; its SIMD path is the AVX2 one
+    if (algorithm_ == HashAlgorithm::kBlake3 && backend_ == Backend::kShaNi) {
+        backend_ = supported(Backend::kAvx2) ? Backend::kAvx2 : Backend::kGeneric;
+    }
+}
+
+HashEngine::HashEngine(HashAlgorithm algorithm, Backend backend)
+    : algorithm_(algorithm), backend_(backend) {
+    if (!supported(backend)) {
+        throw std::runtime_error(std::string("Hash backend not supported by this CPU: ") + backend_name(backend));
+    }
+    if (algorithm == HashAlgorithm::kBlake3 && backend == Backend::kShaNi) {
+        throw std::runtime_error("The sha-ni backend only implements SHA-256");
+    }
+}
+
+const HashEngine& HashEngine::get(HashAlgorithm algorithm) {
+    static const HashEngine sha256(HashAlgorithm::kSha256);
+    static const HashEngine blake3(HashAlgorithm::kBlake3);
+    return algorithm == HashAlgorithm::kBlake3 ? blake3 : sha256;
+}
+
+Digest256 HashEngine::hash(const void* data, size_t len) const {
+    if (algorithm_ == HashAlgorithm::kBlake3) return Blake3::hash(data, len);
+    return sha256_one(scalar_compress(backend_), data, len);
+}
+
+void HashEngine::hash_many(const Input* inputs, size_t n, Digest256* out) const {
+    if (algorithm_ == HashAlgorithm::kBlake3) {
+        Blake3::hash_many(inputs, n, out, backend_ == Backend::kAvx2);
+        return;
+    }
+#ifdef HASH_ENGINE_X86
+    if (algorithm_ == HashAlgorithm::kSha256 && backend_ == Backend::kAvx2) {
+        sha256_many_avx2(inputs, n, out);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < n; ++i) out[i] = hash(inputs[i].data, inputs[i].len);
+}
+
+std::vector<Digest256> HashEngine::hash_many(const std::vector<std::string>& blocks) const {
+    std::vector<Input> inputs;
+    inputs.reserve(blocks.size());
+    for (const auto& block : blocks) inputs.push_back({block.data(), block.size()});
+    std::vector<Digest256> out(blocks.size());
+    hash_many(inputs.data(), inputs.size(), out.data());
+    return out;
+}
+
+Digest256 HashEngine::hash_leaf(const Digest256& leaf) const {
+    uint8_t message[1 + Digest256::kSize];
+    message[0] = kLeafPrefix;
+    std::memcpy(message + 1, leaf.data(), Digest256::kSize);
+    return hash(message, sizeof(message));
+}
+
+/**
+ * @brief Prefixed copies of the inputs go into one buffer first, which also
+ *        lets out alias leaves.
+ */
+void HashEngine::hash_leaves(const Digest256* leaves, size_t n, Digest256* out) const {
+    const size_t size = 1 + Digest256::kSize;
+    std::vector<uint8_t> messages(n * size);
+    std::vector<Input> inputs(n);
+    for (size_t i = 0; i < n; ++i) {
+        uint8_t* message = &messages[i * size];
+        message[0] = kLeafPrefix;
+        std::memcpy(message + 1, leaves[i].data(), Digest256::kSize);
+        inputs[i] = {message, size};
+    }
+    hash_many(inputs.data(), n, out);
+}
+
+Digest256 HashEngine::hash_pair(const Digest256& left, const Digest256& right) const {
+    uint8_t message[1 + 2 * Digest256::kSize];
+    message[0] = kNodePrefix;
+    std::memcpy(message + 1, left.data(), Digest256::kSize);
+    std::memcpy(message + 1 + Digest256::kSize, right.data(), Digest256::kSize);
+    return hash(message, sizeof(message));
+}
+
+void HashEngine::hash_pairs(const Digest256* children, size_t n_parents, Digest256* out) const {
+    static_assert(sizeof(Digest256) == Digest256::kSize, "children must be contiguous bytes");
+    const size_t size = 1 + 2 * Digest256::kSize;
+    std::vector<uint8_t> messages(n_parents * size);
+    std::vector<Input> inputs(n_parents);
+    for (size_t i = 0; i < n_parents; ++i) {
+        uint8_t* message = &messages[i * size];
+        message[0] = kNodePrefix;
+        std::memcpy(message + 1, children + 2 * i, 2 * Digest256::kSize);
+        inputs[i] = {message, size};
+    }
+    hash_many(inputs.data(), n_parents, out);
+}
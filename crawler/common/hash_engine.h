@@ -0,0 +1,112 @@
+#ifndef HASH_ENGINE_H
+#define HASH_ENGINE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "digest.h"
+
+/**
+ * @brief Content hash used for block keys and Merkle nodes. A store keeps the
+ *        algorithm it was created with; the two never mix in one keyspace.
+ */
+enum class HashAlgorithm {
+    kSha256,  ///< FIPS 180-4, interoperable with external tools
+    kBlake3   ///< Faster in portable code; for stores that need no SHA-256 compatibility
+};
+
+/**
+ * @class HashEngine
+ * @brief Batched hashing with runtime CPU dispatch.
+ *
+ * SHA-256 runs on one of three kernels, picked once per process from CPUID:
+ * the SHA extensions (SHA-NI), an AVX2 multi-buffer kernel that hashes eight
+ * independent messages in the lanes of 256-bit registers, or portable C++.
+ * hash_many() is the fast path: it keeps all lanes busy by refilling a lane as
+ * soon as its message ends, so pages of 4 KB blocks and levels of Merkle
+ * parents are hashed without per-call setup. BLAKE3 compresses the 1 KB
+ * chunks of eight inputs at once on AVX2 and is portable C++ otherwise.
+ */
+class HashEngine {
+public:
+    enum class Backend {
+        kGeneric,  ///< Portable C++
+        kAvx2,     ///< 8-lane multi-buffer SHA-256
+        kShaNi     ///< x86 SHA extensions
+    };
+
+    struct Input {
+        const void* data;
+        size_t len;
+    };
+
+    /**
+     * @brief Engine for an algorithm on the fastest backend this CPU supports.
+     */
+    explicit HashEngine(HashAlgorithm algorithm = HashAlgorithm::kSha256);
+
+    /**
+     * @brief Engine pinned to a backend (benchmarks, tests).
+     * @throws std::runtime_error if the CPU lacks the backend.
+     */
+    HashEngine(HashAlgorithm algorithm, Backend backend);
+
+    /**
+     * @brief Shared engine on the best backend, created on first use.
+     */
+    static const HashEngine& get(HashAlgorithm algorithm);
+
+    static Backend best_backend();
+    static bool supported(Backend backend);
+    static const char* backend_name(Backend backend);
+    static const char* algorithm_name(HashAlgorithm algorithm);
+
+    /**
+     * @brief Parse "sha256" or "blake3".
+     * @throws std::runtime_error on an unknown name.
+     */
+    static HashAlgorithm parse_algorithm(const std::string& name);
+
+    HashAlgorithm algorithm() const { return algorithm_; }
+    Backend backend() const { return backend_; }
+
+    Digest256 hash(const void* data, size_t len) const;
+    Digest256 hash(const std::string& data) const { return hash(data.data(), data.size()); }
+
+    /**
+     * @brief Hash n independent inputs into out[0..n).
+     */
+    void hash_many(const Input* inputs, size_t n, Digest256* out) const;
+    std::vector<Digest256> hash_many(const std::vector<std::string>& blocks) const;
+
+    /**
+     * @brief Merkle leaf (RFC 6962): hash of the 33 bytes 0x00 || leaf.
+     */
+    Digest256 hash_leaf(const Digest256& leaf) const;
+
+    /**
+     * @brief out[i] = hash_leaf(leaves[i]) for i < n, as one batch.
+     */
+    void hash_leaves(const Digest256* leaves, size_t n, Digest256* out) const;
+
+    /**
+     * @brief Merkle parent (RFC 6962): hash of the 65 bytes 0x01 || left || right.
+     */
+    Digest256 hash_pair(const Digest256& left, const Digest256& right) const;
+
+    /**
+     * @brief out[i] = hash_pair(children[2i], children[2i + 1]) for i < n_parents,
+     *        as one batch over the contiguous children.
+     */
+    void hash_pairs(const Digest256* children, size_t n_parents, Digest256* out) const;
+
+    static constexpr uint8_t kLeafPrefix = 0x00;
+    static constexpr uint8_t kNodePrefix = 0x01;
+
+private:
+    HashAlgorithm algorithm_;
+    Backend backend_;
+};
+
+#endif // HASH_ENGINE_H
@@ -0,0 +1,18 @@
+#ifndef HASH_MIX_H
+#define HASH_MIX_H
+
+#include <cstdint>
+
+/**
+ * @brief splitmix64 finalizer: spreads a 64-bit key over all output bits.
+ *        For sketch cells, filter slots and simulated link parameters; not
+ *        a cryptographic hash.
+ */
+inline uint64_t mix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+#endif // HASH_MIX_H
@@ -0,0 +1,79 @@
+#ifndef VARINT_H
+#define VARINT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief LEB128 varints (7 bits per byte, low bits first) for compact
+ *        on-disk and on-wire records.
+ */
+inline void put_varint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(char(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(char(value));
+}
+
+/**
+ * @brief Encoded length of value, for sizing a buffer before writing into it.
+ */
+inline size_t varint_size(uint64_t value) {
+    size_t n = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        ++n;
+    }
+    return n;
+}
+
+/**
+ * @brief Write a varint at out, which must have varint_size(value) bytes.
+ * @return One past the last byte written.
+ */
+inline uint8_t* put_varint(uint8_t* out, uint64_t value) {
+    while (value >= 0x80) {
+        *out++ = uint8_t(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = uint8_t(value);
+    return out;
+}
+
+/**
+ * @brief Decode a varint at p, advancing p past it.
+ * @return False if the input ends first or the value overflows 64 bits.
+ */
+inline bool get_varint(const char*& p, const char* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift <= 63 && p < end; shift += 7) {
+        uint8_t byte = uint8_t(*p++);
+        if (shift == 63 && byte > 1) return false;  // Bits past the 64th
+        value |= uint64_t(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Append a varint to a message buffer.
+ */
+inline void put_varint(std::vector<uint8_t>& out, uint64_t value) {
+    uint8_t buf[10];
+    out.insert(out.end(), buf, put_varint(buf, value));
+}
+
+/**
+ * @brief get_varint over a message buffer.
+ */
+inline bool get_varint(const uint8_t*& p, const uint8_t* end, uint64_t& value) {
+    const char* q = reinterpret_cast<const char*>(p);
+    if (!get_varint(q, reinterpret_cast<const char*>(end), value)) return false;
+    p = reinterpret_cast<const uint8_t*>(q);
+    return true;
+}
+
+#endif // VARINT_H
@@ -0,0 +1,117 @@
+#include "block_cache.h"
+#include <cstring>
+
+struct BlockCache::Shard {
+    struct Entry {
+        Digest256 hash;
+        BlockRef block;        ///< Null for a free slot
+        bool referenced = false;
+    };
+
+    std::mutex mutex;
+    size_t capacity;
+    size_t bytes = 0;
+    uint64_t evictions = 0;
+    std::vector<Entry> ring;
+    std::vector<size_t> free_slots;
+    std::unordered_map<Digest256, size_t> index; ///< Digest -> ring slot
+    size_t hand = 0;
+
+    explicit Shard(size_t capacity_bytes) : capacity(capacity_bytes) {}
+
+    /// Sweep the clock hand: clear reference bits until an unreferenced entry turns up.
+    void evict_one() {
+        for (;;) {
+            Entry& entry = ring[hand];
+            size_t slot = hand;
+            hand = (hand + 1) % ring.size();
+            if (!entry.block) continue;
+            if (entry.referenced) {
+                entry.referenced = false;
+                continue;
+            }
+            bytes -= entry.block->size();
+            index.erase(entry.hash);
+            entry.block.reset();
+            free_slots.push_back(slot);
+            ++evictions;
+            return;
+        }
+    }
+};
+
+BlockCache::BlockCache(size_t capacity_bytes, size_t shards) {
+    size_t n = 1;
+    while (n < shards) n <<= 1;
+    shards_.reserve(n);
+    for (size_t i = 0; i < n; ++i) shards_.push_back(std::make_unique<Shard>(capacity_bytes / n));
+}
+
+BlockCache::~BlockCache() = default;
+
+BlockCache::Shard& BlockCache::shard(const Digest256& hash) const {
+    // std::hash<Digest256> uses the first 8 bytes; the shard comes from the next 8
+    uint64_t word;
+    std::memcpy(&word, hash.data() + 8, sizeof(word));
+    return *shards_[word & (shards_.size() - 1)];
+}
+
+BlockCache::BlockRef BlockCache::lookup(const Digest256& hash) {
+    Shard& s = shard(hash);
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto it = s.index.find(hash);
+        if (it != s.index.end()) {
+            Shard::Entry& entry = s.ring[it->second];
+            entry.referenced = true;
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            return entry.block;
+        }
+    }
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+}
+
+void BlockCache::insert(const Digest256& hash, BlockRef block) {
+    Shard& s = shard(hash);
+    if (!block || block->size() > s.capacity) return;
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (s.index.count(hash)) return;
+    while (s.bytes + block->size() > s.capacity) s.evict_one();
+    size_t slot;
+    if (!s.free_slots.empty()) {
+        slot = s.free_slots.back();
+        s.free_slots.pop_back();
+    } else {
+        slot = s.ring.size();
+        s.ring.emplace_back();
+    }
+    s.bytes += block->size();
+    s.ring[slot] = Shard::Entry{hash, std::move(block), false};
+    s.index.emplace(hash, slot);
+}
+
+void BlockCache::erase(const Digest256& hash) {
+    Shard& s = shard(hash);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto it = s.index.find(hash);
+    if (it == s.index.end()) return;
+    Shard::Entry& entry = s.ring[it->second];
+    s.bytes -= entry.block->size();
+    entry.block.reset();
+    s.free_slots.push_back(it->second);
+    s.index.erase(it);
+}
+
+BlockCache::Stats BlockCache::stats() const {
+    Stats stats;
+    stats.hits = hits_.load(std::memory_order_relaxed);
+    stats.misses = misses_.load(std::memory_order_relaxed);
+    for (const auto& s : shards_) {
+        std::lock_guard<std::mutex> lock(s->mutex);
+        stats.bytes += s->bytes;
+        stats.entries += s->index.size();
+        stats.evictions += s->evictions;
+    }
+    return stats;
+}
@@ -0,0 +1,74 @@
+#ifndef BLOCK_CACHE_H
+#define BLOCK_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../common/digest.h"
+
+/**
+ * @class BlockCache
+ * @brief Sharded, byte-bounded CLOCK cache of decoded blocks.
+ *
+ * Blocks are shared as BlockRef (a pinned, immutable string): a lookup hands
+ * out a reference instead of a copy, and a block evicted while a reader still
+ * holds it stays alive until the reader drops it. Each shard has its own lock
+ * and budget; a digest picks its shard from digest bytes that its hash-map
+ * bucket does not use. Eviction is CLOCK (second chance): a hit only sets a
+ * flag, so lookups never reorder a list.
+ */
+class BlockCache {
+public:
+    using BlockRef = std::shared_ptr<const std::string>;
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        size_t bytes = 0;    ///< Block bytes currently cached
+        size_t entries = 0;
+    };
+
+    /**
+     * @param capacity_bytes Total budget, split evenly across shards.
+     * @param shards Rounded up to a power of two.
+     */
+    BlockCache(size_t capacity_bytes, size_t shards);
+    ~BlockCache();
+
+    BlockCache(const BlockCache&) = delete;
+    BlockCache& operator=(const BlockCache&) = delete;
+
+    /**
+     * @brief Cached block, or null.
+     */
+    BlockRef lookup(const Digest256& hash);
+
+    /**
+     * @brief Cache a block, evicting as needed. Blocks larger than a shard's
+     *        budget are not cached.
+     */
+    void insert(const Digest256& hash, BlockRef block);
+
+    /**
+     * @brief Drop a block, e.g. once it is deleted from the store.
+     */
+    void erase(const Digest256& hash);
+
+    Stats stats() const;
+
+private:
+    struct Shard;
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+
+    Shard& shard(const Digest256& hash) const;
+};
+
+#endif // BLOCK_CACHE_H
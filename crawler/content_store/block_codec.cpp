@@ -0,0 +1,173 @@
+#include "block_codec.h"
+#include "../common/varint.h"
+#include <zdict.h>
+#include <zstd.h>
+#include <stdexcept>
+
+namespace {
+
+enum Tag : uint8_t {
+    kRaw = 0,
+    kZstd = 1,
+};
+
+/**
+ * @brief zstd contexts are not thread-safe and costly to create: one pair per thread.
+ */
+struct ZstdContexts {
+    ZSTD_CCtx* cctx = ZSTD_createCCtx();
+    ZSTD_DCtx* dctx = ZSTD_createDCtx();
+
+    ~ZstdContexts() {
+        ZSTD_freeCCtx(cctx);
+        ZSTD_freeDCtx(dctx);
+    }
+};
+
+ZstdContexts& contexts() {
+    thread_local ZstdContexts ctx;
+    return ctx;
+}
+
+} // namespace
+
+/**
+ * @brief A dictionary digested once for each direction.
+ */
+struct BlockCodec::Dictionary {
+    uint32_t id;
+    ZSTD_CDict* cdict;
+    ZSTD_DDict* ddict;
+
+    Dictionary(uint32_t dict_id, const std::string& bytes, int level)
+        : id(dict_id),
+          cdict(ZSTD_createCDict(bytes.data(), bytes.size(), level)),
+          ddict(ZSTD_createDDict(bytes.data(), bytes.size())) {}
+
+    ~Dictionary() {
+        ZSTD_freeCDict(cdict);
+        ZSTD_freeDDict(ddict);
+    }
+};
+
+BlockCodec::BlockCodec(const Config& config) : config_(config) {
+    samples_.reserve(config_.training_samples);
+}
+
+BlockCodec::~BlockCodec() = default;
+
+std::string BlockCodec::encode(const char* data, size_t len) const {
+    std::shared_ptr<const Dictionary> dict;
+    {
+        std::shared_lock<std::shared_mutex> lock(dict_mutex_);
+        dict = active_;
+    }
+    std::string out(1, char(kZstd));
+    put_varint(out, dict ? dict->id : 0);
+    size_t offset = out.size();
+    out.resize(offset + ZSTD_compressBound(len));
+    ZstdContexts& ctx = contexts();
+    size_t n = dict ? ZSTD_compress_usingCDict(ctx.cctx, &out[offset], out.size() - offset, data, len, dict->cdict)
+                    : ZSTD_compressCCtx(ctx.cctx, &out[offset], out.size() - offset, data, len, config_.level);
+    if (ZSTD_isError(n) || offset + n >= 1 + len) {
+        // Incompressible (or zstd failed): keep the block as is
+        out.assign(1, char(kRaw));
+        out.append(data, len);
+        return out;
+    }
+    out.resize(offset + n);
+    return out;
+}
+
+bool BlockCodec::decode(const char* data, size_t len, std::string& out) const {
+    if (len == 0) return false;
+    const char* p = data + 1;
+    const char* end = data + len;
+    if (uint8_t(data[0]) == kRaw) {
+        out.assign(p, end);
+        return true;
+    }
+    uint64_t id;
+    if (uint8_t(data[0]) != kZstd || !get_varint(p, end, id) || id > UINT32_MAX) return false;
+    unsigned long long size = ZSTD_getFrameContentSize(p, size_t(end - p));
+    if (size == ZSTD_CONTENTSIZE_UNKNOWN || size == ZSTD_CONTENTSIZE_ERROR) return false;
+    std::shared_ptr<const Dictionary> dict;
+    if (id != 0 && !(dict = find(uint32_t(id)))) return false;
+    out.resize(size_t(size));
+    ZstdContexts& ctx = contexts();
+    size_t n = dict ? ZSTD_decompress_usingDDict(ctx.dctx, &out[0], out.size(), p, size_t(end - p), dict->ddict)
+                    : ZSTD_decompressDCtx(ctx.dctx, &out[0], out.size(), p, size_t(end - p));
+    return !ZSTD_isError(n) && n == size;
+}
+
+/**
+ * @brief Reservoir-sample the blocks of the current round. The first round
+ *        ends as soon as the sample is full; later ones every retrain_interval.
+ */
+bool BlockCodec::observe(const char* data, size_t len) {
+    std::lock_guard<std::mutex> lock(sample_mutex_);
+    ++observed_;
+    if (samples_.size() < config_.training_samples) {
+        samples_.emplace_back(data, len);
+    } else {
+        std::uniform_int_distribution<size_t> pick(0, observed_ - 1);
+        size_t slot = pick(rng_);
+        if (slot < samples_.size()) samples_[slot].assign(data, len);
+    }
+    size_t round = trained_once_ ? config_.retrain_interval : config_.training_samples;
+    if (round_due_ || observed_ < round || samples_.size() < config_.training_samples) return false;
+    round_due_ = true;
+    return true;
+}
+
+bool BlockCodec::train(std::string& dictionary) {
+    std::vector<std::string> samples;
+    {
+        std::lock_guard<std::mutex> lock(sample_mutex_);
+        samples.swap(samples_);
+        samples_.reserve(config_.training_samples);
+        observed_ = 0;
+        round_due_ = false;
+        trained_once_ = true;
+    }
+    std::string flat;
+    std::vector<size_t> sizes;
+    sizes.reserve(samples.size());
+    for (const auto& sample : samples) {
+        flat += sample;
+        sizes.push_back(sample.size());
+    }
+    dictionary.resize(config_.dictionary_bytes);
+    size_t n = ZDICT_trainFromBuffer(&dictionary[0], dictionary.size(), flat.data(), sizes.data(),
+                                     unsigned(sizes.size()));
+    if (ZDICT_isError(n)) {
+        dictionary.clear();
+        return false;
+    }
+    dictionary.resize(n);
+    return true;
+}
+
+void BlockCodec::add_dictionary(uint32_t id, const std::string& dictionary) {
+    auto dict = std::make_shared<const Dictionary>(id, dictionary, config_.level);
+    if (!dict->cdict || !dict->ddict) {
+        throw std::runtime_error("zstd rejected dictionary " + std::to_string(id));
+    }
+    std::unique_lock<std::shared_mutex> lock(dict_mutex_);
+    dictionaries_[id] = dict;
+    if (!active_ || id > active_->id) {
+        active_ = dict;
+        active_id_.store(id, std::memory_order_release);
+    }
+}
+
+size_t BlockCodec::dictionary_count() const {
+    std::shared_lock<std::shared_mutex> lock(dict_mutex_);
+    return dictionaries_.size();
+}
+
+std::shared_ptr<const BlockCodec::Dictionary> BlockCodec::find(uint32_t id) const {
+    std::shared_lock<std::shared_mutex> lock(dict_mutex_);
+    auto it = dictionaries_.find(id);
+    return it == dictionaries_.end() ? nullptr : it->second;
+}
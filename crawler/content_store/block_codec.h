@@ -0,0 +1,98 @@
+#ifndef BLOCK_CODEC_H
+#define BLOCK_CODEC_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @class BlockCodec
+ * @brief Per-block zstd compression with trained dictionaries.
+ *
+ * A 4 KB block of HTML shares most of its redundancy with other pages, not
+ * with itself, so blocks compress well only against a dictionary. The codec
+ * samples the blocks it encodes (reservoir sampling) and, once enough are
+ * collected, trains a dictionary from them; the owner persists it and
+ * registers it with add_dictionary(), after which new blocks use it. Older
+ * dictionaries stay loaded so earlier blocks remain readable.
+ *
+ * Encoded value: one tag byte, then either the raw block (kRaw, used when
+ * compression does not pay) or a varint dictionary ID (0 = none) followed by
+ * a zstd frame (kZstd). Compression and decompression contexts are per thread
+ * and dictionaries are pre-digested, so decoding is a single
+ * ZSTD_decompress_usingDDict call.
+ */
+class BlockCodec {
+public:
+    struct Config {
+        int level = 3;                          ///< zstd compression level
+        size_t dictionary_bytes = 64 * 1024;    ///< Target dictionary size
+        size_t training_samples = 2000;         ///< Blocks sampled per training round
+        size_t retrain_interval = 200000;       ///< Blocks encoded between later rounds
+    };
+
+    explicit BlockCodec(const Config& config);
+    ~BlockCodec();
+
+    BlockCodec(const BlockCodec&) = delete;
+    BlockCodec& operator=(const BlockCodec&) = delete;
+
+    /**
+     * @brief Encode a block with the newest dictionary. Thread-safe.
+     */
+    std::string encode(const char* data, size_t len) const;
+
+    /**
+     * @brief Decode a value produced by encode(). Thread-safe.
+     * @return False if the value is corrupt or names an unknown dictionary.
+     */
+    bool decode(const char* data, size_t len, std::string& out) const;
+
+    /**
+     * @brief Offer a block to the training sample.
+     * @return True exactly once per round, when a dictionary should be trained.
+     */
+    bool observe(const char* data, size_t len);
+
+    /**
+     * @brief Train a dictionary from the current sample (slow: run it off the
+     *        write path). The sample restarts for the next round.
+     * @return False if zstd could not build a dictionary from the sample.
+     */
+    bool train(std::string& dictionary);
+
+    /**
+     * @brief Register a dictionary under an ID; the highest ID is used for encoding.
+     * @throws std::runtime_error if zstd rejects the dictionary.
+     */
+    void add_dictionary(uint32_t id, const std::string& dictionary);
+
+    uint32_t active_dictionary() const { return active_id_.load(std::memory_order_acquire); }
+    size_t dictionary_count() const;
+
+private:
+    struct Dictionary;
+
+    Config config_;
+    mutable std::shared_mutex dict_mutex_;
+    std::map<uint32_t, std::shared_ptr<const Dictionary>> dictionaries_;
+    std::shared_ptr<const Dictionary> active_;
+    std::atomic<uint32_t> active_id_{0};
+
+    std::mutex sample_mutex_;
+    std::vector<std::string> samples_;
+    size_t observed_ = 0;        ///< Blocks seen this round
+    bool trained_once_ = false;
+    bool round_due_ = false;     ///< observe() already reported this round
+    std::mt19937_64 rng_{0x5eed};
+
+    std::shared_ptr<const Dictionary> find(uint32_t id) const;
+};
+
+#endif // BLOCK_CODEC_H
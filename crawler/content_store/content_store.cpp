@@ -1,69 +1,479 @@
 #include "content_store.h"
 #include <leveldb/db.h>
-#include <openssl/sha.h>
-#include <sstream>
-#include <iomanip>
+#include <leveldb/filter_policy.h>
+#include <leveldb/write_batch.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
 #include <cstring>
 #include <stdexcept>
+#include <unordered_set>
+
+// Manifests share the keyspace with blocks (keyed by the 32 digest bytes)
+static const char kManifestPrefix[] = "manifest:";
+// Block hashes of a store_page manifest, concatenated; the manifest itself is opaque
+static const char kManifestBlocksPrefix[] = "manifestb:";
+// Current PageManifest of a page, in full
+static const char kPagePrefix[] = "page:";
+// Older page versions: key, NUL, 8-byte big-endian version -> delta against the next version
+static const char kPageVersionPrefix[] = "pagev:";
+// Hash algorithm the store was created with; block keys are meaningless under another
+static const char kHashAlgorithmKey[] = "meta:hash_algorithm";
+// "raw" or "zstd": how block values are encoded
+static const char kBlockFormatKey[] = "meta:block_format";
+// Compression dictionaries, keyed by 4-byte big-endian ID
+static const char kDictionaryPrefix[] = "dict:";
+// "leveldb" or "packs": where block values live
+static const char kBlockStorageKey[] = "meta:block_storage";
+
+static std::string dictionary_key(uint32_t id) {
+    std::string key = kDictionaryPrefix;
+    for (int shift = 24; shift >= 0; shift -= 8) key.push_back(char(id >> shift));
+    return key;
+}
+
+// Prefixes of every non-block key; a 32-byte key without one of them is a block
+static const char* const kRecordPrefixes[] = {kManifestPrefix, kManifestBlocksPrefix, kHashAlgorithmKey,
+                                             kBlockFormatKey, kDictionaryPrefix, kBlockStorageKey,
+                                             kPagePrefix, kPageVersionPrefix};
+
+static bool has_prefix(const leveldb::Slice& key, const char* prefix) {
+    size_t len = std::strlen(prefix);
+    return key.size() >= len && std::memcmp(key.data(), prefix, len) == 0;
+}
+
+static bool is_block_key(const leveldb::Slice& key) {
+    if (key.size() != Digest256::kSize) return false;
+    for (const char* prefix : kRecordPrefixes) {
+        if (has_prefix(key, prefix)) return false;
+    }
+    return true;
+}
+
+static std::string page_version_key(const std::string& page_key, uint64_t version) {
+    std::string key = kPageVersionPrefix + page_key;
+    key.push_back('\0');
+    for (int shift = 56; shift >= 0; shift -= 8) key.push_back(char(version >> shift));
+    return key;
+}
 
 /**
- * @brief Helper function to convert a byte array to a hex string.
+ * @brief LevelDB key of a block: the raw digest, no copy.
  */
-static std::string bytes_to_hex(const unsigned char* bytes, size_t len) {
-    std::ostringstream oss;
-    for (size_t i = 0; i < len; ++i) {
-        oss << std::hex << std::setw(2) << std::setfill('0') << (int)bytes[i];
-    }
-    return oss.str();
+static leveldb::Slice block_key(const Digest256& hash) {
+    return leveldb::Slice(hash.data(), Digest256::kSize);
 }
 
+/**
+ * @brief Lock-free bloom filter over the hashes of stored blocks, filled from
+ *        the store when it opens. A negative answer is definitive; a positive
+ *        one must be confirmed.
+ */
+class ContentStore::PresenceFilter {
+public:
+    explicit PresenceFilter(size_t bits) : words_((bits + 63) / 64) {}
+
+    void add(const Digest256& hash) {
+        uint64_t h1, h2;
+        probes(hash, h1, h2);
+        for (int i = 0; i < kProbes; ++i) {
+            uint64_t bit = (h1 + i * h2) % (words_.size() * 64);
+            words_[bit / 64].fetch_or(uint64_t(1) << (bit % 64), std::memory_order_relaxed);
+        }
+    }
+
+    bool may_contain(const Digest256& hash) const {
+        uint64_t h1, h2;
+        probes(hash, h1, h2);
+        for (int i = 0; i < kProbes; ++i) {
+            uint64_t bit = (h1 + i * h2) % (words_.size() * 64);
+            if (!(words_[bit / 64].load(std::memory_order_relaxed) & (uint64_t(1) << (bit % 64)))) return false;
+        }
+        return true;
+    }
+
+private:
+    static constexpr int kProbes = 7; // ~1% false positives at 10 bits per key
+
+    std::vector<std::atomic<uint64_t>> words_;
+
+    // Double hashing (Kirsch-Mitzenmacher): probe i is h1 + i * h2. Digest
+    // bytes are uniformly distributed, so two words of the digest serve as h1, h2.
+    static void probes(const Digest256& hash, uint64_t& h1, uint64_t& h2) {
+        std::memcpy(&h1, hash.bytes.data(), sizeof(h1));
+        std::memcpy(&h2, hash.bytes.data() + sizeof(h1), sizeof(h2));
+        h2 |= 1;
+    }
+};
+
+/**
+ * @brief One caller's batch waiting in the group-commit queue.
+ */
+struct ContentStore::Writer {
+    leveldb::WriteBatch batch;
+    std::vector<std::string> pack_values; ///< Block values bound for the packs, parallel to new_hashes
+    size_t bytes = 0;
+    size_t block_bytes = 0;  ///< Blocks before compression
+    size_t stored_bytes = 0; ///< Block values as written
+    std::vector<Digest256> new_hashes; ///< Added to the presence filter once durable
+    bool done = false;
+    leveldb::Status status;
+    std::condition_variable cv;
+};
+
 /**
  * @brief Construct a ContentStore instance and open the LevelDB database.
  *        Throws std::runtime_error if the database cannot be opened.
  */
-ContentStore::ContentStore(const std::string& db_path) {
+ContentStore::ContentStore(const std::string& db_path) : ContentStore(db_path, Config()) {}
+
+ContentStore::ContentStore(const std::string& db_path, const Config& config)
+    : config_(config), hasher_(&HashEngine::get(config.hash_algorithm)) {
     leveldb::DB* db = nullptr;
     leveldb::Options options;
     options.create_if_missing = true;
+    if (config_.table_bloom_bits_per_key > 0) {
+        // Absent-key Gets then skip the table reads
+        filter_policy_.reset(leveldb::NewBloomFilterPolicy(config_.table_bloom_bits_per_key));
+        options.filter_policy = filter_policy_.get();
+    }
     leveldb::Status status = leveldb::DB::Open(options, db_path, &db);
     if (!status.ok()) {
         throw std::runtime_error("Failed to open LevelDB: " + status.ToString());
     }
     db_.reset(db);
+    check_format(kHashAlgorithmKey, HashEngine::algorithm_name(config_.hash_algorithm));
+    check_format(kBlockFormatKey, config_.compress_blocks ? "zstd" : "raw");
+    bool use_packs = config_.block_storage == BlockStorage::kPackFiles;
+    check_format(kBlockStorageKey, use_packs ? "packs" : "leveldb");
+    if (use_packs) packs_ = std::make_unique<PackStore>(db_path + "/packs", config_.packs);
+    if (config_.compress_blocks) {
+        codec_ = std::make_unique<BlockCodec>(config_.compression);
+        load_dictionaries();
+    }
+    if (config_.presence_filter_bits > 0) load_presence();
+    if (config_.block_cache_bytes > 0) {
+        cache_ = std::make_unique<BlockCache>(config_.block_cache_bytes, config_.block_cache_shards);
+    }
+    // The caller's thread reads too, so more threads than cores only add handoffs
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    size_t read_threads = std::min(config_.read_threads, cores - 1);
+    if (read_threads > 0) read_pool_ = std::make_unique<ThreadPool>(read_threads);
+    if (config_.gc_interval_ms > 0) {
+        gc_thread_ = std::thread([this] {
+            std::unique_lock<std::mutex> lock(gc_thread_mutex_);
+            auto period = std::chrono::milliseconds(config_.gc_interval_ms);
+            while (!gc_cv_.wait_for(lock, period, [this] { return gc_stop_; })) {
+                lock.unlock();
+                collect_garbage();
+                lock.lock();
+            }
+        });
+    }
 }
 
 /**
  * @brief Destructor. Closes the LevelDB database.
  */
 ContentStore::~ContentStore() {
+    {
+        std::lock_guard<std::mutex> lock(gc_thread_mutex_);
+        gc_stop_ = true; // Also cuts a running cycle short at its next pause
+    }
+    gc_cv_.notify_all();
+    if (gc_thread_.joinable()) gc_thread_.join();
+    std::lock_guard<std::mutex> lock(trainer_mutex_);
+    if (trainer_.joinable()) trainer_.join();
     // db_ is a unique_ptr, so it will be cleaned up automatically.
 }
 
+/**
+ * @brief Record a creation-time setting, or verify it on reopen.
+ */
+void ContentStore::check_format(const char* key, const std::string& expected) {
+    std::string stored;
+    leveldb::Status status = db_->Get(leveldb::ReadOptions(), key, &stored);
+    if (status.ok() && stored != expected) {
+        throw std::runtime_error(std::string("ContentStore ") + key + " is " + stored + ", not " + expected);
+    }
+    if (status.IsNotFound()) {
+        status = db_->Put(leveldb::WriteOptions(), key, expected);
+    }
+    if (!status.ok()) {
+        throw std::runtime_error("Failed to read store metadata: " + status.ToString());
+    }
+}
+
+void ContentStore::load_dictionaries() {
+    std::unique_ptr<leveldb::Iterator> it(db_->NewIterator(leveldb::ReadOptions()));
+    const size_t prefix_len = sizeof(kDictionaryPrefix) - 1;
+    for (it->Seek(kDictionaryPrefix); it->Valid(); it->Next()) {
+        leveldb::Slice key = it->key();
+        if (key.size() != prefix_len + 4 || std::memcmp(key.data(), kDictionaryPrefix, prefix_len) != 0) break;
+        uint32_t id = 0;
+        for (size_t i = 0; i < 4; ++i) id = id << 8 | uint8_t(key.data()[prefix_len + i]);
+        codec_->add_dictionary(id, it->value().ToString());
+    }
+}
+
+/**
+ * @brief Size the presence filter for the blocks already stored, with room
+ *        for as many again, and add them all. The pack index knows its count;
+ *        LevelDB block keys are gathered in one pass and added once the
+ *        filter exists.
+ */
+void ContentStore::load_presence() {
+    static const uint64_t kBitsPerBlock = 10;
+    std::vector<Digest256> stored;
+    uint64_t count = 0;
+    if (packs_) {
+        count = packs_->stats().records;
+    } else {
+        leveldb::ReadOptions options;
+        options.fill_cache = false;
+        std::unique_ptr<leveldb::Iterator> it(db_->NewIterator(options));
+        for (it->SeekToFirst(); it->Valid(); it->Next()) {
+            if (is_block_key(it->key())) stored.push_back(Digest256::from_bytes(it->key().data()));
+        }
+        count = stored.size();
+    }
+    size_t bits = std::max<uint64_t>(config_.presence_filter_bits, 2 * count * kBitsPerBlock);
+    presence_ = std::make_unique<PresenceFilter>(bits);
+    if (packs_) {
+        uint64_t cursor = 0;
+        std::vector<PackStore::Entry> entries;
+        for (bool more = true; more;) {
+            entries.clear();
+            more = packs_->scan(cursor, 4096, entries);
+            for (const PackStore::Entry& entry : entries) presence_->add(entry.hash);
+        }
+    }
+    for (const Digest256& hash : stored) presence_->add(hash);
+}
+
+/**
+ * @brief Train the next dictionary on a background thread (one at a time).
+ *        It is persisted before any block can be encoded with it.
+ */
+void ContentStore::start_training() {
+    std::lock_guard<std::mutex> lock(trainer_mutex_);
+    if (training_.exchange(true)) return;
+    if (trainer_.joinable()) trainer_.join();
+    trainer_ = std::thread([this] {
+        std::string dictionary;
+        if (codec_->train(dictionary)) {
+            uint32_t id = codec_->active_dictionary() + 1;
+            try {
+                if (db_->Put(leveldb::WriteOptions(), dictionary_key(id), dictionary).ok()) {
+                    codec_->add_dictionary(id, dictionary);
+                }
+            } catch (const std::runtime_error&) {
+                // Unusable dictionary: keep encoding with the previous one
+            }
+        }
+        training_.store(false);
+    });
+}
+
 /**
  * @brief Store a block of data, returning its SHA-256 hash.
  *        If the block already exists, it is not duplicated.
  */
-std::string ContentStore::store_block(const std::string& data) {
-    std::string hash = sha256(data);
-    // Only store if not already present
+Digest256 ContentStore::store_block(const std::string& data) {
+    return store_blocks({data}).front();
+}
+
+/**
+ * @brief Whether a block is already stored. The presence filter answers "no"
+ *        without touching LevelDB; without a filter every block is written.
+ */
+bool ContentStore::exists(const Digest256& hash) const {
+    if (!presence_ || !presence_->may_contain(hash)) return false;
+    existence_checks_.fetch_add(1, std::memory_order_relaxed);
+    if (packs_) return packs_->contains(hash);
     std::string existing;
-    leveldb::Status s = db_->Get(leveldb::ReadOptions(), hash, &existing);
-    if (!s.ok()) {
-        db_->Put(leveldb::WriteOptions(), hash, data);
+    return db_->Get(leveldb::ReadOptions(), block_key(hash), &existing).ok();
+}
+
+/**
+ * @brief Batch the blocks that are not stored yet (plus optional manifest
+ *        records) and group-commit them.
+ */
+void ContentStore::write_blocks(const std::vector<std::string>& blocks, const std::vector<Digest256>& hashes,
+                                const leveldb::WriteBatch* records) {
+    // Held until the commit: a collection cycle starts marking only between writes
+    std::shared_lock<std::shared_mutex> gate(gc_gate_);
+    if (gc_marking_) {
+        // Registered before exists() runs, so the sweep cannot delete a block this write relies on
+        std::lock_guard<std::mutex> lock(barrier_mutex_);
+        barrier_.insert(hashes.begin(), hashes.end());
+    }
+    Writer writer;
+    std::unordered_set<Digest256> seen;
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        // Repeated blocks within a page are written once
+        if (!seen.insert(hashes[i]).second || exists(hashes[i])) {
+            blocks_deduplicated_.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        // Compression runs here, on the caller's thread, outside the group-commit lock
+        std::string value;
+        if (codec_) {
+            value = codec_->encode(blocks[i].data(), blocks[i].size());
+            if (codec_->observe(blocks[i].data(), blocks[i].size())) start_training();
+        } else {
+            value = blocks[i];
+        }
+        writer.stored_bytes += value.size();
+        writer.bytes += Digest256::kSize + value.size();
+        if (packs_) {
+            writer.pack_values.push_back(std::move(value));
+        } else {
+            writer.batch.Put(block_key(hashes[i]), value);
+        }
+        writer.block_bytes += blocks[i].size();
+        writer.new_hashes.push_back(hashes[i]);
+    }
+    if (records) {
+        writer.batch.Append(*records);
+        writer.bytes += records->ApproximateSize();
     }
-    return hash;
+    if (writer.bytes == 0) return;
+    commit(writer);
+    if (!writer.status.ok()) {
+        throw std::runtime_error("Failed to write to LevelDB: " + writer.status.ToString());
+    }
+    blocks_written_.fetch_add(writer.new_hashes.size(), std::memory_order_relaxed);
+    block_bytes_.fetch_add(writer.block_bytes, std::memory_order_relaxed);
+    stored_bytes_.fetch_add(writer.stored_bytes, std::memory_order_relaxed);
 }
 
 /**
- * @brief Retrieve a block by its hash.
+ * @brief Group commit. The writer at the head of the queue merges the batches
+ *        queued behind it (up to max_group_bytes) into one DB write and
+ *        completes them all; the others just wait for their turn or result.
  */
-std::string ContentStore::get_block(const std::string& hash) const {
+void ContentStore::commit(Writer& writer) {
+    batches_.fetch_add(1, std::memory_order_relaxed);
+    std::unique_lock<std::mutex> lock(write_mutex_);
+    writers_.push_back(&writer);
+    writer.cv.wait(lock, [&] { return writer.done || writers_.front() == &writer; });
+    if (writer.done) return;
+
+    // Leader: take as many queued batches as fit into one group
+    std::vector<Writer*> group{&writer};
+    size_t bytes = writer.bytes;
+    for (size_t i = 1; i < writers_.size() && bytes + writers_[i]->bytes <= config_.max_group_bytes; ++i) {
+        group.push_back(writers_[i]);
+        bytes += writers_[i]->bytes;
+    }
+    lock.unlock();
+
+    leveldb::Status status;
+    if (packs_) {
+        // Blocks first: the manifests below may only name blocks already appended
+        std::vector<PackStore::Record> records;
+        for (Writer* member : group) {
+            for (size_t i = 0; i < member->pack_values.size(); ++i) {
+                records.push_back({&member->new_hashes[i], &member->pack_values[i]});
+            }
+        }
+        try {
+            packs_->append(records);
+        } catch (const std::runtime_error& e) {
+            status = leveldb::Status::IOError(e.what());
+        }
+    }
+    if (status.ok()) {
+        leveldb::WriteBatch merged;
+        leveldb::WriteBatch* batch = &writer.batch;
+        if (group.size() > 1) {
+            for (Writer* member : group) merged.Append(member->batch);
+            batch = &merged;
+        }
+        leveldb::WriteOptions options;
+        options.sync = config_.sync_writes;
+        status = db_->Write(options, batch);
+    }
+    group_commits_.fetch_add(1, std::memory_order_relaxed);
+    if (status.ok() && presence_) {
+        for (Writer* member : group) {
+            for (const Digest256& hash : member->new_hashes) presence_->add(hash);
+        }
+    }
+
+    lock.lock();
+    for (Writer* member : group) {
+        writers_.pop_front();
+        member->status = status;
+        member->done = true;
+        if (member != &writer) member->cv.notify_one();
+    }
+    // Hand leadership to the next queued writer
+    if (!writers_.empty()) writers_.front()->cv.notify_one();
+}
+
+/**
+ * @brief Read and decode a block from storage, bypassing the cache.
+ */
+ContentStore::BlockRef ContentStore::read_block(const Digest256& hash) const {
     std::string value;
-    leveldb::Status s = db_->Get(leveldb::ReadOptions(), hash, &value);
-    if (s.ok()) {
-        return value;
+    if (packs_) {
+        if (!packs_->get(hash, value)) return nullptr;
+    } else if (!db_->Get(leveldb::ReadOptions(), block_key(hash), &value).ok()) {
+        return nullptr;
+    }
+    if (!codec_) return std::make_shared<const std::string>(std::move(value));
+    auto block = std::make_shared<std::string>();
+    if (!codec_->decode(value.data(), value.size(), *block)) {
+        throw std::runtime_error("Corrupt block " + hash.hex());
     }
-    return ""; // Not found
+    return block;
+}
+
+/**
+ * @brief Retrieve a block by its hash, through the cache.
+ */
+ContentStore::BlockRef ContentStore::get_block_ref(const Digest256& hash) const {
+    if (!cache_) return read_block(hash);
+    if (BlockRef block = cache_->lookup(hash)) return block;
+    BlockRef block = read_block(hash);
+    if (block) cache_->insert(hash, block);
+    return block;
+}
+
+/**
+ * @brief Cache hits are answered in place; misses are read by the pool.
+ */
+std::vector<ContentStore::BlockRef> ContentStore::get_block_refs(const std::vector<Digest256>& hashes,
+                                                                 bool fill_cache) const {
+    // Below this many misses, handing work to the pool costs more than it saves
+    static const size_t kParallelMisses = 4;
+    std::vector<BlockRef> blocks(hashes.size());
+    std::vector<size_t> misses;
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        if (cache_ && (blocks[i] = cache_->lookup(hashes[i]))) continue;
+        misses.push_back(i);
+    }
+    auto load = [&](size_t m) {
+        size_t i = misses[m];
+        blocks[i] = read_block(hashes[i]);
+        if (cache_ && fill_cache && blocks[i]) cache_->insert(hashes[i], blocks[i]);
+    };
+    if (read_pool_ && misses.size() >= kParallelMisses) {
+        read_pool_->parallel_for(misses.size(), load);
+    } else {
+        for (size_t m = 0; m < misses.size(); ++m) load(m);
+    }
+    return blocks;
+}
+
+/**
+ * @brief Retrieve a block by its hash.
+ */
+std::string ContentStore::get_block(const Digest256& hash) const {
+    BlockRef block = get_block_ref(hash);
+    return block ? *block : std::string();
 }
 
 /**
@@ -79,38 +489,386 @@ std::vector<std::string> ContentStore::chunk_data(const std::string& data, size_
     return blocks;
 }
 
+/**
+ * @brief Gear table for chunk_content: 256 fixed pseudo-random words
+ *        (splitmix64), the same in every build so boundaries are stable.
+ */
+static const uint64_t* gear_table() {
+    static const auto table = [] {
+        std::array<uint64_t, 256> gear{};
+        uint64_t state = 0x9E3779B97F4A7C15ULL;
+        for (uint64_t& word : gear) {
+            uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            word = z ^ (z >> 31);
+        }
+        return gear;
+    }();
+    return table.data();
+}
+
+std::vector<std::string> ContentStore::chunk_content(const std::string& data, size_t min_size, size_t avg_size,
+                                                     size_t max_size) {
+    const uint64_t* gear = gear_table();
+    int bits = 0;
+    while ((size_t(1) << (bits + 1)) <= avg_size) ++bits;
+    // The hash shifts left, so its high bits cover the most bytes: mask those
+    const uint64_t strict_mask = ~uint64_t(0) << (64 - std::min(bits + 1, 63));
+    const uint64_t loose_mask = ~uint64_t(0) << (64 - std::max(bits - 1, 1));
+    std::vector<std::string> blocks;
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data.data());
+    size_t start = 0;
+    while (start < data.size()) {
+        size_t left = data.size() - start;
+        size_t len = left;
+        if (left > min_size) {
+            size_t end = std::min(left, max_size);
+            size_t normal = std::min(end, avg_size);
+            uint64_t hash = 0;
+            size_t i = min_size;
+            for (; i < normal; ++i) {
+                hash = (hash << 1) + gear[bytes[start + i]];
+                if (!(hash & strict_mask)) break;
+            }
+            if (i == normal) {
+                for (; i < end; ++i) {
+                    hash = (hash << 1) + gear[bytes[start + i]];
+                    if (!(hash & loose_mask)) break;
+                }
+            }
+            len = std::min(i + 1, end);
+        }
+        blocks.push_back(data.substr(start, len));
+        start += len;
+    }
+    return blocks;
+}
+
 /**
  * @brief Store multiple blocks, returning their hashes.
  *        Useful for storing a whole document efficiently.
  */
-std::vector<std::string> ContentStore::store_blocks(const std::vector<std::string>& blocks) {
-    std::vector<std::string> hashes;
-    for (const auto& block : blocks) {
-        hashes.push_back(store_block(block));
-    }
+std::vector<Digest256> ContentStore::store_blocks(const std::vector<std::string>& blocks) {
+    std::vector<Digest256> hashes = hash_blocks(blocks);
+    write_blocks(blocks, hashes, nullptr);
     return hashes;
 }
 
+/**
+ * @brief Hash blocks without storing them.
+ */
+std::vector<Digest256> ContentStore::hash_blocks(const std::vector<std::string>& blocks) const {
+    return hasher_->hash_many(blocks);
+}
+
+/**
+ * @brief Store a page's new blocks and its manifest in a single WriteBatch,
+ *        with the block hashes beside it for the collector's mark phase.
+ */
+void ContentStore::store_page(const std::string& page_key, const std::vector<std::string>& blocks,
+                              const std::vector<Digest256>& hashes, const std::string& manifest) {
+    if (hashes.size() != blocks.size()) {
+        throw std::invalid_argument("store_page: one hash per block expected");
+    }
+    std::string hash_list;
+    hash_list.reserve(hashes.size() * Digest256::kSize);
+    for (const Digest256& hash : hashes) hash_list.append(hash.data(), Digest256::kSize);
+    leveldb::WriteBatch records;
+    records.Put(kManifestPrefix + page_key, manifest);
+    records.Put(kManifestBlocksPrefix + page_key, hash_list);
+    write_blocks(blocks, hashes, &records);
+}
+
+/**
+ * @brief Retrieve the manifest stored by store_page.
+ */
+std::string ContentStore::get_manifest(const std::string& page_key) const {
+    std::string value;
+    if (db_->Get(leveldb::ReadOptions(), kManifestPrefix + page_key, &value).ok()) {
+        return value;
+    }
+    return "";
+}
+
+/**
+ * @brief Write the new version in full and turn the old current version into
+ *        a delta against it. The per-page lock keeps two fetches of the same
+ *        URL from both building on the same predecessor.
+ */
+PageManifest ContentStore::store_page_version(const std::string& page_key, const std::vector<std::string>& blocks,
+                                              const std::vector<Digest256>& hashes, const Digest256& root,
+                                              PageManifest* previous) {
+    if (hashes.size() != blocks.size()) {
+        throw std::invalid_argument("store_page_version: one hash per block expected");
+    }
+    std::mutex& page_mutex = page_mutexes_[std::hash<std::string>()(page_key) % page_mutexes_.size()];
+    std::lock_guard<std::mutex> lock(page_mutex);
+    PageManifest head;
+    bool has_head = get_page(page_key, head);
+    if (previous) *previous = head;
+    if (has_head && head.root == root && head.blocks == hashes) {
+        pages_unchanged_.fetch_add(1, std::memory_order_relaxed);
+        return head;
+    }
+
+    PageManifest current;
+    current.version = head.version + 1;
+    current.root = root;
+    current.blocks = hashes;
+    leveldb::WriteBatch records;
+    std::string encoded = current.encode();
+    records.Put(kPagePrefix + page_key, encoded);
+    size_t bytes = encoded.size();
+    if (has_head) {
+        std::string delta = head.encode_delta(current);
+        records.Put(page_version_key(page_key, head.version), delta);
+        bytes += delta.size();
+        if (config_.max_page_versions > 0 && current.version > config_.max_page_versions) {
+            records.Delete(page_version_key(page_key, current.version - config_.max_page_versions));
+        }
+    }
+    write_blocks(blocks, hashes, &records);
+    page_versions_.fetch_add(1, std::memory_order_relaxed);
+    manifest_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+    return current;
+}
+
+bool ContentStore::get_page(const std::string& page_key, PageManifest& manifest) const {
+    std::string value;
+    if (!db_->Get(leveldb::ReadOptions(), kPagePrefix + page_key, &value).ok()) {
+        manifest = PageManifest();
+        return false;
+    }
+    if (!PageManifest::decode(value.data(), value.size(), manifest)) {
+        throw std::runtime_error("Corrupt manifest for " + page_key);
+    }
+    return true;
+}
+
+/**
+ * @brief Walk back from the current version, applying one delta per step.
+ */
+bool ContentStore::get_page(const std::string& page_key, uint64_t version, PageManifest& manifest) const {
+    PageManifest current;
+    if (version == 0 || !get_page(page_key, current) || version > current.version) return false;
+    while (current.version > version) {
+        std::string delta;
+        if (!db_->Get(leveldb::ReadOptions(), page_version_key(page_key, current.version - 1), &delta).ok()) {
+            return false; // Dropped by max_page_versions
+        }
+        PageManifest older;
+        if (!PageManifest::apply_delta(current, delta.data(), delta.size(), older)) {
+            throw std::runtime_error("Corrupt manifest delta for " + page_key);
+        }
+        current = std::move(older);
+    }
+    manifest = std::move(current);
+    return true;
+}
+
+/**
+ * @brief Mark and sweep. Marking starts once in-flight writes have committed;
+ *        from then on writes add their hashes to the barrier, which the sweep
+ *        treats as marked. Both phases pause every 256 keys to hold
+ *        gc_keys_per_sec. Pack compaction runs after the sweep.
+ */
+ContentStore::GcReport ContentStore::collect_garbage() {
+    std::lock_guard<std::mutex> run(gc_run_mutex_);
+    const auto start = std::chrono::steady_clock::now();
+    GcReport report;
+    uint64_t keys = 0;
+    auto pace = [&](size_t n) {
+        uint64_t before = keys;
+        keys += n;
+        if (n > 0 && before / 256 == keys / 256) return true;
+        std::unique_lock<std::mutex> lock(gc_thread_mutex_);
+        if (config_.gc_keys_per_sec == 0) return !gc_stop_;
+        auto due = start + std::chrono::microseconds(keys * 1000000 / config_.gc_keys_per_sec);
+        return !gc_cv_.wait_until(lock, due, [this] { return gc_stop_; });
+    };
+    {
+        std::unique_lock<std::shared_mutex> gate(gc_gate_);
+        gc_marking_ = true;
+    }
+    PresenceFilter marked(config_.gc_mark_bits);
+    if (mark(marked, report, pace)) sweep(marked, report, pace);
+    {
+        std::unique_lock<std::shared_mutex> gate(gc_gate_);
+        gc_marking_ = false;
+        std::lock_guard<std::mutex> lock(barrier_mutex_);
+        barrier_.clear();
+    }
+    if (packs_ && pace(0)) report.pack_bytes_freed = packs_->compact(config_.gc_compact_fraction);
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    gc_cycles_.fetch_add(1, std::memory_order_relaxed);
+    gc_blocks_reclaimed_.fetch_add(report.blocks_reclaimed, std::memory_order_relaxed);
+    gc_bytes_reclaimed_.fetch_add(report.bytes_reclaimed, std::memory_order_relaxed);
+    return report;
+}
+
+/**
+ * @brief Mark every block of every stored page version (the current versions
+ *        in full plus the literal hashes of the deltas) and of every
+ *        store_page manifest.
+ * @return False if the cycle was stopped or a manifest is corrupt; the
+ *         sweep must not run on an incomplete mark.
+ */
+bool ContentStore::mark(PresenceFilter& marked, GcReport& report, const std::function<bool(size_t)>& pace) {
+    leveldb::ReadOptions options;
+    options.fill_cache = false;
+    std::unique_ptr<leveldb::Iterator> it(db_->NewIterator(options));
+    PageManifest manifest;
+    for (it->Seek(kPagePrefix); it->Valid() && has_prefix(it->key(), kPagePrefix); it->Next()) {
+        leveldb::Slice value = it->value();
+        if (!PageManifest::decode(value.data(), value.size(), manifest)) return false;
+        for (const Digest256& hash : manifest.blocks) marked.add(hash);
+        ++report.manifests_marked;
+        if (!pace(1)) return false;
+    }
+    std::vector<Digest256> literals;
+    for (it->Seek(kPageVersionPrefix); it->Valid() && has_prefix(it->key(), kPageVersionPrefix); it->Next()) {
+        leveldb::Slice value = it->value();
+        literals.clear();
+        if (!PageManifest::delta_literals(value.data(), value.size(), literals)) return false;
+        for (const Digest256& hash : literals) marked.add(hash);
+        ++report.manifests_marked;
+        if (!pace(1)) return false;
+    }
+    for (it->Seek(kManifestBlocksPrefix); it->Valid() && has_prefix(it->key(), kManifestBlocksPrefix); it->Next()) {
+        leveldb::Slice value = it->value();
+        if (value.size() % Digest256::kSize != 0) return false;
+        for (size_t offset = 0; offset < value.size(); offset += Digest256::kSize) {
+            marked.add(Digest256::from_bytes(value.data() + offset));
+        }
+        ++report.manifests_marked;
+        if (!pace(1)) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Walk the stored blocks and reclaim the unmarked ones in batches.
+ */
+void ContentStore::sweep(const PresenceFilter& marked, GcReport& report, const std::function<bool(size_t)>& pace) {
+    static const size_t kSweepBatch = 256;
+    std::vector<Digest256> garbage;
+    std::vector<uint64_t> sizes;
+    if (packs_) {
+        uint64_t cursor = 0;
+        std::vector<PackStore::Entry> entries;
+        for (bool more = true; more;) {
+            entries.clear();
+            more = packs_->scan(cursor, kSweepBatch, entries);
+            for (const PackStore::Entry& entry : entries) {
+                if (marked.may_contain(entry.hash)) continue;
+                garbage.push_back(entry.hash);
+                sizes.push_back(entry.len);
+            }
+            report.blocks_scanned += entries.size();
+            reclaim(garbage, sizes, report);
+            garbage.clear();
+            sizes.clear();
+            if (!pace(entries.size())) return;
+        }
+        return;
+    }
+    leveldb::ReadOptions options;
+    options.fill_cache = false;
+    std::unique_ptr<leveldb::Iterator> it(db_->NewIterator(options));
+    for (it->SeekToFirst(); it->Valid(); it->Next()) {
+        if (!is_block_key(it->key())) continue;
+        ++report.blocks_scanned;
+        Digest256 hash = Digest256::from_bytes(it->key().data());
+        if (!marked.may_contain(hash)) {
+            garbage.push_back(hash);
+            sizes.push_back(it->value().size());
+        }
+        if (garbage.size() == kSweepBatch) {
+            reclaim(garbage, sizes, report);
+            garbage.clear();
+            sizes.clear();
+        }
+        if (!pace(1)) break;
+    }
+    reclaim(garbage, sizes, report);
+}
+
+/**
+ * @brief Delete unmarked blocks that no write registered in the meantime.
+ *        Holding barrier_mutex_ makes the check and the delete atomic with
+ *        respect to writers registering their hashes.
+ */
+void ContentStore::reclaim(const std::vector<Digest256>& hashes, const std::vector<uint64_t>& sizes,
+                           GcReport& report) {
+    if (hashes.empty()) return;
+    std::lock_guard<std::mutex> lock(barrier_mutex_);
+    std::vector<Digest256> victims;
+    leveldb::WriteBatch batch;
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        if (barrier_.count(hashes[i])) continue;
+        victims.push_back(hashes[i]);
+        batch.Delete(block_key(hashes[i]));
+        bytes += sizes[i];
+    }
+    if (victims.empty()) return;
+    if (packs_) {
+        packs_->remove(victims);
+    } else if (!db_->Write(leveldb::WriteOptions(), &batch).ok()) {
+        return; // Left for the next cycle
+    }
+    if (cache_) {
+        for (const Digest256& hash : victims) cache_->erase(hash);
+    }
+    report.blocks_reclaimed += victims.size();
+    report.bytes_reclaimed += bytes;
+}
+
+/**
+ * @brief Snapshot of the write-path counters.
+ */
+ContentStore::Stats ContentStore::stats() const {
+    Stats stats;
+    stats.blocks_written = blocks_written_.load(std::memory_order_relaxed);
+    stats.blocks_deduplicated = blocks_deduplicated_.load(std::memory_order_relaxed);
+    stats.existence_checks = existence_checks_.load(std::memory_order_relaxed);
+    stats.batches = batches_.load(std::memory_order_relaxed);
+    stats.group_commits = group_commits_.load(std::memory_order_relaxed);
+    stats.block_bytes = block_bytes_.load(std::memory_order_relaxed);
+    stats.stored_bytes = stored_bytes_.load(std::memory_order_relaxed);
+    stats.dictionaries = codec_ ? codec_->dictionary_count() : 0;
+    stats.pack_files = packs_ ? packs_->stats().packs : 0;
+    stats.page_versions = page_versions_.load(std::memory_order_relaxed);
+    stats.pages_unchanged = pages_unchanged_.load(std::memory_order_relaxed);
+    stats.manifest_bytes = manifest_bytes_.load(std::memory_order_relaxed);
+    stats.gc_cycles = gc_cycles_.load(std::memory_order_relaxed);
+    stats.gc_blocks_reclaimed = gc_blocks_reclaimed_.load(std::memory_order_relaxed);
+    stats.gc_bytes_reclaimed = gc_bytes_reclaimed_.load(std::memory_order_relaxed);
+    if (cache_) {
+        BlockCache::Stats cache = cache_->stats();
+        stats.cache_hits = cache.hits;
+        stats.cache_misses = cache.misses;
+    }
+    return stats;
+}
+
 /**
  * @brief Retrieve multiple blocks by their hashes.
  */
-std::vector<std::string> ContentStore::get_blocks(const std::vector<std::string>& hashes) const {
+std::vector<std::string> ContentStore::get_blocks(const std::vector<Digest256>& hashes) const {
     std::vector<std::string> blocks;
-    for (const auto& hash : hashes) {
-        blocks.push_back(get_block(hash));
+    blocks.reserve(hashes.size());
+    for (const BlockRef& block : get_block_refs(hashes)) {
+        blocks.push_back(block ? *block : std::string());
     }
     return blocks;
 }
 
 /**
- * @brief Compute SHA-256 hash of a data block using OpenSSL.
+ * @brief Compute SHA-256 hash of a data block.
  *        Returns the hash as a hex-encoded string.
  */
 std::string ContentStore::sha256(const std::string& data) {
-    unsigned char hash[SHA256_DIGEST_LENGTH];
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
-    SHA256_Update(&sha256, data.c_str(), data.size());
-    SHA256_Final(hash, &sha256);
-    return bytes_to_hex(hash, SHA256_DIGEST_LENGTH);
-} 
\ No newline at end of file
+    return Digest256::of(data).hex();
+}
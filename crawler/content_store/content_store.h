@@ -4,10 +4,28 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_set>
+#include "block_cache.h"
+#include "block_codec.h"
+#include "pack_store.h"
+#include "page_manifest.h"
+#include "thread_pool.h"
+#include "../common/digest.h"
+#include "../common/hash_engine.h"
 
 // Forward declaration for LevelDB
 namespace leveldb {
     class DB;
+    class FilterPolicy;
+    class WriteBatch;
 }
 
 /**
@@ -15,34 +33,158 @@ namespace leveldb {
  * @brief Content-addressed storage for chunked web content using LevelDB and SHA-256.
  *
  * Chunks input data into 4KB blocks, hashes each block, and stores them in LevelDB.
- * Provides methods to store and retrieve blocks by their hash.
+ * Provides methods to store and retrieve blocks by their hash. Blocks are keyed
+ * by the 32 raw digest bytes; hex appears only in sha256() and logs.
+ *
+ * Writes are batched: all new blocks of a call go into one leveldb::WriteBatch,
+ * and batches from concurrent callers are group-committed by whichever caller
+ * reaches the head of the write queue first (one DB write, and one fsync when
+ * sync_writes is set, per group). Whether a block already exists is answered
+ * by an in-memory bloom filter of stored hashes, filled from the block keys
+ * (or the pack index) when the store opens; only "maybe present" answers
+ * are confirmed with a Get, which LevelDB's own table bloom filters keep
+ * cheap. Blocks the filter has not seen are written blindly: content-addressed
+ * puts are idempotent.
+ *
+ * With compress_blocks set, each block is stored zstd-compressed against a
+ * dictionary trained in the background from sampled blocks (see BlockCodec).
+ * Dictionaries are stored in the DB under their ID, and every block value
+ * names the dictionary it needs.
+ *
+ * With block_storage = kPackFiles, block values go to an append-only
+ * PackStore in <db_path>/packs instead of LevelDB, which then holds only
+ * manifests and metadata. Blocks are immutable, so LevelDB compaction
+ * rewriting them level after level was pure write amplification. A group
+ * commit appends its blocks to the packs before it writes its manifests,
+ * so a manifest never names a missing block.
+ *
+ * Pages are versioned: store_page_version() keeps the current PageManifest
+ * of a URL in full and each older version as a delta against its successor,
+ * so the previous block list of a page is one Get away and a diff between
+ * versions needs no re-fetch. Older versions beyond max_page_versions are
+ * dropped in the same write.
+ *
+ * Blocks that no stored page version references are reclaimed by a
+ * mark-and-sweep collector (collect_garbage(), or every gc_interval_ms on a
+ * background thread). The mark phase reads only manifests; the sweep deletes
+ * unmarked blocks in small, paced batches so foreground writes never wait
+ * long. Blocks written while a cycle runs are protected by a write barrier.
+ * Page versions and store_page() manifests are the roots: blocks stored with
+ * store_blocks() alone are garbage to the collector.
+ *
+ * Reads go through a sharded CLOCK cache of decoded blocks (see BlockCache),
+ * handed out as BlockRef so callers share the cached string instead of
+ * copying it. get_block_refs() serves hits from the cache and fans the misses
+ * out over a small thread pool, so reassembling a page costs roughly one
+ * storage read of latency rather than one per block.
  */
 class ContentStore {
 public:
+    using BlockRef = BlockCache::BlockRef;
+
+    enum class BlockStorage {
+        kLevelDb,   ///< Blocks are LevelDB values
+        kPackFiles  ///< Blocks are appended to pack files (see PackStore)
+    };
+
+    struct Config {
+        size_t presence_filter_bits = size_t(1) << 24; ///< Smallest in-memory bloom (2 MB), 0 disables it;
+                                                       ///< grown at open to 20 bits per stored block
+        int table_bloom_bits_per_key = 10;             ///< LevelDB filter policy, 0 disables it
+        size_t max_group_bytes = 4 * 1024 * 1024;      ///< Upper bound on one group commit
+        bool sync_writes = false;                      ///< fsync each group commit
+        HashAlgorithm hash_algorithm = HashAlgorithm::kSha256; ///< Fixed when the store is created
+        bool compress_blocks = false;                  ///< zstd per block; fixed when the store is created
+        BlockCodec::Config compression;
+        BlockStorage block_storage = BlockStorage::kLevelDb; ///< Fixed when the store is created
+        PackStore::Config packs;
+        size_t block_cache_bytes = 64 * 1024 * 1024;   ///< Decoded-block cache, 0 disables it
+        size_t block_cache_shards = 16;
+        size_t max_page_versions = 16;                 ///< Versions kept per page (current included), 0 keeps all
+        size_t read_threads = 4;                       ///< Multi-get fan-out (at most cores - 1), 0 reads on the caller's thread
+        size_t gc_interval_ms = 0;                     ///< Background collection period, 0 disables it
+        size_t gc_keys_per_sec = 50000;                ///< Pace of mark and sweep, 0 unthrottled
+        size_t gc_mark_bits = size_t(1) << 27;         ///< Bloom filter of marked blocks (16 MB)
+        double gc_compact_fraction = 0.5;              ///< Rewrite a sealed pack once this much of it is garbage
+    };
+
+    /**
+     * @brief Outcome of one garbage collection cycle.
+     */
+    struct GcReport {
+        uint64_t manifests_marked = 0;  ///< Page records read: versions, deltas, store_page manifests
+        uint64_t blocks_scanned = 0;    ///< Stored blocks examined by the sweep
+        uint64_t blocks_reclaimed = 0;  ///< Blocks deleted
+        uint64_t bytes_reclaimed = 0;   ///< Stored bytes of the deleted blocks
+        uint64_t pack_bytes_freed = 0;  ///< Disk space returned by pack compaction
+        double seconds = 0;
+    };
+
+    /**
+     * @brief Counters for monitoring store throughput.
+     */
+    struct Stats {
+        uint64_t blocks_written = 0;    ///< Blocks newly stored
+        uint64_t blocks_deduplicated = 0; ///< Blocks skipped because they were already stored
+        uint64_t existence_checks = 0;  ///< Gets issued to confirm a "maybe present" filter answer
+        uint64_t batches = 0;           ///< Write batches submitted
+        uint64_t group_commits = 0;     ///< DB writes (each may carry several batches)
+        uint64_t block_bytes = 0;       ///< Size of the blocks written
+        uint64_t stored_bytes = 0;      ///< Size of their stored values (after compression)
+        size_t dictionaries = 0;        ///< Compression dictionaries trained so far
+        size_t pack_files = 0;          ///< Pack files, with kPackFiles storage
+        uint64_t cache_hits = 0;        ///< Block reads served by the cache
+        uint64_t cache_misses = 0;      ///< Block reads that went to storage
+        uint64_t page_versions = 0;     ///< Page versions stored by store_page_version
+        uint64_t pages_unchanged = 0;   ///< store_page_version calls that matched the current version
+        uint64_t manifest_bytes = 0;    ///< Size of the manifest records and deltas written
+        uint64_t gc_cycles = 0;         ///< Completed garbage collection cycles
+        uint64_t gc_blocks_reclaimed = 0;
+        uint64_t gc_bytes_reclaimed = 0;
+    };
+
     /**
      * @brief Construct a ContentStore instance.
      * @param db_path Path to the LevelDB database directory.
+     * @throws std::runtime_error if the DB cannot be opened or was created
+     *         with a different hash algorithm.
      */
     explicit ContentStore(const std::string& db_path);
+    ContentStore(const std::string& db_path, const Config& config);
 
     /**
-     * @brief Destructor. Closes the LevelDB database.
+     * @brief Destructor. Waits for dictionary training, closes the LevelDB database.
      */
     ~ContentStore();
 
     /**
-     * @brief Store a block of data, returning its SHA-256 hash.
+     * @brief Store a block of data, returning its SHA-256 digest.
      * @param data The data block to store (should be <= 4KB).
-     * @return The SHA-256 hash of the block (hex-encoded).
+     * @return The SHA-256 digest of the block.
      */
-    std::string store_block(const std::string& data);
+    Digest256 store_block(const std::string& data);
 
     /**
-     * @brief Retrieve a block by its hash.
-     * @param hash The SHA-256 hash of the block (hex-encoded).
+     * @brief Retrieve a block by its digest.
+     * @param hash The SHA-256 digest of the block.
      * @return The data block, or empty string if not found.
      */
-    std::string get_block(const std::string& hash) const;
+    std::string get_block(const Digest256& hash) const;
+
+    /**
+     * @brief Retrieve a block without copying it: the cached block stays valid
+     *        for as long as the reference is held, even after eviction.
+     * @return The block, or null if not found.
+     * @throws std::runtime_error if the stored value is corrupt.
+     */
+    BlockRef get_block_ref(const Digest256& hash) const;
+
+    /**
+     * @brief Retrieve many blocks, reading cache misses in parallel.
+     * @param fill_cache False for one-off scans (bulk reindex) that should not evict hot blocks.
+     * @return One reference per hash, null where not found.
+     */
+    std::vector<BlockRef> get_block_refs(const std::vector<Digest256>& hashes, bool fill_cache = true) const;
 
     /**
      * @brief Chunk input data into 4KB blocks.
@@ -52,18 +194,90 @@ public:
     static std::vector<std::string> chunk_data(const std::string& data, size_t chunk_size = 4096);
 
     /**
-     * @brief Store multiple blocks, returning their hashes.
+     * @brief Content-defined chunking (FastCDC): cut where a gear hash of the
+     *        last 64 bytes matches a mask, so boundaries follow the content
+     *        and an insertion or deletion changes only the blocks around it.
+     *        Cuts are harder to hit before avg_size and easier after it
+     *        (normalized chunking), which keeps sizes close to avg_size.
+     * @param avg_size Target block size, a power of two.
+     * @return Blocks of min_size..max_size bytes (the last may be shorter).
+     */
+    static std::vector<std::string> chunk_content(const std::string& data, size_t min_size = 1024,
+                                                  size_t avg_size = 4096, size_t max_size = 16384);
+
+    /**
+     * @brief Store multiple blocks, returning their digests.
      * @param blocks Vector of data blocks.
-     * @return Vector of SHA-256 hashes (hex-encoded).
+     * @return Vector of SHA-256 digests.
      */
-    std::vector<std::string> store_blocks(const std::vector<std::string>& blocks);
+    std::vector<Digest256> store_blocks(const std::vector<std::string>& blocks);
 
     /**
-     * @brief Retrieve multiple blocks by their hashes.
-     * @param hashes Vector of SHA-256 hashes (hex-encoded).
+     * @brief Retrieve multiple blocks by their digests.
+     * @param hashes Vector of SHA-256 digests.
      * @return Vector of data blocks (empty string if not found).
      */
-    std::vector<std::string> get_blocks(const std::vector<std::string>& hashes) const;
+    std::vector<std::string> get_blocks(const std::vector<Digest256>& hashes) const;
+
+    /**
+     * @brief Hash blocks without storing them, as one HashEngine batch.
+     * @return Vector of digests under the store's hash algorithm.
+     */
+    std::vector<Digest256> hash_blocks(const std::vector<std::string>& blocks) const;
+
+    HashAlgorithm hash_algorithm() const { return config_.hash_algorithm; }
+
+    /**
+     * @brief Store a page's blocks and its manifest record in one atomic write:
+     *        readers never see a manifest whose blocks are missing.
+     * @param page_key Key of the manifest (e.g. the page URL).
+     * @param blocks Data blocks of the page.
+     * @param hashes hash_blocks(blocks), computed by the caller to build the manifest.
+     * @param manifest Serialized manifest stored under page_key.
+     */
+    void store_page(const std::string& page_key, const std::vector<std::string>& blocks,
+                    const std::vector<Digest256>& hashes, const std::string& manifest);
+
+    /**
+     * @brief Retrieve the manifest stored by store_page.
+     * @return The manifest, or empty string if not found.
+     */
+    std::string get_manifest(const std::string& page_key) const;
+
+    /**
+     * @brief Store a new version of a page: its new blocks, its manifest as
+     *        the current version, and the previous version as a delta, in one
+     *        atomic write. Nothing is written if the page is unchanged.
+     * @param root Merkle root over hashes.
+     * @param previous If given, receives the version this one replaces
+     *        (version 0 for a page seen for the first time).
+     * @return The page's current manifest after the call.
+     */
+    PageManifest store_page_version(const std::string& page_key, const std::vector<std::string>& blocks,
+                                    const std::vector<Digest256>& hashes, const Digest256& root,
+                                    PageManifest* previous = nullptr);
+
+    /**
+     * @brief Current version of a page.
+     * @return False if the page has no versions.
+     * @throws std::runtime_error if the stored manifest is corrupt.
+     */
+    bool get_page(const std::string& page_key, PageManifest& manifest) const;
+
+    /**
+     * @brief A specific version of a page, rebuilt from the deltas.
+     * @return False if that version was never stored or has been dropped.
+     * @throws std::runtime_error if a stored manifest or delta is corrupt.
+     */
+    bool get_page(const std::string& page_key, uint64_t version, PageManifest& manifest) const;
+
+    Stats stats() const;
+
+    /**
+     * @brief Run one mark-and-sweep cycle now, paced by gc_keys_per_sec.
+     *        Cycles never overlap; a call made during one waits for it.
+     */
+    GcReport collect_garbage();
 
     /**
      * @brief Compute SHA-256 hash of a data block.
@@ -72,8 +286,68 @@ public:
      */
     static std::string sha256(const std::string& data);
 
+    /**
+     * @brief Compute the SHA-256 digest of a data block.
+     */
+    static Digest256 digest(const std::string& data) { return Digest256::of(data); }
+
 private:
+    class PresenceFilter;
+    struct Writer;
+
+    Config config_;
+    const HashEngine* hasher_;
+    std::unique_ptr<const leveldb::FilterPolicy> filter_policy_; // must outlive db_
     std::unique_ptr<leveldb::DB> db_;
+    std::unique_ptr<PresenceFilter> presence_;
+    std::unique_ptr<PackStore> packs_;   ///< Null unless kPackFiles
+    std::unique_ptr<BlockCache> cache_;  ///< Null if block_cache_bytes is 0
+    std::unique_ptr<ThreadPool> read_pool_; ///< Null if read_threads is 0
+    std::unique_ptr<BlockCodec> codec_;  ///< Null unless compress_blocks
+    std::mutex trainer_mutex_;
+    std::thread trainer_;
+    std::atomic<bool> training_{false};
+
+    std::mutex write_mutex_;
+    std::deque<Writer*> writers_;
+    std::array<std::mutex, 64> page_mutexes_; ///< Serialize versioning of a page (striped by key)
+
+    std::mutex gc_run_mutex_;           ///< One cycle at a time
+    std::shared_mutex gc_gate_;         ///< Writers hold it shared; a cycle takes it to start and end marking
+    bool gc_marking_ = false;           ///< A cycle is running (guarded by gc_gate_)
+    std::mutex barrier_mutex_;
+    std::unordered_set<Digest256> barrier_; ///< Blocks written or referenced during the cycle
+    std::mutex gc_thread_mutex_;
+    std::condition_variable gc_cv_;
+    bool gc_stop_ = false;
+    std::thread gc_thread_;
+
+    std::atomic<uint64_t> blocks_written_{0};
+    std::atomic<uint64_t> blocks_deduplicated_{0};
+    mutable std::atomic<uint64_t> existence_checks_{0};
+    std::atomic<uint64_t> batches_{0};
+    std::atomic<uint64_t> group_commits_{0};
+    std::atomic<uint64_t> block_bytes_{0};
+    std::atomic<uint64_t> stored_bytes_{0};
+    std::atomic<uint64_t> page_versions_{0};
+    std::atomic<uint64_t> pages_unchanged_{0};
+    std::atomic<uint64_t> manifest_bytes_{0};
+    std::atomic<uint64_t> gc_cycles_{0};
+    std::atomic<uint64_t> gc_blocks_reclaimed_{0};
+    std::atomic<uint64_t> gc_bytes_reclaimed_{0};
+
+    bool exists(const Digest256& hash) const;
+    BlockRef read_block(const Digest256& hash) const;
+    void write_blocks(const std::vector<std::string>& blocks, const std::vector<Digest256>& hashes,
+                      const leveldb::WriteBatch* records);
+    void commit(Writer& writer);
+    void check_format(const char* key, const std::string& expected);
+    void load_dictionaries();
+    void load_presence();
+    void start_training();
+    bool mark(PresenceFilter& marked, GcReport& report, const std::function<bool(size_t)>& pace);
+    void sweep(const PresenceFilter& marked, GcReport& report, const std::function<bool(size_t)>& pace);
+    void reclaim(const std::vector<Digest256>& hashes, const std::vector<uint64_t>& sizes, GcReport& report);
 };
 
 #endif // CONTENT_STORE_H 
\ No newline at end of file
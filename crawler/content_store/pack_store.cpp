@@ -0,0 +1,551 @@
+#include "pack_store.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace {
+
+const char kIndexMagic[8] = {'C', 'S', 'P', 'K', 'I', 'D', 'X', '1'};
+const uint32_t kIndexVersion = 2;
+const uint32_t kTombstone = UINT32_MAX; // Slot.pack of a removed record: probes continue past it
+const size_t kRecordHeader = Digest256::kSize + 4; // digest, u32 LE value length
+
+[[noreturn]] void fail(const std::string& what, const std::string& path) {
+    throw std::runtime_error("PackStore: " + what + " " + path + ": " + std::strerror(errno));
+}
+
+uint64_t prefix_of(const Digest256& hash) {
+    uint64_t prefix;
+    std::memcpy(&prefix, hash.data(), sizeof(prefix));
+    return prefix;
+}
+
+void put_u32(std::string& out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) out.push_back(char(value >> (8 * i)));
+}
+
+uint32_t get_u32(const char* p) {
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; --i) value = value << 8 | uint8_t(p[i]);
+    return value;
+}
+
+} // namespace
+
+struct PackStore::IndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t clean;      ///< 1 only while the store is closed
+    uint64_t capacity;   ///< Slots, a power of two
+    uint64_t count;      ///< Occupied slots, tombstones included
+    uint64_t tombstones; ///< Slots of removed records
+    uint64_t pack_bytes; ///< Total pack size the index covers (checked on open)
+};
+
+struct PackStore::Slot {
+    uint64_t prefix;  ///< First 8 digest bytes
+    uint32_t pack;    ///< Pack number, 0 = empty slot, kTombstone = removed
+    uint32_t len;     ///< Value length
+    uint64_t offset;  ///< Record offset in the pack
+};
+
+PackStore::PackStore(const std::string& dir, const Config& config) : dir_(dir), config_(config) {
+    std::error_code ec;
+    std::filesystem::create_directories(dir_, ec);
+    if (ec) throw std::runtime_error("PackStore: cannot create " + dir_ + ": " + ec.message());
+    open_packs();
+    if (!open_index()) {
+        rebuild_index();
+        rebuilt_ = true;
+    }
+    // Dirty until closed: a crash from here on forces a rebuild
+    header().clean = 0;
+    if (msync(index_map_, sizeof(IndexHeader), MS_SYNC) != 0) fail("cannot sync", index_path());
+}
+
+/**
+ * @brief Mark the index clean once everything it covers is on disk.
+ */
+PackStore::~PackStore() {
+    bool synced = true;
+    uint64_t total = 0;
+    for (Pack& pack : packs_) {
+        synced = fdatasync(pack.fd) == 0 && synced;
+        total += pack.size;
+    }
+    if (index_map_) {
+        synced = msync(index_map_, index_bytes_, MS_SYNC) == 0 && synced;
+        if (synced) {
+            header().pack_bytes = total;
+            header().clean = 1;
+            msync(index_map_, sizeof(IndexHeader), MS_SYNC);
+        }
+        munmap(index_map_, index_bytes_);
+        close(index_fd_);
+    }
+    for (Pack& pack : packs_) {
+        if (pack.map) munmap(const_cast<char*>(pack.map), pack.size);
+        close(pack.fd);
+    }
+}
+
+PackStore::IndexHeader& PackStore::header() const {
+    return *reinterpret_cast<IndexHeader*>(index_map_);
+}
+
+PackStore::Slot* PackStore::slots() const {
+    return reinterpret_cast<Slot*>(index_map_ + sizeof(IndexHeader));
+}
+
+std::string PackStore::pack_path(size_t number) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "/pack-%06zu.dat", number);
+    return dir_ + name;
+}
+
+std::string PackStore::index_path() const {
+    return dir_ + "/index.dat";
+}
+
+/**
+ * @brief Open pack-000001.dat onward; all but the last are sealed.
+ */
+void PackStore::open_packs() {
+    struct stat st;
+    for (size_t number = 1; stat(pack_path(number).c_str(), &st) == 0; ++number) {
+        Pack pack;
+        pack.fd = open(pack_path(number).c_str(), O_RDWR);
+        if (pack.fd < 0) fail("cannot open", pack_path(number));
+        pack.size = uint64_t(st.st_size);
+        packs_.push_back(pack);
+    }
+    if (packs_.empty()) {
+        start_pack();
+        return;
+    }
+    for (size_t i = 0; i + 1 < packs_.size(); ++i) seal(packs_[i]);
+}
+
+/**
+ * @brief Map an existing index if it was closed cleanly and matches the packs.
+ */
+bool PackStore::open_index() {
+    int fd = open(index_path().c_str(), O_RDWR);
+    if (fd < 0) return false;
+    struct stat st;
+    IndexHeader h;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(h) || pread(fd, &h, sizeof(h), 0) != ssize_t(sizeof(h))) {
+        close(fd);
+        return false;
+    }
+    uint64_t total = 0;
+    for (const Pack& pack : packs_) total += pack.size;
+    bool valid = std::memcmp(h.magic, kIndexMagic, sizeof(kIndexMagic)) == 0 && h.version == kIndexVersion &&
+                 h.clean == 1 && h.pack_bytes == total && h.capacity != 0 && (h.capacity & (h.capacity - 1)) == 0 &&
+                 uint64_t(st.st_size) == sizeof(h) + h.capacity * sizeof(Slot);
+    if (!valid) {
+        close(fd);
+        return false;
+    }
+    void* map = mmap(nullptr, size_t(st.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+    index_fd_ = fd;
+    index_map_ = static_cast<char*>(map);
+    index_bytes_ = size_t(st.st_size);
+    return true;
+}
+
+void PackStore::create_index(uint64_t capacity, const std::string& path, int& fd, char*& map, size_t& bytes) {
+    bytes = sizeof(IndexHeader) + capacity * sizeof(Slot);
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) fail("cannot create", path);
+    if (ftruncate(fd, off_t(bytes)) != 0) fail("cannot size", path);
+    void* m = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (m == MAP_FAILED) fail("cannot map", path);
+    map = static_cast<char*>(m);
+    // A fresh file reads as zeros: every slot is empty
+    IndexHeader* h = reinterpret_cast<IndexHeader*>(map);
+    std::memcpy(h->magic, kIndexMagic, sizeof(kIndexMagic));
+    h->version = kIndexVersion;
+    h->clean = 0;
+    h->capacity = capacity;
+    h->count = 0;
+    h->tombstones = 0;
+    h->pack_bytes = 0;
+}
+
+/**
+ * @brief Recreate the index by scanning every pack, cutting a torn tail off the last one.
+ */
+void PackStore::rebuild_index() {
+    uint64_t capacity = 1;
+    while (capacity < config_.initial_index_slots) capacity <<= 1;
+    if (index_map_) {
+        munmap(index_map_, index_bytes_);
+        close(index_fd_);
+    }
+    create_index(capacity, index_path(), index_fd_, index_map_, index_bytes_);
+    for (size_t number = 1; number <= packs_.size(); ++number) {
+        uint64_t valid = scan_pack(number);
+        Pack& pack = packs_[number - 1];
+        if (valid == pack.size) continue;
+        if (number != packs_.size()) {
+            throw std::runtime_error("PackStore: corrupt sealed pack " + pack_path(number));
+        }
+        // Torn append: the index never pointed past it
+        if (ftruncate(pack.fd, off_t(valid)) != 0) fail("cannot truncate", pack_path(number));
+        pack.size = valid;
+    }
+}
+
+/**
+ * @brief Index the records of one pack.
+ * @return Length of its well-formed prefix.
+ */
+uint64_t PackStore::scan_pack(size_t number) {
+    const Pack& pack = packs_[number - 1];
+    char head[kRecordHeader];
+    uint64_t offset = 0;
+    while (offset + kRecordHeader <= pack.size) {
+        if (!read_at(pack, offset, kRecordHeader, head)) fail("cannot read", pack_path(number));
+        uint32_t len = get_u32(head + Digest256::kSize);
+        if (offset + kRecordHeader + len > pack.size) break;
+        insert(prefix_of(Digest256::from_bytes(head)), uint32_t(number), offset, len);
+        offset += kRecordHeader + len;
+    }
+    return offset;
+}
+
+/**
+ * @brief Double the table into a new file and swap it in with a rename.
+ *        Tombstones are not carried over.
+ */
+void PackStore::grow_index() {
+    const std::string tmp = index_path() + ".tmp";
+    int old_fd = index_fd_;
+    char* old_map = index_map_;
+    size_t old_bytes = index_bytes_;
+    const Slot* old_slots = slots();
+    uint64_t old_capacity = header().capacity;
+
+    create_index(old_capacity * 2, tmp, index_fd_, index_map_, index_bytes_);
+    for (uint64_t i = 0; i < old_capacity; ++i) {
+        const Slot& slot = old_slots[i];
+        if (slot.pack && slot.pack != kTombstone) insert(slot.prefix, slot.pack, slot.offset, slot.len);
+    }
+    if (std::rename(tmp.c_str(), index_path().c_str()) != 0) fail("cannot replace", index_path());
+    munmap(old_map, old_bytes);
+    close(old_fd);
+}
+
+/**
+ * @brief Linear probing from the slot named by the digest prefix. The table
+ *        never fills (it grows at 70%), so an empty slot ends every probe.
+ */
+void PackStore::insert(uint64_t prefix, uint32_t pack, uint64_t offset, uint32_t len) {
+    IndexHeader& h = header();
+    if ((h.count + 1) * 10 > h.capacity * 7) {
+        grow_index();
+        insert(prefix, pack, offset, len);
+        return;
+    }
+    const uint64_t mask = h.capacity - 1;
+    Slot* table = slots();
+    uint64_t i = prefix & mask;
+    while (table[i].pack) i = (i + 1) & mask;
+    table[i] = Slot{prefix, pack, len, offset};
+    ++h.count;
+}
+
+/**
+ * @brief Probe for a digest, confirming prefix matches against the pack record.
+ */
+PackStore::Slot* PackStore::find(const Digest256& hash, std::string* value) const {
+    const uint64_t prefix = prefix_of(hash);
+    const uint64_t mask = header().capacity - 1;
+    Slot* table = slots();
+    char digest[Digest256::kSize];
+    for (uint64_t i = prefix & mask; table[i].pack; i = (i + 1) & mask) {
+        Slot& slot = table[i];
+        if (slot.prefix != prefix || slot.pack == kTombstone) continue;
+        const Pack& pack = packs_[slot.pack - 1];
+        if (value && !pack.map) {
+            value->resize(slot.len);
+            if (!read_record(pack, slot.offset, digest, &(*value)[0], slot.len)) continue;
+        } else if (!read_at(pack, slot.offset, sizeof(digest), digest)) {
+            continue;
+        }
+        if (std::memcmp(digest, hash.data(), Digest256::kSize) != 0) continue;
+        if (value && pack.map) value->assign(pack.map + slot.offset + kRecordHeader, slot.len);
+        return &slot;
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Read a record's digest and value with one preadv, straight into the caller's buffers.
+ */
+bool PackStore::read_record(const Pack& pack, uint64_t offset, char* digest, char* value, size_t len) const {
+    if (offset + kRecordHeader + len > pack.size) return false;
+    char length[4];
+    iovec parts[3] = {{digest, Digest256::kSize}, {length, sizeof(length)}, {value, len}};
+    ssize_t n = preadv(pack.fd, parts, 3, off_t(offset));
+    if (n == ssize_t(kRecordHeader + len)) return true;
+    // Short read (or EINTR): fall back to pread loops
+    return read_at(pack, offset, Digest256::kSize, digest) && read_at(pack, offset + kRecordHeader, len, value);
+}
+
+bool PackStore::read_at(const Pack& pack, uint64_t offset, size_t len, char* out) const {
+    if (offset + len > pack.size) return false;
+    if (pack.map) {
+        std::memcpy(out, pack.map + offset, len);
+        return true;
+    }
+    while (len > 0) {
+        ssize_t n = pread(pack.fd, out, len, off_t(offset));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        out += n;
+        offset += uint64_t(n);
+        len -= size_t(n);
+    }
+    return true;
+}
+
+void PackStore::start_pack() {
+    const std::string path = pack_path(packs_.size() + 1);
+    Pack pack;
+    pack.fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (pack.fd < 0) fail("cannot create", path);
+    packs_.push_back(pack);
+}
+
+/**
+ * @brief A sealed pack never changes again, so it can be mapped whole.
+ */
+void PackStore::seal(Pack& pack) {
+    if (!config_.mmap_sealed || pack.size == 0) return;
+    void* map = mmap(nullptr, size_t(pack.size), PROT_READ, MAP_SHARED, pack.fd, 0);
+    if (map == MAP_FAILED) return; // Fall back to pread
+    madvise(map, size_t(pack.size), MADV_RANDOM);
+    pack.map = static_cast<const char*>(map);
+}
+
+void PackStore::write_pack(Pack& pack, const std::string& data) {
+    const char* p = data.data();
+    size_t left = data.size();
+    uint64_t offset = pack.size;
+    while (left > 0) {
+        ssize_t n = pwrite(pack.fd, p, left, off_t(offset));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) fail("cannot write", pack_path(packs_.size()));
+        p += n;
+        offset += uint64_t(n);
+        left -= size_t(n);
+    }
+    if (config_.sync && fdatasync(pack.fd) != 0) fail("cannot sync", pack_path(packs_.size()));
+}
+
+/**
+ * @brief Append new records to the active pack, rotating when it would pass
+ *        max_pack_bytes. Records are indexed only once their bytes are written,
+ *        so readers never follow an index entry into unwritten data.
+ */
+void PackStore::append(const std::vector<Record>& records) {
+    std::lock_guard<std::mutex> append_lock(append_mutex_);
+    write_records(records, false);
+}
+
+/**
+ * @brief Write records to the active pack. New records are inserted into the
+ *        index; relocated ones (compaction) repoint their existing slot.
+ *        Called with append_mutex_ held: only appenders modify the index and
+ *        packs_, so this thread reads them unlocked.
+ */
+void PackStore::write_records(const std::vector<Record>& records, bool relocate) {
+    struct Pending {
+        const Digest256* hash;
+        uint64_t offset;
+        uint32_t len;
+    };
+    std::string buffer;
+    std::vector<Pending> pending;
+    std::unordered_set<Digest256> seen;
+
+    auto flush = [&] {
+        if (buffer.empty()) return;
+        Pack& active = packs_.back();
+        write_pack(active, buffer);
+        // Relocated records must be durable before compaction truncates their old pack
+        if (relocate && !config_.sync && fdatasync(active.fd) != 0) fail("cannot sync", pack_path(packs_.size()));
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        active.size += buffer.size();
+        const uint32_t number = uint32_t(packs_.size());
+        for (const Pending& p : pending) {
+            Slot* slot = relocate ? find(*p.hash, nullptr) : nullptr;
+            if (slot) {
+                slot->pack = number;
+                slot->offset = p.offset;
+            } else if (!relocate) {
+                insert(prefix_of(*p.hash), number, p.offset, p.len);
+            }
+        }
+        buffer.clear();
+        pending.clear();
+    };
+
+    for (const Record& record : records) {
+        if (record.value->size() > UINT32_MAX) throw std::runtime_error("PackStore: block too large");
+        if (!seen.insert(*record.hash).second || (!relocate && find(*record.hash, nullptr))) continue;
+        const size_t size = kRecordHeader + record.value->size();
+        uint64_t end = packs_.back().size + buffer.size();
+        if (end > 0 && end + size > config_.max_pack_bytes) {
+            flush();
+            std::unique_lock<std::shared_mutex> lock(mutex_);
+            seal(packs_.back());
+            start_pack();
+        }
+        pending.push_back({record.hash, packs_.back().size + buffer.size(), uint32_t(record.value->size())});
+        buffer.append(record.hash->data(), Digest256::kSize);
+        put_u32(buffer, uint32_t(record.value->size()));
+        buffer += *record.value;
+    }
+    flush();
+}
+
+/**
+ * @brief Tombstone the index slots of the given blocks. Their bytes stay in
+ *        the packs until compact() rewrites them.
+ */
+uint64_t PackStore::remove(const std::vector<Digest256>& hashes) {
+    std::lock_guard<std::mutex> append_lock(append_mutex_);
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    uint64_t bytes = 0;
+    for (const Digest256& hash : hashes) {
+        Slot* slot = find(hash, nullptr);
+        if (!slot) continue;
+        bytes += kRecordHeader + slot->len;
+        slot->pack = kTombstone;
+        ++header().tombstones;
+    }
+    return bytes;
+}
+
+/**
+ * @brief Visit live slots from cursor on, reading each digest from its pack.
+ *        Slots move when the index grows, so a scan that spans a growth may
+ *        miss or repeat a few blocks.
+ */
+bool PackStore::scan(uint64_t& cursor, size_t max_entries, std::vector<Entry>& out) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    const Slot* table = slots();
+    const uint64_t capacity = header().capacity;
+    char digest[Digest256::kSize];
+    for (; cursor < capacity && out.size() < max_entries; ++cursor) {
+        const Slot& slot = table[cursor];
+        if (!slot.pack || slot.pack == kTombstone) continue;
+        if (read_at(packs_[slot.pack - 1], slot.offset, sizeof(digest), digest)) {
+            out.push_back({Digest256::from_bytes(digest), slot.len});
+        }
+    }
+    return cursor < capacity;
+}
+
+/**
+ * @brief Rewrite the live records of mostly-dead sealed packs into the active
+ *        pack, then truncate the old files (pack numbers stay contiguous).
+ *        Appends can run between chunks of a pack.
+ */
+uint64_t PackStore::compact(double min_dead_fraction) {
+    // Chunk of live records moved per append_mutex_ hold
+    static const size_t kChunkBytes = 4 * 1024 * 1024;
+    std::vector<uint64_t> live;
+    size_t sealed;
+    {
+        std::lock_guard<std::mutex> append_lock(append_mutex_);
+        sealed = packs_.size() - 1;
+        live.assign(sealed, 0);
+        const Slot* table = slots();
+        for (uint64_t i = 0; i < header().capacity; ++i) {
+            uint32_t pack = table[i].pack;
+            if (pack && pack != kTombstone && pack <= sealed) live[pack - 1] += kRecordHeader + table[i].len;
+        }
+    }
+    uint64_t freed = 0;
+    for (size_t number = 1; number <= sealed; ++number) {
+        uint64_t size = packs_[number - 1].size;
+        if (size == 0 || double(size - live[number - 1]) < min_dead_fraction * double(size)) continue;
+        // Gather the live records of this pack, then move them chunk by chunk
+        std::vector<std::pair<uint64_t, uint32_t>> records;
+        {
+            std::lock_guard<std::mutex> append_lock(append_mutex_);
+            const Slot* table = slots();
+            for (uint64_t i = 0; i < header().capacity; ++i) {
+                if (table[i].pack == number) records.emplace_back(table[i].offset, table[i].len);
+            }
+        }
+        for (size_t first = 0; first < records.size();) {
+            std::lock_guard<std::mutex> append_lock(append_mutex_);
+            std::vector<Digest256> hashes;
+            std::vector<std::string> values;
+            size_t bytes = 0, last = first;
+            for (; last < records.size() && (last == first || bytes < kChunkBytes); ++last) {
+                char head[kRecordHeader];
+                hashes.emplace_back();
+                values.emplace_back(records[last].second, '\0');
+                if (!read_at(packs_[number - 1], records[last].first, kRecordHeader, head) ||
+                    !read_at(packs_[number - 1], records[last].first + kRecordHeader, records[last].second,
+                             &values.back()[0])) {
+                    fail("cannot read", pack_path(number));
+                }
+                hashes.back() = Digest256::from_bytes(head);
+                bytes += kRecordHeader + records[last].second;
+            }
+            std::vector<Record> moved;
+            for (size_t i = 0; i < hashes.size(); ++i) moved.push_back({&hashes[i], &values[i]});
+            write_records(moved, true);
+            first = last;
+        }
+        std::lock_guard<std::mutex> append_lock(append_mutex_);
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        Pack& pack = packs_[number - 1];
+        if (pack.map) munmap(const_cast<char*>(pack.map), pack.size);
+        pack.map = nullptr;
+        if (ftruncate(pack.fd, 0) != 0) fail("cannot truncate", pack_path(number));
+        freed += pack.size - live[number - 1];
+        pack.size = 0;
+    }
+    return freed;
+}
+
+bool PackStore::get(const Digest256& hash, std::string& value) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return find(hash, &value) != nullptr;
+}
+
+bool PackStore::contains(const Digest256& hash) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return find(hash, nullptr) != nullptr;
+}
+
+PackStore::Stats PackStore::stats() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    Stats stats;
+    stats.packs = packs_.size();
+    for (const Pack& pack : packs_) stats.pack_bytes += pack.size;
+    stats.records = header().count - header().tombstones;
+    stats.index_slots = header().capacity;
+    stats.rebuilt = rebuilt_;
+    return stats;
+}
@@ -0,0 +1,146 @@
+#ifndef PACK_STORE_H
+#define PACK_STORE_H
+
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+#include "../common/digest.h"
+
+/**
+ * @class PackStore
+ * @brief Append-only storage for immutable, content-addressed blocks.
+ *
+ * Blocks are appended to pack files (pack-NNNNNN.dat) as
+ * [32-byte digest][u32 length][value]; a pack is sealed and a new one started
+ * once it reaches max_pack_bytes. Nothing is ever rewritten, so every block
+ * is written to disk exactly once (LevelDB compaction rewrote each block
+ * several times).
+ *
+ * The index (index.dat) is an mmap'd open-addressing hash table of 24-byte
+ * slots: the first 8 digest bytes, pack number, length and offset. A prefix
+ * match is confirmed against the digest in the pack record, so prefix
+ * collisions are harmless. The table doubles when it is 70% full. It is
+ * marked dirty while open; after a crash it is rebuilt by scanning the packs,
+ * and a torn record at the end of the last pack is cut off.
+ *
+ * remove() only tombstones index slots; compact() later copies the live
+ * records of mostly-dead sealed packs to the active pack and truncates the
+ * old file to zero length.
+ *
+ * Reads use the mapping of sealed packs and pread for the active one.
+ * Appends are serialized; they write outside the index lock, so get() and
+ * contains() only wait while new records are being indexed.
+ */
+class PackStore {
+public:
+    struct Config {
+        uint64_t max_pack_bytes = 256ull * 1024 * 1024; ///< Rotation threshold
+        uint64_t initial_index_slots = 1 << 16;        ///< Rounded up to a power of two
+        bool mmap_sealed = true;                        ///< Read sealed packs through mmap (else pread)
+        bool sync = false;                              ///< fdatasync each append
+    };
+
+    struct Stats {
+        size_t packs = 0;          ///< Pack files, including the active one
+        uint64_t pack_bytes = 0;   ///< Bytes in all packs
+        uint64_t records = 0;      ///< Blocks indexed
+        uint64_t index_slots = 0;  ///< Capacity of the index table
+        bool rebuilt = false;      ///< The index was rebuilt from the packs on open
+    };
+
+    struct Record {
+        const Digest256* hash;
+        const std::string* value;
+    };
+
+    struct Entry {
+        Digest256 hash;
+        uint32_t len;  ///< Stored value length
+    };
+
+    /**
+     * @brief Open (or create) the pack directory.
+     * @throws std::runtime_error on I/O errors.
+     */
+    PackStore(const std::string& dir, const Config& config);
+    ~PackStore();
+
+    PackStore(const PackStore&) = delete;
+    PackStore& operator=(const PackStore&) = delete;
+
+    /**
+     * @brief Append records (skipping hashes already present) with one write per pack touched.
+     * @throws std::runtime_error on I/O errors.
+     */
+    void append(const std::vector<Record>& records);
+
+    bool get(const Digest256& hash, std::string& value) const;
+    bool contains(const Digest256& hash) const;
+
+    /**
+     * @brief Drop blocks from the index.
+     * @return Pack bytes the removed records occupy.
+     */
+    uint64_t remove(const std::vector<Digest256>& hashes);
+
+    /**
+     * @brief Incremental listing of stored blocks: appends up to max_entries
+     *        to out, starting at cursor (0 for a new scan).
+     * @return False once the scan is complete.
+     */
+    bool scan(uint64_t& cursor, size_t max_entries, std::vector<Entry>& out) const;
+
+    /**
+     * @brief Reclaim the space of removed records: sealed packs in which at
+     *        least min_dead_fraction of the bytes are removed are rewritten.
+     * @return Bytes of disk space freed.
+     */
+    uint64_t compact(double min_dead_fraction);
+
+    Stats stats() const;
+
+private:
+    struct Slot;
+    struct IndexHeader;
+    struct Pack {
+        int fd = -1;
+        uint64_t size = 0;
+        const char* map = nullptr; ///< Whole file, for sealed packs with mmap_sealed
+    };
+
+    std::string dir_;
+    Config config_;
+    std::mutex append_mutex_;         ///< One appender at a time
+    mutable std::shared_mutex mutex_; ///< Exclusive while the index or packs_ change
+    std::vector<Pack> packs_;         ///< Index i is pack number i + 1
+    int index_fd_ = -1;
+    char* index_map_ = nullptr;
+    size_t index_bytes_ = 0;
+    bool rebuilt_ = false;
+
+    IndexHeader& header() const;
+    Slot* slots() const;
+    std::string pack_path(size_t number) const;
+    std::string index_path() const;
+
+    void open_packs();
+    bool open_index();
+    void rebuild_index();
+    void create_index(uint64_t capacity, const std::string& path, int& fd, char*& map, size_t& bytes);
+    void grow_index();
+    void start_pack();
+    void seal(Pack& pack);
+    void write_pack(Pack& pack, const std::string& data);
+    uint64_t scan_pack(size_t number);
+
+    /// Slot holding hash, or nullptr; value (if given) receives the block
+    Slot* find(const Digest256& hash, std::string* value) const;
+    void write_records(const std::vector<Record>& records, bool relocate);
+    void insert(uint64_t prefix, uint32_t pack, uint64_t offset, uint32_t len);
+    bool read_at(const Pack& pack, uint64_t offset, size_t len, char* out) const;
+    bool read_record(const Pack& pack, uint64_t offset, char* digest, char* value, size_t len) const;
+};
+
+#endif // PACK_STORE_H
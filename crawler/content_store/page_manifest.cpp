@@ -0,0 +1,145 @@
+#include "page_manifest.h"
+#include "../common/varint.h"
+#include <algorithm>
+#include <unordered_map>
+
+namespace {
+
+bool get_digest(const char*& p, const char* end, Digest256& out) {
+    if (size_t(end - p) < Digest256::kSize) return false;
+    out = Digest256::from_bytes(p);
+    p += Digest256::kSize;
+    return true;
+}
+
+void put_header(std::string& out, const PageManifest& manifest) {
+    put_varint(out, manifest.version);
+    out.append(manifest.root.data(), Digest256::kSize);
+    put_varint(out, manifest.blocks.size());
+}
+
+bool get_header(const char*& p, const char* end, PageManifest& out, uint64_t& count) {
+    return get_varint(p, end, out.version) && get_digest(p, end, out.root) && get_varint(p, end, count);
+}
+
+} // namespace
+
+std::string PageManifest::encode() const {
+    std::string out;
+    out.reserve(24 + (blocks.size() + 1) * Digest256::kSize);
+    put_header(out, *this);
+    for (const Digest256& hash : blocks) out.append(hash.data(), Digest256::kSize);
+    return out;
+}
+
+bool PageManifest::decode(const char* data, size_t len, PageManifest& out) {
+    const char* p = data;
+    const char* end = data + len;
+    uint64_t count;
+    if (!get_header(p, end, out, count)) return false;
+    size_t left = size_t(end - p);
+    if (left % Digest256::kSize != 0 || count != left / Digest256::kSize) return false;
+    out.blocks.resize(size_t(count));
+    for (Digest256& hash : out.blocks) get_digest(p, end, hash);
+    return true;
+}
+
+/**
+ * @brief Greedy copy/literal cover of blocks by runs of base. A run continues
+ *        from where the previous copy ended when it can (repeated blocks), and
+ *        otherwise starts at the first occurrence of the block in base.
+ */
+std::string PageManifest::encode_delta(const PageManifest& base) const {
+    std::unordered_map<Digest256, size_t> first;
+    first.reserve(base.blocks.size());
+    for (size_t i = base.blocks.size(); i-- > 0;) first[base.blocks[i]] = i;
+
+    std::string out;
+    put_header(out, *this);
+    size_t literal_start = 0;
+    size_t next_base = 0;
+    auto flush_literals = [&](size_t end) {
+        if (end == literal_start) return;
+        put_varint(out, uint64_t(end - literal_start) << 1 | 1);
+        for (size_t i = literal_start; i < end; ++i) out.append(blocks[i].data(), Digest256::kSize);
+    };
+    for (size_t i = 0; i < blocks.size();) {
+        size_t start;
+        if (next_base < base.blocks.size() && base.blocks[next_base] == blocks[i]) {
+            start = next_base;
+        } else {
+            auto it = first.find(blocks[i]);
+            if (it == first.end()) {
+                ++i;
+                continue;
+            }
+            start = it->second;
+        }
+        flush_literals(i);
+        size_t run = 1;
+        while (i + run < blocks.size() && start + run < base.blocks.size() &&
+               base.blocks[start + run] == blocks[i + run]) {
+            ++run;
+        }
+        put_varint(out, uint64_t(run) << 1);
+        put_varint(out, start);
+        i += run;
+        literal_start = i;
+        next_base = start + run;
+    }
+    flush_literals(blocks.size());
+    return out;
+}
+
+bool PageManifest::apply_delta(const PageManifest& base, const char* data, size_t len, PageManifest& out) {
+    const char* p = data;
+    const char* end = data + len;
+    uint64_t count;
+    PageManifest result;
+    if (!get_header(p, end, result, count)) return false;
+    // count is untrusted: reserve no more than base and the literals could supply
+    result.blocks.reserve(size_t(std::min<uint64_t>(count, base.blocks.size() + (end - p) / Digest256::kSize)));
+    while (result.blocks.size() < count) {
+        uint64_t op;
+        if (!get_varint(p, end, op)) return false;
+        uint64_t run = op >> 1;
+        if (run == 0 || run > count - result.blocks.size()) return false;
+        if (op & 1) {
+            for (uint64_t i = 0; i < run; ++i) {
+                result.blocks.emplace_back();
+                if (!get_digest(p, end, result.blocks.back())) return false;
+            }
+        } else {
+            uint64_t start;
+            if (!get_varint(p, end, start) || start > base.blocks.size() || run > base.blocks.size() - start) {
+                return false;
+            }
+            result.blocks.insert(result.blocks.end(), base.blocks.begin() + start, base.blocks.begin() + start + run);
+        }
+    }
+    if (p != end) return false;
+    out = std::move(result);
+    return true;
+}
+
+bool PageManifest::delta_literals(const char* data, size_t len, std::vector<Digest256>& out) {
+    const char* p = data;
+    const char* end = data + len;
+    PageManifest header;
+    uint64_t count;
+    if (!get_header(p, end, header, count)) return false;
+    for (uint64_t produced = 0; produced < count;) {
+        uint64_t op, start;
+        if (!get_varint(p, end, op) || (op >> 1) == 0 || (op >> 1) > count - produced) return false;
+        produced += op >> 1;
+        if (!(op & 1)) {
+            if (!get_varint(p, end, start)) return false;
+            continue;
+        }
+        for (uint64_t i = 0; i < (op >> 1); ++i) {
+            out.emplace_back();
+            if (!get_digest(p, end, out.back())) return false;
+        }
+    }
+    return p == end;
+}
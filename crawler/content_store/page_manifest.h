@@ -0,0 +1,57 @@
+#ifndef PAGE_MANIFEST_H
+#define PAGE_MANIFEST_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "../common/digest.h"
+
+/**
+ * @struct PageManifest
+ * @brief One version of a page: its block hashes in order and their Merkle root.
+ *
+ * The current version of a page is stored in full; older ones are stored as
+ * deltas against the version after them. A delta is a list of operations that
+ * rebuild the block list from the base: copy a run of base hashes, or insert
+ * literal hashes. A page edit that touches a few blocks therefore costs a few
+ * bytes plus one literal per new block.
+ *
+ * Full encoding:  varint version, root (32 bytes), varint count, count hashes.
+ * Delta encoding: varint version, root, varint count, then operations until
+ *                 count hashes are produced: varint (length << 1 | literal),
+ *                 followed by a varint base offset (copy) or length hashes (literal).
+ */
+struct PageManifest {
+    uint64_t version = 0;           ///< 1 for a page's first version; 0 means no manifest
+    Digest256 root;                 ///< Merkle root over blocks
+    std::vector<Digest256> blocks;  ///< Block hashes in page order
+
+    std::string encode() const;
+
+    /**
+     * @return False if the record is truncated or malformed.
+     */
+    static bool decode(const char* data, size_t len, PageManifest& out);
+
+    /**
+     * @brief Encode this manifest relative to base.
+     */
+    std::string encode_delta(const PageManifest& base) const;
+
+    /**
+     * @brief Rebuild a manifest from base and a delta produced by encode_delta.
+     * @return False if the delta is malformed or does not fit base.
+     */
+    static bool apply_delta(const PageManifest& base, const char* data, size_t len, PageManifest& out);
+
+    /**
+     * @brief Hashes a delta spells out (its literals), without the base.
+     *        Every hash of a version is either in the version after it or a
+     *        literal of its delta, so the current version plus the literals of
+     *        all deltas name every block of every stored version.
+     * @return False if the delta is malformed.
+     */
+    static bool delta_literals(const char* data, size_t len, std::vector<Digest256>& out);
+};
+
+#endif // PAGE_MANIFEST_H
@@ -0,0 +1,83 @@
+#include "thread_pool.h"
+#include <atomic>
+#include <exception>
+
+struct ThreadPool::Loop {
+    size_t n;
+    const std::function<void(size_t)>* fn;
+    std::atomic<size_t> next{0};
+    size_t finished = 0;             ///< Guarded by mutex
+    std::exception_ptr error;        ///< Guarded by mutex
+    std::mutex mutex;
+    std::condition_variable done;
+
+    /// Claim and run iterations until none are left.
+    void run() {
+        size_t ran = 0;
+        std::exception_ptr failure;
+        for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < n; ++ran) {
+            try {
+                (*fn)(i);
+            } catch (...) {
+                if (!failure) failure = std::current_exception();
+            }
+        }
+        if (ran == 0) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (failure && !error) error = failure;
+        finished += ran;
+        if (finished == n) done.notify_all();
+    }
+};
+
+ThreadPool::ThreadPool(size_t threads) {
+    workers_.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) workers_.emplace_back([this] { work(); });
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& worker : workers_) worker.join();
+}
+
+void ThreadPool::work() {
+    for (;;) {
+        std::shared_ptr<Loop> loop;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return stop_ || !loops_.empty(); });
+            if (stop_) return;
+            loop = loops_.front();
+            // Fully claimed loops leave the queue; their last iterations may still be running
+            if (loop->next.load(std::memory_order_relaxed) >= loop->n) {
+                loops_.pop_front();
+                continue;
+            }
+        }
+        loop->run();
+    }
+}
+
+void ThreadPool::parallel_for(size_t n, const std::function<void(size_t)>& fn) {
+    if (n == 0) return;
+    auto loop = std::make_shared<Loop>();
+    loop->n = n;
+    loop->fn = &fn;
+    if (n > 1 && !workers_.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            loops_.push_back(loop);
+        }
+        cv_.notify_all();
+    }
+    loop->run();
+    {
+        std::unique_lock<std::mutex> lock(loop->mutex);
+        loop->done.wait(lock, [&] { return loop->finished == n; });
+    }
+    if (loop->error) std::rethrow_exception(loop->error);
+}
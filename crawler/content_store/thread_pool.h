@@ -0,0 +1,49 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @class ThreadPool
+ * @brief Fixed worker threads for fan-out loops.
+ *
+ * parallel_for() publishes a loop whose iterations workers (and the calling
+ * thread) claim one at a time from an atomic counter; it returns once every
+ * iteration has finished. Several loops may run at once from different callers.
+ */
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * @brief Run fn(0) .. fn(n - 1) across the pool and the calling thread.
+     *        The first exception thrown by fn is rethrown here.
+     */
+    void parallel_for(size_t n, const std::function<void(size_t)>& fn);
+
+    size_t size() const { return workers_.size(); }
+
+private:
+    struct Loop;
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::shared_ptr<Loop>> loops_; ///< Loops with unclaimed iterations
+    bool stop_ = false;
+
+    void work();
+};
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,534 @@
+#include "charset.h"
+#include <iconv.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+// HTML requires <meta> charset declarations to appear within the first 1024 bytes
+constexpr size_t kMetaPrescanBytes = 1024;
+constexpr char kReplacement[] = "\xEF\xBF\xBD"; // U+FFFD
+
+// windows-1252 0x80-0x9F; the rest of the upper half maps to the same code point
+const uint16_t kWindows1252High[32] = {
+    0x20AC, 0x0081, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+    0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008D, 0x017D, 0x008F,
+    0x0090, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+    0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x009D, 0x017E, 0x0178};
+
+void append_utf8(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+/**
+ * @brief Check one UTF-8 sequence (RFC 3629: no overlongs, surrogates or code points above U+10FFFF).
+ * @return Its length if valid, 0 if invalid, -1 if valid so far but cut off by the end of the buffer.
+ */
+int utf8_sequence(const unsigned char* p, size_t avail) {
+    unsigned char c = p[0];
+    unsigned char lo = 0x80, hi = 0xBF;
+    int n;
+    if (c < 0x80) return 1;
+    if (c >= 0xC2 && c <= 0xDF) {
+        n = 2;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        n = 3;
+        if (c == 0xE0) lo = 0xA0;
+        else if (c == 0xED) hi = 0x9F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        n = 4;
+        if (c == 0xF0) lo = 0x90;
+        else if (c == 0xF4) hi = 0x8F;
+    } else {
+        return 0;
+    }
+    for (int k = 1; k < n; ++k) {
+        if (static_cast<size_t>(k) >= avail) return -1;
+        unsigned char b = p[k];
+        if (k == 1 ? (b < lo || b > hi) : (b < 0x80 || b > 0xBF)) return 0;
+    }
+    return n;
+}
+
+/**
+ * @brief Structural fit of a byte string to one multi-byte encoding.
+ */
+struct EncodingScore {
+    size_t doubles = 0;      ///< Well-formed multi-byte characters
+    size_t singles = 0;      ///< Single-byte non-ASCII characters (Shift_JIS half-width kana)
+    size_t errors = 0;       ///< Bytes that cannot occur in this encoding
+    size_t kana_leads = 0;   ///< Lead bytes of the kana rows (0x82/0x83 in Shift_JIS, 0xA4/0xA5 in EUC)
+    size_t hangul_leads = 0; ///< EUC lead bytes 0xB0-0xC8 (the KS X 1001 hangul rows)
+    size_t spaced = 0;       ///< Spaces directly after a multi-byte character
+
+    bool plausible() const { return doubles > 0 && errors * 50 <= doubles && doubles >= singles; }
+};
+
+EncodingScore score_shift_jis(const unsigned char* p, size_t len) {
+    EncodingScore s;
+    for (size_t i = 0; i < len;) {
+        unsigned char c = p[i];
+        if (c < 0x80) {
+            ++i;
+        } else if (c >= 0xA1 && c <= 0xDF) {
+            ++s.singles;
+            ++i;
+        } else if ((c >= 0x81 && c <= 0x9F) || (c >= 0xE0 && c <= 0xFC)) {
+            if (i + 1 >= len) break;
+            unsigned char t = p[i + 1];
+            if ((t >= 0x40 && t <= 0x7E) || (t >= 0x80 && t <= 0xFC)) {
+                ++s.doubles;
+                if (c == 0x82 || c == 0x83) ++s.kana_leads;
+                i += 2;
+            } else {
+                ++s.errors;
+                ++i;
+            }
+        } else {
+            ++s.errors;
+            ++i;
+        }
+    }
+    return s;
+}
+
+EncodingScore score_euc(const unsigned char* p, size_t len) {
+    EncodingScore s;
+    bool after_double = false;
+    for (size_t i = 0; i < len;) {
+        unsigned char c = p[i];
+        if (c < 0x80) {
+            if (c == ' ' && after_double) ++s.spaced;
+            after_double = false;
+            ++i;
+            continue;
+        }
+        size_t n = c == 0x8F ? 3 : 2;
+        if (c != 0x8E && c != 0x8F && (c < 0xA1 || c == 0xFF)) {
+            ++s.errors;
+            ++i;
+            continue;
+        }
+        if (i + n > len) break;
+        bool ok = true;
+        for (size_t k = 1; k < n; ++k) ok = ok && p[i + k] >= 0xA1 && p[i + k] <= 0xFE;
+        if (!ok) {
+            ++s.errors;
+            ++i;
+            continue;
+        }
+        ++s.doubles;
+        if (c == 0xA4 || c == 0xA5) ++s.kana_leads;
+        if (c >= 0xB0 && c <= 0xC8) ++s.hangul_leads;
+        after_double = true;
+        i += n;
+    }
+    return s;
+}
+
+EncodingScore score_gb18030(const unsigned char* p, size_t len) {
+    EncodingScore s;
+    for (size_t i = 0; i < len;) {
+        unsigned char c = p[i];
+        if (c < 0x80) {
+            ++i;
+            continue;
+        }
+        if (c == 0x80 || c == 0xFF) {
+            ++s.errors;
+            ++i;
+            continue;
+        }
+        if (i + 1 >= len) break;
+        unsigned char t = p[i + 1];
+        if (t >= 0x30 && t <= 0x39) {
+            // Four-byte form: lead, digit, lead, digit
+            if (i + 3 >= len) break;
+            if (p[i + 2] >= 0x81 && p[i + 2] <= 0xFE && p[i + 3] >= 0x30 && p[i + 3] <= 0x39) {
+                ++s.doubles;
+                i += 4;
+                continue;
+            }
+        } else if ((t >= 0x40 && t <= 0x7E) || (t >= 0x80 && t <= 0xFE)) {
+            ++s.doubles;
+            i += 2;
+            continue;
+        }
+        ++s.errors;
+        ++i;
+    }
+    return s;
+}
+
+/**
+ * @brief Whether non-ASCII bytes mostly stand alone between ASCII, as accented
+ *        letters in single-byte Latin text do (CJK text has long multi-byte runs).
+ */
+bool mostly_isolated_high_bytes(const unsigned char* p, size_t len) {
+    size_t runs = 0, single_runs = 0;
+    for (size_t i = 0; i < len;) {
+        if (p[i] < 0x80) {
+            ++i;
+            continue;
+        }
+        size_t start = i;
+        while (i < len && p[i] >= 0x80) ++i;
+        ++runs;
+        if (i - start == 1) ++single_runs;
+    }
+    return single_runs * 10 >= runs * 9;
+}
+
+std::string to_lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+    return s;
+}
+
+} // namespace
+
+/**
+ * @brief Map a WHATWG encoding label to the name iconv knows it by.
+ *        Web "Shift_JIS", "EUC-KR" and "GB2312" are in practice the Microsoft
+ *        supersets, and ISO-8859-1/ASCII labels mean windows-1252.
+ */
+std::string CharsetDetector::canonical_name(const std::string& label) {
+    size_t start = label.find_first_not_of(" \t\r\n\"'");
+    if (start == std::string::npos) return "";
+    size_t end = label.find_last_not_of(" \t\r\n\"'");
+    std::string name = to_lower(label.substr(start, end - start + 1));
+    if (name.size() > 40) return "";
+    for (char c : name) {
+        if (!std::isalnum(static_cast<unsigned char>(c)) && c != '-' && c != '_' && c != '.' && c != ':') return "";
+    }
+    static const struct { const char* label; const char* name; } kAliases[] = {
+        {"utf-8", "UTF-8"}, {"utf8", "UTF-8"}, {"unicode-1-1-utf-8", "UTF-8"},
+        {"us-ascii", "WINDOWS-1252"}, {"ascii", "WINDOWS-1252"}, {"iso-8859-1", "WINDOWS-1252"},
+        {"iso8859-1", "WINDOWS-1252"}, {"iso_8859-1", "WINDOWS-1252"}, {"latin1", "WINDOWS-1252"},
+        {"l1", "WINDOWS-1252"}, {"cp1252", "WINDOWS-1252"}, {"windows-1252", "WINDOWS-1252"},
+        {"x-cp1252", "WINDOWS-1252"},
+        {"shift_jis", "CP932"}, {"shift-jis", "CP932"}, {"sjis", "CP932"}, {"x-sjis", "CP932"},
+        {"ms_kanji", "CP932"}, {"windows-31j", "CP932"}, {"csshiftjis", "CP932"}, {"ms932", "CP932"},
+        {"euc-jp", "EUC-JP"}, {"x-euc-jp", "EUC-JP"},
+        {"euc-kr", "CP949"}, {"ks_c_5601-1987", "CP949"}, {"korean", "CP949"}, {"windows-949", "CP949"},
+        {"cp949", "CP949"},
+        {"gb2312", "GB18030"}, {"gbk", "GB18030"}, {"x-gbk", "GB18030"}, {"gb18030", "GB18030"},
+        {"cp936", "GB18030"}, {"chinese", "GB18030"}, {"csgb2312", "GB18030"},
+        {"big5", "BIG5-HKSCS"}, {"big5-hkscs", "BIG5-HKSCS"}, {"x-x-big5", "BIG5-HKSCS"},
+        {"utf-16", "UTF-16LE"}, {"utf-16le", "UTF-16LE"}, {"utf-16be", "UTF-16BE"}};
+    for (const auto& alias : kAliases) {
+        if (name == alias.label) return alias.name;
+    }
+    std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+    return name;
+}
+
+/**
+ * @brief Extract the charset parameter ("text/html; charset=Shift_JIS").
+ */
+std::string CharsetDetector::charset_from_content_type(const std::string& value) {
+    std::string lower = to_lower(value);
+    for (size_t pos = lower.find("charset"); pos != std::string::npos; pos = lower.find("charset", pos + 7)) {
+        size_t i = lower.find_first_not_of(" \t", pos + 7);
+        if (i == std::string::npos || lower[i] != '=') continue;
+        i = lower.find_first_not_of(" \t", i + 1);
+        if (i == std::string::npos) return "";
+        char quote = (lower[i] == '"' || lower[i] == '\'') ? lower[i++] : 0;
+        size_t end = quote ? value.find(quote, i) : value.find_first_of(" \t;,\"'>/", i);
+        return value.substr(i, end == std::string::npos ? std::string::npos : end - i);
+    }
+    return "";
+}
+
+/**
+ * @brief Prescan <meta> tags in the first 1024 bytes for a charset
+ *        (covers both <meta charset> and the http-equiv Content-Type form).
+ */
+std::string CharsetDetector::sniff_meta(const char* data, size_t len) {
+    std::string head = to_lower(std::string(data, std::min(len, kMetaPrescanBytes)));
+    for (size_t pos = head.find("<meta"); pos != std::string::npos; pos = head.find("<meta", pos + 5)) {
+        size_t end = head.find('>', pos);
+        if (end == std::string::npos) break;
+        std::string label = charset_from_content_type(head.substr(pos + 5, end - pos - 5));
+        if (!label.empty()) return label;
+    }
+    return "";
+}
+
+/**
+ * @brief Statistical fallback over undeclared bytes. Valid UTF-8 wins outright;
+ *        otherwise each multi-byte family is scored by how well the bytes fit its
+ *        structure, with kana/hangul row frequencies breaking ties between the
+ *        EUC encodings. Anything that fits none of them is windows-1252.
+ */
+CharsetDetection CharsetDetector::guess(const char* data, size_t len) {
+    CharsetDetection result;
+    size_t ascii = Utf8Transcoder::ascii_prefix(data, len);
+    if (ascii == len) return result; // kDefault: nothing to go on yet
+    result.source = CharsetSource::kStatistic;
+    const auto* p = reinterpret_cast<const unsigned char*>(data);
+    size_t valid = Utf8Transcoder::valid_utf8_prefix(data, len);
+    if (valid == len || utf8_sequence(p + valid, len - valid) < 0) return result;
+
+    EncodingScore sjis = score_shift_jis(p, len);
+    EncodingScore euc = score_euc(p, len);
+    EncodingScore gb = score_gb18030(p, len);
+    if (sjis.plausible() && sjis.errors <= euc.errors && sjis.kana_leads * 4 >= sjis.doubles) {
+        result.charset = "CP932";
+    } else if (mostly_isolated_high_bytes(p, len)) {
+        result.charset = "WINDOWS-1252";
+    } else if (euc.plausible()) {
+        if (euc.kana_leads * 4 >= euc.doubles) result.charset = "EUC-JP";
+        else if (euc.hangul_leads * 10 >= euc.doubles * 9 && euc.spaced * 8 >= euc.doubles) result.charset = "CP949";
+        else result.charset = "GB18030";
+    } else if (gb.plausible()) {
+        result.charset = "GB18030";
+    } else if (sjis.plausible()) {
+        result.charset = "CP932";
+    } else {
+        result.charset = "WINDOWS-1252";
+    }
+    return result;
+}
+
+/**
+ * @brief BOM, then the HTTP header label, then <meta>, then the statistical guess.
+ */
+CharsetDetection CharsetDetector::detect(const std::string& header_charset, const char* data, size_t len) {
+    CharsetDetection result;
+    const auto* p = reinterpret_cast<const unsigned char*>(data);
+    if (len >= 3 && p[0] == 0xEF && p[1] == 0xBB && p[2] == 0xBF) {
+        result.source = CharsetSource::kBom;
+        return result;
+    }
+    if (len >= 2 && ((p[0] == 0xFF && p[1] == 0xFE) || (p[0] == 0xFE && p[1] == 0xFF))) {
+        result.charset = p[0] == 0xFF ? "UTF-16LE" : "UTF-16BE";
+        result.source = CharsetSource::kBom;
+        return result;
+    }
+    std::string name = canonical_name(header_charset);
+    if (!name.empty()) {
+        result.charset = name;
+        result.source = CharsetSource::kHeader;
+        return result;
+    }
+    name = canonical_name(sniff_meta(data, len));
+    if (!name.empty()) {
+        // A document readable as ASCII cannot really be UTF-16, whatever it claims
+        result.charset = name.compare(0, 6, "UTF-16") == 0 ? "UTF-8" : name;
+        result.source = CharsetSource::kMeta;
+        return result;
+    }
+    return guess(data, len);
+}
+
+/**
+ * @brief iconv descriptor for encodings without a built-in fast path.
+ */
+struct Utf8Transcoder::Iconv {
+    iconv_t cd;
+    explicit Iconv(iconv_t handle) : cd(handle) {}
+    ~Iconv() { iconv_close(cd); }
+};
+
+Utf8Transcoder::Utf8Transcoder(const CharsetDetection& detection)
+    : mode_(Mode::kUtf8), charset_(detection.charset), tentative_(detection.tentative()) {
+    if (detection.source == CharsetSource::kBom) skip_ = charset_ == "UTF-8" ? 3 : 2;
+    if (charset_ == "UTF-8") return;
+    if (charset_ == "WINDOWS-1252") {
+        mode_ = Mode::kWindows1252;
+        return;
+    }
+    iconv_t cd = iconv_open("UTF-8", charset_.c_str());
+    if (cd == reinterpret_cast<iconv_t>(-1)) {
+        // Unsupported label: treat like an undeclared document
+        charset_ = "UTF-8";
+        tentative_ = true;
+        return;
+    }
+    iconv_ = std::make_unique<Iconv>(cd);
+    mode_ = Mode::kIconv;
+}
+
+Utf8Transcoder::~Utf8Transcoder() = default;
+
+/**
+ * @brief Count leading ASCII bytes, 32 (then 16) bytes per step where SIMD is available.
+ */
+size_t Utf8Transcoder::ascii_prefix(const char* data, size_t len) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 32 <= len; i += 32) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 16));
+        if (_mm_movemask_epi8(_mm_or_si128(a, b))) break;
+    }
+    for (; i + 16 <= len; i += 16) {
+        int mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+#elif defined(__aarch64__)
+    for (; i + 16 <= len; i += 16) {
+        if (vmaxvq_u8(vld1q_u8(reinterpret_cast<const uint8_t*>(data + i))) >= 0x80) break;
+    }
+#endif
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        if (word & 0x8080808080808080ULL) break;
+    }
+    while (i < len && !(static_cast<unsigned char>(data[i]) & 0x80)) ++i;
+    return i;
+}
+
+/**
+ * @brief Validate UTF-8, skipping ASCII runs with ascii_prefix().
+ */
+size_t Utf8Transcoder::valid_utf8_prefix(const char* data, size_t len) {
+    const auto* p = reinterpret_cast<const unsigned char*>(data);
+    size_t i = 0;
+    while (i < len) {
+        i += ascii_prefix(data + i, len - i);
+        if (i == len) break;
+        int n = utf8_sequence(p + i, len - i);
+        if (n <= 0) break;
+        i += n;
+    }
+    return i;
+}
+
+/**
+ * @brief Convert the next chunk (dropping a BOM at the start of the document).
+ */
+void Utf8Transcoder::feed(const char* data, size_t len, std::string& out) {
+    if (skip_ > 0) {
+        size_t n = std::min(skip_, len);
+        data += n;
+        len -= n;
+        skip_ -= n;
+    }
+    if (len == 0) return;
+    switch (mode_) {
+    case Mode::kUtf8: feed_utf8(data, len, out); break;
+    case Mode::kWindows1252: feed_windows1252(data, len, out); break;
+    case Mode::kIconv: feed_iconv(data, len, out); break;
+    }
+}
+
+/**
+ * @brief Copy valid UTF-8 through; replace invalid sequences (or, for an
+ *        undeclared document, switch to windows-1252 at the first one).
+ */
+void Utf8Transcoder::feed_utf8(const char* data, size_t len, std::string& out) {
+    std::string joined;
+    if (!pending_.empty()) {
+        joined.swap(pending_);
+        joined.append(data, len);
+        data = joined.data();
+        len = joined.size();
+    }
+    const auto* p = reinterpret_cast<const unsigned char*>(data);
+    size_t i = 0;
+    while (i < len) {
+        size_t run = valid_utf8_prefix(data + i, len - i);
+        out.append(data + i, run);
+        i += run;
+        if (i == len) break;
+        if (utf8_sequence(p + i, len - i) < 0) {
+            pending_.assign(data + i, len - i);
+            return;
+        }
+        if (tentative_) {
+            mode_ = Mode::kWindows1252;
+            charset_ = "WINDOWS-1252";
+            tentative_ = false;
+            feed_windows1252(data + i, len - i, out);
+            return;
+        }
+        out += kReplacement;
+        ++replacements_;
+        ++i;
+    }
+}
+
+/**
+ * @brief Table-driven windows-1252 decode with the ASCII fast path.
+ */
+void Utf8Transcoder::feed_windows1252(const char* data, size_t len, std::string& out) {
+    size_t i = 0;
+    while (i < len) {
+        size_t run = ascii_prefix(data + i, len - i);
+        out.append(data + i, run);
+        i += run;
+        for (; i < len && (static_cast<unsigned char>(data[i]) & 0x80); ++i) {
+            unsigned char c = static_cast<unsigned char>(data[i]);
+            append_utf8(out, c < 0xA0 ? kWindows1252High[c - 0x80] : c);
+        }
+    }
+}
+
+/**
+ * @brief Convert through iconv, carrying incomplete input over to the next chunk.
+ */
+void Utf8Transcoder::feed_iconv(const char* data, size_t len, std::string& out) {
+    std::string joined;
+    if (!pending_.empty()) {
+        joined.swap(pending_);
+        joined.append(data, len);
+        data = joined.data();
+        len = joined.size();
+    }
+    char buffer[8192];
+    char* in = const_cast<char*>(data);
+    size_t in_left = len;
+    while (in_left > 0) {
+        char* dst = buffer;
+        size_t dst_left = sizeof(buffer);
+        size_t rc = iconv(iconv_->cd, &in, &in_left, &dst, &dst_left);
+        out.append(buffer, dst - buffer);
+        if (rc != static_cast<size_t>(-1) || errno == E2BIG) continue;
+        if (errno == EINVAL) {
+            // Sequence split by the chunk boundary
+            pending_.assign(in, in_left);
+            return;
+        }
+        out += kReplacement; // EILSEQ
+        ++replacements_;
+        ++in;
+        --in_left;
+    }
+}
+
+/**
+ * @brief Flush held-back bytes and any iconv shift state.
+ */
+void Utf8Transcoder::finish(std::string& out) {
+    if (!pending_.empty()) {
+        out += kReplacement;
+        ++replacements_;
+        pending_.clear();
+    }
+    if (mode_ == Mode::kIconv) {
+        char buffer[64];
+        char* dst = buffer;
+        size_t dst_left = sizeof(buffer);
+        iconv(iconv_->cd, nullptr, nullptr, &dst, &dst_left);
+        out.append(buffer, dst - buffer);
+    }
+}
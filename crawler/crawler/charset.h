@@ -0,0 +1,131 @@
+#ifndef CHARSET_H
+#define CHARSET_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+/**
+ * @brief Where a document's character encoding came from, in order of precedence.
+ */
+enum class CharsetSource {
+    kBom,         ///< UTF-8 / UTF-16 byte order mark
+    kHeader,      ///< charset parameter of the HTTP Content-Type
+    kMeta,        ///< <meta charset> or <meta http-equiv="Content-Type"> in the first 1024 bytes
+    kStatistic,   ///< byte-pattern guess over the prescan buffer
+    kDefault      ///< nothing to go on (ASCII so far): UTF-8, falling back to windows-1252
+};
+
+struct CharsetDetection {
+    std::string charset = "UTF-8";  ///< Canonical (iconv) encoding name
+    CharsetSource source = CharsetSource::kDefault;
+
+    /**
+     * @brief A default may be revised: a tentative UTF-8 decode switches to
+     *        windows-1252 at the first invalid sequence instead of emitting U+FFFD.
+     */
+    bool tentative() const { return source == CharsetSource::kDefault; }
+};
+
+/**
+ * @class CharsetDetector
+ * @brief Encoding detection for fetched documents, following the HTML
+ *        encoding-sniffing order: BOM, transport header, <meta> prescan, then a
+ *        statistical guess between UTF-8, Shift_JIS, EUC-JP, EUC-KR, GB18030
+ *        and windows-1252.
+ */
+class CharsetDetector {
+public:
+    /**
+     * @param header_charset Label from the Content-Type header (may be empty).
+     * @param data First bytes of the body (1-4 KB is plenty).
+     */
+    static CharsetDetection detect(const std::string& header_charset, const char* data, size_t len);
+
+    /**
+     * @brief Map a WHATWG encoding label ("latin1", "sjis", "gbk", ...) to the iconv name.
+     *        Unknown labels are upper-cased and passed through; empty input stays empty.
+     */
+    static std::string canonical_name(const std::string& label);
+
+    /**
+     * @brief charset="..." in a Content-Type header value or http-equiv content attribute.
+     */
+    static std::string charset_from_content_type(const std::string& value);
+
+    /**
+     * @brief Look for a charset declaration in <meta> tags within the first 1024 bytes.
+     */
+    static std::string sniff_meta(const char* data, size_t len);
+
+    /**
+     * @brief Guess the encoding of undeclared bytes from their multi-byte structure.
+     */
+    static CharsetDetection guess(const char* data, size_t len);
+};
+
+/**
+ * @class Utf8Transcoder
+ * @brief Streaming conversion of a document to UTF-8.
+ *
+ * Chunks may split multi-byte sequences anywhere; incomplete tails are held
+ * back until the next feed(). UTF-8 input is validated rather than converted:
+ * ASCII runs are skipped 32 bytes at a time with SIMD compares and only
+ * non-ASCII sequences are checked byte by byte, so the common case costs
+ * little more than a copy. windows-1252 is table-driven with the same ASCII
+ * fast path; other encodings go through iconv. Invalid input becomes U+FFFD.
+ */
+class Utf8Transcoder {
+public:
+    explicit Utf8Transcoder(const CharsetDetection& detection);
+    ~Utf8Transcoder();
+
+    Utf8Transcoder(const Utf8Transcoder&) = delete;
+    Utf8Transcoder& operator=(const Utf8Transcoder&) = delete;
+
+    /**
+     * @brief Convert the next chunk, appending UTF-8 to out.
+     */
+    void feed(const char* data, size_t len, std::string& out);
+
+    /**
+     * @brief End of input: flush held-back bytes (an incomplete sequence becomes U+FFFD).
+     */
+    void finish(std::string& out);
+
+    /// Encoding actually used (a tentative UTF-8 guess may have switched to windows-1252)
+    const std::string& charset() const { return charset_; }
+    size_t replacements() const { return replacements_; }
+
+    /**
+     * @brief Number of leading ASCII bytes (SIMD).
+     */
+    static size_t ascii_prefix(const char* data, size_t len);
+
+    /**
+     * @brief Length of the longest valid UTF-8 prefix. Stops early at a
+     *        sequence that is merely truncated by the end of the buffer.
+     */
+    static size_t valid_utf8_prefix(const char* data, size_t len);
+
+    static bool is_valid_utf8(const char* data, size_t len) { return valid_utf8_prefix(data, len) == len; }
+
+private:
+    enum class Mode { kUtf8, kWindows1252, kIconv };
+
+    struct Iconv;
+
+    Mode mode_;
+    std::string charset_;
+    bool tentative_;
+    std::string pending_;         ///< Bytes of an incomplete trailing sequence
+    size_t skip_ = 0;             ///< BOM bytes still to drop
+    size_t replacements_ = 0;
+    std::unique_ptr<Iconv> iconv_;
+
+    void feed_utf8(const char* data, size_t len, std::string& out);
+    void feed_windows1252(const char* data, size_t len, std::string& out);
+    void feed_iconv(const char* data, size_t len, std::string& out);
+};
+
+#endif // CHARSET_H
@@ -0,0 +1,107 @@
+#ifndef CRAWL_STATS_H
+#define CRAWL_STATS_H
+
+#include <atomic>
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+/**
+ * @class LatencyHistogram
+ * @brief Lock-free, log-bucketed latency histogram (microsecond resolution).
+ *
+ * Each power of two is split into four sub-buckets, so percentiles are
+ * accurate to within ~19% while recording costs a single relaxed increment.
+ */
+class LatencyHistogram {
+public:
+    static constexpr size_t kBuckets = 128;
+
+    /**
+     * @brief Record one latency sample.
+     * @param micros Latency in microseconds.
+     */
+    void record(uint64_t micros) {
+        buckets_[bucket_for(micros)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_us_.fetch_add(micros, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Approximate percentile (upper bound of the containing bucket).
+     * @param p Percentile in [0, 100].
+     * @return Latency in microseconds, 0 if no samples were recorded.
+     */
+    uint64_t percentile(double p) const {
+        uint64_t total = count_.load(std::memory_order_relaxed);
+        if (total == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(std::ceil(total * p / 100.0));
+        if (rank == 0) rank = 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBuckets; ++i) {
+            seen += buckets_[i].load(std::memory_order_relaxed);
+            if (seen >= rank) return bucket_upper(i);
+        }
+        return bucket_upper(kBuckets - 1);
+    }
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Mean latency in microseconds (0 if empty).
+     */
+    uint64_t mean() const {
+        uint64_t n = count();
+        return n ? sum_us_.load(std::memory_order_relaxed) / n : 0;
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, kBuckets> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_us_{0};
+
+    static size_t bucket_for(uint64_t micros) {
+        if (micros < 4) return static_cast<size_t>(micros);
+        int log2 = 63 - __builtin_clzll(micros);
+        size_t sub = static_cast<size_t>((micros >> (log2 - 2)) & 3);
+        size_t idx = static_cast<size_t>(log2) * 4 + sub;
+        return idx < kBuckets ? idx : kBuckets - 1;
+    }
+
+    static uint64_t bucket_upper(size_t idx) {
+        if (idx < 8) return idx < 4 ? idx : 3; // 4..7 are never populated
+        size_t log2 = idx / 4, sub = idx % 4;
+        return ((4 + sub + 1) << (log2 - 2)) - 1;
+    }
+};
+
+/**
+ * @struct CrawlStats
+ * @brief Counters exported by the crawler for benchmarking and monitoring.
+ *
+ * All fields are updated with relaxed atomics from the worker threads and can
+ * be read at any time without stopping the crawl.
+ */
+struct CrawlStats {
+    std::atomic<uint64_t> fetches_attempted{0};  ///< curl transfers started (pages + robots.txt)
+    std::atomic<uint64_t> fetches_failed{0};     ///< transfers that did not complete with CURLE_OK
+    std::atomic<uint64_t> pages_processed{0};    ///< pages chunked, stored and indexed
+    std::atomic<uint64_t> pages_unchanged{0};    ///< pages identical to their stored version (not reindexed)
+    std::atomic<uint64_t> bytes_downloaded{0};   ///< body bytes received
+    std::atomic<uint64_t> throttled_responses{0}; ///< 429/503 answers fed back to the rate limiter
+    std::atomic<uint64_t> aborted_content_type{0}; ///< transfers aborted by the Content-Type allowlist
+    std::atomic<uint64_t> aborted_too_large{0};    ///< transfers aborted by the size cap
+    std::atomic<uint64_t> bytes_avoided{0};        ///< declared body bytes never downloaded
+    std::atomic<uint64_t> urls_filtered{0};        ///< URLs dropped by extension before the frontier
+    std::atomic<uint64_t> sitemaps_fetched{0};     ///< sitemap and sitemap-index documents parsed
+    std::atomic<uint64_t> sitemap_urls{0};         ///< URLs enqueued from sitemaps
+    std::atomic<uint64_t> transcoded_pages{0};     ///< bodies decoded from an encoding other than UTF-8
+    std::atomic<uint64_t> utf8_replacements{0};    ///< invalid byte sequences replaced with U+FFFD
+    std::atomic<uint64_t> text_bytes_indexed{0};   ///< extracted text handed to the tokenizer
+    std::atomic<uint64_t> boilerplate_blocks{0};   ///< HTML text blocks dropped as boilerplate
+    std::atomic<uint64_t> diffs_published{0};      ///< diff packets encoded for changed pages
+    std::atomic<uint64_t> diff_bytes{0};           ///< total size of those packets
+    LatencyHistogram fetch_latency_us;           ///< end-to-end latency of each fetch_url call
+};
+
+#endif // CRAWL_STATS_H
@@ -10,15 +10,31 @@
 #include <sstream>
 #include <iomanip>
 #include <ctime>
+#include <charconv>
 #include "../p2p_dht/p2p_dht.h"
+#include "../merkle_tree/diff_packet.h"
+#include "charset.h"
+#include "html_extractor.h"
 #include "include/tokenizer.h"
 #include "include/stemmer.h"
 #include <atomic>
+#include <condition_variable>
+#include <strings.h>
 /**
  * @brief Construct a Crawler instance with configuration and DHT node.
  */
 Crawler::Crawler(const std::string& db_path, std::shared_ptr<p2p_dht::DHTNode> dht_node)
-    : content_store_(std::make_unique<ContentStore>(db_path)), dht_node_(dht_node) {}
+    : Crawler(db_path, dht_node, ContentStore::Config()) {}
+
+Crawler::Crawler(const std::string& db_path, std::shared_ptr<p2p_dht::DHTNode> dht_node,
+                 const ContentStore::Config& store_config)
+    : content_store_(std::make_unique<ContentStore>(db_path, store_config)), dht_node_(dht_node),
+      domain_sync_(content_store_->hash_algorithm()) {
+    if (dht_node_) shards_ = std::make_unique<CrawlShards>(dht_node_->peer_id(), CrawlShards::Config());
+    // A host handed over to this node arrives as an announcement for a host it has no pages of
+    domain_sync_.set_adopt(
+        [this](const std::string& domain) { return shards_ && shards_->owner(domain) == shards_->self(); });
+}
 
 /**
  * @brief Add seed URLs to the crawl frontier (thread-safe).
@@ -27,18 +43,26 @@ void Crawler::add_seed_urls(const std::vector<std::string>& urls) {
     std::lock_guard<std::mutex> lock(frontier_mutex_);
     for (const auto& url : urls) {
         if (seen_urls_.find(url) == seen_urls_.end()) {
-            frontier_.push(url);
+            push_frontier_locked(url, kSeedPriority);
             seen_urls_.insert(url);
         }
     }
 }
 
+/**
+ * @brief Push a URL onto the priority frontier. Caller holds frontier_mutex_.
+ */
+void Crawler::push_frontier_locked(const std::string& url, double priority) {
+    frontier_.push(FrontierEntry{url, priority, frontier_seq_++});
+}
+
 /**
  * @brief Main crawling loop. Fetches URLs from the frontier and processes them.
  *        This is a simplified, single-threaded version for clarity.
  */
 void Crawler::run() {
     while (true) {
+        if (ingest_queued_sitemap()) continue;
         std::string url;
         {
             std::lock_guard<std::mutex> lock(frontier_mutex_);
@@ -46,7 +70,7 @@ void Crawler::run() {
                 std::cout << "Frontier empty. Crawling complete." << std::endl;
                 break;
             }
-            url = frontier_.front();
+            url = frontier_.top().url;
             frontier_.pop();
         }
         fetch_and_process(url);
@@ -56,53 +80,260 @@ void Crawler::run() {
 }
 
 /**
- * @brief Helper function for libcurl to write fetched data to a std::string.
+ * @brief Per-transfer state shared by the libcurl write and header callbacks.
+ */
+struct FetchContext {
+    std::string* out = nullptr;          ///< Body buffer (unused when streaming to sink)
+    FetchInfo* info = nullptr;
+    const FetchFilter* filter = nullptr; ///< nullptr: download anything
+    const std::function<bool(const char*, size_t)>* sink = nullptr; ///< Streaming consumer
+    long status = 0;             ///< Status of the response whose headers are being read
+    size_t received = 0;         ///< Body bytes of the final response
+    bool transcode = false;      ///< Convert text bodies to UTF-8 as they arrive
+    std::string prescan;         ///< Body bytes held until the encoding is known
+    std::unique_ptr<Utf8Transcoder> transcoder;
+};
+
+// Body bytes inspected for a BOM, <meta charset> and byte statistics before decoding starts
+constexpr size_t kCharsetPrescanBytes = 4096;
+
+/**
+ * @brief Detect the body's encoding from the header label and the prescan
+ *        buffer, then decode the buffered bytes. Non-text bodies pass through.
+ */
+static void start_transcoding(FetchContext& ctx) {
+    const std::string& type = ctx.info->content_type;
+    bool text = type.empty() || type.compare(0, 5, "text/") == 0 || type.find("xml") != std::string::npos;
+    if (!text) {
+        ctx.transcode = false;
+        ctx.out->append(ctx.prescan);
+    } else {
+        CharsetDetection detection = CharsetDetector::detect(ctx.info->charset, ctx.prescan.data(), ctx.prescan.size());
+        ctx.transcoder = std::make_unique<Utf8Transcoder>(detection);
+        ctx.transcoder->feed(ctx.prescan.data(), ctx.prescan.size(), *ctx.out);
+    }
+    ctx.prescan.clear();
+    ctx.prescan.shrink_to_fit();
+}
+
+/**
+ * @brief Helper function for libcurl to write fetched data to a std::string
+ *        (or a streaming sink). Stops the transfer once a filtered body grows
+ *        past the size cap, or when the sink asks to stop.
  */
 static size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp) {
-    ((std::string*)userp)->append((char*)contents, size * nmemb);
-    return size * nmemb;
+    auto* ctx = static_cast<FetchContext*>(userp);
+    size_t len = size * nmemb;
+    ctx->received += len;
+    if (ctx->sink) {
+        // Only the final response's body is content; skip redirect bodies
+        if (ctx->status >= 300 && ctx->status < 400) return len;
+        return (*ctx->sink)(static_cast<const char*>(contents), len) ? len : 0;
+    }
+    if (ctx->filter && ctx->received > ctx->filter->max_content_length) {
+        ctx->info->filtered = true;
+        return 0; // abort: CURLE_WRITE_ERROR
+    }
+    const char* data = static_cast<const char*>(contents);
+    if (ctx->transcoder) {
+        ctx->transcoder->feed(data, len, *ctx->out);
+    } else if (ctx->transcode) {
+        ctx->prescan.append(data, len);
+        if (ctx->prescan.size() >= kCharsetPrescanBytes) start_transcoding(*ctx);
+    } else {
+        ctx->out->append(data, len);
+    }
+    return len;
+}
+
+/**
+ * @brief Extract and trim the value of a "Name: value" header line.
+ */
+static std::string header_value(const std::string& line, size_t name_len) {
+    std::string value = line.substr(name_len);
+    value.erase(0, value.find_first_not_of(" \t"));
+    value.erase(value.find_last_not_of(" \t\r\n") + 1);
+    return value;
+}
+
+// Retry-After values are clamped to this before HostRateLimiter applies its own cap
+constexpr long kMaxRetryAfterS = 24 * 3600;
+
+/**
+ * @brief libcurl header callback: captures status, Retry-After, Content-Type and
+ *        Content-Length of the final response, and aborts filtered transfers
+ *        before any body byte is downloaded.
+ */
+static size_t HeaderCallback(char* buffer, size_t size, size_t nitems, void* userp) {
+    size_t len = size * nitems;
+    auto* ctx = static_cast<FetchContext*>(userp);
+    FetchInfo* info = ctx->info;
+    std::string line(buffer, len);
+    // Headers of redirect hops are not the content we are going to receive
+    bool redirect = ctx->status >= 300 && ctx->status < 400;
+    if (line.compare(0, 5, "HTTP/") == 0) {
+        // New response (e.g. after a redirect): forget headers of the previous one
+        info->retry_after_s = -1;
+        info->content_type.clear();
+        info->charset.clear();
+        info->content_length = -1;
+        auto space = line.find(' ');
+        ctx->status = space == std::string::npos ? 0 : std::atol(line.c_str() + space + 1);
+    } else if (line.size() > 13 && strncasecmp(line.c_str(), "Content-Type:", 13) == 0) {
+        std::string type = header_value(line, 13);
+        info->charset = CharsetDetector::charset_from_content_type(type);
+        type = type.substr(0, type.find(';'));
+        type.erase(type.find_last_not_of(" \t") + 1);
+        std::transform(type.begin(), type.end(), type.begin(), ::tolower);
+        info->content_type = type;
+        if (ctx->filter && !redirect && !ctx->filter->allows_content_type(type)) {
+            info->filtered = true;
+            return 0; // abort before the body
+        }
+    } else if (line.size() > 15 && strncasecmp(line.c_str(), "Content-Length:", 15) == 0) {
+        info->content_length = std::atoll(header_value(line, 15).c_str());
+        if (ctx->filter && !redirect && info->content_length > static_cast<long long>(ctx->filter->max_content_length)) {
+            info->filtered = true;
+            return 0;
+        }
+    } else if (line.size() > 12 && strncasecmp(line.c_str(), "Retry-After:", 12) == 0) {
+        std::string value = header_value(line, 12);
+        bool digits = std::all_of(value.begin(), value.end(), [](unsigned char c) { return std::isdigit(c); });
+        if (!value.empty() && digits) {
+            // Overlong values fail to parse and keep the cap
+            long seconds = kMaxRetryAfterS;
+            std::from_chars(value.data(), value.data() + value.size(), seconds);
+            info->retry_after_s = static_cast<int>(std::min(seconds, kMaxRetryAfterS));
+        } else if (!value.empty()) {
+            // HTTP-date form
+            time_t when = curl_getdate(value.c_str(), nullptr);
+            if (when > 0) {
+                time_t seconds = std::min<time_t>(std::max<time_t>(0, when - std::time(nullptr)), kMaxRetryAfterS);
+                info->retry_after_s = static_cast<int>(seconds);
+            }
+        }
+    }
+    return len;
 }
 
 /**
  * @brief Fetch the content of a URL using libcurl.
+ *        Text bodies are decoded to UTF-8 as they stream in.
+ *        If info is given, it receives the final HTTP status, headers and latency.
+ *        If filter is given, disallowed or oversized responses are aborted early.
+ */
+bool Crawler::fetch_url(const std::string& url, std::string& out_content, FetchInfo* info,
+                        const FetchFilter* filter) {
+    FetchInfo local_info;
+    if (!info) info = &local_info;
+    FetchContext ctx;
+    ctx.out = &out_content;
+    ctx.info = info;
+    ctx.filter = filter;
+    ctx.transcode = true;
+    bool ok = perform_fetch(url, ctx);
+    if (ctx.transcode && !ctx.transcoder && !ctx.prescan.empty()) start_transcoding(ctx);
+    if (ctx.transcoder) {
+        ctx.transcoder->finish(out_content);
+        info->charset = ctx.transcoder->charset();
+        if (info->charset != "UTF-8") stats_.transcoded_pages.fetch_add(1, std::memory_order_relaxed);
+        stats_.utf8_replacements.fetch_add(ctx.transcoder->replacements(), std::memory_order_relaxed);
+    }
+    if (info->filtered) {
+        bool wrong_type = !filter->allows_content_type(info->content_type);
+        (wrong_type ? stats_.aborted_content_type : stats_.aborted_too_large).fetch_add(1, std::memory_order_relaxed);
+        if (info->content_length > static_cast<long long>(out_content.size())) {
+            stats_.bytes_avoided.fetch_add(info->content_length - out_content.size(), std::memory_order_relaxed);
+        }
+        out_content.clear();
+        return false;
+    }
+    return ok;
+}
+
+/**
+ * @brief Fetch a URL and hand the body to sink chunk by chunk as it arrives,
+ *        without buffering it. The sink returns false to stop the transfer.
+ */
+bool Crawler::fetch_stream(const std::string& url, const std::function<bool(const char*, size_t)>& sink,
+                           FetchInfo* info) {
+    FetchInfo local_info;
+    if (!info) info = &local_info;
+    FetchContext ctx;
+    ctx.info = info;
+    ctx.sink = &sink;
+    return perform_fetch(url, ctx);
+}
+
+/**
+ * @brief Run one libcurl transfer with the given callback context and record fetch stats.
  */
-bool Crawler::fetch_url(const std::string& url, std::string& out_content) {
+bool Crawler::perform_fetch(const std::string& url, FetchContext& ctx) {
     CURL* curl = curl_easy_init();
     if (!curl) return false;
+    stats_.fetches_attempted.fetch_add(1, std::memory_order_relaxed);
+    auto start = std::chrono::steady_clock::now();
     CURLcode res;
+    FetchInfo* info = ctx.info;
     curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &out_content);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &ctx);
     curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
     curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L); // 10 second timeout
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &ctx);
     res = curl_easy_perform(curl);
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &info->http_status);
     curl_easy_cleanup(curl);
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    info->latency_ms = elapsed.count() / 1000.0;
+    stats_.fetch_latency_us.record(static_cast<uint64_t>(elapsed.count()));
+    stats_.bytes_downloaded.fetch_add(ctx.received, std::memory_order_relaxed);
+    if (info->filtered) return false;
+    if (res != CURLE_OK) stats_.fetches_failed.fetch_add(1, std::memory_order_relaxed);
     return (res == CURLE_OK);
 }
 
 /**
- * @brief Set the minimum delay (in milliseconds) between requests to the same domain.
+ * @brief Set the initial delay (in milliseconds) between requests to the same domain.
+ *        The per-host controller adapts it from there; the floor is lowered if needed.
  */
 void Crawler::set_domain_delay(int ms) {
-    domain_delay_ms_ = ms;
+    HostRateLimiter::Config config = rate_limiter_.config();
+    config.initial_interval_ms = ms;
+    config.min_interval_ms = std::min(config.min_interval_ms, ms);
+    rate_limiter_.set_config(config);
 }
 
 /**
- * @brief Check and enforce domain rate limiting. Sleeps if needed.
+ * @brief Configure the Content-Type allowlist, size cap and blocked URL extensions.
  */
-void Crawler::enforce_domain_delay(const std::string& domain) {
-    auto now = std::chrono::steady_clock::now();
-    auto it = last_fetch_time_.find(domain);
-    if (it != last_fetch_time_.end()) {
-        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - it->second).count();
-        if (elapsed < domain_delay_ms_) {
-            int sleep_ms = domain_delay_ms_ - static_cast<int>(elapsed);
-            if (sleep_ms > 0) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(sleep_ms));
-            }
-        }
-    }
-    last_fetch_time_[domain] = std::chrono::steady_clock::now();
+void Crawler::set_fetch_filter(const FetchFilter& filter) {
+    fetch_filter_ = filter;
+}
+
+/**
+ * @brief Whether the URL path ends in an extension that is never worth fetching as HTML.
+ */
+bool Crawler::has_blocked_extension(const std::string& url) const {
+    size_t scheme = url.find("://");
+    size_t path_start = url.find('/', scheme == std::string::npos ? 0 : scheme + 3);
+    if (path_start == std::string::npos) return false;
+    size_t path_end = url.find_first_of("?#", path_start);
+    if (path_end == std::string::npos) path_end = url.size();
+    size_t last_slash = url.rfind('/', path_end - 1);
+    size_t dot = url.rfind('.', path_end - 1);
+    if (dot == std::string::npos || dot < last_slash || dot + 1 >= path_end) return false;
+    std::string ext = url.substr(dot + 1, path_end - dot - 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return fetch_filter_.blocked_extensions.count(ext) > 0;
+}
+
+/**
+ * @brief Configure the adaptive per-host rate control (AIMD) and global bandwidth cap.
+ */
+void Crawler::set_rate_limits(const HostRateLimiter::Config& config) {
+    rate_limiter_.set_config(config);
 }
 
 /**
@@ -116,29 +347,73 @@ void Crawler::fetch_and_process(const std::string& url) {
             return;
         }
         std::string domain = extract_domain(url);
-        enforce_domain_delay(domain);
         std::string html;
-        if (!fetch_url(url, html)) {
+        FetchInfo info;
+        rate_limiter_.acquire(domain);
+        bool fetched = fetch_url(url, html, &info, &fetch_filter_);
+        HostRateLimiter::Outcome outcome;
+        outcome.http_status = info.http_status;
+        outcome.transport_error = !fetched && !info.filtered;
+        outcome.latency_ms = info.latency_ms;
+        outcome.bytes = html.size();
+        outcome.retry_after_s = info.retry_after_s;
+        rate_limiter_.release(domain, outcome);
+        if (info.filtered) {
+            log("Skipped (" + (info.content_type.empty() ? std::string("oversized") : info.content_type) + "): " + url);
+            return;
+        }
+        if (!fetched) {
             log("Failed to fetch: " + url);
             return;
         }
-        // Chunk and store content
-        auto blocks = ContentStore::chunk_data(html);
-        auto hashes = content_store_->store_blocks(blocks);
+        if (info.http_status == 429 || info.http_status == 503) {
+            stats_.throttled_responses.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (info.http_status >= 400) {
+            log("HTTP " + std::to_string(info.http_status) + " for: " + url);
+            return;
+        }
+        // Chunk and hash content
+        auto blocks = ContentStore::chunk_content(html);
+        auto hashes = content_store_->hash_blocks(blocks);
         // Build Merkle tree
-        MerkleTree new_tree(hashes);
-        MerkleTree old_tree({});
-        publish_diff(url, old_tree, new_tree);
+        MerkleTree new_tree(hashes, content_store_->hash_algorithm());
+        // Store the blocks and the new page version atomically; the version it replaces comes back
+        PageManifest previous;
+        PageManifest current = content_store_->store_page_version(url, blocks, hashes, new_tree.root(), &previous);
+        stats_.pages_processed.fetch_add(1, std::memory_order_relaxed);
+        record_domain_page(url, current.root);
+        if (current.version == previous.version) {
+            // Same content as the last crawl: nothing to publish or reindex
+            stats_.pages_unchanged.fetch_add(1, std::memory_order_relaxed);
+            extract_and_enqueue_links(html, url);
+            return;
+        }
+        MerkleTree old_tree(previous.blocks, content_store_->hash_algorithm());
+        publish_diff(url, old_tree, new_tree, blocks);
         log("Root hash for " + url + ": " + new_tree.root_hash());
         // Index content if indexer is set
         if (indexer_) {
             // For demo: use URL as doc_id, tokenize and stem content
             Tokenizer tokenizer;
             Stemmer stemmer;
-            auto tokens = tokenizer.tokenize(html);
+            // Index the page's main content rather than its markup
+            std::string text;
+            if (info.content_type.compare(0, 10, "text/plain") == 0) {
+                text = html;
+            } else {
+                ExtractedDocument doc = HtmlExtractor().extract(html);
+                text = doc.text();
+                stats_.boilerplate_blocks.fetch_add(doc.blocks_total - doc.blocks_kept, std::memory_order_relaxed);
+            }
+            stats_.text_bytes_indexed.fetch_add(text.size(), std::memory_order_relaxed);
+            auto tokens = tokenizer.tokenize(text);
             std::vector<std::string> stemmed;
             for (const auto& t : tokens) stemmed.push_back(stemmer.stem(t));
-            indexer_->add_document(url, stemmed);
+            {
+                std::lock_guard<std::mutex> lock(index_mutex_);
+                indexer_->add_document(url, stemmed);
+            }
             log("Indexed content for: " + url);
         }
         // Extract and enqueue links
@@ -201,9 +476,97 @@ bool Crawler::fetch_and_cache_robots(const std::string& domain) {
             if (!path.empty()) rules.allow.push_back(path);
         } else if (line.find("User-agent:") == 0) {
             relevant = false;
+        } else if (strncasecmp(line.c_str(), "Sitemap:", 8) == 0) {
+            std::string sitemap = line.substr(8);
+            sitemap.erase(0, sitemap.find_first_not_of(" \t"));
+            if (!sitemap.empty()) rules.sitemaps.push_back(sitemap);
         }
     }
-    robots_cache_[domain] = rules;
+    bool first;
+    {
+        std::lock_guard<std::mutex> lock(robots_mutex_);
+        first = robots_cache_.emplace(domain, rules).second;
+        if (!first) robots_cache_[domain] = rules;
+    }
+    // Seed the frontier from the host's sitemaps the first time we see it. A
+    // worker fetches them later, so the URL waiting on robots.txt goes ahead.
+    if (first && sitemap_config_.enabled && !rules.sitemaps.empty()) {
+        std::lock_guard<std::mutex> lock(frontier_mutex_);
+        for (const auto& sitemap : rules.sitemaps) sitemap_queue_.emplace_back(sitemap, domain);
+    }
+    return true;
+}
+
+/**
+ * @brief Configure sitemap discovery limits (or disable it).
+ */
+void Crawler::set_sitemap_config(const SitemapConfig& config) {
+    sitemap_config_ = config;
+}
+
+/**
+ * @brief Stream a sitemap (or sitemap index, plain or gzipped) and enqueue its
+ *        same-host URLs with lastmod/changefreq priority hints. Indexes are
+ *        followed breadth-first up to the configured depth and document count.
+ */
+void Crawler::ingest_sitemap(const std::string& sitemap_url, const std::string& domain) {
+    std::vector<std::pair<std::string, int>> pending{{sitemap_url, 0}};
+    std::unordered_set<std::string> visited;
+    size_t url_budget = sitemap_config_.max_urls_per_host;
+    std::time_t now = std::time(nullptr);
+    std::string host = domain;
+    std::transform(host.begin(), host.end(), host.begin(), ::tolower);
+
+    for (size_t next = 0; next < pending.size() && visited.size() < sitemap_config_.max_sitemaps_per_host; ++next) {
+        std::string url = pending[next].first;
+        int depth = pending[next].second;
+        if (!visited.insert(url).second || url_budget == 0) continue;
+
+        SitemapParser parser([&](const SitemapEntry& entry) {
+            std::string loc = normalize_url(entry.loc);
+            // Sitemaps may only list URLs of their own host
+            if (extract_domain(loc) != host) return;
+            if (entry.is_index) {
+                if (depth < sitemap_config_.max_index_depth) pending.emplace_back(loc, depth + 1);
+            } else if (url_budget > 0) {
+                --url_budget;
+                add_url(loc, entry.priority_hint(now));
+                stats_.sitemap_urls.fetch_add(1, std::memory_order_relaxed);
+            }
+        }, std::min<size_t>(url_budget + sitemap_config_.max_sitemaps_per_host, 50000));
+
+        // robots.txt may point at a sitemap on another host; that host pays for the fetch
+        std::string sitemap_host = extract_domain(url);
+        FetchInfo info;
+        rate_limiter_.acquire(sitemap_host);
+        bool fetched = fetch_stream(url, [&](const char* data, size_t len) {
+            return parser.feed(data, len);
+        }, &info);
+        if (fetched) parser.finish();
+        HostRateLimiter::Outcome outcome;
+        outcome.http_status = info.http_status;
+        outcome.transport_error = !fetched && parser.entries() == 0;
+        outcome.latency_ms = info.latency_ms;
+        outcome.retry_after_s = info.retry_after_s;
+        rate_limiter_.release(sitemap_host, outcome);
+        stats_.sitemaps_fetched.fetch_add(1, std::memory_order_relaxed);
+        log("Sitemap " + url + ": " + std::to_string(parser.entries()) + " entries");
+    }
+}
+
+/**
+ * @brief Ingest the oldest sitemap queued by fetch_and_cache_robots.
+ * @return False if none was queued.
+ */
+bool Crawler::ingest_queued_sitemap() {
+    std::pair<std::string, std::string> job;
+    {
+        std::lock_guard<std::mutex> lock(frontier_mutex_);
+        if (sitemap_queue_.empty()) return false;
+        job = std::move(sitemap_queue_.front());
+        sitemap_queue_.pop_front();
+    }
+    ingest_sitemap(job.first, job.second);
     return true;
 }
 
@@ -212,7 +575,7 @@ bool Crawler::fetch_and_cache_robots(const std::string& domain) {
  */
 bool Crawler::is_allowed_by_rules(const std::string& url, const RobotsRules& rules) const {
     // Extract path from URL
-    std::regex re(R"(^https?://[^/]+(/.*)?$");
+    std::regex re(R"(^https?://[^/]+(/.*)?$)");
     std::smatch match;
     std::string path = "/";
     if (std::regex_search(url, match, re) && match.size() > 1 && match[1].matched) {
@@ -231,39 +594,60 @@ bool Crawler::is_allowed_by_rules(const std::string& url, const RobotsRules& rul
 /**
  * @brief Check if a URL is allowed by robots.txt (fetches and caches as needed).
  */
-bool Crawler::allowed_by_robots(const std::string& url) const {
+bool Crawler::allowed_by_robots(const std::string& url) {
     std::string domain = extract_domain(url);
     if (domain.empty()) return false;
     // Check cache
-    auto it = robots_cache_.find(domain);
-    if (it == robots_cache_.end()) {
-        if (!fetch_and_cache_robots(domain)) {
-            // If robots.txt cannot be fetched, default to allow
-            return true;
-        }
-        it = robots_cache_.find(domain);
+    {
+        std::lock_guard<std::mutex> lock(robots_mutex_);
+        auto it = robots_cache_.find(domain);
+        if (it != robots_cache_.end()) return is_allowed_by_rules(url, it->second);
+    }
+    if (!fetch_and_cache_robots(domain)) {
+        // If robots.txt cannot be fetched, default to allow
+        return true;
     }
-    return is_allowed_by_rules(url, it->second);
+    std::lock_guard<std::mutex> lock(robots_mutex_);
+    return is_allowed_by_rules(url, robots_cache_[domain]);
+}
+
+/**
+ * @brief Publish a page's Merkle diff as a DiffPacket on the diff topic. Small
+ *        changed blocks are inlined so subscribers can apply the edit directly.
+ */
+void Crawler::publish_diff(const std::string& url, const MerkleTree& old_tree, const MerkleTree& new_tree,
+                           const std::vector<std::string>& blocks) {
+    MerkleDiff diff = new_tree.compare(old_tree);
+    std::vector<uint8_t> packet;
+    DiffPacket::encode(url, old_tree, new_tree, diff, &blocks, kDiffInlineLimit, content_store_->hash_algorithm(),
+                       packet);
+    stats_.diffs_published.fetch_add(1, std::memory_order_relaxed);
+    stats_.diff_bytes.fetch_add(packet.size(), std::memory_order_relaxed);
+    if (dht_node_) dht_node_->publish(diff_topic_, packet);
 }
 
 /**
- * @brief Publish Merkle diff for a domain via P2P DHT (placeholder).
- *        Real implementation should serialize and send diff packet.
+ * @brief Add a stored page to its host's MerkleSearchTree. Unchanged pages are
+ *        recorded too (a no-op once present), so a restarted crawler fills
+ *        its trees back in as it recrawls.
  */
-void Crawler::publish_diff(const std::string& domain, const MerkleTree& old_tree, const MerkleTree& new_tree) const {
-    // TODO: Implement P2P DHT diff publishing
-    std::cout << "Publishing diff for domain: " << domain << std::endl;
-    std::cout << "Old root: " << old_tree.root_hash() << ", New root: " << new_tree.root_hash() << std::endl;
-    auto diffs = new_tree.diff(old_tree);
-    std::cout << "Updated hashes: [";
-    for (const auto& h : diffs) std::cout << h << ", ";
-    std::cout << "]" << std::endl;
+void Crawler::record_domain_page(const std::string& url, const Digest256& root) {
+    domain_sync_.record(extract_domain(url), url, root);
+}
+
+void Crawler::sync_domain(const std::string& peer, const std::string& domain) {
+    if (!dht_node_) return;
+    try {
+        dht_node_->send_direct(peer, domain_sync_.announce(domain));
+    } catch (const std::exception& ex) {
+        log(std::string("Domain sync error: ") + ex.what());
+    }
 }
 
 /**
  * @brief Normalize a URL (remove fragments, lowercase host, etc.).
  */
-std::string Crawler::normalize_url(const std::string& url) const{
+std::string Crawler::normalize_url(const std::string& url) {
     // Basic normalization: lowercase scheme/host, remove fragment
     std::regex re(R"(^([a-zA-Z]+)://([^/#?]+)([^#]*)#?.*$)");
     std::smatch match;
@@ -281,27 +665,207 @@ std::string Crawler::normalize_url(const std::string& url) const{
 /**
  * @brief Add a single URL to the crawl frontier (normalized, deduplicated, thread-safe).
  */
-void Crawler::add_url(const std::string& url) {
-    std::string norm = normalize_url(url);
+void Crawler::add_url(const std::string& url, double priority) {
+    if (has_blocked_extension(url)) {
+        stats_.urls_filtered.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    enqueue_url(normalize_url(url), priority, true);
+}
+
+void Crawler::enqueue_url(const std::string& url, double priority, bool may_route, bool force) {
+    std::string owner;
+    if (may_route && shards_) {
+        owner = shards_->owner(extract_domain(url));
+        if (owner == shards_->self()) owner.clear();
+    }
+    std::vector<CrawlShards::Batch> ready;
+    {
+        std::lock_guard<std::mutex> lock(frontier_mutex_);
+        std::lock_guard<std::mutex> seen_lock(seen_mutex_);
+        // A URL routed away counts as seen too, so each is sent once
+        if (!seen_urls_.insert(url).second && !force) return;
+        if (owner.empty()) {
+            push_frontier_locked(url, priority);
+        } else {
+            shards_->route(owner, CrawlShards::Url{url, priority}, ready);
+        }
+    }
+    send_url_batches(ready);
+}
+
+void Crawler::set_sharding(const CrawlShards::Config& config) {
+    shards_.reset();
+    if (dht_node_ && config.enabled) shards_ = std::make_unique<CrawlShards>(dht_node_->peer_id(), config);
+}
+
+std::string Crawler::host_owner(const std::string& host) const {
+    return shards_ ? shards_->owner(host) : std::string();
+}
+
+CrawlShards::Stats Crawler::shard_stats() const {
+    return shards_ ? shards_->stats() : CrawlShards::Stats();
+}
+
+size_t Crawler::frontier_size() {
     std::lock_guard<std::mutex> lock(frontier_mutex_);
-    std::lock_guard<std::mutex> seen_lock(seen_mutex_);
-    if (seen_urls_.find(norm) == seen_urls_.end()) {
-        frontier_.push(norm);
-        seen_urls_.insert(norm);
+    return frontier_.size();
+}
+
+void Crawler::refresh_shards() {
+    if (!shards_) return;
+    try {
+        if (shards_->set_peers(dht_node_->get_peers(dht_topic_))) {
+            log("Crawl nodes changed: " + std::to_string(shards_->stats().members) + " members");
+            rebalance_frontier();
+        }
+    } catch (const std::exception& ex) {
+        log(std::string("Shard refresh error: ") + ex.what());
     }
 }
 
+void Crawler::leave_shards() {
+    if (shards_ && shards_->leave()) rebalance_frontier();
+}
+
 /**
- * @brief Placeholder: Publish a URL to the DHT (to be implemented).
+ * @brief Hand the frontier URLs on hosts this node no longer owns to their
+ *        new owners; the rest keep their priority and order.
+ */
+void Crawler::rebalance_frontier() {
+    std::vector<std::pair<std::string, CrawlShards::Url>> moving;
+    {
+        std::lock_guard<std::mutex> lock(frontier_mutex_);
+        std::vector<FrontierEntry> keep;
+        while (!frontier_.empty()) {
+            const FrontierEntry& entry = frontier_.top();
+            std::string owner = shards_->owner(extract_domain(entry.url));
+            if (owner == shards_->self()) {
+                keep.push_back(entry);
+            } else {
+                moving.emplace_back(owner, CrawlShards::Url{entry.url, entry.priority});
+            }
+            frontier_.pop();
+        }
+        frontier_ = std::priority_queue<FrontierEntry>(std::less<FrontierEntry>(), std::move(keep));
+    }
+    // New owners pull the pages already crawled on their hosts, instead of fetching them again
+    for (const std::string& domain : domain_sync_.domains()) {
+        std::string owner = shards_->owner(domain);
+        if (owner != shards_->self()) sync_domain(owner, domain);
+    }
+    if (moving.empty()) return;
+    std::vector<CrawlShards::Batch> ready;
+    shards_->hand_off(moving, ready);
+    send_url_batches(ready);
+    log("Handed off " + std::to_string(moving.size()) + " URLs");
+}
+
+void Crawler::flush_url_batches() {
+    if (shards_) send_url_batches(shards_->flush());
+}
+
+void Crawler::send_url_batches(const std::vector<CrawlShards::Batch>& batches) {
+    for (const CrawlShards::Batch& batch : batches) {
+        try {
+            dht_node_->send_direct(batch.first, batch.second);
+        } catch (const std::exception& ex) {
+            log(std::string("URL batch error: ") + ex.what());
+        }
+    }
+}
+
+/**
+ * @brief Take the URLs another node routed here. Those on hosts this node
+ *        does not own (the nodes disagree on the members) go on to the owner
+ *        once, unless that is the sender: it has left, or is leaving.
+ */
+void Crawler::handle_url_batch(const std::string& from_peer, const std::vector<uint8_t>& data) {
+    uint8_t flags = 0;
+    std::vector<CrawlShards::Url> urls;
+    if (!shards_ || !CrawlShards::decode(data.data(), data.size(), flags, urls)) return;
+    std::unordered_map<std::string, std::vector<CrawlShards::Url>> forward;  // Per owner
+    size_t forwarded = 0;
+    for (CrawlShards::Url& url : urls) {
+        std::string owner = shards_->owner(extract_domain(url.url));
+        if ((flags & CrawlShards::kForwardable) && owner != shards_->self() && owner != from_peer) {
+            forward[owner].push_back(std::move(url));
+            ++forwarded;
+            continue;
+        }
+        enqueue_url(url.url, url.priority, false, (flags & CrawlShards::kHandOff) != 0);
+    }
+    shards_->count_received(urls.size(), forwarded);
+    for (const auto& entry : forward) {
+        send_url_batches({{entry.first, CrawlShards::encode(flags & ~CrawlShards::kForwardable, entry.second)}});
+    }
+    if (forwarded > 0) log("Forwarded " + std::to_string(forwarded) + " URLs from " + from_peer);
+}
+
+/**
+ * @brief Share a discovered URL with peers. It joins the seen-URL set, which
+ *        sync_seen_urls reconciles with each peer, instead of being gossiped
+ *        on its own.
  */
 void Crawler::dht_publish_url(const std::string& url) {
     if (!dht_node_) return;
-    std::vector<uint8_t> data(url.begin(), url.end());
+    url_sync_.add(normalize_url(url));
+}
+
+void Crawler::set_url_sync_interval(int ms) {
+    url_sync_interval_ms_ = ms;
+}
+
+void Crawler::sync_seen_urls() {
+    if (!dht_node_) return;
+    try {
+        for (const std::string& peer : dht_node_->get_peers(dht_topic_)) {
+            dht_node_->send_direct(peer, url_sync_.sketch(peer));
+        }
+    } catch (const std::exception& ex) {
+        log(std::string("URL sync error: ") + ex.what());
+    }
+}
+
+/**
+ * @brief Take a URL batch, or answer a peer's URL sketch or resolve
+ *        message; URLs it taught us on this node's hosts enter the frontier.
+ *        Pages learned through DomainSync count as crawled.
+ */
+void Crawler::handle_direct_message(const std::string& from_peer, const std::vector<uint8_t>& data) {
+    if (CrawlShards::is_batch_message(data.data(), data.size())) {
+        handle_url_batch(from_peer, data);
+        return;
+    }
+    if (DomainSync::is_sync_message(data.data(), data.size())) {
+        std::vector<std::string> pages;
+        std::vector<uint8_t> reply = domain_sync_.handle(from_peer, data.data(), data.size(), pages);
+        if (!pages.empty()) {
+            std::lock_guard<std::mutex> lock(frontier_mutex_);
+            std::lock_guard<std::mutex> seen_lock(seen_mutex_);
+            for (const std::string& url : pages) seen_urls_.insert(url);
+        }
+        for (const std::string& url : pages) url_sync_.add(url);
+        if (!pages.empty()) log("Learned " + std::to_string(pages.size()) + " crawled pages from " + from_peer);
+        try {
+            if (!reply.empty()) dht_node_->send_direct(from_peer, reply);
+        } catch (const std::exception& ex) {
+            log(std::string("Domain sync error: ") + ex.what());
+        }
+        return;
+    }
+    if (!UrlSetSync::is_sync_message(data.data(), data.size())) return;
+    std::vector<std::string> learned;
+    std::vector<uint8_t> reply = url_sync_.handle(from_peer, data.data(), data.size(), learned);
+    for (const std::string& url : learned) {
+        // The owner of another node's host learns the URL in its own exchanges
+        if (!shards_ || shards_->owner(extract_domain(url)) == shards_->self()) add_url(url);
+    }
+    if (!learned.empty()) log("Learned " + std::to_string(learned.size()) + " URLs from " + from_peer);
     try {
-        dht_node_->publish(dht_topic_, data);
-        log("Published URL to DHT: " + url);
+        if (!reply.empty()) dht_node_->send_direct(from_peer, reply);
     } catch (const std::exception& ex) {
-        log(std::string("DHT publish error: ") + ex.what());
+        log(std::string("URL sync error: ") + ex.what());
     }
 }
 
@@ -320,22 +884,77 @@ void Crawler::run_concurrent(int num_threads, int max_pages) {
     std::atomic<int> pages_crawled{0};
     // Subscribe to DHT topic for URLs
     if (dht_node_) {
-        dht_node_->subscribe(dht_topic_, [this](const std::string& from_peer, const std::vector<uint8_t>& data) {
+        dht_node_->subscribe(dht_topic_, [this](const std::string&, const std::vector<uint8_t>& data) {
             std::string url(data.begin(), data.end());
             log("Received URL from DHT: " + url);
             add_url(url);
         });
+        dht_node_->on_direct_message([this](const std::string& from_peer, const std::vector<uint8_t>& data) {
+            handle_direct_message(from_peer, data);
+        });
     }
+    refresh_shards();
+    // In the background while the workers run: reconcile seen URLs with peers,
+    // send URL batches to their owners and follow the crawl node membership
+    std::vector<std::pair<int, std::function<void()>>> tasks;  // Interval (ms), task
+    if (dht_node_ && url_sync_interval_ms_ > 0) tasks.emplace_back(url_sync_interval_ms_, [this] { sync_seen_urls(); });
+    if (shards_) {
+        tasks.emplace_back(std::max(1, shards_->config().flush_interval_ms), [this] { flush_url_batches(); });
+        tasks.emplace_back(std::max(1, shards_->config().membership_interval_ms), [this] { refresh_shards(); });
+    }
+    std::mutex sync_mutex;
+    std::condition_variable sync_cv;
+    bool workers_done = false;
+    std::thread sync_thread;
+    if (!tasks.empty()) {
+        sync_thread = std::thread([&]() {
+            std::vector<std::chrono::steady_clock::time_point> due;
+            for (const auto& task : tasks) due.push_back(std::chrono::steady_clock::now() + std::chrono::milliseconds(task.first));
+            std::unique_lock<std::mutex> lock(sync_mutex);
+            while (!sync_cv.wait_until(lock, *std::min_element(due.begin(), due.end()), [&] { return workers_done; })) {
+                lock.unlock();
+                for (size_t i = 0; i < tasks.size(); ++i) {
+                    if (std::chrono::steady_clock::now() < due[i]) continue;
+                    tasks[i].second();
+                    due[i] = std::chrono::steady_clock::now() + std::chrono::milliseconds(tasks[i].first);
+                }
+                lock.lock();
+            }
+        });
+    }
+    // How many rate-limited URLs a worker looks past before backing off
+    constexpr size_t kMaxDeferred = 64;
     auto worker = [&]() {
+        std::vector<FrontierEntry> deferred;
         while (true) {
+            // Sitemaps queued by robots.txt fetches seed the frontier; take them first
+            if (ingest_queued_sitemap()) continue;
             std::string url;
+            auto wait = std::chrono::steady_clock::duration::max();
             {
                 std::lock_guard<std::mutex> lock(frontier_mutex_);
-                if (frontier_.empty() || (max_pages > 0 && pages_crawled >= max_pages)) {
+                if ((frontier_.empty() && sitemap_queue_.empty()) || (max_pages > 0 && pages_crawled >= max_pages)) {
                     break;
                 }
-                url = frontier_.front();
-                frontier_.pop();
+                // Take the best URL whose host is ready; set aside (then restore) rate-limited ones
+                while (!frontier_.empty() && deferred.size() < kMaxDeferred) {
+                    FrontierEntry entry = frontier_.top();
+                    frontier_.pop();
+                    auto host_wait = rate_limiter_.ready_in(extract_domain(entry.url));
+                    if (host_wait <= std::chrono::steady_clock::duration::zero()) {
+                        url = entry.url;
+                        break;
+                    }
+                    wait = std::min(wait, host_wait);
+                    deferred.push_back(std::move(entry));
+                }
+                for (auto& entry : deferred) frontier_.push(std::move(entry));
+                deferred.clear();
+            }
+            if (url.empty()) {
+                // Nothing is ready: back off briefly
+                std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(wait, std::chrono::milliseconds(20)));
+                continue;
             }
             fetch_and_process(url);
             ++pages_crawled;
@@ -348,6 +967,15 @@ void Crawler::run_concurrent(int num_threads, int max_pages) {
     for (auto& t : threads) {
         t.join();
     }
+    if (sync_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(sync_mutex);
+            workers_done = true;
+        }
+        sync_cv.notify_one();
+        sync_thread.join();
+    }
+    flush_url_batches();
     log("Concurrent crawl complete. Pages crawled: " + std::to_string(pages_crawled));
 }
 
@@ -396,7 +1024,7 @@ std::string Crawler::resolve_url(const std::string& link, const std::string& bas
     if (link.empty()) return "";
     // Absolute URL
     if (link.find("http://") == 0 || link.find("https://") == 0) {
-        return Crawler::normalize_url(link);
+        return normalize_url(link);
     }
     // Protocol-relative (//example.com)
     if (link.find("//") == 0) {
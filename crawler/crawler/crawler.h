@@ -4,60 +4,233 @@
 #include <string>
 #include <vector>
 #include <queue>
+#include <deque>
 #include <unordered_set>
 #include <memory>
 #include <mutex>
 #include "../content_store/content_store.h"
 #include "../merkle_tree/merkle_tree.h"
+#include "../merkle_tree/merkle_search_tree.h"
 #include <unordered_map>
 #include <chrono>
 #include <thread>
 #include "../p2p_dht/p2p_dht.h"
 #include "include/inverted_index.h"
+#include "crawl_stats.h"
+#include "host_rate_limiter.h"
+#include "sitemap.h"
+#include "url_sketch.h"
+#include "domain_sync.h"
+#include "host_shards.h"
+#include <functional>
+
+/**
+ * @brief Response metadata captured by fetch_url (final response after redirects).
+ */
+struct FetchInfo {
+    long http_status = 0;
+    int retry_after_s = -1;   ///< Retry-After in seconds, -1 if absent
+    double latency_ms = 0;
+    std::string content_type; ///< Media type without parameters, lowercased
+    long long content_length = -1; ///< Declared Content-Length, -1 if absent
+    bool filtered = false;    ///< Transfer aborted by the FetchFilter (not a transport error)
+    std::string charset;      ///< Content-Type charset label; after fetch_url, the encoding the body was decoded from
+};
+
+/**
+ * @brief Header-phase and URL-level filters that keep non-HTML content out of the pipeline.
+ *
+ * Transfers are aborted as soon as the final response's Content-Type is outside
+ * the allowlist or its Content-Length exceeds the cap; bodies without a declared
+ * length are cut off once they pass the cap. URLs whose path ends in a known
+ * binary extension never enter the frontier.
+ */
+struct FetchFilter {
+    std::unordered_set<std::string> allowed_content_types = {
+        "text/html", "application/xhtml+xml", "text/plain"};
+    size_t max_content_length = 10 * 1024 * 1024;
+    std::unordered_set<std::string> blocked_extensions = {
+        "pdf", "jpg", "jpeg", "png", "gif", "webp", "svg", "ico", "bmp", "tif", "tiff",
+        "mp3", "mp4", "m4a", "m4v", "avi", "mov", "mkv", "webm", "wav", "ogg", "flac",
+        "zip", "gz", "tgz", "bz2", "xz", "7z", "rar", "tar", "iso", "dmg", "exe", "msi", "bin",
+        "apk", "deb", "rpm", "jar", "woff", "woff2", "ttf", "otf", "eot", "css", "js",
+        "doc", "docx", "xls", "xlsx", "ppt", "pptx"};
+
+    /**
+     * @brief Whether a media type (lowercase, no parameters) may be downloaded.
+     *        An empty type (header absent) is allowed.
+     */
+    bool allows_content_type(const std::string& type) const {
+        return type.empty() || allowed_content_types.count(type) > 0;
+    }
+};
 
 struct RobotsRules {
     std::vector<std::string> disallow;
     std::vector<std::string> allow;
+    std::vector<std::string> sitemaps;  ///< Sitemap: URLs (apply to every user-agent group)
+};
+
+/**
+ * @brief Limits for sitemap discovery through robots.txt.
+ */
+struct SitemapConfig {
+    bool enabled = true;
+    size_t max_urls_per_host = 50000;    ///< URLs enqueued from all of a host's sitemaps
+    size_t max_sitemaps_per_host = 64;   ///< Sitemap documents fetched per host (incl. indexes)
+    int max_index_depth = 2;             ///< Nesting of sitemap indexes followed
 };
 
+/**
+ * @brief A URL waiting in the frontier. Higher priority is crawled first; equal
+ *        priorities keep insertion (FIFO) order.
+ */
+struct FrontierEntry {
+    std::string url;
+    double priority;
+    uint64_t seq;
+
+    bool operator<(const FrontierEntry& other) const {
+        if (priority != other.priority) return priority < other.priority;
+        return seq > other.seq;
+    }
+};
+
+struct FetchContext;
+
 class Crawler {
 public:
     Crawler(const std::string& db_path, std::shared_ptr<p2p_dht::DHTNode> dht_node);
+    Crawler(const std::string& db_path, std::shared_ptr<p2p_dht::DHTNode> dht_node,
+            const ContentStore::Config& store_config);
 
     void add_seed_urls(const std::vector<std::string>& urls);
+    void run();
     void run_concurrent(int num_threads = 4, int max_pages = 0);
-    void add_url(const std::string& url);
-    std::string normalize_url(const std::string& url) const;
+    static constexpr double kDefaultPriority = 0.5; ///< Links found in pages (sitemap default)
+    static constexpr double kSeedPriority = 1.0;
+    void add_url(const std::string& url, double priority = kDefaultPriority);
+    void set_sitemap_config(const SitemapConfig& config);
+    void ingest_sitemap(const std::string& sitemap_url, const std::string& domain);
+    static std::string normalize_url(const std::string& url);
     void dht_publish_url(const std::string& url);
+    /**
+     * @brief Send every topic peer a sketch of the seen-URL set (UrlSetSync).
+     *        run_concurrent calls this every url sync interval.
+     */
+    void sync_seen_urls();
+    void set_url_sync_interval(int ms);
+    UrlSetSync::Stats url_sync_stats() const { return url_sync_.stats(); }
+    /**
+     * @brief Host ownership across the crawl nodes (CrawlShards). With a DHT
+     *        node it is on by default; a URL on another node's host is sent
+     *        to that node instead of entering the frontier.
+     */
+    void set_sharding(const CrawlShards::Config& config);
+    /**
+     * @brief List the crawl nodes again (the peers on the URL topic). If they
+     *        changed, hand the frontier URLs this node no longer owns to their
+     *        owners. run_concurrent calls this every membership interval.
+     */
+    void refresh_shards();
+    /**
+     * @brief Hand every frontier URL to the other nodes and own no more hosts,
+     *        before shutting down.
+     */
+    void leave_shards();
+    /**
+     * @brief Send the URL batches waiting for other nodes. run_concurrent
+     *        calls this every flush interval.
+     */
+    void flush_url_batches();
+    /**
+     * @brief Peer ID of the node that crawls host (this node's own ID for its
+     *        hosts); empty without sharding.
+     */
+    std::string host_owner(const std::string& host) const;
+    CrawlShards::Stats shard_stats() const;
+    size_t frontier_size();
     std::vector<std::string> dht_receive_urls();
     void fetch_and_process(const std::string& url);
-    bool allowed_by_robots(const std::string& url) const;
-    void publish_diff(const std::string& domain, const MerkleTree& old_tree, const MerkleTree& new_tree) const;
+    bool allowed_by_robots(const std::string& url);
+    bool is_allowed_by_rules(const std::string& url, const RobotsRules& rules) const;
+    static constexpr size_t kDiffInlineLimit = 2048; ///< Blocks up to this size travel inside diff packets
+    void publish_diff(const std::string& url, const MerkleTree& old_tree, const MerkleTree& new_tree,
+                      const std::vector<std::string>& blocks);
     void set_domain_delay(int ms);
+    void set_rate_limits(const HostRateLimiter::Config& config);
+    void set_fetch_filter(const FetchFilter& filter);
+    bool has_blocked_extension(const std::string& url) const;
+    const HostRateLimiter& rate_limiter() const { return rate_limiter_; }
     void extract_and_enqueue_links(const std::string& html, const std::string& base_url);
     std::string resolve_url(const std::string& link, const std::string& base_url) const;
     static void log(const std::string& msg);
     void set_indexer(InvertedIndex* indexer);
+    const CrawlStats& stats() const { return stats_; }
+    const ContentStore& content_store() const { return *content_store_; }
+    /**
+     * @brief Snapshot of the pages crawled on a host: URL hash to page root,
+     *        for reconciling with a peer's copy (MstReconciler).
+     */
+    MerkleSearchTree domain_tree(const std::string& domain) const { return domain_sync_.tree(domain); }
+    /**
+     * @brief URLs of a host's page keys; keys it does not know are skipped.
+     */
+    std::vector<std::string> domain_urls(const std::string& domain, const std::vector<Digest256>& keys) const {
+        return domain_sync_.urls(domain, keys);
+    }
+    /**
+     * @brief Offer peer this node's pages on a host (DomainSync). The peer
+     *        pulls the ones it lacks and stops treating them as uncrawled.
+     *        A rebalance does this for every host that moved to another node.
+     */
+    void sync_domain(const std::string& peer, const std::string& domain);
+    DomainSync::Stats domain_sync_stats() const { return domain_sync_.stats(); }
 
 private:
     std::unique_ptr<ContentStore> content_store_;
     std::shared_ptr<p2p_dht::DHTNode> dht_node_;
     std::string dht_topic_ = "urls";
-    std::queue<std::string> frontier_;
+    std::string diff_topic_ = "diffs";
+    UrlSetSync url_sync_;
+    std::unique_ptr<CrawlShards> shards_;  ///< Null without a DHT node or with sharding disabled
+    int url_sync_interval_ms_ = 5000; ///< 0 disables periodic sketch exchange
+    std::priority_queue<FrontierEntry> frontier_;
+    uint64_t frontier_seq_ = 0;
+    SitemapConfig sitemap_config_;
+    std::deque<std::pair<std::string, std::string>> sitemap_queue_; ///< Sitemap URL and its host; guarded by frontier_mutex_
     std::unordered_set<std::string> seen_urls_;
     std::mutex frontier_mutex_;
     std::unordered_map<std::string, RobotsRules> robots_cache_;
-    std::unordered_map<std::string, std::chrono::steady_clock::time_point> last_fetch_time_;
-    int domain_delay_ms_ = 1000;
+    std::mutex robots_mutex_;
+    HostRateLimiter rate_limiter_;
+    FetchFilter fetch_filter_;
     std::mutex seen_mutex_;
-    std::mutex fetch_time_mutex_;
+    std::mutex index_mutex_; ///< InvertedIndex updates are read-modify-write
     InvertedIndex* indexer_ = nullptr;
+    CrawlStats stats_;
+
+    DomainSync domain_sync_;  ///< Pages crawled per host
+    void record_domain_page(const std::string& url, const Digest256& root);
+    void handle_direct_message(const std::string& from_peer, const std::vector<uint8_t>& data);
+    void handle_url_batch(const std::string& from_peer, const std::vector<uint8_t>& data);
+    /**
+     * @brief Add a normalized URL to the frontier, or route it to its owner.
+     * @param force Enqueue here even if seen (a URL this node routed, sent back).
+     */
+    void enqueue_url(const std::string& url, double priority, bool may_route, bool force = false);
+    void rebalance_frontier();
+    void send_url_batches(const std::vector<CrawlShards::Batch>& batches);
 
-    bool fetch_url(const std::string& url, std::string& out_content);
+    bool fetch_url(const std::string& url, std::string& out_content, FetchInfo* info = nullptr,
+                   const FetchFilter* filter = nullptr);
+    bool fetch_stream(const std::string& url, const std::function<bool(const char*, size_t)>& sink,
+                      FetchInfo* info = nullptr);
+    bool perform_fetch(const std::string& url, FetchContext& ctx);
+    void push_frontier_locked(const std::string& url, double priority);
     bool fetch_and_cache_robots(const std::string& domain);
-    bool is_allowed_by_rules(const std::string& url, const RobotsRules& rules) const;
+    bool ingest_queued_sitemap();
     static std::string extract_domain(const std::string& url);
-    void enforce_domain_delay(const std::string& domain);
 };
 
 #endif // CRAWLER_H
\ No newline at end of file
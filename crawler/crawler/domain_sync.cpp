@@ -0,0 +1,235 @@
+#include "domain_sync.h"
+#include "../common/varint.h"
+
+namespace {
+
+void put_string(std::vector<uint8_t>& out, const std::string& value) {
+    put_varint(out, value.size());
+    out.insert(out.end(), value.begin(), value.end());
+}
+
+bool get_string(const uint8_t*& p, const uint8_t* end, std::string& value) {
+    uint64_t size;
+    if (!get_varint(p, end, size) || size > uint64_t(end - p)) return false;
+    value.assign(reinterpret_cast<const char*>(p), size_t(size));
+    p += size;
+    return true;
+}
+
+void put_digest(std::vector<uint8_t>& out, const Digest256& digest) {
+    out.insert(out.end(), digest.bytes.begin(), digest.bytes.end());
+}
+
+bool get_digest(const uint8_t*& p, const uint8_t* end, Digest256& digest) {
+    if (size_t(end - p) < Digest256::kSize) return false;
+    digest = Digest256::from_bytes(reinterpret_cast<const char*>(p));
+    p += Digest256::kSize;
+    return true;
+}
+
+std::vector<uint8_t> header(uint8_t type, const std::string& domain, size_t count) {
+    std::vector<uint8_t> out{type};
+    put_string(out, domain);
+    put_varint(out, count);
+    return out;
+}
+
+/**
+ * @return False unless count fixed-size digests follow exactly.
+ */
+bool get_digests(const uint8_t*& p, const uint8_t* end, std::vector<Digest256>& out) {
+    uint64_t count;
+    if (!get_varint(p, end, count) || count != uint64_t(end - p) / Digest256::kSize ||
+        uint64_t(end - p) % Digest256::kSize != 0) {
+        return false;
+    }
+    out.resize(size_t(count));
+    for (Digest256& digest : out) get_digest(p, end, digest);
+    return true;
+}
+
+} // namespace
+
+DomainSync::DomainSync(HashAlgorithm algorithm) : algorithm_(algorithm) {}
+
+DomainSync::DomainPages& DomainSync::domain_locked(const std::string& domain) {
+    auto it = domains_.find(domain);
+    if (it == domains_.end()) it = domains_.emplace(domain, DomainPages{MerkleSearchTree(algorithm_), {}}).first;
+    return it->second;
+}
+
+void DomainSync::record(const std::string& domain, const std::string& url, const Digest256& root) {
+    Digest256 key = MerkleSearchTree::key_for(url);
+    std::lock_guard<std::mutex> lock(mutex_);
+    DomainPages& pages = domain_locked(domain);
+    pages.tree.insert(key, root);
+    pages.urls.emplace(key, url);
+}
+
+MerkleSearchTree DomainSync::tree(const std::string& domain) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = domains_.find(domain);
+    return it == domains_.end() ? MerkleSearchTree(algorithm_) : it->second.tree;
+}
+
+std::vector<std::string> DomainSync::urls(const std::string& domain, const std::vector<Digest256>& keys) const {
+    std::vector<std::string> out;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = domains_.find(domain);
+    if (it == domains_.end()) return out;
+    for (const Digest256& key : keys) {
+        auto found = it->second.urls.find(key);
+        if (found != it->second.urls.end()) out.push_back(found->second);
+    }
+    return out;
+}
+
+std::vector<std::string> DomainSync::domains() const {
+    std::vector<std::string> out;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& entry : domains_) {
+        if (entry.second.tree.size() > 0) out.push_back(entry.first);
+    }
+    return out;
+}
+
+void DomainSync::set_adopt(std::function<bool(const std::string& domain)> adopt) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    adopt_ = std::move(adopt);
+}
+
+std::vector<uint8_t> DomainSync::announce(const std::string& domain) const {
+    std::vector<uint8_t> out{kRoot};
+    put_string(out, domain);
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = domains_.find(domain);
+    put_digest(out, it == domains_.end() ? Digest256() : it->second.tree.root());
+    return out;
+}
+
+std::vector<uint8_t> DomainSync::after_round_locked(const std::string& key, const std::string& domain,
+                                                    Session& session) {
+    const MstReconciler& reconciler = *session.reconciler;
+    if (!reconciler.done()) {
+        std::vector<uint8_t> out = header(kGetNodes, domain, reconciler.wanted().size());
+        for (const Digest256& hash : reconciler.wanted()) put_digest(out, hash);
+        return out;
+    }
+    if (reconciler.missing().empty()) {
+        sessions_.erase(key);
+        return {};
+    }
+    std::vector<uint8_t> out = header(kGetPages, domain, reconciler.missing().size());
+    for (const MerkleSearchTree::Entry& entry : reconciler.missing()) {
+        session.missing[entry.key] = entry.value;
+        put_digest(out, entry.key);
+    }
+    session.reconciler.reset();
+    return out;
+}
+
+std::vector<uint8_t> DomainSync::handle(const std::string& peer, const uint8_t* data, size_t len,
+                                        std::vector<std::string>& learned) {
+    if (!is_sync_message(data, len)) return {};
+    const uint8_t* p = data + 1;
+    const uint8_t* end = data + len;
+    std::string domain;
+    if (!get_string(p, end, domain)) return {};
+    std::string key = peer + '\n' + domain;
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (data[0] == kRoot) {
+        Digest256 root;
+        if (!get_digest(p, end, root) || p != end) return {};
+        // Any peer may announce any host: only held or adopted ones get an entry
+        auto it = domains_.find(domain);
+        if (it == domains_.end() && !(adopt_ && adopt_(domain))) return {};
+        DomainPages& pages = it != domains_.end() ? it->second : domain_locked(domain);
+        if (root == pages.tree.root()) return {};
+        Session& session = sessions_[key];
+        session = Session();
+        session.reconciler = std::make_unique<MstReconciler>(pages.tree, root);
+        ++stats_.announcements;
+        return after_round_locked(key, domain, session);
+    }
+    if (data[0] == kGetNodes) {
+        std::vector<Digest256> hashes;
+        if (!get_digests(p, end, hashes)) return {};
+        auto it = domains_.find(domain);
+        std::vector<std::string> nodes;
+        if (it != domains_.end()) nodes = it->second.tree.serve(hashes);
+        std::vector<uint8_t> out = header(kNodes, domain, nodes.size());
+        for (const std::string& node : nodes) put_string(out, node);
+        return out;
+    }
+    if (data[0] == kGetPages) {
+        std::vector<Digest256> keys;
+        if (!get_digests(p, end, keys)) return {};
+        auto it = domains_.find(domain);
+        std::vector<uint8_t> body;
+        size_t count = 0;
+        if (it != domains_.end()) {
+            for (const Digest256& page : keys) {
+                auto url = it->second.urls.find(page);
+                Digest256 root;
+                if (url == it->second.urls.end() || !it->second.tree.find(page, &root)) continue;
+                put_string(body, url->second);
+                put_digest(body, root);
+                ++count;
+            }
+        }
+        std::vector<uint8_t> out = header(kPages, domain, count);
+        out.insert(out.end(), body.begin(), body.end());
+        return out;
+    }
+
+    auto session = sessions_.find(key);
+    if (session == sessions_.end()) return {};
+    uint64_t count;
+    if (!get_varint(p, end, count)) return {};
+    if (data[0] == kNodes) {
+        if (!session->second.reconciler) return {};
+        std::vector<std::string> nodes;
+        for (uint64_t i = 0; i < count; ++i) {
+            std::string node;
+            if (!get_string(p, end, node)) return {};
+            nodes.push_back(std::move(node));
+        }
+        if (p != end) return {};
+        MstReconciler& reconciler = *session->second.reconciler;
+        uint64_t before = reconciler.bytes_received();
+        // A node that was not asked for is dropped; the walk goes on with the rest
+        reconciler.receive(nodes);
+        ++stats_.rounds;
+        stats_.nodes_received += nodes.size();
+        stats_.node_bytes += reconciler.bytes_received() - before;
+        return after_round_locked(key, domain, session->second);
+    }
+
+    // kPages: keep the pages that were asked for, with the root the tree announced
+    if (session->second.reconciler) return {};
+    DomainPages& pages = domain_locked(domain);
+    for (uint64_t i = 0; i < count; ++i) {
+        std::string url;
+        Digest256 root;
+        if (!get_string(p, end, url) || !get_digest(p, end, root)) break;
+        Digest256 page = MerkleSearchTree::key_for(url);
+        auto wanted = session->second.missing.find(page);
+        if (wanted == session->second.missing.end() || wanted->second != root) {
+            ++stats_.pages_rejected;
+            continue;
+        }
+        session->second.missing.erase(wanted);
+        pages.tree.insert(page, root);
+        pages.urls[page] = url;
+        learned.push_back(std::move(url));
+        ++stats_.pages_learned;
+    }
+    sessions_.erase(session);
+    return {};
+}
+
+DomainSync::Stats DomainSync::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
@@ -0,0 +1,125 @@
+#ifndef DOMAIN_SYNC_H
+#define DOMAIN_SYNC_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../merkle_tree/merkle_search_tree.h"
+
+/**
+ * @class DomainSync
+ * @brief The pages a crawler has fetched, one MerkleSearchTree per host, and
+ *        the message exchange that pulls a peer's pages for a host.
+ *
+ * A node that has crawled a host announces the host's root to a peer
+ * (announce()). If the peer's root differs, the peer walks the announced tree
+ * with an MstReconciler, one kGetNodes/kNodes round trip per tree level,
+ * then asks for the URLs of the entries it lacks or holds with another page
+ * root. It keeps the pages whose key and root match an entry it asked for:
+ * they go into its own tree and are reported as learned, so the crawler can
+ * skip fetching them again. A session lasts until kPages arrives; a new
+ * announcement from the same peer for the same host replaces it.
+ * Announcements for hosts this node holds no page of are ignored, unless
+ * set_adopt() accepts the host (one the node has just come to own).
+ *
+ * Messages (integers are varints, digests 32 bytes, strings length-prefixed):
+ *   kRoot:     u8 type, host, root
+ *   kGetNodes: u8 type, host, count, node hashes
+ *   kNodes:    u8 type, host, count, node encodings (strings)
+ *   kGetPages: u8 type, host, count, page keys
+ *   kPages:    u8 type, host, count, per page its URL and root
+ *
+ * Thread-safe.
+ */
+class DomainSync {
+public:
+    static constexpr uint8_t kRoot = 0x30;
+    static constexpr uint8_t kGetNodes = 0x31;
+    static constexpr uint8_t kNodes = 0x32;
+    static constexpr uint8_t kGetPages = 0x33;
+    static constexpr uint8_t kPages = 0x34;
+
+    struct Stats {
+        uint64_t announcements = 0;   ///< kRoot messages that started a walk
+        uint64_t rounds = 0;          ///< kNodes answers processed
+        uint64_t nodes_received = 0;
+        uint64_t node_bytes = 0;
+        uint64_t pages_learned = 0;
+        uint64_t pages_rejected = 0;  ///< Not asked for, or with another root
+    };
+
+    explicit DomainSync(HashAlgorithm algorithm = HashAlgorithm::kSha256);
+
+    /**
+     * @brief Add a crawled page to its host's tree, or replace its root.
+     */
+    void record(const std::string& domain, const std::string& url, const Digest256& root);
+
+    /**
+     * @brief Snapshot of a host's tree (empty if the host is unknown).
+     */
+    MerkleSearchTree tree(const std::string& domain) const;
+
+    /**
+     * @brief URLs of a host's page keys; keys it does not know are skipped.
+     */
+    std::vector<std::string> urls(const std::string& domain, const std::vector<Digest256>& keys) const;
+
+    /**
+     * @brief Hosts with at least one page.
+     */
+    std::vector<std::string> domains() const;
+
+    /**
+     * @brief Hosts without a recorded page whose announcements are still
+     *        taken; by default none are.
+     */
+    void set_adopt(std::function<bool(const std::string& domain)> adopt);
+
+    /**
+     * @brief kRoot message opening an exchange about domain.
+     */
+    std::vector<uint8_t> announce(const std::string& domain) const;
+
+    /**
+     * @brief Handle a message from peer. URLs of the pages it taught us are
+     *        appended to learned.
+     * @return Reply to send back, empty when the exchange is over or the
+     *         message is malformed.
+     */
+    std::vector<uint8_t> handle(const std::string& peer, const uint8_t* data, size_t len,
+                                std::vector<std::string>& learned);
+
+    static bool is_sync_message(const uint8_t* data, size_t len) {
+        return len > 0 && data[0] >= kRoot && data[0] <= kPages;
+    }
+
+    Stats stats() const;
+
+private:
+    struct DomainPages {
+        MerkleSearchTree tree;
+        std::unordered_map<Digest256, std::string> urls;  ///< Page key -> URL
+    };
+
+    struct Session {
+        std::unique_ptr<MstReconciler> reconciler;
+        std::unordered_map<Digest256, Digest256> missing;  ///< Page key -> root, once the walk is done
+    };
+
+    const HashAlgorithm algorithm_;
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, DomainPages> domains_;  ///< Node-based: sessions keep references into it
+    std::unordered_map<std::string, Session> sessions_;     ///< Per peer and host
+    std::function<bool(const std::string&)> adopt_;
+    Stats stats_;
+
+    DomainPages& domain_locked(const std::string& domain);
+    std::vector<uint8_t> after_round_locked(const std::string& key, const std::string& domain, Session& session);
+};
+
+#endif // DOMAIN_SYNC_H
@@ -0,0 +1,191 @@
+#include "host_rate_limiter.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Poll interval while a host has no free connection slot; release() wakes waiters earlier.
+constexpr auto kSlotPoll = std::chrono::milliseconds(10);
+// Latency inflation below this many milliseconds is treated as noise.
+constexpr double kLatencyNoiseMs = 10.0;
+// EWMA weights of a new latency sample for the fast (current) and slow (baseline) averages.
+constexpr double kLatencyAlpha = 0.2;
+constexpr double kBaselineAlpha = 0.02;
+
+} // namespace
+
+/**
+ * @brief Construct a rate limiter with default AIMD parameters.
+ */
+HostRateLimiter::HostRateLimiter() : HostRateLimiter(Config()) {}
+
+/**
+ * @brief Construct a rate limiter with the given AIMD parameters.
+ */
+HostRateLimiter::HostRateLimiter(const Config& config) : config_(config) {
+    bandwidth_tokens_ = static_cast<double>(config_.max_bytes_per_sec);
+}
+
+/**
+ * @brief Replace the AIMD parameters. Existing host state is kept and re-clamped.
+ */
+void HostRateLimiter::set_config(const Config& config) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    config_ = config;
+    bandwidth_tokens_ = std::min(bandwidth_tokens_, static_cast<double>(config_.max_bytes_per_sec));
+    for (auto& entry : hosts_) {
+        HostState& state = entry.second;
+        state.window = std::min(state.window, static_cast<double>(config_.max_connections_per_host));
+        state.interval_ms = std::clamp(state.interval_ms,
+            static_cast<double>(config_.min_interval_ms), static_cast<double>(config_.max_interval_ms));
+    }
+    cv_.notify_all();
+}
+
+/**
+ * @brief Current AIMD parameters.
+ */
+HostRateLimiter::Config HostRateLimiter::config() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return config_;
+}
+
+/**
+ * @brief Look up (or create) the controller state for a host. Caller holds mutex_.
+ */
+HostRateLimiter::HostState& HostRateLimiter::state_for(const std::string& host) {
+    auto it = hosts_.find(host);
+    if (it == hosts_.end()) {
+        HostState state;
+        state.interval_ms = std::max(config_.initial_interval_ms, config_.min_interval_ms);
+        it = hosts_.emplace(host, state).first;
+    }
+    return it->second;
+}
+
+/**
+ * @brief Add bandwidth tokens for the elapsed time (burst capped at one second). Caller holds mutex_.
+ */
+void HostRateLimiter::refill_bandwidth_locked(Clock::time_point now) {
+    if (config_.max_bytes_per_sec == 0) return;
+    double elapsed = std::chrono::duration<double>(now - bandwidth_refill_).count();
+    bandwidth_refill_ = now;
+    double cap = static_cast<double>(config_.max_bytes_per_sec);
+    bandwidth_tokens_ = std::min(cap, bandwidth_tokens_ + elapsed * cap);
+}
+
+/**
+ * @brief Time until a fetch to this host may start, zero if it may start now. Caller holds mutex_.
+ */
+HostRateLimiter::Clock::duration HostRateLimiter::wait_locked(HostState& state, Clock::time_point now) {
+    if (now < state.blocked_until) return state.blocked_until - now;
+    if (state.in_flight >= std::max(1, static_cast<int>(state.window))) return kSlotPoll;
+    if (now < state.next_start) return state.next_start - now;
+    if (config_.max_bytes_per_sec > 0 && bandwidth_tokens_ < 0) {
+        double seconds = -bandwidth_tokens_ / static_cast<double>(config_.max_bytes_per_sec);
+        return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+    }
+    return Clock::duration::zero();
+}
+
+/**
+ * @brief How long until a fetch to host could start. Does not reserve a slot.
+ */
+HostRateLimiter::Clock::duration HostRateLimiter::ready_in(const std::string& host) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = Clock::now();
+    refill_bandwidth_locked(now);
+    return wait_locked(state_for(host), now);
+}
+
+/**
+ * @brief Block until the host's window, interval, Retry-After and the global
+ *        bandwidth budget all allow a new fetch, then take a connection slot.
+ */
+void HostRateLimiter::acquire(const std::string& host) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        auto now = Clock::now();
+        refill_bandwidth_locked(now);
+        HostState& state = state_for(host);
+        auto wait = wait_locked(state, now);
+        if (wait <= Clock::duration::zero()) {
+            ++state.in_flight;
+            state.next_start = now + std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double, std::milli>(state.interval_ms));
+            return;
+        }
+        cv_.wait_for(lock, wait);
+    }
+}
+
+/**
+ * @brief Whether an outcome signals that the host (or the path to it) is overloaded.
+ */
+bool HostRateLimiter::congested(const HostState& state, const Outcome& outcome) const {
+    if (outcome.transport_error) return true;
+    if (outcome.http_status == 429 || outcome.http_status >= 500) return true;
+    return state.latency_base_ms > 0
+        && state.latency_ewma_ms > config_.latency_factor * state.latency_base_ms
+        && state.latency_ewma_ms - state.latency_base_ms > kLatencyNoiseMs;
+}
+
+/**
+ * @brief Return a connection slot and apply additive increase / multiplicative decrease.
+ */
+void HostRateLimiter::release(const std::string& host, const Outcome& outcome) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = Clock::now();
+    HostState& state = state_for(host);
+    if (state.in_flight > 0) --state.in_flight;
+    if (config_.max_bytes_per_sec > 0) {
+        refill_bandwidth_locked(now);
+        bandwidth_tokens_ -= static_cast<double>(outcome.bytes);
+    }
+
+    if (!outcome.transport_error) {
+        double latency = outcome.latency_ms;
+        state.latency_ewma_ms = state.latency_ewma_ms == 0
+            ? latency : (1 - kLatencyAlpha) * state.latency_ewma_ms + kLatencyAlpha * latency;
+        // Baseline is a slow average, so only a sustained rise counts as inflation
+        state.latency_base_ms = state.latency_base_ms == 0
+            ? latency : (1 - kBaselineAlpha) * state.latency_base_ms + kBaselineAlpha * latency;
+    }
+
+    const double min_interval = config_.min_interval_ms;
+    const double max_interval = config_.max_interval_ms;
+    if (congested(state, outcome)) {
+        if (outcome.retry_after_s >= 0) {
+            int seconds = std::min(outcome.retry_after_s, config_.max_retry_after_s);
+            state.blocked_until = std::max(state.blocked_until, now + std::chrono::seconds(seconds));
+        }
+        // Decrease at most once per round trip so one burst of failures counts once
+        auto rtt = std::chrono::duration<double, std::milli>(std::max(state.latency_ewma_ms, 1.0));
+        if (now - state.last_decrease >= rtt || outcome.retry_after_s >= 0) {
+            state.window = std::max(1.0, state.window * config_.decrease_factor);
+            state.interval_ms = std::min(max_interval,
+                std::max(state.interval_ms, min_interval) / config_.decrease_factor);
+            state.last_decrease = now;
+            ++state.congestion_events;
+        }
+    } else if (outcome.http_status < 400) {
+        state.window = std::min(static_cast<double>(config_.max_connections_per_host),
+                                state.window + config_.window_step / state.window);
+        state.interval_ms = std::max(min_interval, state.interval_ms - config_.interval_step_ms);
+    }
+    cv_.notify_all();
+}
+
+/**
+ * @brief Snapshot all host controllers.
+ */
+std::vector<HostRateLimiter::HostSnapshot> HostRateLimiter::snapshot() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<HostSnapshot> out;
+    out.reserve(hosts_.size());
+    for (const auto& entry : hosts_) {
+        const HostState& s = entry.second;
+        out.push_back({entry.first, s.in_flight, s.window, s.interval_ms, s.latency_ewma_ms, s.congestion_events});
+    }
+    return out;
+}
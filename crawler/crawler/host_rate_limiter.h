@@ -0,0 +1,114 @@
+#ifndef HOST_RATE_LIMITER_H
+#define HOST_RATE_LIMITER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class HostRateLimiter
+ * @brief Adaptive per-host politeness and concurrency control (AIMD).
+ *
+ * Every host has a connection window (parallel fetches allowed) and a request
+ * interval (minimum spacing between fetch starts). Healthy responses grow the
+ * window and shrink the interval additively; 429/503, transport errors and
+ * latency inflation shrink the window and stretch the interval
+ * multiplicatively, at most once per observed round trip. Retry-After blocks a
+ * host outright. A global token bucket caps total download bandwidth.
+ */
+class HostRateLimiter {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Config {
+        int initial_interval_ms = 1000;   ///< Spacing for a host we know nothing about
+        int min_interval_ms = 50;         ///< Politeness floor even for the fastest hosts
+        int max_interval_ms = 60000;      ///< Backoff ceiling
+        int interval_step_ms = 50;        ///< Additive decrease of the interval per success
+        int max_connections_per_host = 8; ///< Upper bound of the connection window
+        double window_step = 1.0;         ///< Window grows by window_step / window per success
+        double decrease_factor = 0.5;     ///< Multiplicative decrease (window *= f, interval /= f)
+        double latency_factor = 3.0;      ///< Congestion if latency EWMA exceeds factor x baseline
+        int max_retry_after_s = 3600;     ///< Cap on honoured Retry-After values
+        uint64_t max_bytes_per_sec = 0;   ///< Global bandwidth cap (0 = unlimited)
+    };
+
+    /**
+     * @brief Result of a completed fetch, fed back into the controller.
+     */
+    struct Outcome {
+        long http_status = 0;      ///< 0 if the transfer failed before a response
+        bool transport_error = false;
+        double latency_ms = 0;
+        uint64_t bytes = 0;
+        int retry_after_s = -1;    ///< Parsed Retry-After, -1 if absent
+    };
+
+    /**
+     * @brief Snapshot of one host's controller state (for logging and benchmarks).
+     */
+    struct HostSnapshot {
+        std::string host;
+        int in_flight;
+        double window;
+        double interval_ms;
+        double latency_ewma_ms;
+        uint64_t congestion_events;
+    };
+
+    HostRateLimiter();
+    explicit HostRateLimiter(const Config& config);
+
+    void set_config(const Config& config);
+    Config config() const;
+
+    /**
+     * @brief How long until a fetch to host could start (zero if it could start now).
+     *        Does not reserve anything; used to skip busy hosts in the frontier.
+     */
+    Clock::duration ready_in(const std::string& host);
+
+    /**
+     * @brief Block until a fetch to host may start, then take a connection slot.
+     *        Every acquire() must be paired with exactly one release().
+     */
+    void acquire(const std::string& host);
+
+    /**
+     * @brief Return the connection slot and adapt the host's window and interval.
+     */
+    void release(const std::string& host, const Outcome& outcome);
+
+    std::vector<HostSnapshot> snapshot() const;
+
+private:
+    struct HostState {
+        int in_flight = 0;
+        double window = 1.0;
+        double interval_ms = 0;
+        Clock::time_point next_start{};
+        Clock::time_point blocked_until{};
+        Clock::time_point last_decrease{};
+        double latency_ewma_ms = 0;
+        double latency_base_ms = 0;
+        uint64_t congestion_events = 0;
+    };
+
+    Config config_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::unordered_map<std::string, HostState> hosts_;
+    double bandwidth_tokens_ = 0;   ///< Bytes that may still be downloaded (negative = debt)
+    Clock::time_point bandwidth_refill_ = Clock::now();
+
+    HostState& state_for(const std::string& host);
+    Clock::duration wait_locked(HostState& state, Clock::time_point now);
+    void refill_bandwidth_locked(Clock::time_point now);
+    bool congested(const HostState& state, const Outcome& outcome) const;
+};
+
+#endif // HOST_RATE_LIMITER_H
@@ -0,0 +1,176 @@
+#include "host_shards.h"
+#include "../common/digest.h"
+#include "../common/varint.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr size_t kHeaderBytes = 1 + 1 + 10;  ///< Type, flags, URL count
+
+void put_url(std::vector<uint8_t>& out, const CrawlShards::Url& url) {
+    put_varint(out, url.url.size());
+    out.insert(out.end(), url.url.begin(), url.url.end());
+    out.push_back(uint8_t(std::lround(std::min(1.0, std::max(0.0, url.priority)) * 255)));
+}
+
+} // namespace
+
+// ---------------------------------------------------------------- HostRing
+
+HostRing::HostRing(int virtual_nodes) : virtual_nodes_(std::max(1, virtual_nodes)) {}
+
+uint64_t HostRing::position(const std::string& key) {
+    Digest256 digest = Digest256::of(key);
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) value = value << 8 | digest.bytes[i];
+    return value;
+}
+
+bool HostRing::set_members(std::vector<std::string> members) {
+    std::sort(members.begin(), members.end());
+    members.erase(std::unique(members.begin(), members.end()), members.end());
+    if (members == members_) return false;
+    members_ = std::move(members);
+    points_.clear();
+    points_.reserve(members_.size() * size_t(virtual_nodes_));
+    for (size_t m = 0; m < members_.size(); ++m) {
+        for (int i = 0; i < virtual_nodes_; ++i) {
+            points_.emplace_back(position(members_[m] + "#" + std::to_string(i)), uint32_t(m));
+        }
+    }
+    std::sort(points_.begin(), points_.end());
+    return true;
+}
+
+const std::string& HostRing::owner(const std::string& host) const {
+    static const std::string kNone;
+    if (points_.empty()) return kNone;
+    auto it = std::lower_bound(points_.begin(), points_.end(), std::make_pair(position(host), uint32_t(0)));
+    if (it == points_.end()) it = points_.begin();
+    return members_[it->second];
+}
+
+// ---------------------------------------------------------------- CrawlShards
+
+CrawlShards::CrawlShards(const std::string& self, const Config& config)
+    : self_(self), config_(config), ring_(config.virtual_nodes) {
+    ring_.set_members({self_});
+}
+
+bool CrawlShards::set_peers(const std::vector<std::string>& peers) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    peers_ = peers;
+    peers_.erase(std::remove(peers_.begin(), peers_.end(), self_), peers_.end());
+    return update_ring_locked();
+}
+
+bool CrawlShards::leave() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    leaving_ = true;
+    return update_ring_locked();
+}
+
+bool CrawlShards::update_ring_locked() {
+    std::vector<std::string> members = peers_;
+    if (!leaving_ || members.empty()) members.push_back(self_);
+    if (!ring_.set_members(std::move(members))) return false;
+    stats_.members = ring_.members().size();
+    ++stats_.rebalances;
+    return true;
+}
+
+std::string CrawlShards::owner(const std::string& host) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return ring_.owner(host);
+}
+
+bool CrawlShards::full(const Pending& pending) const {
+    return pending.count >= config_.batch_urls || pending.body.size() + kHeaderBytes >= config_.batch_bytes;
+}
+
+void CrawlShards::route(const std::string& owner, const Url& url, std::vector<Batch>& ready) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Pending& pending = pending_[owner];
+    put_url(pending.body, url);
+    ++pending.count;
+    ++stats_.urls_routed;
+    if (full(pending)) ready.push_back(take_locked(owner, kForwardable, pending));
+}
+
+void CrawlShards::hand_off(const std::vector<std::pair<std::string, Url>>& urls, std::vector<Batch>& ready) {
+    std::unordered_map<std::string, Pending> by_owner;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& entry : urls) {
+        Pending& pending = by_owner[entry.first];
+        put_url(pending.body, entry.second);
+        ++pending.count;
+        if (full(pending)) ready.push_back(take_locked(entry.first, kForwardable | kHandOff, pending));
+    }
+    for (auto& entry : by_owner) {
+        if (entry.second.count > 0) ready.push_back(take_locked(entry.first, kForwardable | kHandOff, entry.second));
+    }
+    stats_.urls_handed_off += urls.size();
+}
+
+CrawlShards::Batch CrawlShards::take_locked(const std::string& owner, uint8_t flags, Pending& pending) {
+    std::vector<uint8_t> message;
+    message.reserve(kHeaderBytes + pending.body.size());
+    message.push_back(kUrlBatch);
+    message.push_back(flags);
+    put_varint(message, pending.count);
+    message.insert(message.end(), pending.body.begin(), pending.body.end());
+    pending.body.clear();
+    pending.count = 0;
+    ++stats_.batches_sent;
+    stats_.batch_bytes += message.size();
+    return {owner, std::move(message)};
+}
+
+std::vector<CrawlShards::Batch> CrawlShards::flush() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Batch> out;
+    for (auto& entry : pending_) {
+        if (entry.second.count > 0) out.push_back(take_locked(entry.first, kForwardable, entry.second));
+    }
+    // Queues come back on demand; members that left leave none behind
+    pending_.clear();
+    return out;
+}
+
+std::vector<uint8_t> CrawlShards::encode(uint8_t flags, const std::vector<Url>& urls) {
+    std::vector<uint8_t> message;
+    message.push_back(kUrlBatch);
+    message.push_back(flags);
+    put_varint(message, urls.size());
+    for (const Url& url : urls) put_url(message, url);
+    return message;
+}
+
+bool CrawlShards::decode(const uint8_t* data, size_t len, uint8_t& flags, std::vector<Url>& urls) {
+    if (len < 2 || data[0] != kUrlBatch) return false;
+    flags = data[1];
+    const char* p = reinterpret_cast<const char*>(data) + 2;
+    const char* end = reinterpret_cast<const char*>(data) + len;
+    uint64_t count, size;
+    if (!get_varint(p, end, count)) return false;
+    for (uint64_t i = 0; i < count; ++i) {
+        // The URL and its priority byte; size + 1 could wrap
+        if (!get_varint(p, end, size) || size >= uint64_t(end - p)) return false;
+        std::string url(p, size_t(size));
+        p += size;
+        urls.push_back(Url{std::move(url), uint8_t(*p++) / 255.0});
+    }
+    return p == end;
+}
+
+void CrawlShards::count_received(size_t urls, size_t forwarded) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.urls_received += urls;
+    stats_.urls_forwarded += forwarded;
+}
+
+CrawlShards::Stats CrawlShards::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
@@ -0,0 +1,186 @@
+#ifndef HOST_SHARDS_H
+#define HOST_SHARDS_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * @class HostRing
+ * @brief Consistent hashing of hosts onto crawl nodes.
+ *
+ * Each member ID is placed at virtual_nodes points of a 64-bit ring: the
+ * first eight bytes of the SHA-256 of the ID and the point's index. A host
+ * belongs to the member of the first point at or after the host's own hash,
+ * wrapping around. A member that joins takes over about 1/n of the hosts,
+ * each from the member that held it; one that leaves gives its hosts to the
+ * members of the following points. No other host changes hands. With 128
+ * points per member the busiest member holds about 1.3 times its share.
+ *
+ * Not thread-safe.
+ */
+class HostRing {
+public:
+    static constexpr int kVirtualNodes = 128;
+
+    explicit HostRing(int virtual_nodes = kVirtualNodes);
+
+    /**
+     * @return False if the members were already these (in any order).
+     */
+    bool set_members(std::vector<std::string> members);
+
+    const std::vector<std::string>& members() const { return members_; }
+
+    /**
+     * @brief Member that owns host; empty when there are no members.
+     */
+    const std::string& owner(const std::string& host) const;
+
+    static uint64_t position(const std::string& key);
+
+private:
+    int virtual_nodes_;
+    std::vector<std::string> members_;                   ///< Sorted, unique
+    std::vector<std::pair<uint64_t, uint32_t>> points_;  ///< Ring position and member index, sorted
+};
+
+/**
+ * @class CrawlShards
+ * @brief Host ownership for a group of crawlers, and batching of the URLs a
+ *        crawler finds on hosts it does not own.
+ *
+ * The members are this node and the peers subscribed to the URL topic. The
+ * HostRing gives every host one owner, so a host is crawled, and its rate
+ * limit kept, by a single node. A URL for another member joins that
+ * member's batch. A batch is sent once it holds batch_urls URLs or
+ * batch_bytes, or at the next flush(). When the members change, the crawler
+ * hands the URLs it no longer owns to their new owners (Crawler::refresh_shards).
+ *
+ * A receiver whose view of the members differs from the sender's may not
+ * own a URL it is sent. It forwards such a URL to the owner it sees, without
+ * kForwardable, so a URL travels at most two hops. If that owner is the
+ * sender, which is leaving, the receiver keeps the URL. Handed-off URLs come from
+ * a frontier and have not been crawled, so the receiver enqueues them even if
+ * it has seen them (it may have handed them off itself earlier).
+ *
+ * Batch message (integers are varints):
+ *   kUrlBatch: u8 type, u8 flags (kForwardable, kHandOff), URL count, per URL
+ *              its length, bytes and priority (u8, 255 = 1.0)
+ *
+ * Thread-safe.
+ */
+class CrawlShards {
+public:
+    static constexpr uint8_t kUrlBatch = 0x20;
+    static constexpr uint8_t kForwardable = 1;
+    static constexpr uint8_t kHandOff = 2;
+
+    struct Config {
+        bool enabled = true;
+        size_t batch_urls = 512;
+        size_t batch_bytes = 48 * 1024;
+        int flush_interval_ms = 250;         ///< Longest a routed URL waits in a batch
+        int membership_interval_ms = 5000;   ///< How often the topic peers are listed again
+        int virtual_nodes = HostRing::kVirtualNodes;
+    };
+
+    struct Stats {
+        uint64_t members = 1;
+        uint64_t rebalances = 0;       ///< Membership changes
+        uint64_t urls_routed = 0;      ///< Found here, sent to their owner
+        uint64_t urls_handed_off = 0;  ///< Frontier URLs sent to a new owner on rebalance
+        uint64_t urls_forwarded = 0;   ///< Received for a host this node does not own, passed on
+        uint64_t urls_received = 0;
+        uint64_t batches_sent = 0;
+        uint64_t batch_bytes = 0;
+    };
+
+    struct Url {
+        std::string url;
+        double priority;
+    };
+    using Batch = std::pair<std::string, std::vector<uint8_t>>;  ///< Owner and message
+
+    CrawlShards(const std::string& self, const Config& config);
+
+    const std::string& self() const { return self_; }
+    const Config& config() const { return config_; }
+
+    /**
+     * @brief Set the other members; this node is always one.
+     * @return True if the ring changed.
+     */
+    bool set_peers(const std::vector<std::string>& peers);
+
+    /**
+     * @brief Stop owning hosts: from now on every host belongs to a peer
+     *        (unless there are none). For a node about to shut down.
+     * @return True if the ring changed.
+     */
+    bool leave();
+
+    /**
+     * @brief Owner of host; self() while alone.
+     */
+    std::string owner(const std::string& host) const;
+
+    /**
+     * @brief Queue url for owner. A batch that fills up is moved to ready.
+     */
+    void route(const std::string& owner, const Url& url, std::vector<Batch>& ready);
+
+    /**
+     * @brief Messages handing frontier URLs to their new owners after a
+     *        rebalance, appended to ready.
+     */
+    void hand_off(const std::vector<std::pair<std::string, Url>>& urls, std::vector<Batch>& ready);
+
+    /**
+     * @brief Take every batch that holds URLs.
+     */
+    std::vector<Batch> flush();
+
+    /**
+     * @brief One batch message, for forwarding.
+     */
+    static std::vector<uint8_t> encode(uint8_t flags, const std::vector<Url>& urls);
+
+    /**
+     * @return False if the message is truncated or malformed.
+     */
+    static bool decode(const uint8_t* data, size_t len, uint8_t& flags, std::vector<Url>& urls);
+
+    static bool is_batch_message(const uint8_t* data, size_t len) { return len > 0 && data[0] == kUrlBatch; }
+
+    /**
+     * @brief Count a received batch and the URLs from it passed on.
+     */
+    void count_received(size_t urls, size_t forwarded);
+
+    Stats stats() const;
+
+private:
+    struct Pending {
+        std::vector<uint8_t> body;  ///< Encoded URLs
+        size_t count = 0;
+    };
+
+    const std::string self_;
+    const Config config_;
+    mutable std::mutex mutex_;
+    HostRing ring_;
+    std::vector<std::string> peers_;
+    bool leaving_ = false;
+    std::unordered_map<std::string, Pending> pending_;  ///< Per owner
+    Stats stats_;
+
+    bool update_ring_locked();
+    bool full(const Pending& pending) const;
+    Batch take_locked(const std::string& owner, uint8_t flags, Pending& pending);
+};
+
+#endif // HOST_SHARDS_H
@@ -0,0 +1,393 @@
+#include "html_extractor.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+struct Block {
+    std::string text;
+    size_t link_chars = 0;
+    size_t words = 0;
+    bool boilerplate = false;
+};
+
+enum class BlockClass { kBad, kShort, kGood };
+
+const char* const kRawTextTags[] = {
+    "script", "style", "noscript", "template", "svg", "iframe", "object", "canvas", "select", "math"};
+
+const char* const kBlockTags[] = {
+    "p", "div", "br", "li", "ul", "ol", "td", "th", "tr", "table", "section", "article", "main",
+    "nav", "header", "footer", "aside", "blockquote", "pre", "form", "dd", "dt", "dl", "figure",
+    "figcaption", "hr", "address", "details", "summary", "h1", "h2", "h3", "h4", "h5", "h6",
+    "body", "html", "title", "menu", "caption", "center", "fieldset", "legend", "button"};
+
+// Containers whose nesting we track (to know when a boilerplate region ends).
+const char* const kContainerTags[] = {
+    "div", "section", "article", "main", "nav", "header", "footer", "aside", "ul", "ol",
+    "table", "form", "menu", "span", "p", "li", "center"};
+
+const char* const kBoilerplateTags[] = {"nav", "header", "footer", "aside", "form", "menu"};
+
+const char* const kBoilerplateHints[] = {
+    "nav", "menu", "footer", "sidebar", "breadcrumb", "cookie", "banner", "advert", "social",
+    "share", "comment", "related", "promo", "subscribe", "popup", "modal", "masthead", "toolbar"};
+
+template <size_t N>
+bool in_list(const std::string& name, const char* const (&list)[N]) {
+    for (const char* item : list) {
+        if (name == item) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Append a code point as UTF-8.
+ */
+void append_utf8(std::string& out, unsigned long cp) {
+    if (cp == 0 || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) cp = 0xFFFD;
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+/**
+ * @brief Whether the tag's class or id attribute suggests navigation or other boilerplate.
+ */
+bool has_boilerplate_hint(const std::string& attrs) {
+    if (attrs.empty()) return false;
+    std::string lower = attrs;
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    for (const char* attr : {"class=", "id="}) {
+        size_t pos = lower.find(attr);
+        while (pos != std::string::npos) {
+            // Must be a whole attribute name, not e.g. data-id=
+            if (pos == 0 || std::isspace(static_cast<unsigned char>(lower[pos - 1]))) {
+                size_t start = pos + std::strlen(attr);
+                char quote = start < lower.size() ? lower[start] : ' ';
+                size_t end = (quote == '"' || quote == '\'')
+                    ? lower.find(quote, ++start) : lower.find_first_of(" \t\n", start);
+                std::string value = lower.substr(start, end == std::string::npos ? std::string::npos : end - start);
+                for (const char* hint : kBoilerplateHints) {
+                    if (value.find(hint) != std::string::npos) return true;
+                }
+            }
+            pos = lower.find(attr, pos + 1);
+        }
+    }
+    return false;
+}
+
+size_t count_words(const std::string& text) {
+    size_t words = 0;
+    bool in_word = false;
+    for (char c : text) {
+        bool space = std::isspace(static_cast<unsigned char>(c));
+        if (!space && !in_word) ++words;
+        in_word = !space;
+    }
+    return words;
+}
+
+/**
+ * @brief Find the end of a tag starting at '<' (index of '>'), honouring quoted attribute values.
+ */
+size_t find_tag_end(const std::string& html, size_t pos) {
+    char quote = 0;
+    for (size_t i = pos + 1; i < html.size(); ++i) {
+        char c = html[i];
+        if (quote) {
+            if (c == quote) quote = 0;
+        } else if (c == '"' || c == '\'') {
+            quote = c;
+        } else if (c == '>') {
+            return i;
+        }
+    }
+    return std::string::npos;
+}
+
+/**
+ * @brief Case-insensitive search for "</name" starting at pos.
+ */
+size_t find_closing_tag(const std::string& html, size_t pos, const std::string& name) {
+    while ((pos = html.find("</", pos)) != std::string::npos) {
+        if (strncasecmp(html.c_str() + pos + 2, name.c_str(), name.size()) == 0) return pos;
+        pos += 2;
+    }
+    return std::string::npos;
+}
+
+/**
+ * @brief Mutable state of one extraction pass.
+ */
+class Extraction {
+public:
+    explicit Extraction(ExtractedDocument& doc) : doc_(doc) {}
+
+    void text_char(char c) {
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            pending_space_ = true;
+            return;
+        }
+        std::string& out = target();
+        if (pending_space_ && !out.empty()) {
+            out += ' ';
+            if (link_depth_ > 0 && !in_title_) ++current_.link_chars;
+        }
+        pending_space_ = false;
+        out += c;
+        if (link_depth_ > 0 && !in_title_) ++current_.link_chars;
+    }
+
+    void text(const std::string& s) {
+        for (char c : s) text_char(c);
+    }
+
+    void open_tag(const std::string& name, const std::string& attrs) {
+        if (name == "title") {
+            in_title_ = true;
+            pending_space_ = false;
+            return;
+        }
+        if (in_list(name, kBlockTags)) flush();
+        if (name == "a") ++link_depth_;
+        if (name.size() == 2 && name[0] == 'h' && name[1] >= '1' && name[1] <= '6') in_heading_ = true;
+        if (in_list(name, kContainerTags) || in_list(name, kBoilerplateTags)) {
+            bool boiler = in_list(name, kBoilerplateTags) || has_boilerplate_hint(attrs);
+            stack_.push_back({name, boiler});
+            if (boiler) ++boilerplate_depth_;
+        }
+    }
+
+    void close_tag(const std::string& name) {
+        if (name == "title") {
+            in_title_ = false;
+            return;
+        }
+        if (in_list(name, kBlockTags)) flush();
+        if (name == "a" && link_depth_ > 0) --link_depth_;
+        if (name.size() == 2 && name[0] == 'h' && name[1] >= '1' && name[1] <= '6') in_heading_ = false;
+        // Pop back to the matching container; unmatched close tags are ignored
+        for (size_t i = stack_.size(); i-- > 0;) {
+            if (stack_[i].first != name) continue;
+            for (size_t j = i; j < stack_.size(); ++j) {
+                if (stack_[j].second) --boilerplate_depth_;
+            }
+            stack_.resize(i);
+            break;
+        }
+    }
+
+    void flush() {
+        pending_space_ = false;
+        if (current_.text.empty()) return;
+        current_.words = count_words(current_.text);
+        current_.boilerplate = boilerplate_depth_ > 0;
+        if (current_is_heading_) {
+            if (!current_.boilerplate) doc_.headings.push_back(current_.text);
+        } else {
+            blocks_.push_back(std::move(current_));
+        }
+        current_ = Block();
+        current_is_heading_ = false;
+    }
+
+    std::vector<Block>& blocks() { return blocks_; }
+
+private:
+    ExtractedDocument& doc_;
+    Block current_;
+    bool current_is_heading_ = false;
+    std::vector<Block> blocks_;
+    std::vector<std::pair<std::string, bool>> stack_;
+    int boilerplate_depth_ = 0;
+    int link_depth_ = 0;
+    bool in_title_ = false;
+    bool in_heading_ = false;
+    bool pending_space_ = false;
+
+    std::string& target() {
+        if (in_title_) return doc_.title;
+        if (in_heading_ && current_.text.empty()) current_is_heading_ = true;
+        return current_.text;
+    }
+};
+
+} // namespace
+
+/**
+ * @brief Title, headings and body joined for tokenization.
+ */
+std::string ExtractedDocument::text() const {
+    std::string out = title;
+    for (const auto& heading : headings) {
+        out += '\n';
+        out += heading;
+    }
+    out += '\n';
+    out += body;
+    return out;
+}
+
+HtmlExtractor::HtmlExtractor() : HtmlExtractor(Config()) {}
+
+HtmlExtractor::HtmlExtractor(const Config& config) : config_(config) {}
+
+/**
+ * @brief Decode a character reference body ("amp", "#233", "#xE9").
+ */
+std::string HtmlExtractor::decode_entity(const std::string& name) {
+    std::string out;
+    if (name.size() > 1 && name[0] == '#') {
+        bool hex = name[1] == 'x' || name[1] == 'X';
+        const char* digits = name.c_str() + (hex ? 2 : 1);
+        if (*digits == '\0') return out;
+        char* end = nullptr;
+        unsigned long cp = std::strtoul(digits, &end, hex ? 16 : 10);
+        if (*end != '\0') return out;
+        append_utf8(out, cp);
+        return out;
+    }
+    static const struct { const char* name; unsigned long cp; } kNamed[] = {
+        {"amp", '&'}, {"lt", '<'}, {"gt", '>'}, {"quot", '"'}, {"apos", '\''}, {"nbsp", ' '},
+        {"copy", 0xA9}, {"reg", 0xAE}, {"trade", 0x2122}, {"mdash", 0x2014}, {"ndash", 0x2013},
+        {"hellip", 0x2026}, {"lsquo", 0x2018}, {"rsquo", 0x2019}, {"ldquo", 0x201C}, {"rdquo", 0x201D},
+        {"laquo", 0xAB}, {"raquo", 0xBB}, {"middot", 0xB7}, {"bull", 0x2022}, {"euro", 0x20AC},
+        {"pound", 0xA3}, {"yen", 0xA5}, {"cent", 0xA2}, {"deg", 0xB0}, {"times", 0xD7},
+        {"eacute", 0xE9}, {"egrave", 0xE8}, {"aacute", 0xE1}, {"agrave", 0xE0}, {"uuml", 0xFC},
+        {"ouml", 0xF6}, {"auml", 0xE4}, {"szlig", 0xDF}, {"ccedil", 0xE7}, {"ntilde", 0xF1}};
+    for (const auto& e : kNamed) {
+        if (name == e.name) {
+            append_utf8(out, e.cp);
+            break;
+        }
+    }
+    return out;
+}
+
+/**
+ * @brief Extract title, headings and main-content text from HTML in one pass,
+ *        then classify the resulting blocks.
+ */
+ExtractedDocument HtmlExtractor::extract(const std::string& html) const {
+    ExtractedDocument doc;
+    Extraction state(doc);
+    const size_t n = html.size();
+    size_t i = 0;
+    while (i < n) {
+        char c = html[i];
+        if (c == '<') {
+            if (html.compare(i, 4, "<!--") == 0) {
+                size_t end = html.find("-->", i + 4);
+                i = end == std::string::npos ? n : end + 3;
+                continue;
+            }
+            if (i + 1 < n && (html[i + 1] == '!' || html[i + 1] == '?')) {
+                size_t end = html.find('>', i);
+                i = end == std::string::npos ? n : end + 1;
+                continue;
+            }
+            bool closing = i + 1 < n && html[i + 1] == '/';
+            size_t name_start = i + (closing ? 2 : 1);
+            size_t name_end = name_start;
+            while (name_end < n && std::isalnum(static_cast<unsigned char>(html[name_end]))) ++name_end;
+            if (name_end == name_start) {
+                // Not a tag ("a < b"): literal text
+                state.text_char(c);
+                ++i;
+                continue;
+            }
+            size_t tag_end = find_tag_end(html, i);
+            if (tag_end == std::string::npos) break;
+            std::string name = html.substr(name_start, name_end - name_start);
+            std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+            if (closing) {
+                state.close_tag(name);
+                i = tag_end + 1;
+                continue;
+            }
+            bool self_closing = tag_end > 0 && html[tag_end - 1] == '/';
+            if (in_list(name, kRawTextTags) && !self_closing) {
+                // Skip the element's content wholesale
+                size_t close = find_closing_tag(html, tag_end + 1, name);
+                size_t close_end = close == std::string::npos ? std::string::npos : html.find('>', close);
+                i = close_end == std::string::npos ? n : close_end + 1;
+                continue;
+            }
+            state.open_tag(name, html.substr(name_end, tag_end - name_end));
+            if (self_closing) state.close_tag(name);
+            i = tag_end + 1;
+        } else if (c == '&') {
+            size_t semi = html.find(';', i + 1);
+            if (semi != std::string::npos && semi - i <= 10) {
+                std::string decoded = decode_entity(html.substr(i + 1, semi - i - 1));
+                if (!decoded.empty()) {
+                    state.text(decoded);
+                    i = semi + 1;
+                    continue;
+                }
+            }
+            state.text_char(c);
+            ++i;
+        } else {
+            state.text_char(c);
+            ++i;
+        }
+    }
+    state.flush();
+
+    // Classify blocks, then resolve short blocks from their nearest non-short neighbours
+    std::vector<Block>& blocks = state.blocks();
+    std::vector<BlockClass> cls(blocks.size());
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        const Block& block = blocks[b];
+        double density = block.text.empty() ? 0.0 : static_cast<double>(block.link_chars) / block.text.size();
+        if (block.boilerplate || density > config_.max_link_density || block.words < config_.min_short_words) {
+            cls[b] = BlockClass::kBad;
+        } else {
+            cls[b] = block.words >= config_.min_content_words ? BlockClass::kGood : BlockClass::kShort;
+        }
+    }
+    bool any_good = std::find(cls.begin(), cls.end(), BlockClass::kGood) != cls.end();
+    std::vector<bool> keep(blocks.size(), false);
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        if (cls[b] == BlockClass::kGood) {
+            keep[b] = true;
+        } else if (cls[b] == BlockClass::kShort) {
+            if (!any_good) {
+                // Tiny page without long blocks: keep every non-boilerplate block
+                keep[b] = true;
+                continue;
+            }
+            BlockClass prev = BlockClass::kShort, next = BlockClass::kShort;
+            for (size_t p = b; p-- > 0 && prev == BlockClass::kShort;) prev = cls[p];
+            for (size_t q = b + 1; q < blocks.size() && next == BlockClass::kShort; ++q) next = cls[q];
+            bool prev_ok = prev == BlockClass::kGood || prev == BlockClass::kShort; // kShort here: no neighbour
+            bool next_ok = next == BlockClass::kGood || next == BlockClass::kShort;
+            keep[b] = prev_ok && next_ok;
+        }
+    }
+    doc.blocks_total = blocks.size();
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        if (!keep[b]) continue;
+        if (!doc.body.empty()) doc.body += '\n';
+        doc.body += blocks[b].text;
+        ++doc.blocks_kept;
+    }
+    return doc;
+}
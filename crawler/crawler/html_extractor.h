@@ -0,0 +1,59 @@
+#ifndef HTML_EXTRACTOR_H
+#define HTML_EXTRACTOR_H
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief Text fields recovered from an HTML page.
+ */
+struct ExtractedDocument {
+    std::string title;
+    std::vector<std::string> headings;   ///< h1-h6 text in document order
+    std::string body;                    ///< Main-content blocks, one per line
+    size_t blocks_total = 0;             ///< Text blocks seen
+    size_t blocks_kept = 0;              ///< Blocks classified as main content
+
+    /**
+     * @brief Title, headings and body joined for tokenization.
+     */
+    std::string text() const;
+};
+
+/**
+ * @class HtmlExtractor
+ * @brief Single-pass HTML-to-text extractor with boilerplate removal.
+ *
+ * One scan over the markup splits the page into text blocks at block-level
+ * tags, skipping script/style/noscript/template/svg content and comments and
+ * decoding character references. Each block records its word count, how much
+ * of it is link text and whether it sits inside navigation-like containers
+ * (nav/header/footer/aside or class/id hints such as "menu" or "sidebar").
+ * Blocks are then classified in the style of jusText: long, link-poor blocks
+ * are content, link-heavy or boilerplate-container blocks are dropped, and
+ * short blocks are kept only when surrounded by content.
+ */
+class HtmlExtractor {
+public:
+    struct Config {
+        size_t min_content_words = 10;       ///< Blocks at least this long may be content on their own
+        size_t min_short_words = 3;          ///< Shorter blocks are always dropped
+        double max_link_density = 0.33;      ///< Link characters / all characters
+    };
+
+    HtmlExtractor();
+    explicit HtmlExtractor(const Config& config);
+
+    ExtractedDocument extract(const std::string& html) const;
+
+    /**
+     * @brief Decode one character reference body (without '&' and ';'), e.g. "amp" or "#x41".
+     * @return UTF-8 text, or empty if unknown.
+     */
+    static std::string decode_entity(const std::string& name);
+
+private:
+    Config config_;
+};
+
+#endif // HTML_EXTRACTOR_H
@@ -0,0 +1,270 @@
+#include "sitemap.h"
+#include <zlib.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+// Longest tag or field value kept; anything longer is truncated (URLs are capped at 2,048 by the protocol).
+constexpr size_t kMaxFieldBytes = 4096;
+constexpr size_t kInflateWindow = 16 * 1024;
+
+/**
+ * @brief Trim whitespace and decode the five predefined XML entities.
+ */
+std::string clean_value(const std::string& raw) {
+    size_t start = raw.find_first_not_of(" \t\r\n");
+    if (start == std::string::npos) return "";
+    size_t end = raw.find_last_not_of(" \t\r\n");
+    std::string out;
+    out.reserve(end - start + 1);
+    for (size_t i = start; i <= end; ++i) {
+        if (raw[i] != '&') {
+            out += raw[i];
+            continue;
+        }
+        static const struct { const char* name; char ch; } kEntities[] = {
+            {"&amp;", '&'}, {"&lt;", '<'}, {"&gt;", '>'}, {"&quot;", '"'}, {"&apos;", '\''}};
+        bool matched = false;
+        for (const auto& e : kEntities) {
+            size_t n = std::strlen(e.name);
+            if (raw.compare(i, n, e.name) == 0) {
+                out += e.ch;
+                i += n - 1;
+                matched = true;
+                break;
+            }
+        }
+        if (!matched) out += '&';
+    }
+    return out;
+}
+
+/**
+ * @brief Parse the date part of a W3C datetime (YYYY[-MM[-DD]]...) as UTC midnight.
+ */
+bool parse_w3c_date(const std::string& value, std::time_t& out) {
+    int y = 0, m = 1, d = 1;
+    if (std::sscanf(value.c_str(), "%4d-%2d-%2d", &y, &m, &d) < 1 || y < 1970) return false;
+    std::tm tm{};
+    tm.tm_year = y - 1900;
+    tm.tm_mon = std::clamp(m, 1, 12) - 1;
+    tm.tm_mday = std::clamp(d, 1, 31);
+    out = timegm(&tm);
+    return out != static_cast<std::time_t>(-1);
+}
+
+} // namespace
+
+/**
+ * @brief Frontier priority hint: sitemap <priority> (default 0.5) adjusted by
+ *        how recently the page changed and how often it claims to change.
+ */
+double SitemapEntry::priority_hint(std::time_t now) const {
+    double hint = priority >= 0 ? priority : 0.5;
+    std::time_t modified;
+    if (!lastmod.empty() && parse_w3c_date(lastmod, modified)) {
+        double age_days = std::difftime(now, modified) / 86400.0;
+        if (age_days < 2) hint += 0.3;
+        else if (age_days < 7) hint += 0.2;
+        else if (age_days < 30) hint += 0.1;
+        else if (age_days > 365) hint -= 0.1;
+    }
+    if (changefreq == "always" || changefreq == "hourly" || changefreq == "daily") hint += 0.1;
+    else if (changefreq == "weekly") hint += 0.05;
+    else if (changefreq == "yearly" || changefreq == "never") hint -= 0.1;
+    return std::clamp(hint, 0.0, 1.0);
+}
+
+/**
+ * @brief zlib state for gzipped sitemaps (.xml.gz).
+ */
+struct SitemapParser::Inflater {
+    z_stream stream{};
+    bool ok = false;
+    bool ended = false;  ///< Z_STREAM_END seen; trailing bytes are ignored
+    char window[kInflateWindow];
+
+    Inflater() {
+        // 16 + MAX_WBITS: expect a gzip header
+        ok = inflateInit2(&stream, 16 + MAX_WBITS) == Z_OK;
+    }
+    ~Inflater() {
+        if (ok) inflateEnd(&stream);
+    }
+};
+
+/**
+ * @brief Construct a parser that reports records through on_entry.
+ */
+SitemapParser::SitemapParser(EntryCallback on_entry, size_t max_entries, size_t max_bytes)
+    : on_entry_(std::move(on_entry)), max_entries_(max_entries), max_bytes_(max_bytes) {}
+
+SitemapParser::~SitemapParser() = default;
+
+/**
+ * @brief Push the next chunk; inflates gzip input through a fixed window.
+ */
+bool SitemapParser::feed(const char* data, size_t len) {
+    if (stopped_) return false;
+    if (len == 0) return true;
+    if (!sniffed_) {
+        sniffed_ = true;
+        if (static_cast<unsigned char>(data[0]) == 0x1f) inflater_ = std::make_unique<Inflater>();
+    }
+    if (!inflater_) return parse(data, len);
+    if (!inflater_->ok) return !(stopped_ = true);
+
+    z_stream& zs = inflater_->stream;
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    zs.avail_in = static_cast<uInt>(len);
+    return inflate_pending();
+}
+
+/**
+ * @brief Drain the inflater after the last chunk.
+ */
+bool SitemapParser::finish() {
+    if (stopped_) return false;
+    if (!inflater_ || inflater_->ended) return true;
+    inflater_->stream.avail_in = 0;
+    if (!inflate_pending()) return false;
+    // A gzip stream cut short still yields the records before the cut
+    return inflater_->ended;
+}
+
+/**
+ * @brief Inflate the queued input and parse it. A window that comes back
+ *        full may leave output inside zlib, so inflate runs again until it
+ *        has room to spare.
+ */
+bool SitemapParser::inflate_pending() {
+    z_stream& zs = inflater_->stream;
+    while (!inflater_->ended) {
+        zs.next_out = reinterpret_cast<Bytef*>(inflater_->window);
+        zs.avail_out = kInflateWindow;
+        int rc = inflate(&zs, Z_NO_FLUSH);
+        if (rc == Z_BUF_ERROR) break;  // No input and no output pending: wait for the next chunk
+        if (rc != Z_OK && rc != Z_STREAM_END) return !(stopped_ = true);
+        size_t produced = kInflateWindow - zs.avail_out;
+        if (produced > 0 && !parse(inflater_->window, produced)) return false;
+        if (rc == Z_STREAM_END) inflater_->ended = true;
+        if (zs.avail_in == 0 && zs.avail_out > 0) break;
+    }
+    return true;
+}
+
+/**
+ * @brief Append a character to the current field value (bounded).
+ */
+void SitemapParser::append_text(char c) {
+    if (field_ != Field::kNone && text_.size() < kMaxFieldBytes) text_ += c;
+}
+
+/**
+ * @brief Run the tag/text state machine over decompressed bytes.
+ */
+bool SitemapParser::parse(const char* data, size_t len) {
+    bytes_ += len;
+    if (bytes_ > max_bytes_) return !(stopped_ = true);
+    for (size_t i = 0; i < len && !stopped_; ++i) {
+        char c = data[i];
+        switch (state_) {
+        case State::kText:
+            if (c == '<') {
+                state_ = State::kTag;
+                tag_.clear();
+            } else {
+                append_text(c);
+            }
+            break;
+        case State::kTag:
+            if (c == '>') {
+                state_ = State::kText;
+                handle_tag(tag_);
+                break;
+            }
+            if (tag_.size() < kMaxFieldBytes) tag_ += c;
+            if (tag_ == "!--") {
+                state_ = State::kComment;
+                tag_.clear();
+            } else if (tag_ == "![CDATA[") {
+                state_ = State::kCData;
+                tag_.clear();
+            }
+            break;
+        case State::kComment:
+            // tag_ holds the last two characters to spot "-->"
+            if (c == '>' && tag_ == "--") state_ = State::kText;
+            tag_ += c;
+            if (tag_.size() > 2) tag_.erase(0, tag_.size() - 2);
+            break;
+        case State::kCData:
+            // Same two-character tail trick for "]]>"; the "]]" already copied is dropped
+            if (c == '>' && tag_ == "]]") {
+                if (text_.size() >= 2 && text_.compare(text_.size() - 2, 2, "]]") == 0) text_.resize(text_.size() - 2);
+                state_ = State::kText;
+                break;
+            }
+            append_text(c);
+            tag_ += c;
+            if (tag_.size() > 2) tag_.erase(0, tag_.size() - 2);
+            break;
+        }
+    }
+    return !stopped_;
+}
+
+/**
+ * @brief React to an opening or closing tag (namespaced extensions such as image:loc are ignored).
+ */
+void SitemapParser::handle_tag(const std::string& tag) {
+    if (tag.empty() || tag[0] == '?' || tag[0] == '!') return;
+    bool closing = tag[0] == '/';
+    size_t start = closing ? 1 : 0;
+    size_t end = tag.find_first_of(" \t\r\n/", start);
+    std::string name = tag.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    if (name.find(':') != std::string::npos) return;
+
+    if (!closing) {
+        if (name == "url" || name == "sitemap") {
+            current_ = SitemapEntry();
+            current_.is_index = name == "sitemap";
+            in_record_ = true;
+        } else if (in_record_) {
+            if (name == "loc") field_ = Field::kLoc;
+            else if (name == "lastmod") field_ = Field::kLastmod;
+            else if (name == "changefreq") field_ = Field::kChangefreq;
+            else if (name == "priority") field_ = Field::kPriority;
+            text_.clear();
+        }
+        return;
+    }
+
+    if (name == "url" || name == "sitemap") {
+        if (in_record_ && !current_.loc.empty()) {
+            on_entry_(current_);
+            if (++entries_ >= max_entries_) stopped_ = true;
+        }
+        in_record_ = false;
+        field_ = Field::kNone;
+        return;
+    }
+    if (field_ == Field::kNone) return;
+    std::string value = clean_value(text_);
+    switch (field_) {
+    case Field::kLoc: current_.loc = value; break;
+    case Field::kLastmod: current_.lastmod = value; break;
+    case Field::kChangefreq:
+        std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+        current_.changefreq = value;
+        break;
+    case Field::kPriority:
+        if (!value.empty()) current_.priority = std::clamp(std::atof(value.c_str()), 0.0, 1.0);
+        break;
+    case Field::kNone: break;
+    }
+    field_ = Field::kNone;
+    text_.clear();
+}
@@ -0,0 +1,95 @@
+#ifndef SITEMAP_H
+#define SITEMAP_H
+
+#include <cstddef>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <string>
+
+/**
+ * @brief One <url> or <sitemap> record from a sitemap or sitemap index.
+ */
+struct SitemapEntry {
+    bool is_index = false;   ///< true for <sitemap> (points at another sitemap)
+    std::string loc;
+    std::string lastmod;     ///< W3C datetime as written, may be empty
+    std::string changefreq;  ///< always|hourly|daily|weekly|monthly|yearly|never, may be empty
+    double priority = -1;    ///< <priority> in [0, 1], -1 if absent
+
+    /**
+     * @brief Frontier priority in [0, 1] combining <priority>, lastmod recency and changefreq.
+     *        Recently modified and frequently changing pages are crawled first.
+     */
+    double priority_hint(std::time_t now) const;
+};
+
+/**
+ * @class SitemapParser
+ * @brief Streaming parser for XML sitemaps and sitemap indexes (plain or gzipped).
+ *
+ * Bytes are pushed in arbitrary chunks as they arrive from the network and
+ * records are emitted as soon as their closing tag is seen. Memory use is
+ * bounded by the per-field cap regardless of document size: the document is
+ * never buffered, and gzip input (detected by its magic bytes) is inflated
+ * through a fixed-size window.
+ */
+class SitemapParser {
+public:
+    using EntryCallback = std::function<void(const SitemapEntry& entry)>;
+
+    /**
+     * @param on_entry Called for every complete <url> or <sitemap> record.
+     * @param max_entries Stop after this many records (sitemaps.org allows 50,000).
+     * @param max_bytes Stop after this many (decompressed) bytes (spec limit 50 MB).
+     */
+    explicit SitemapParser(EntryCallback on_entry, size_t max_entries = 50000,
+                           size_t max_bytes = 50 * 1024 * 1024);
+    ~SitemapParser();
+
+    SitemapParser(const SitemapParser&) = delete;
+    SitemapParser& operator=(const SitemapParser&) = delete;
+
+    /**
+     * @brief Push the next chunk of the (possibly gzipped) document.
+     * @return False once a limit is hit or the gzip stream is corrupt; the caller should stop feeding.
+     */
+    bool feed(const char* data, size_t len);
+
+    /**
+     * @brief Parse what is still buffered once the document has been fed.
+     * @return False if a limit was hit or the gzip stream is truncated or corrupt.
+     */
+    bool finish();
+
+    size_t entries() const { return entries_; }
+
+private:
+    enum class State { kText, kTag, kComment, kCData };
+    enum class Field { kNone, kLoc, kLastmod, kChangefreq, kPriority };
+
+    struct Inflater;
+
+    EntryCallback on_entry_;
+    size_t max_entries_;
+    size_t max_bytes_;
+    size_t bytes_ = 0;
+    size_t entries_ = 0;
+    bool sniffed_ = false;
+    bool stopped_ = false;
+    std::unique_ptr<Inflater> inflater_;
+
+    State state_ = State::kText;
+    Field field_ = Field::kNone;
+    bool in_record_ = false;
+    std::string tag_;
+    std::string text_;
+    SitemapEntry current_;
+
+    bool inflate_pending();
+    bool parse(const char* data, size_t len);
+    void handle_tag(const std::string& tag);
+    void append_text(char c);
+};
+
+#endif // SITEMAP_H
@@ -0,0 +1,267 @@
+#include "url_sketch.h"
+#include "../common/digest.h"
+#include "../common/hash_mix.h"
+#include "../common/varint.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+uint32_t check_hash(uint64_t key) { return uint32_t(mix64(key ^ 0xC2B2AE3D27D4EB4Full) >> 32); }
+
+void put_u64(std::vector<uint8_t>& out, uint64_t value) {
+    for (int i = 0; i < 8; ++i) out.push_back(uint8_t(value >> (8 * i)));
+}
+
+bool get_u64(const char*& p, const char* end, uint64_t& value) {
+    if (end - p < 8) return false;
+    value = 0;
+    for (int i = 0; i < 8; ++i) value |= uint64_t(uint8_t(p[i])) << (8 * i);
+    p += 8;
+    return true;
+}
+
+void put_u32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) out.push_back(uint8_t(value >> (8 * i)));
+}
+
+bool get_u32(const char*& p, const char* end, uint32_t& value) {
+    if (end - p < 4) return false;
+    value = 0;
+    for (int i = 0; i < 4; ++i) value |= uint32_t(uint8_t(p[i])) << (8 * i);
+    p += 4;
+    return true;
+}
+
+} // namespace
+
+Iblt::Iblt(int log2_partition) : log2_partition_(log2_partition), cells_(size_t(kHashes) << log2_partition) {}
+
+size_t Iblt::cell_index(uint64_t key, int partition) const {
+    size_t mask = (size_t(1) << log2_partition_) - 1;
+    // Masking the same hash keeps a key's cell in every folded size
+    return (size_t(partition) << log2_partition_) | (mix64(key + uint64_t(partition)) & mask);
+}
+
+void Iblt::update(uint64_t key, int64_t delta) {
+    uint64_t check = check_hash(key);
+    for (int i = 0; i < kHashes; ++i) {
+        Cell& cell = cells_[cell_index(key, i)];
+        cell.count += delta;
+        cell.key_sum ^= key;
+        cell.hash_sum ^= check;
+    }
+}
+
+Iblt Iblt::fold(int log2_partition) const {
+    if (log2_partition > log2_partition_) throw std::invalid_argument("Iblt::fold: cannot grow a table");
+    Iblt out(log2_partition);
+    size_t width = size_t(1) << log2_partition_;
+    size_t mask = (size_t(1) << log2_partition) - 1;
+    for (int i = 0; i < kHashes; ++i) {
+        const Cell* from = &cells_[size_t(i) * width];
+        Cell* to = &out.cells_[size_t(i) << log2_partition];
+        for (size_t j = 0; j < width; ++j) {
+            Cell& cell = to[j & mask];
+            cell.count += from[j].count;
+            cell.key_sum ^= from[j].key_sum;
+            cell.hash_sum ^= from[j].hash_sum;
+        }
+    }
+    return out;
+}
+
+void Iblt::subtract(const Iblt& other) {
+    if (other.log2_partition_ != log2_partition_) throw std::invalid_argument("Iblt::subtract: size mismatch");
+    for (size_t i = 0; i < cells_.size(); ++i) {
+        cells_[i].count -= other.cells_[i].count;
+        cells_[i].key_sum ^= other.cells_[i].key_sum;
+        cells_[i].hash_sum ^= other.cells_[i].hash_sum;
+    }
+}
+
+bool Iblt::peel(std::vector<uint64_t>& positive, std::vector<uint64_t>& negative) const {
+    Iblt work = *this;
+    auto pure = [&](size_t i) {
+        const Cell& cell = work.cells_[i];
+        uint8_t count = uint8_t(cell.count);
+        return (count == 1 || count == 0xFF) && cell.hash_sum == check_hash(cell.key_sum);
+    };
+    std::vector<size_t> queue;
+    for (size_t i = 0; i < work.cells_.size(); ++i) {
+        if (pure(i)) queue.push_back(i);
+    }
+    while (!queue.empty()) {
+        size_t i = queue.back();
+        queue.pop_back();
+        if (!pure(i)) continue;  // Already peeled through another of its cells
+        uint64_t key = work.cells_[i].key_sum;
+        int64_t sign = uint8_t(work.cells_[i].count) == 1 ? 1 : -1;
+        (sign > 0 ? positive : negative).push_back(key);
+        work.update(key, -sign);
+        for (int p = 0; p < kHashes; ++p) {
+            size_t j = work.cell_index(key, p);
+            if (pure(j)) queue.push_back(j);
+        }
+    }
+    for (const Cell& cell : work.cells_) {
+        if (uint8_t(cell.count) != 0 || cell.key_sum != 0 || cell.hash_sum != 0) return false;
+    }
+    return true;
+}
+
+void Iblt::encode(std::vector<uint8_t>& out) const {
+    out.reserve(out.size() + cells_.size() * kCellBytes);
+    for (const Cell& cell : cells_) {
+        out.push_back(uint8_t(cell.count));
+        put_u64(out, cell.key_sum);
+        put_u32(out, cell.hash_sum);
+    }
+}
+
+bool Iblt::decode(const char*& p, const char* end, int log2_partition, Iblt& out) {
+    // Check the size before allocating for an untrusted log2_partition
+    if (log2_partition < 0 || log2_partition > 30 ||
+        (size_t(kHashes) << log2_partition) > size_t(end - p) / kCellBytes) {
+        return false;
+    }
+    out = Iblt(log2_partition);
+    for (Cell& cell : out.cells_) {
+        cell.count = uint8_t(*p++);
+        get_u64(p, end, cell.key_sum);
+        get_u32(p, end, cell.hash_sum);
+    }
+    return true;
+}
+
+UrlSetSync::UrlSetSync() : sketch_(kMaxLog2Partition) {}
+
+uint64_t UrlSetSync::fingerprint(const std::string& url) {
+    Digest256 digest = Digest256::of(url);
+    uint64_t value;
+    std::memcpy(&value, digest.bytes.data(), sizeof(value));
+    return value;
+}
+
+bool UrlSetSync::add(const std::string& url) {
+    uint64_t key = fingerprint(url);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!urls_.emplace(key, url).second) return false;
+    sketch_.insert(key);
+    return true;
+}
+
+size_t UrlSetSync::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return urls_.size();
+}
+
+UrlSetSync::Stats UrlSetSync::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+int UrlSetSync::log2_partition_for(uint64_t d) {
+    // 1.5 cells per key plus slack for small differences, over kHashes partitions
+    uint64_t cells = d / 2 + 8;
+    int log2 = kMinLog2Partition;
+    while (log2 < kMaxLog2Partition && (uint64_t(1) << log2) < cells) ++log2;
+    return log2;
+}
+
+std::vector<uint8_t> UrlSetSync::sketch(const std::string& peer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = last_difference_.find(peer);
+    // New discoveries since the last exchange: expect up to twice the last difference
+    uint64_t expected = it == last_difference_.end() ? 64 : 2 * it->second;
+    return sketch_locked(log2_partition_for(expected));
+}
+
+std::vector<uint8_t> UrlSetSync::sketch_locked(int log2_partition) {
+    std::vector<uint8_t> out;
+    out.push_back(kSketch);
+    put_varint(out, uint64_t(log2_partition));
+    put_varint(out, urls_.size());
+    sketch_.fold(log2_partition).encode(out);
+    ++stats_.sketches_sent;
+    stats_.sketch_bytes += out.size();
+    return out;
+}
+
+std::vector<uint8_t> UrlSetSync::resolve_locked(const std::vector<uint64_t>& send, const std::vector<uint64_t>& want) {
+    std::vector<const std::string*> urls;
+    for (uint64_t key : send) {
+        auto it = urls_.find(key);
+        if (it != urls_.end()) urls.push_back(&it->second);  // Skip fingerprints the peer misremembered
+    }
+    std::vector<uint8_t> out;
+    out.push_back(kResolve);
+    put_varint(out, urls.size());
+    for (const std::string* url : urls) {
+        put_varint(out, url->size());
+        out.insert(out.end(), url->begin(), url->end());
+    }
+    put_varint(out, want.size());
+    for (uint64_t key : want) put_u64(out, key);
+    stats_.resolve_bytes += out.size();
+    return out;
+}
+
+std::vector<uint8_t> UrlSetSync::handle(const std::string& peer, const uint8_t* data, size_t len,
+                                        std::vector<std::string>& learned) {
+    const char* p = reinterpret_cast<const char*>(data);
+    const char* end = p + len;
+    if (!is_sync_message(data, len)) return {};
+    uint8_t type = uint8_t(*p++);
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (type == kSketch) {
+        uint64_t log2, their_size;
+        Iblt diff(0);
+        if (!get_varint(p, end, log2) || !get_varint(p, end, their_size) || log2 < uint64_t(kMinLog2Partition) ||
+            log2 > uint64_t(kMaxLog2Partition) || !Iblt::decode(p, end, int(log2), diff) || p != end) {
+            return {};
+        }
+        uint64_t gap = their_size > urls_.size() ? their_size - urls_.size() : urls_.size() - their_size;
+        std::vector<uint64_t> theirs, ours;
+        if (int(log2) >= log2_partition_for(gap)) {
+            diff.subtract(sketch_.fold(int(log2)));
+            if (diff.peel(theirs, ours)) {
+                ++stats_.decoded;
+                last_difference_[peer] = theirs.size() + ours.size();
+                if (theirs.empty() && ours.empty()) return {};
+                return resolve_locked(ours, theirs);
+            }
+        }
+        ++stats_.decode_failures;
+        if (int(log2) >= kMaxLog2Partition) return {};  // Too far apart for a sketch; retry next period
+        int next = std::min(kMaxLog2Partition, std::max(int(log2) + 2, log2_partition_for(gap)));
+        last_difference_[peer] = std::max<uint64_t>(last_difference_[peer], uint64_t(1) << next);
+        return sketch_locked(next);
+    }
+
+    uint64_t count;
+    if (!get_varint(p, end, count)) return {};
+    std::vector<std::string> urls;
+    for (uint64_t i = 0; i < count; ++i) {
+        uint64_t size;
+        if (!get_varint(p, end, size) || size > uint64_t(end - p)) return {};
+        urls.emplace_back(p, size_t(size));
+        p += size;
+    }
+    uint64_t wanted;
+    if (!get_varint(p, end, wanted) || wanted != uint64_t(end - p) / 8 || uint64_t(end - p) % 8 != 0) return {};
+    std::vector<uint64_t> want(static_cast<size_t>(wanted));
+    for (uint64_t& key : want) get_u64(p, end, key);
+    for (std::string& url : urls) {
+        uint64_t key = fingerprint(url);
+        if (!urls_.emplace(key, url).second) continue;
+        sketch_.insert(key);
+        ++stats_.urls_learned;
+        learned.push_back(std::move(url));
+    }
+    last_difference_[peer] = urls.size() + want.size();
+    if (want.empty()) return {};
+    return resolve_locked(want, {});
+}
@@ -0,0 +1,176 @@
+#ifndef URL_SKETCH_H
+#define URL_SKETCH_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class Iblt
+ * @brief Invertible Bloom lookup table over 64-bit keys.
+ *
+ * Every key is added to one cell in each of kHashes partitions of equal size;
+ * a cell keeps the count, the XOR of its keys and the XOR of their 32-bit
+ * check hashes. Counts are compared modulo 256 (a cell that holds one key
+ * has count 1 or -1), so a cell travels in 13 bytes. Subtracting a peer's
+ * table cancels the keys both sides have, and the difference is listed by
+ * peeling cells that hold a single key. Peeling succeeds with high
+ * probability once there are about 1.3 cells per differing key, however
+ * large the sets are.
+ *
+ * The partition size is a power of two, and a table folds to any smaller
+ * power of two by adding the upper half of each partition onto the lower
+ * half. One table sized for the largest difference therefore yields a
+ * sketch of every smaller size without being rebuilt.
+ */
+class Iblt {
+public:
+    static constexpr int kHashes = 3;
+    static constexpr size_t kCellBytes = 13;
+
+    struct Cell {
+        int64_t count = 0;
+        uint64_t key_sum = 0;
+        uint32_t hash_sum = 0;
+    };
+
+    /**
+     * @param log2_partition Each partition has 2^log2_partition cells.
+     */
+    explicit Iblt(int log2_partition);
+
+    void insert(uint64_t key) { update(key, 1); }
+    void erase(uint64_t key) { update(key, -1); }
+
+    int log2_partition() const { return log2_partition_; }
+    size_t size() const { return cells_.size(); }
+
+    /**
+     * @brief This table folded to 2^log2_partition cells per partition.
+     * @throws std::invalid_argument if that is larger than this table.
+     */
+    Iblt fold(int log2_partition) const;
+
+    /**
+     * @brief Subtract other cell by cell.
+     * @throws std::invalid_argument if the sizes differ.
+     */
+    void subtract(const Iblt& other);
+
+    /**
+     * @brief List the keys of a subtracted table: positive ones were only in
+     *        this table, negative ones only in the other.
+     * @return False if peeling got stuck (the difference is too large for
+     *         the table); the lists then hold what was recovered.
+     */
+    bool peel(std::vector<uint64_t>& positive, std::vector<uint64_t>& negative) const;
+
+    /**
+     * @brief Append the cells: per cell the low byte of the count, the key
+     *        sum (8 bytes) and the check sum (4 bytes), little-endian.
+     */
+    void encode(std::vector<uint8_t>& out) const;
+
+    /**
+     * @return False if the record is truncated, malformed or not a table of
+     *         2^log2_partition cells per partition.
+     */
+    static bool decode(const char*& p, const char* end, int log2_partition, Iblt& out);
+
+private:
+    int log2_partition_;
+    std::vector<Cell> cells_;
+
+    void update(uint64_t key, int64_t delta);
+    size_t cell_index(uint64_t key, int partition) const;
+};
+
+/**
+ * @class UrlSetSync
+ * @brief The set of URLs a crawler has seen, reconciled with peers through
+ *        IBLT sketches instead of per-URL gossip.
+ *
+ * Each URL is keyed by a 64-bit fingerprint (the first eight bytes of its
+ * SHA-256) and added once to a sketch of kMaxLog2Partition. To sync with a
+ * peer, sketch() folds it to a size guessed from the difference the last
+ * exchange with that peer decoded. The peer subtracts its own sketch folded
+ * to the same size and peels the difference. It answers with the URLs the
+ * sender lacks and the fingerprints it lacks itself, and the sender answers
+ * those with URLs. A sketch that does not peel is answered with the peer's
+ * own sketch at four times the size, so a bad guess costs one more round
+ * trip, not a full transfer. The size gap between the sets bounds the
+ * difference from below and skips sizes that cannot work.
+ *
+ * Messages (integers are varints):
+ *   kSketch:  u8 type, log2 partition, set size, cells (Iblt::encode)
+ *   kResolve: u8 type, URL count, per URL its length and bytes,
+ *             wanted count, wanted fingerprints (8 bytes each)
+ *
+ * Thread-safe.
+ */
+class UrlSetSync {
+public:
+    static constexpr uint8_t kSketch = 0x10;
+    static constexpr uint8_t kResolve = 0x11;
+    static constexpr int kMinLog2Partition = 3;
+    static constexpr int kMaxLog2Partition = 15;  ///< 98,304 cells, decodes ~75,000 differences
+
+    struct Stats {
+        uint64_t sketches_sent = 0;
+        uint64_t sketch_bytes = 0;
+        uint64_t resolve_bytes = 0;
+        uint64_t decoded = 0;           ///< Sketches that peeled
+        uint64_t decode_failures = 0;   ///< Sketches answered with a larger one
+        uint64_t urls_learned = 0;
+    };
+
+    UrlSetSync();
+
+    static uint64_t fingerprint(const std::string& url);
+
+    /**
+     * @return False if the URL was already in the set.
+     */
+    bool add(const std::string& url);
+
+    size_t size() const;
+
+    /**
+     * @brief Sketch message opening an exchange with peer.
+     */
+    std::vector<uint8_t> sketch(const std::string& peer);
+
+    /**
+     * @brief Handle a message from peer. URLs it taught us are added to the
+     *        set and appended to learned.
+     * @return Reply to send back, empty when the exchange is over or the
+     *         message is malformed.
+     */
+    std::vector<uint8_t> handle(const std::string& peer, const uint8_t* data, size_t len,
+                                std::vector<std::string>& learned);
+
+    static bool is_sync_message(const uint8_t* data, size_t len) {
+        return len > 0 && (data[0] == kSketch || data[0] == kResolve);
+    }
+
+    Stats stats() const;
+
+private:
+    mutable std::mutex mutex_;
+    Iblt sketch_;
+    std::unordered_map<uint64_t, std::string> urls_;
+    std::unordered_map<std::string, uint64_t> last_difference_;  ///< Per peer
+    Stats stats_;
+
+    /**
+     * @brief Smallest partition expected to peel a difference of d keys.
+     */
+    static int log2_partition_for(uint64_t d);
+
+    std::vector<uint8_t> sketch_locked(int log2_partition);
+    std::vector<uint8_t> resolve_locked(const std::vector<uint64_t>& send, const std::vector<uint64_t>& want);
+};
+
+#endif // URL_SKETCH_H
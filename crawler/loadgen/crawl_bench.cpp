@@ -0,0 +1,202 @@
+// crawl_bench.cpp
+// Crawl load generator: runs Crawler::run_concurrent against a local SyntheticWeb
+//
+// Usage: crawl_bench [--hosts 4] [--pages-per-host 1000] [--threads 16]
+//                    [--max-pages 2000] [--latency-ms 20] [--latency-sigma 0.5]
+//                    [--error-rate 0.01] [--redirect-rate 0.05] [--fanout 10]
+//                    [--min-bytes 2048] [--max-bytes 65536] [--delay-ms 0]
+//                    [--throttle-rate 0] [--max-conns 8] [--min-interval-ms 0]
+//                    [--bandwidth 0] [--sitemaps 1] [--index 1] [--compress 0]
+//                    [--packs 0] [--port 18080] [--seed 42]
+//
+// The synthetic web is served from a forked child process so that the CPU time
+// reported per page belongs to the crawler alone.
+
+#include "synthetic_web.h"
+#include "httplib.h"
+#include "../crawler/crawler.h"
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+struct BenchArgs {
+    SyntheticWeb::Config web;
+    int threads = 16;
+    int max_pages = 2000;
+    int delay_ms = 0;
+    bool index = true;
+    HostRateLimiter::Config limits;
+    ContentStore::Config store;
+};
+
+void parse_args(int argc, char* argv[], BenchArgs& args) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const char* flag = argv[i];
+        const char* value = argv[i + 1];
+        if (std::strcmp(flag, "--hosts") == 0) args.web.num_hosts = std::stoi(value);
+        else if (std::strcmp(flag, "--pages-per-host") == 0) args.web.pages_per_host = std::stoi(value);
+        else if (std::strcmp(flag, "--threads") == 0) args.threads = std::stoi(value);
+        else if (std::strcmp(flag, "--max-pages") == 0) args.max_pages = std::stoi(value);
+        else if (std::strcmp(flag, "--latency-ms") == 0) args.web.latency_median_ms = std::stod(value);
+        else if (std::strcmp(flag, "--latency-sigma") == 0) args.web.latency_sigma = std::stod(value);
+        else if (std::strcmp(flag, "--error-rate") == 0) args.web.error_rate = std::stod(value);
+        else if (std::strcmp(flag, "--redirect-rate") == 0) args.web.redirect_rate = std::stod(value);
+        else if (std::strcmp(flag, "--fanout") == 0) args.web.links_per_page = std::stoi(value);
+        else if (std::strcmp(flag, "--min-bytes") == 0) args.web.min_page_bytes = std::stoul(value);
+        else if (std::strcmp(flag, "--max-bytes") == 0) args.web.max_page_bytes = std::stoul(value);
+        else if (std::strcmp(flag, "--delay-ms") == 0) args.delay_ms = std::stoi(value);
+        else if (std::strcmp(flag, "--throttle-rate") == 0) args.web.throttle_rate = std::stod(value);
+        else if (std::strcmp(flag, "--max-conns") == 0) args.limits.max_connections_per_host = std::stoi(value);
+        else if (std::strcmp(flag, "--min-interval-ms") == 0) args.limits.min_interval_ms = std::stoi(value);
+        else if (std::strcmp(flag, "--bandwidth") == 0) args.limits.max_bytes_per_sec = std::stoull(value);
+        else if (std::strcmp(flag, "--sitemaps") == 0) args.web.sitemaps = std::stoi(value) != 0;
+        else if (std::strcmp(flag, "--index") == 0) args.index = std::stoi(value) != 0;
+        else if (std::strcmp(flag, "--compress") == 0) args.store.compress_blocks = std::stoi(value) != 0;
+        else if (std::strcmp(flag, "--packs") == 0) {
+            args.store.block_storage = std::stoi(value) != 0 ? ContentStore::BlockStorage::kPackFiles
+                                                             : ContentStore::BlockStorage::kLevelDb;
+        }
+        else if (std::strcmp(flag, "--port") == 0) args.web.base_port = std::stoi(value);
+        else if (std::strcmp(flag, "--seed") == 0) args.web.seed = std::stoull(value);
+        else std::cerr << "Ignoring unknown flag " << flag << std::endl;
+    }
+}
+
+double cpu_seconds() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6
+         + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+/**
+ * @brief Poll every host's robots.txt until all servers answer (or give up).
+ */
+bool wait_for_servers(const SyntheticWeb& web, int num_hosts) {
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        bool all_up = true;
+        for (int host = 0; host < num_hosts && all_up; ++host) {
+            httplib::Client client(web.host_url(host));
+            client.set_connection_timeout(0, 100000);
+            auto res = client.Get("/robots.txt");
+            all_up = res && res->status == 200;
+        }
+        if (all_up) return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return false;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    BenchArgs args;
+    args.limits.min_interval_ms = 0;
+    parse_args(argc, argv, args);
+    SyntheticWeb web(args.web);
+
+    pid_t server_pid = fork();
+    if (server_pid < 0) {
+        std::perror("fork");
+        return 1;
+    }
+    if (server_pid == 0) {
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, SIGTERM);
+        sigprocmask(SIG_BLOCK, &set, nullptr);
+        prctl(PR_SET_PDEATHSIG, SIGTERM); // don't outlive a crashed or interrupted parent
+        if (!web.start()) _exit(1);
+        int sig = 0;
+        sigwait(&set, &sig);
+        web.stop();
+        _exit(0);
+    }
+
+    int rc = 0;
+    if (!wait_for_servers(web, args.web.num_hosts)) {
+        std::cerr << "Synthetic web did not come up" << std::endl;
+        rc = 1;
+    } else {
+        std::string db_path = (std::filesystem::temp_directory_path()
+            / ("crawl_bench_db_" + std::to_string(getpid()))).string();
+        {
+            std::unique_ptr<InvertedIndex> index;
+            if (args.index) index = std::make_unique<InvertedIndex>(db_path + "_index");
+            Crawler crawler(db_path, nullptr, args.store);
+            crawler.set_indexer(index.get());
+            args.limits.initial_interval_ms = args.delay_ms;
+            crawler.set_rate_limits(args.limits);
+            crawler.add_seed_urls(web.seed_urls());
+
+            // Crawler logs every step to stdout; keep it out of the measurement output
+            std::ostringstream sink;
+            auto* saved = std::cout.rdbuf(sink.rdbuf());
+            double cpu_start = cpu_seconds();
+            auto wall_start = std::chrono::steady_clock::now();
+            crawler.run_concurrent(args.threads, args.max_pages);
+            double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+            double cpu = cpu_seconds() - cpu_start;
+            std::cout.rdbuf(saved);
+
+            const CrawlStats& stats = crawler.stats();
+            uint64_t pages = stats.pages_processed.load();
+            ContentStore::Stats store = crawler.content_store().stats();
+            std::cout << std::fixed << std::setprecision(2)
+                      << "hosts=" << args.web.num_hosts << " threads=" << args.threads
+                      << " latency_median_ms=" << args.web.latency_median_ms << "\n"
+                      << "pages_processed   " << pages << " (unchanged " << stats.pages_unchanged.load() << ")\n"
+                      << "fetches           " << stats.fetches_attempted.load()
+                      << " (failed " << stats.fetches_failed.load() << ")\n"
+                      << "bytes_downloaded  " << stats.bytes_downloaded.load() << "\n"
+                      << "throttled (429)   " << stats.throttled_responses.load() << "\n"
+                      << "filtered          type=" << stats.aborted_content_type.load()
+                      << " size=" << stats.aborted_too_large.load()
+                      << " extension=" << stats.urls_filtered.load()
+                      << " bytes_avoided=" << stats.bytes_avoided.load() << "\n"
+                      << "sitemaps          " << stats.sitemaps_fetched.load()
+                      << " (urls " << stats.sitemap_urls.load() << ")\n"
+                      << "charset           transcoded=" << stats.transcoded_pages.load()
+                      << " replacements=" << stats.utf8_replacements.load() << "\n"
+                      << "store             written=" << store.blocks_written
+                      << " dedup=" << store.blocks_deduplicated << " gets=" << store.existence_checks
+                      << " batches=" << store.batches << " commits=" << store.group_commits
+                      << " versions=" << store.page_versions << " manifest_bytes=" << store.manifest_bytes << "\n"
+                      << "store_bytes       blocks=" << store.block_bytes << " stored=" << store.stored_bytes
+                      << " ratio=" << (store.stored_bytes ? double(store.block_bytes) / store.stored_bytes : 0.0)
+                      << " dictionaries=" << store.dictionaries << " packs=" << store.pack_files << "\n"
+                      << "diffs             " << stats.diffs_published.load()
+                      << " (bytes " << stats.diff_bytes.load() << ")\n"
+                      << "text_indexed      " << stats.text_bytes_indexed.load()
+                      << " bytes (boilerplate blocks " << stats.boilerplate_blocks.load() << ")\n"
+                      << "wall_seconds      " << wall << "\n"
+                      << "pages_per_sec     " << (wall > 0 ? pages / wall : 0.0) << "\n"
+                      << "fetch_p50_ms      " << stats.fetch_latency_us.percentile(50) / 1000.0 << "\n"
+                      << "fetch_p99_ms      " << stats.fetch_latency_us.percentile(99) / 1000.0 << "\n"
+                      << "cpu_ms_per_page   " << (pages ? cpu * 1000.0 / pages : 0.0) << std::endl;
+            for (const auto& host : crawler.rate_limiter().snapshot()) {
+                std::cout << "  host " << host.host << " window=" << host.window
+                          << " interval_ms=" << host.interval_ms << " latency_ewma_ms=" << host.latency_ewma_ms
+                          << " backoffs=" << host.congestion_events << "\n";
+            }
+        }
+        std::error_code ec;
+        std::filesystem::remove_all(db_path, ec);
+        std::filesystem::remove_all(db_path + "_index", ec);
+    }
+
+    kill(server_pid, SIGTERM);
+    waitpid(server_pid, nullptr, 0);
+    return rc;
+}
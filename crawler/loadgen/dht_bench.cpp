@@ -0,0 +1,156 @@
+// dht_bench.cpp
+// Kademlia load generator: starts many nodes on 127.0.0.1 in one event loop,
+// joins them one by one, then measures lookup latency, hops and requests
+//
+// Usage: dht_bench [--nodes 1000] [--lookups 2000] [--values 200] [--concurrency 32]
+//                  [--k 20] [--alpha 3] [--timeout-ms 1000] [--seed 42]
+
+#include "kademlia.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using p2p_dht::KademliaNode;
+using p2p_dht::NodeId;
+
+struct BenchArgs {
+    int nodes = 1000;
+    int lookups = 2000;
+    int values = 200;
+    int concurrency = 32;
+    KademliaNode::Config config;
+    uint64_t seed = 42;
+};
+
+void parse_args(int argc, char* argv[], BenchArgs& args) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const char* flag = argv[i];
+        const char* value = argv[i + 1];
+        if (std::strcmp(flag, "--nodes") == 0) args.nodes = std::stoi(value);
+        else if (std::strcmp(flag, "--lookups") == 0) args.lookups = std::stoi(value);
+        else if (std::strcmp(flag, "--values") == 0) args.values = std::stoi(value);
+        else if (std::strcmp(flag, "--concurrency") == 0) args.concurrency = std::stoi(value);
+        else if (std::strcmp(flag, "--k") == 0) args.config.k = std::stoul(value);
+        else if (std::strcmp(flag, "--alpha") == 0) args.config.alpha = std::stoul(value);
+        else if (std::strcmp(flag, "--timeout-ms") == 0) args.config.rpc_timeout_ms = std::stoi(value);
+        else if (std::strcmp(flag, "--seed") == 0) args.seed = std::stoull(value);
+        else std::cerr << "Ignoring unknown flag " << flag << std::endl;
+    }
+}
+
+/**
+ * @brief Runs async lookups with at most `concurrency` in flight and gathers their results.
+ */
+class LookupRunner {
+public:
+    explicit LookupRunner(int concurrency) : concurrency_(concurrency) {}
+
+    template <typename Start>
+    void run(int count, Start start) {
+        for (int i = 0; i < count; ++i) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                done_.wait(lock, [&] { return inflight_ < concurrency_; });
+                ++inflight_;
+            }
+            start(i, [this](const KademliaNode::LookupResult& result, bool ok) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                results_.push_back(result);
+                failures_ += ok ? 0 : 1;
+                --inflight_;
+                done_.notify_all();
+            });
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [&] { return inflight_ == 0; });
+    }
+
+    void report(const char* name) {
+        std::vector<double> latency;
+        double hops = 0, queries = 0;
+        int max_hops = 0;
+        for (const auto& result : results_) {
+            latency.push_back(result.latency_ms);
+            hops += result.hops;
+            queries += result.queries;
+            max_hops = std::max(max_hops, result.hops);
+        }
+        std::sort(latency.begin(), latency.end());
+        auto pct = [&](double p) { return latency[size_t(p * (latency.size() - 1))]; };
+        double n = double(results_.size());
+        std::cout << std::left << std::setw(12) << name << std::right << std::setw(6) << results_.size()
+                  << " lookups" << std::setw(5) << failures_ << " missed" << std::fixed << std::setprecision(2)
+                  << "  latency p50 " << pct(0.5) << " p90 " << pct(0.9) << " p99 " << pct(0.99) << " ms"
+                  << "  hops mean " << hops / n << " max " << max_hops << "  queries mean " << queries / n
+                  << std::endl;
+        results_.clear();
+        failures_ = 0;
+    }
+
+private:
+    int concurrency_;
+    std::mutex mutex_;
+    std::condition_variable done_;
+    int inflight_ = 0;
+    int failures_ = 0;
+    std::vector<KademliaNode::LookupResult> results_;
+};
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    BenchArgs args;
+    parse_args(argc, argv, args);
+    std::mt19937_64 rng(args.seed);
+
+    auto loop = std::make_shared<p2p_dht::EventLoop>();
+    std::vector<std::shared_ptr<KademliaNode>> nodes;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < args.nodes; ++i) {
+        nodes.push_back(std::make_shared<KademliaNode>("127.0.0.1", 0, args.config, loop));
+        if (i > 0) nodes.back()->join({nodes[rng() % i]->contact().address()});
+    }
+    double join_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    size_t table = 0;
+    for (auto& node : nodes) table += node->routing_table_size();
+    std::cout << args.nodes << " nodes joined in " << std::fixed << std::setprecision(2) << join_s << " s, "
+              << double(table) / nodes.size() << " contacts per routing table" << std::endl;
+
+    LookupRunner runner(args.concurrency);
+    runner.run(args.lookups, [&](int, auto done) {
+        size_t from_index = rng() % nodes.size();
+        size_t to_index = (from_index + 1 + rng() % (nodes.size() - 1)) % nodes.size();
+        auto& from = nodes[from_index];
+        NodeId target = nodes[to_index]->id();
+        from->find_node(target, [done, target](const KademliaNode::LookupResult& result) {
+            done(result, !result.closest.empty() && result.closest.front().id == target);
+        });
+    });
+    runner.report("find_node");
+
+    std::vector<NodeId> keys;
+    for (int i = 0; i < args.values; ++i) {
+        keys.push_back(KademliaNode::key_for("key-" + std::to_string(i)));
+        nodes[rng() % nodes.size()]->put(keys.back(), "value-" + std::to_string(i));
+    }
+    // Puts are asynchronous: give the stores time to land before looking them up
+    std::this_thread::sleep_for(std::chrono::seconds(2));
+    runner.run(args.values, [&](int i, auto done) {
+        nodes[rng() % nodes.size()]->find_value(keys[i], [done](const KademliaNode::LookupResult& result) {
+            done(result, !result.values.empty());
+        });
+    });
+    runner.report("find_value");
+    return 0;
+}
@@ -0,0 +1,109 @@
+// diff_bench.cpp
+// Diff packet micro-benchmark: packet size and encode/decode speed for typical
+// page edits, against the old hex listing of changed hashes
+//
+// Usage: diff_bench [--page-bytes 262144] [--iterations 20000] [--inline-limit 2048]
+
+#include "content_store.h"
+#include "diff_packet.h"
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct BenchArgs {
+    size_t page_bytes = 256 * 1024;
+    int iterations = 20000;
+    size_t inline_limit = 2048;
+};
+
+void parse_args(int argc, char* argv[], BenchArgs& args) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const char* flag = argv[i];
+        const char* value = argv[i + 1];
+        if (std::strcmp(flag, "--page-bytes") == 0) args.page_bytes = std::stoul(value);
+        else if (std::strcmp(flag, "--iterations") == 0) args.iterations = std::stoi(value);
+        else if (std::strcmp(flag, "--inline-limit") == 0) args.inline_limit = std::stoul(value);
+        else std::cerr << "Ignoring unknown flag " << flag << std::endl;
+    }
+}
+
+/**
+ * @brief Mean wall time of fn over iterations, in microseconds.
+ */
+template <typename Fn>
+double mean_micros(int iterations, Fn fn) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) fn();
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+std::string random_text(std::mt19937_64& rng, size_t bytes) {
+    static const char* const kWords[] = {"the ", "crawler ", "index ", "<p>", "</p>\n", "search ", "page ",
+                                         "block ", "merkle ", "<div class=\"post\">", "</div>", "peer "};
+    std::string text;
+    while (text.size() < bytes) text += kWords[rng() % 12];
+    return text;
+}
+
+void run(const BenchArgs& args, const char* name, const std::string& before, const std::string& after) {
+    const HashEngine& engine = HashEngine::get(HashAlgorithm::kSha256);
+    std::vector<std::string> old_blocks = ContentStore::chunk_content(before);
+    std::vector<std::string> new_blocks = ContentStore::chunk_content(after);
+    MerkleTree old_tree(engine.hash_many(old_blocks));
+    MerkleTree new_tree(engine.hash_many(new_blocks));
+    MerkleDiff diff = new_tree.compare(old_tree);
+    const std::string url = "https://example.com/articles/2024/some-page.html";
+
+    std::vector<uint8_t> packet;
+    std::vector<uint8_t> hashes_only;
+    DiffPacket::encode(url, old_tree, new_tree, diff, nullptr, 0, HashAlgorithm::kSha256, hashes_only);
+    double encode_us = mean_micros(args.iterations, [&] {
+        DiffPacket::encode(url, old_tree, new_tree, diff, &new_blocks, args.inline_limit, HashAlgorithm::kSha256,
+                           packet);
+    });
+    DiffPacket decoded;
+    double decode_us = mean_micros(args.iterations, [&] {
+        if (!DiffPacket::decode(packet.data(), packet.size(), decoded)) std::abort();
+    });
+    // What the old publish_diff printed: one 64-digit hex hash (plus ", ") per changed leaf
+    size_t hex_bytes = new_tree.diff(old_tree).size() * 66 + 2 * 64;
+    std::cout << std::left << std::setw(14) << name << std::right << std::setw(6) << new_tree.size() << " leaves"
+              << std::setw(4) << diff.hunks.size() << " hunks" << std::setw(4) << diff.added.size() << "+"
+              << std::setw(3) << diff.removed.size() << "-" << std::setw(3) << diff.modified.size() << "~"
+              << std::setw(8) << packet.size() << " B packet" << std::setw(7) << hashes_only.size()
+              << " B no-inline" << std::setw(7) << hex_bytes << " B hex" << std::fixed << std::setprecision(2)
+              << std::setw(8) << encode_us << " us enc" << std::setw(8) << decode_us << " us dec" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    BenchArgs args;
+    parse_args(argc, argv, args);
+
+    std::mt19937_64 rng(42);
+    std::string page = random_text(rng, args.page_bytes);
+    std::string paragraph = "<p>" + random_text(rng, 300) + "</p>";
+
+    std::string inserted = page;
+    inserted.insert(page.size() / 3, paragraph);
+    std::string modified = page;
+    modified.replace(page.size() / 2, paragraph.size(), paragraph);
+    std::string scattered = page;
+    for (int k = 1; k <= 5; ++k) scattered.insert(scattered.size() * k / 6, paragraph);
+    std::string truncated = page.substr(0, page.size() * 3 / 4);
+
+    run(args, "insert", page, inserted);
+    run(args, "modify", page, modified);
+    run(args, "5 inserts", page, scattered);
+    run(args, "truncate 1/4", page, truncated);
+    run(args, "rewrite", page, random_text(rng, args.page_bytes));
+    return 0;
+}
@@ -0,0 +1,123 @@
+// gossip_bench.cpp
+// Gossip load generator: nodes on 127.0.0.1 subscribe to one topic and
+// publish URL-sized messages at increasing rates; reports delivery and the
+// frames each peer receives per second
+//
+// Usage: gossip_bench [--nodes 50] [--rates 100,1000,10000] [--seconds 2]
+//                     [--flush-ms 50] [--message-bytes 80] [--seed 42]
+
+#include "kademlia.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using p2p_dht::GossipRouter;
+using p2p_dht::KademliaNode;
+
+struct BenchArgs {
+    int nodes = 50;
+    std::vector<int> rates = {100, 1000, 10000};
+    int seconds = 2;
+    size_t message_bytes = 80;
+    KademliaNode::Config config;
+    uint64_t seed = 42;
+};
+
+void parse_args(int argc, char* argv[], BenchArgs& args) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const char* flag = argv[i];
+        const char* value = argv[i + 1];
+        if (std::strcmp(flag, "--nodes") == 0) args.nodes = std::stoi(value);
+        else if (std::strcmp(flag, "--rates") == 0) {
+            args.rates.clear();
+            std::stringstream list(value);
+            std::string rate;
+            while (std::getline(list, rate, ',')) args.rates.push_back(std::stoi(rate));
+        }
+        else if (std::strcmp(flag, "--seconds") == 0) args.seconds = std::stoi(value);
+        else if (std::strcmp(flag, "--flush-ms") == 0) args.config.gossip.flush_interval_ms = std::stoi(value);
+        else if (std::strcmp(flag, "--message-bytes") == 0) args.message_bytes = std::stoul(value);
+        else if (std::strcmp(flag, "--seed") == 0) args.seed = std::stoull(value);
+        else std::cerr << "Ignoring unknown flag " << flag << std::endl;
+    }
+}
+
+GossipRouter::Stats total(const std::vector<std::shared_ptr<KademliaNode>>& nodes) {
+    GossipRouter::Stats sum;
+    for (auto& node : nodes) {
+        GossipRouter::Stats stats = node->gossip_stats();
+        sum.published += stats.published;
+        sum.delivered += stats.delivered;
+        sum.duplicates += stats.duplicates;
+        sum.dropped += stats.dropped;
+        sum.frames_sent += stats.frames_sent;
+        sum.frame_bytes += stats.frame_bytes;
+        sum.peers += stats.peers;
+    }
+    return sum;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    BenchArgs args;
+    parse_args(argc, argv, args);
+    std::mt19937_64 rng(args.seed);
+    args.config.peer_cache_s = 1;
+
+    auto loop = std::make_shared<p2p_dht::EventLoop>();
+    std::vector<std::shared_ptr<KademliaNode>> nodes;
+    std::atomic<uint64_t> received{0};
+    for (int i = 0; i < args.nodes; ++i) {
+        nodes.push_back(std::make_shared<KademliaNode>("127.0.0.1", 0, args.config, loop));
+        if (i > 0) nodes.back()->join({nodes[rng() % i]->contact().address()});
+    }
+    for (auto& node : nodes) {
+        node->subscribe("urls", [&](const std::string&, const std::vector<uint8_t>&) { ++received; });
+    }
+    // Let the meshes form: a subscriber lookup, then heartbeats
+    std::this_thread::sleep_for(std::chrono::seconds(3));
+    size_t mesh = 0;
+    for (auto& node : nodes) mesh += node->gossip_mesh("urls").size();
+    std::cout << args.nodes << " subscribers, mean mesh degree " << std::fixed << std::setprecision(1)
+              << double(mesh) / nodes.size() << ", flush interval " << args.config.gossip.flush_interval_ms << " ms"
+              << std::endl;
+
+    uint64_t sequence = 0;
+    for (int rate : args.rates) {
+        GossipRouter::Stats before = total(nodes);
+        uint64_t received_before = received.load();
+        auto start = std::chrono::steady_clock::now();
+        int messages = rate * args.seconds;
+        for (int i = 0; i < messages; ++i) {
+            std::string url = "http://host" + std::to_string(rng() % 1000) + ".example.com/page/" + std::to_string(sequence++);
+            url.resize(std::max(url.size(), args.message_bytes), 'x');
+            nodes[rng() % nodes.size()]->publish("urls", std::vector<uint8_t>(url.begin(), url.end()));
+            std::this_thread::sleep_until(start + std::chrono::microseconds(int64_t(i + 1) * 1000000 / rate));
+        }
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        GossipRouter::Stats after = total(nodes);
+        uint64_t frames = after.frames_sent - before.frames_sent;
+        uint64_t bytes = after.frame_bytes - before.frame_bytes;
+        double expected = double(messages) * (args.nodes - 1);
+        // Mesh links are used in both directions
+        std::cout << std::setw(7) << rate << " msg/s (" << std::setprecision(0) << messages / elapsed
+                  << " achieved): delivered " << std::setprecision(2)
+                  << 100.0 * double(received.load() - received_before) / expected << "%, " << std::setprecision(1)
+                  << double(frames) / double(mesh) / elapsed << " frames/s per mesh link, "
+                  << double(after.delivered - before.delivered) / double(std::max<uint64_t>(1, frames))
+                  << " messages per frame, " << double(bytes) / double(messages) / args.nodes
+                  << " B per message per node, " << after.dropped - before.dropped << " dropped" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,97 @@
+// hash_bench.cpp
+// Hashing micro-benchmark: throughput of every HashEngine backend on 4 KB
+// content blocks and on Merkle parents (65-byte prefixed pairs)
+//
+// Usage: hash_bench [--blocks 20000] [--block-bytes 4096] [--pairs 262144] [--rounds 3]
+
+#include "hash_engine.h"
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct BenchArgs {
+    size_t blocks = 20000;
+    size_t block_bytes = 4096;
+    size_t pairs = 1 << 18;
+    int rounds = 3;
+};
+
+void parse_args(int argc, char* argv[], BenchArgs& args) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const char* flag = argv[i];
+        const char* value = argv[i + 1];
+        if (std::strcmp(flag, "--blocks") == 0) args.blocks = std::stoul(value);
+        else if (std::strcmp(flag, "--block-bytes") == 0) args.block_bytes = std::stoul(value);
+        else if (std::strcmp(flag, "--pairs") == 0) args.pairs = std::stoul(value);
+        else if (std::strcmp(flag, "--rounds") == 0) args.rounds = std::stoi(value);
+        else std::cerr << "Ignoring unknown flag " << flag << std::endl;
+    }
+}
+
+/**
+ * @brief Best-of-rounds wall time of fn, in seconds.
+ */
+template <typename Fn>
+double best_seconds(int rounds, Fn fn) {
+    double best = 1e30;
+    for (int r = 0; r < rounds; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+void run(const BenchArgs& args, const HashEngine& engine, const std::vector<std::string>& blocks,
+         const std::vector<Digest256>& children) {
+    std::vector<Digest256> block_out;
+    double block_s = best_seconds(args.rounds, [&] { block_out = engine.hash_many(blocks); });
+    std::vector<Digest256> parents(children.size() / 2);
+    double pair_s = best_seconds(args.rounds, [&] {
+        engine.hash_pairs(children.data(), parents.size(), parents.data());
+    });
+    double single_s = best_seconds(args.rounds, [&] {
+        for (const auto& block : blocks) block_out[0] = engine.hash(block);
+    });
+    std::cout << std::left << std::setw(8) << HashEngine::algorithm_name(engine.algorithm())
+              << std::setw(10) << HashEngine::backend_name(engine.backend()) << std::right << std::fixed
+              << std::setprecision(0)
+              << std::setw(10) << blocks.size() * args.block_bytes / block_s / 1e6 << " MB/s batched"
+              << std::setw(10) << blocks.size() * args.block_bytes / single_s / 1e6 << " MB/s single"
+              << std::setprecision(2)
+              << std::setw(10) << parents.size() / pair_s / 1e6 << " M pairs/s" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    BenchArgs args;
+    parse_args(argc, argv, args);
+
+    std::mt19937_64 rng(42);
+    std::vector<std::string> blocks(args.blocks, std::string(args.block_bytes, '\0'));
+    for (auto& block : blocks) {
+        for (auto& c : block) c = static_cast<char>(rng());
+    }
+    std::vector<Digest256> children(2 * args.pairs);
+    for (auto& child : children) {
+        for (auto& b : child.bytes) b = static_cast<uint8_t>(rng());
+    }
+
+    std::cout << "best backend: " << HashEngine::backend_name(HashEngine::best_backend()) << std::endl;
+    for (auto backend : {HashEngine::Backend::kGeneric, HashEngine::Backend::kAvx2, HashEngine::Backend::kShaNi}) {
+        if (!HashEngine::supported(backend)) continue;
+        run(args, HashEngine(HashAlgorithm::kSha256, backend), blocks, children);
+    }
+    for (auto backend : {HashEngine::Backend::kGeneric, HashEngine::Backend::kAvx2}) {
+        if (!HashEngine::supported(backend)) continue;
+        run(args, HashEngine(HashAlgorithm::kBlake3, backend), blocks, children);
+    }
+    return 0;
+}
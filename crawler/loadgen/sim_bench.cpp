@@ -0,0 +1,203 @@
+// sim_bench.cpp
+// Large-scale DHT simulation: thousands of Kademlia nodes in one process on a
+// SimNetwork with a virtual clock. Joins them in concurrent batches, then
+// measures lookups, gossip delivery and lookups after churn; the same seed
+// gives the same numbers
+//
+// Usage: sim_bench [--nodes 10000] [--lookups 2000] [--batch 100] [--latency-ms 20]
+//                  [--jitter-ms 5] [--loss 0] [--churn 0.2] [--subscribers 500]
+//                  [--messages 200] [--k 20] [--seed 42]
+
+#include "kademlia.h"
+#include "sim_network.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+using p2p_dht::KademliaNode;
+using p2p_dht::SimNetwork;
+
+struct BenchArgs {
+    size_t nodes = 10000;
+    int lookups = 2000;
+    size_t batch = 100;
+    double churn = 0.2;
+    size_t subscribers = 500;
+    int messages = 200;
+    SimNetwork::Config network;
+    KademliaNode::Config config;
+    uint64_t seed = 42;
+};
+
+void parse_args(int argc, char* argv[], BenchArgs& args) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const char* flag = argv[i];
+        const char* value = argv[i + 1];
+        if (std::strcmp(flag, "--nodes") == 0) args.nodes = std::stoul(value);
+        else if (std::strcmp(flag, "--lookups") == 0) args.lookups = std::stoi(value);
+        else if (std::strcmp(flag, "--batch") == 0) args.batch = std::stoul(value);
+        else if (std::strcmp(flag, "--latency-ms") == 0) args.network.latency_ms = std::stod(value);
+        else if (std::strcmp(flag, "--jitter-ms") == 0) args.network.jitter_ms = std::stod(value);
+        else if (std::strcmp(flag, "--loss") == 0) args.network.loss = std::stod(value);
+        else if (std::strcmp(flag, "--churn") == 0) args.churn = std::stod(value);
+        else if (std::strcmp(flag, "--subscribers") == 0) args.subscribers = std::stoul(value);
+        else if (std::strcmp(flag, "--messages") == 0) args.messages = std::stoi(value);
+        else if (std::strcmp(flag, "--k") == 0) args.config.k = std::stoul(value);
+        else if (std::strcmp(flag, "--seed") == 0) args.seed = std::stoull(value);
+        else std::cerr << "Ignoring unknown flag " << flag << std::endl;
+    }
+}
+
+double rss_mb() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("VmRSS:", 0) == 0) return std::stod(line.substr(6)) / 1024.0;
+    }
+    return 0;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+struct LookupStats {
+    int done = 0;
+    int exact = 0;
+    double hops = 0;
+    double queries = 0;
+    std::vector<double> latency_ms;
+};
+
+// Lookups from random live nodes to random live targets, 64 in flight
+LookupStats run_lookups(SimNetwork& network, std::vector<std::shared_ptr<KademliaNode>>& nodes, int count,
+                        std::mt19937_64& rng) {
+    std::vector<size_t> live;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        if (nodes[i]) live.push_back(i);
+    }
+    LookupStats stats;
+    int started = 0;
+    while (stats.done < count) {
+        while (started < count && started - stats.done < 64) {
+            size_t from = live[rng() % live.size()];
+            size_t to = live[rng() % live.size()];
+            if (from == to) continue;
+            ++started;
+            p2p_dht::NodeId target = nodes[to]->id();
+            nodes[from]->find_node(target, [&stats, target](const KademliaNode::LookupResult& result) {
+                ++stats.done;
+                stats.exact += !result.closest.empty() && result.closest.front().id == target;
+                stats.hops += result.hops;
+                stats.queries += result.queries;
+                stats.latency_ms.push_back(result.latency_ms);
+            });
+        }
+        int target_done = stats.done + 1;
+        network.run_until([&] { return stats.done >= target_done; }, std::chrono::minutes(5));
+    }
+    std::sort(stats.latency_ms.begin(), stats.latency_ms.end());
+    return stats;
+}
+
+void print_lookups(const std::string& label, const LookupStats& stats) {
+    auto pct = [&](double q) { return stats.latency_ms[size_t(q * (stats.latency_ms.size() - 1))]; };
+    std::cout << label << ": " << std::fixed << std::setprecision(2) << 100.0 * stats.exact / stats.done
+              << "% exact, " << std::setprecision(2) << stats.hops / stats.done << " hops, " << std::setprecision(1)
+              << stats.queries / stats.done << " queries, virtual p50 " << std::setprecision(0) << pct(0.5)
+              << " ms p99 " << pct(0.99) << " ms" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    BenchArgs args;
+    parse_args(argc, argv, args);
+    args.network.seed = args.seed;
+    args.config.gossip.seen_expected = 2000;  // Keeps 10k seen caches small
+    args.config.peer_cache_s = 1;             // Meshes fill within the settling time
+    std::mt19937_64 rng(args.seed);
+    SimNetwork network(args.network);
+    std::vector<std::shared_ptr<KademliaNode>> nodes;
+
+    // Join in batches that run concurrently; each joiner uses an earlier node as its seed
+    auto wall = std::chrono::steady_clock::now();
+    auto virtual_start = network.now();
+    while (nodes.size() < args.nodes) {
+        size_t first = nodes.size();
+        size_t last = first == 0 ? 1 : std::min(args.nodes, first + std::max<size_t>(1, args.batch));
+        size_t joined = 0;
+        for (size_t i = first; i < last; ++i) {
+            nodes.push_back(std::make_shared<KademliaNode>(network.add_endpoint(), args.config));
+            nodes[i]->join_async(first == 0 ? std::vector<p2p_dht::Contact>() : std::vector<p2p_dht::Contact>{nodes[rng() % first]->contact()},
+                                 [&joined] { ++joined; });
+        }
+        network.run_until([&] { return joined == last - first; }, std::chrono::minutes(5));
+    }
+    double mean_table = 0;
+    for (auto& node : nodes) mean_table += double(node->routing_table_size());
+    std::cout << args.nodes << " nodes joined in " << std::fixed << std::setprecision(1) << seconds_since(wall)
+              << " s wall (" << std::chrono::duration<double>(network.now() - virtual_start).count()
+              << " s virtual), mean routing table " << mean_table / nodes.size() << ", RSS " << std::setprecision(0)
+              << rss_mb() << " MB" << std::endl;
+
+    wall = std::chrono::steady_clock::now();
+    print_lookups("find_node", run_lookups(network, nodes, args.lookups, rng));
+    std::cout << "  " << std::setprecision(1) << seconds_since(wall) << " s wall" << std::endl;
+
+    // Gossip: a topic with a few hundred subscribers, messages from random subscribers
+    std::vector<size_t> subscribers;
+    uint64_t received = 0;
+    for (size_t i = 0; i < std::min(args.subscribers, nodes.size()); ++i) {
+        size_t index = rng() % nodes.size();
+        subscribers.push_back(index);
+        nodes[index]->subscribe("urls", [&received](const std::string&, const std::vector<uint8_t>&) { ++received; });
+    }
+    std::sort(subscribers.begin(), subscribers.end());
+    subscribers.erase(std::unique(subscribers.begin(), subscribers.end()), subscribers.end());
+    network.run_for(std::chrono::seconds(10));
+    wall = std::chrono::steady_clock::now();
+    auto frames_sent = [&] {
+        uint64_t frames = 0;
+        for (size_t index : subscribers) frames += nodes[index]->gossip_stats().frames_sent;
+        return frames;
+    };
+    uint64_t frames_before = frames_sent();
+    for (int m = 0; m < args.messages; ++m) {
+        std::string url = "http://host" + std::to_string(rng() % 1000) + ".example.com/page/" + std::to_string(m);
+        nodes[subscribers[rng() % subscribers.size()]]->publish("urls", std::vector<uint8_t>(url.begin(), url.end()));
+        network.run_for(std::chrono::milliseconds(10));
+    }
+    network.run_for(std::chrono::seconds(2));
+    std::cout << "gossip: " << subscribers.size() << " subscribers, delivered " << std::setprecision(2)
+              << 100.0 * double(received) / double(args.messages * (subscribers.size() - 1)) << "%, "
+              << std::setprecision(1) << double(frames_sent() - frames_before) / args.messages
+              << " frames per message, " << seconds_since(wall) << " s wall" << std::endl;
+
+    // Churn: a fraction of the nodes vanish without notice
+    size_t removed = 0;
+    for (size_t i = 1; i < nodes.size(); ++i) {
+        if (double(rng() % 1000000) / 1e6 < args.churn) {
+            nodes[i].reset();
+            ++removed;
+        }
+    }
+    network.run_for(std::chrono::seconds(1));
+    wall = std::chrono::steady_clock::now();
+    print_lookups("after " + std::to_string(removed) + " nodes left", run_lookups(network, nodes, args.lookups, rng));
+    std::cout << "  " << std::setprecision(1) << seconds_since(wall) << " s wall" << std::endl;
+
+    const SimNetwork::Stats& stats = network.stats();
+    std::cout << stats.sent << " datagrams, " << stats.lost << " lost, " << stats.offline << " to departed nodes, "
+              << stats.events << " events; RSS " << std::setprecision(0) << rss_mb() << " MB" << std::endl;
+    return 0;
+}
@@ -0,0 +1,303 @@
+#include "synthetic_web.h"
+#include "httplib.h"
+#include <zlib.h>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <iostream>
+#include <random>
+
+namespace {
+
+/**
+ * @brief SplitMix64 finalizer, used to derive all per-page properties from the seed.
+ */
+uint64_t mix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+const char* const kWords[] = {
+    "search", "engine", "privacy", "crawler", "index", "network", "peer", "content",
+    "merkle", "tree", "hash", "block", "storage", "query", "result", "ranking",
+    "distributed", "node", "topic", "message", "latency", "throughput", "cache", "page",
+    "document", "token", "stem", "diff", "update", "domain", "robots", "fetch",
+};
+constexpr size_t kNumWords = sizeof(kWords) / sizeof(kWords[0]);
+
+/**
+ * @brief Gzip a buffer in one shot (sitemaps are small enough).
+ */
+std::string gzip(const std::string& data) {
+    z_stream zs{};
+    deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    std::string out(deflateBound(&zs, data.size()), '\0');
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    zs.avail_in = static_cast<uInt>(data.size());
+    zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    zs.avail_out = static_cast<uInt>(out.size());
+    deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return out;
+}
+
+} // namespace
+
+/**
+ * @brief Construct the synthetic web (servers are created lazily by start()).
+ */
+SyntheticWeb::SyntheticWeb(const Config& config) : config_(config) {}
+
+/**
+ * @brief Destructor. Stops all servers.
+ */
+SyntheticWeb::~SyntheticWeb() {
+    stop();
+}
+
+/**
+ * @brief Deterministic 64-bit hash of (seed, host, page, salt).
+ */
+uint64_t SyntheticWeb::page_hash(int host, int page, uint64_t salt) const {
+    uint64_t h = mix64(config_.seed);
+    h = mix64(h ^ static_cast<uint64_t>(host));
+    h = mix64(h ^ static_cast<uint64_t>(page));
+    return mix64(h ^ salt);
+}
+
+/**
+ * @brief Deterministic uniform value in [0, 1) for (host, page, salt).
+ */
+double SyntheticWeb::unit(int host, int page, uint64_t salt) const {
+    return (page_hash(host, page, salt) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * @brief Build the href for outgoing link `slot` of a page.
+ *        Same-host links are root-relative; cross-host links are absolute.
+ */
+std::string SyntheticWeb::link_target(int host, int page, int slot) const {
+    uint64_t salt = 0x1000 + static_cast<uint64_t>(slot);
+    uint64_t h = page_hash(host, page, salt);
+    int target_host = host;
+    if (config_.num_hosts > 1 && unit(host, page, salt ^ 0xc0ffee) < config_.cross_host_ratio) {
+        target_host = static_cast<int>(h % static_cast<uint64_t>(config_.num_hosts));
+    }
+    int target_page = static_cast<int>((h >> 20) % static_cast<uint64_t>(config_.pages_per_host));
+    std::string prefix = "/p/";
+    std::string suffix;
+    double kind = unit(host, page, salt ^ 0xbeef);
+    if (kind < config_.disallowed_link_ratio) {
+        prefix = config_.disallow_prefix;
+    } else if (kind < config_.disallowed_link_ratio + config_.redirect_rate) {
+        prefix = "/r/";
+    } else if (kind < config_.disallowed_link_ratio + config_.redirect_rate + config_.binary_link_ratio) {
+        // Half of the binaries are recognisable by extension, half only by their headers
+        prefix = "/b/";
+        if (slot % 2) suffix = ".pdf";
+    }
+    std::string path = prefix + std::to_string(target_page) + suffix;
+    if (target_host == host) return path;
+    return host_url(target_host) + path;
+}
+
+/**
+ * @brief Render the HTML body of a page. Size and links are deterministic.
+ */
+std::string SyntheticWeb::render_page(int host, int page) const {
+    size_t span = config_.max_page_bytes > config_.min_page_bytes
+        ? config_.max_page_bytes - config_.min_page_bytes : 0;
+    size_t target = config_.min_page_bytes + static_cast<size_t>(unit(host, page, 1) * span);
+    std::string html;
+    html.reserve(target + 256);
+    html += "<html><head><title>Host " + std::to_string(host) + " page " + std::to_string(page)
+          + "</title><script>var page = {host: " + std::to_string(host) + ", page: " + std::to_string(page)
+          + "};</script></head><body>\n";
+    uint64_t rng = page_hash(host, page, 2);
+    int links_left = config_.links_per_page;
+    // Spread links evenly through the body text
+    size_t link_every = links_left > 0 ? std::max<size_t>(target / (links_left + 1), 64) : 0;
+    size_t next_link = link_every;
+    while (html.size() < target) {
+        html += "<p>";
+        for (int w = 0; w < 12; ++w) {
+            rng = mix64(rng);
+            html += kWords[rng % kNumWords];
+            html += ' ';
+        }
+        html += "</p>\n";
+        if (links_left > 0 && html.size() >= next_link) {
+            int slot = config_.links_per_page - links_left;
+            html += "<a href=\"" + link_target(host, page, slot) + "\">link " + std::to_string(slot) + "</a>\n";
+            --links_left;
+            next_link += link_every;
+        }
+    }
+    for (; links_left > 0; --links_left) {
+        int slot = config_.links_per_page - links_left;
+        html += "<a href=\"" + link_target(host, page, slot) + "\">link " + std::to_string(slot) + "</a>\n";
+    }
+    html += "<footer><p>Synthetic web generated for crawler load testing, all rights reserved</p></footer>\n"
+            "</body></html>\n";
+    return html;
+}
+
+/**
+ * @brief Sitemap index listing one gzipped child sitemap per chunk of pages.
+ */
+std::string SyntheticWeb::render_sitemap_index(int host) const {
+    std::string xml = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                      "<sitemapindex xmlns=\"http://www.sitemaps.org/schemas/sitemap/0.9\">\n";
+    int chunks = (config_.pages_per_host + config_.sitemap_chunk - 1) / config_.sitemap_chunk;
+    for (int chunk = 0; chunk < chunks; ++chunk) {
+        xml += "<sitemap><loc>" + host_url(host) + "/sitemap-" + std::to_string(chunk) + ".xml.gz</loc></sitemap>\n";
+    }
+    return xml + "</sitemapindex>\n";
+}
+
+/**
+ * @brief Child sitemap for one chunk of pages, with deterministic lastmod/changefreq/priority.
+ */
+std::string SyntheticWeb::render_sitemap(int host, int chunk) const {
+    static const char* const kFreqs[] = {"hourly", "daily", "weekly", "monthly", "yearly"};
+    std::string xml = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                      "<urlset xmlns=\"http://www.sitemaps.org/schemas/sitemap/0.9\">\n";
+    int first = chunk * config_.sitemap_chunk;
+    int last = std::min(config_.pages_per_host, first + config_.sitemap_chunk);
+    std::time_t now = std::time(nullptr);
+    for (int page = first; page < last; ++page) {
+        std::time_t modified = now - static_cast<std::time_t>(unit(host, page, 4) * 400 * 86400);
+        char date[16];
+        std::tm tm{};
+        gmtime_r(&modified, &tm);
+        std::strftime(date, sizeof(date), "%Y-%m-%d", &tm);
+        xml += "<url><loc>" + host_url(host) + "/p/" + std::to_string(page) + "</loc><lastmod>" + date
+             + "</lastmod><changefreq>" + kFreqs[page_hash(host, page, 5) % 5] + "</changefreq></url>\n";
+    }
+    return xml + "</urlset>\n";
+}
+
+/**
+ * @brief Sleep for a log-normally distributed response latency.
+ */
+void SyntheticWeb::inject_latency() const {
+    if (config_.latency_median_ms <= 0) return;
+    thread_local std::mt19937_64 rng(std::random_device{}());
+    double ms = config_.latency_median_ms;
+    if (config_.latency_sigma > 0) {
+        std::lognormal_distribution<double> dist(std::log(config_.latency_median_ms), config_.latency_sigma);
+        ms = dist(rng);
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(static_cast<int64_t>(ms * 1000.0)));
+}
+
+/**
+ * @brief Register robots.txt, page, redirect and disallowed-page handlers for one host.
+ */
+void SyntheticWeb::install_routes(httplib::Server& server, int host) {
+    server.Get("/robots.txt", [this, host](const httplib::Request&, httplib::Response& res) {
+        requests_served_.fetch_add(1, std::memory_order_relaxed);
+        std::string robots = "User-agent: *\nDisallow: " + config_.disallow_prefix + "\n";
+        if (config_.sitemaps) robots += "Sitemap: " + host_url(host) + "/sitemap.xml\n";
+        res.set_content(robots, "text/plain");
+    });
+    server.Get("/sitemap.xml", [this, host](const httplib::Request&, httplib::Response& res) {
+        requests_served_.fetch_add(1, std::memory_order_relaxed);
+        res.set_content(render_sitemap_index(host), "application/xml");
+    });
+    server.Get(R"(/sitemap-(\d+)\.xml\.gz)", [this, host](const httplib::Request& req, httplib::Response& res) {
+        requests_served_.fetch_add(1, std::memory_order_relaxed);
+        res.set_content(gzip(render_sitemap(host, std::stoi(req.matches[1]))), "application/gzip");
+    });
+    auto serve_page = [this, host](const httplib::Request& req, httplib::Response& res) {
+        requests_served_.fetch_add(1, std::memory_order_relaxed);
+        inject_latency();
+        if (config_.throttle_rate > 0) {
+            thread_local std::mt19937_64 rng(std::random_device{}());
+            if (std::uniform_real_distribution<double>(0, 1)(rng) < config_.throttle_rate) {
+                res.status = 429;
+                res.set_header("Retry-After", std::to_string(config_.retry_after_s));
+                return;
+            }
+        }
+        int page = std::stoi(req.matches[1]);
+        if (page < 0 || page >= config_.pages_per_host) {
+            res.status = 404;
+            return;
+        }
+        if (unit(host, page, 3) < config_.error_rate) {
+            res.status = 500;
+            res.set_content("Internal Server Error", "text/plain");
+            return;
+        }
+        res.set_content(render_page(host, page), "text/html; charset=utf-8");
+    };
+    server.Get(R"(/p/(\d+))", serve_page);
+    server.Get(config_.disallow_prefix + R"((\d+))", serve_page);
+    server.Get(R"(/b/(\d+)(\.pdf)?)", [this](const httplib::Request&, httplib::Response& res) {
+        requests_served_.fetch_add(1, std::memory_order_relaxed);
+        inject_latency();
+        res.set_content(std::string(config_.binary_bytes, '\x25'), "application/pdf");
+    });
+    server.Get(R"(/r/(\d+))", [this](const httplib::Request& req, httplib::Response& res) {
+        requests_served_.fetch_add(1, std::memory_order_relaxed);
+        inject_latency();
+        res.set_redirect("/p/" + req.matches[1].str());
+    });
+}
+
+/**
+ * @brief Bind every host server on 127.0.0.1 and start them in background threads.
+ */
+bool SyntheticWeb::start() {
+    for (int host = 0; host < config_.num_hosts; ++host) {
+        auto server = std::make_unique<httplib::Server>();
+        int threads = config_.server_threads;
+        server->new_task_queue = [threads] { return new httplib::ThreadPool(threads); };
+        install_routes(*server, host);
+        if (!server->bind_to_port("127.0.0.1", config_.base_port + host)) {
+            std::cerr << "SyntheticWeb: failed to bind port " << config_.base_port + host << std::endl;
+            stop();
+            return false;
+        }
+        httplib::Server* raw = server.get();
+        servers_.push_back(std::move(server));
+        threads_.emplace_back([raw] { raw->listen_after_bind(); });
+    }
+    for (auto& server : servers_) server->wait_until_ready();
+    return true;
+}
+
+/**
+ * @brief Stop all servers and join their listener threads.
+ */
+void SyntheticWeb::stop() {
+    for (auto& server : servers_) server->stop();
+    for (auto& t : threads_) {
+        if (t.joinable()) t.join();
+    }
+    threads_.clear();
+    servers_.clear();
+}
+
+/**
+ * @brief Entry URLs (page 0 of every host).
+ */
+std::vector<std::string> SyntheticWeb::seed_urls() const {
+    std::vector<std::string> seeds;
+    for (int host = 0; host < config_.num_hosts; ++host) {
+        seeds.push_back(host_url(host) + "/p/0");
+    }
+    return seeds;
+}
+
+/**
+ * @brief Base URL of host i.
+ */
+std::string SyntheticWeb::host_url(int host) const {
+    return "http://127.0.0.1:" + std::to_string(config_.base_port + host);
+}
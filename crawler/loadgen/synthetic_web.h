@@ -0,0 +1,112 @@
+// synthetic_web.h
+// Local synthetic web graph served over HTTP for crawler load testing
+//
+// Responsibilities:
+// - Generates a deterministic web graph (hosts, pages, links) from a seed
+// - Serves each host from its own httplib::Server on 127.0.0.1
+// - Injects latency, redirects, server errors and robots.txt rules
+// - Publishes a sitemap index with gzipped child sitemaps per host
+//
+// Everything binds to localhost, so the harness works without network access.
+
+#ifndef SYNTHETIC_WEB_H
+#define SYNTHETIC_WEB_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace httplib {
+    class Server;
+}
+
+/**
+ * @class SyntheticWeb
+ * @brief Serves a generated web graph from one local HTTP server per host.
+ *
+ * Page `/p/<id>` on host `h` is fully determined by (seed, h, id): its size,
+ * outgoing links and whether it fails or redirects. Only the injected latency
+ * is sampled per request, from a log-normal distribution.
+ */
+class SyntheticWeb {
+public:
+    struct Config {
+        int num_hosts = 4;                 ///< Number of simulated hosts (one port each)
+        int pages_per_host = 1000;         ///< Pages per host, ids 0..pages_per_host-1
+        size_t min_page_bytes = 2048;      ///< Minimum HTML body size
+        size_t max_page_bytes = 65536;     ///< Maximum HTML body size
+        int links_per_page = 10;           ///< Outgoing <a href> links per page
+        double cross_host_ratio = 0.2;     ///< Fraction of links pointing to other hosts
+        double latency_median_ms = 20.0;   ///< Median of the log-normal response latency
+        double latency_sigma = 0.5;        ///< Shape of the log-normal (0 = constant latency)
+        double error_rate = 0.01;          ///< Fraction of pages answering 500
+        double redirect_rate = 0.05;       ///< Fraction of links that go through a 302
+        double throttle_rate = 0.0;        ///< Fraction of requests answered 429 + Retry-After
+        int retry_after_s = 1;             ///< Retry-After value sent with 429s
+        std::string disallow_prefix = "/private/"; ///< Disallowed in every host's robots.txt
+        double disallowed_link_ratio = 0.02;       ///< Fraction of links into the disallowed prefix
+        double binary_link_ratio = 0.02;   ///< Fraction of links to large application/pdf bodies
+        size_t binary_bytes = 1 << 20;     ///< Size of each binary body
+        bool sitemaps = true;              ///< Advertise a sitemap index in robots.txt
+        int sitemap_chunk = 500;           ///< URLs per gzipped child sitemap
+        int base_port = 18080;             ///< Host i listens on base_port + i
+        int server_threads = 64;           ///< Worker threads per host server
+        uint64_t seed = 42;                ///< Graph seed
+    };
+
+    explicit SyntheticWeb(const Config& config);
+    ~SyntheticWeb();
+
+    SyntheticWeb(const SyntheticWeb&) = delete;
+    SyntheticWeb& operator=(const SyntheticWeb&) = delete;
+
+    /**
+     * @brief Bind all host servers and start serving in background threads.
+     * @return False if any port could not be bound.
+     */
+    bool start();
+
+    /**
+     * @brief Stop all servers and join their threads.
+     */
+    void stop();
+
+    /**
+     * @brief Entry URLs (page 0 of every host), suitable as crawl seeds.
+     */
+    std::vector<std::string> seed_urls() const;
+
+    /**
+     * @brief Base URL of host i, e.g. "http://127.0.0.1:18080".
+     */
+    std::string host_url(int host) const;
+
+    /**
+     * @brief Render the HTML body of a page (exposed for tests and sizing).
+     */
+    std::string render_page(int host, int page) const;
+
+    /**
+     * @brief Total requests served across all hosts.
+     */
+    uint64_t requests_served() const { return requests_served_.load(std::memory_order_relaxed); }
+
+private:
+    Config config_;
+    std::vector<std::unique_ptr<httplib::Server>> servers_;
+    std::vector<std::thread> threads_;
+    std::atomic<uint64_t> requests_served_{0};
+
+    void install_routes(httplib::Server& server, int host);
+    uint64_t page_hash(int host, int page, uint64_t salt) const;
+    double unit(int host, int page, uint64_t salt) const;
+    std::string link_target(int host, int page, int slot) const;
+    void inject_latency() const;
+    std::string render_sitemap_index(int host) const;
+    std::string render_sitemap(int host, int chunk) const;
+};
+
+#endif // SYNTHETIC_WEB_H
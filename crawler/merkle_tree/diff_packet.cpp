@@ -0,0 +1,87 @@
+#include "diff_packet.h"
+#include "../common/varint.h"
+#include <cstring>
+
+namespace {
+
+Digest256 to_digest(const uint8_t* bytes) {
+    return Digest256::from_bytes(reinterpret_cast<const char*>(bytes));
+}
+
+} // namespace
+
+void DiffPacket::encode(const std::string& url, const MerkleTree& old_tree, const MerkleTree& new_tree,
+                        const MerkleDiff& diff, const std::vector<std::string>* blocks, size_t inline_limit,
+                        HashAlgorithm algorithm, std::vector<uint8_t>& out) {
+    auto inline_block = [&](uint64_t leaf) -> const std::string* {
+        if (!blocks || leaf >= blocks->size() || (*blocks)[leaf].size() > inline_limit) return nullptr;
+        return &(*blocks)[leaf];
+    };
+
+    // Pass 1: exact size
+    size_t size = 2 + varint_size(url.size()) + url.size() + 2 * Digest256::kSize + varint_size(old_tree.size()) +
+                  varint_size(new_tree.size()) + varint_size(diff.hunks.size());
+    uint64_t old_end = 0;
+    for (const MerkleDiff::Hunk& hunk : diff.hunks) {
+        size += varint_size(hunk.old_begin - old_end) + varint_size(hunk.old_count) + varint_size(hunk.new_count);
+        old_end = hunk.old_begin + hunk.old_count;
+        for (uint64_t k = 0; k < hunk.new_count; ++k) {
+            const std::string* block = inline_block(hunk.new_begin + k);
+            size += Digest256::kSize + (block ? varint_size(block->size() + 1) + block->size() : 1);
+        }
+    }
+
+    // Pass 2: write in place
+    out.resize(size);
+    uint8_t* p = out.data();
+    *p++ = kVersion;
+    *p++ = uint8_t(algorithm);
+    p = put_varint(p, url.size());
+    std::memcpy(p, url.data(), url.size());
+    p += url.size();
+    Digest256 roots[2] = {old_tree.root(), new_tree.root()};
+    std::memcpy(p, roots, sizeof(roots));
+    p += sizeof(roots);
+    p = put_varint(p, old_tree.size());
+    p = put_varint(p, new_tree.size());
+    p = put_varint(p, diff.hunks.size());
+    old_end = 0;
+    for (const MerkleDiff::Hunk& hunk : diff.hunks) {
+        p = put_varint(p, hunk.old_begin - old_end);
+        p = put_varint(p, hunk.old_count);
+        p = put_varint(p, hunk.new_count);
+        old_end = hunk.old_begin + hunk.old_count;
+        for (uint64_t k = 0; k < hunk.new_count; ++k) {
+            std::memcpy(p, new_tree.leaf(hunk.new_begin + k).data(), Digest256::kSize);
+            p += Digest256::kSize;
+            const std::string* block = inline_block(hunk.new_begin + k);
+            p = put_varint(p, block ? block->size() + 1 : 0);
+            if (block) {
+                std::memcpy(p, block->data(), block->size());
+                p += block->size();
+            }
+        }
+    }
+}
+
+/**
+ * @brief DiffWire does the parsing; this copies the hashes into Digest256s.
+ */
+bool DiffPacket::decode(const uint8_t* data, size_t len, DiffPacket& out) {
+    DiffWire wire;
+    if (!DiffWire::decode(data, len, wire) || wire.algorithm > uint8_t(HashAlgorithm::kBlake3)) return false;
+    DiffPacket packet;
+    packet.algorithm = HashAlgorithm(wire.algorithm);
+    packet.url = std::move(wire.url);
+    packet.old_root = to_digest(wire.old_root);
+    packet.new_root = to_digest(wire.new_root);
+    packet.old_leaf_count = wire.old_leaf_count;
+    packet.new_leaf_count = wire.new_leaf_count;
+    packet.hunks = std::move(wire.hunks);
+    packet.leaves.reserve(wire.leaves.size());
+    for (const DiffWire::Leaf& leaf : wire.leaves) {
+        packet.leaves.push_back({to_digest(leaf.hash), leaf.block, leaf.block_len});
+    }
+    out = std::move(packet);
+    return true;
+}
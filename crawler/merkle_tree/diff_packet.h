@@ -0,0 +1,72 @@
+// diff_packet.h
+// Binary Merkle diff packets for peers and indexers
+// Part of the crawler module for the next-gen search engine
+//
+// Interface:
+//   struct DiffPacket {
+//       static void encode(const std::string& url, const MerkleTree& old_tree,
+//                          const MerkleTree& new_tree, const MerkleDiff& diff,
+//                          const std::vector<std::string>* blocks, size_t inline_limit,
+//                          HashAlgorithm algorithm, std::vector<uint8_t>& out);
+//       static bool decode(const uint8_t* data, size_t len, DiffPacket& out);
+//   };
+
+#ifndef DIFF_PACKET_H
+#define DIFF_PACKET_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "merkle_tree.h"
+#include "../common/diff_wire.h"
+
+/**
+ * @struct DiffPacket
+ * @brief Wire form of a page's MerkleDiff: what a peer or an indexer needs to
+ *        bring its copy of a page from the old root to the new one.
+ *
+ * The layout is documented in DiffWire (crawler/common/diff_wire.h), whose
+ * decoder this shares with the indexer. Blocks up to the inline limit travel
+ * in the packet, so a small edit needs no block fetch.
+ */
+struct DiffPacket {
+    static constexpr uint8_t kVersion = DiffWire::kVersion;
+
+    using Hunk = DiffWire::Hunk;
+
+    struct Leaf {
+        Digest256 hash;
+        const char* block = nullptr; ///< Inline block, pointing into the decoded buffer
+        size_t block_len = 0;
+    };
+
+    HashAlgorithm algorithm = HashAlgorithm::kSha256;
+    std::string url;
+    Digest256 old_root;
+    Digest256 new_root;
+    uint64_t old_leaf_count = 0;
+    uint64_t new_leaf_count = 0;
+    std::vector<Hunk> hunks;
+    std::vector<Leaf> leaves;    ///< New leaves of every hunk, in order
+
+    /**
+     * @brief Encode a diff straight into out: the size is computed first, out
+     *        is sized once and every field, hash and inline block is written
+     *        in place with no intermediate buffers.
+     * @param blocks Blocks of new_tree (by leaf index), or null to inline none.
+     * @param inline_limit Largest block sent inline.
+     */
+    static void encode(const std::string& url, const MerkleTree& old_tree, const MerkleTree& new_tree,
+                       const MerkleDiff& diff, const std::vector<std::string>* blocks, size_t inline_limit,
+                       HashAlgorithm algorithm, std::vector<uint8_t>& out);
+
+    /**
+     * @brief Parse a packet. Inline blocks are not copied: they point into data,
+     *        which must outlive out.
+     * @return False if the packet is truncated, malformed, of another version,
+     *         or its hunks do not fit the leaf counts.
+     */
+    static bool decode(const uint8_t* data, size_t len, DiffPacket& out);
+};
+
+#endif // DIFF_PACKET_H
\ No newline at end of file
@@ -0,0 +1,277 @@
+#include "merkle_search_tree.h"
+#include "../common/varint.h"
+#include <algorithm>
+
+namespace {
+
+bool get_digest(const char*& p, const char* end, Digest256& out) {
+    if (size_t(end - p) < Digest256::kSize) return false;
+    out = Digest256::from_bytes(p);
+    p += Digest256::kSize;
+    return true;
+}
+
+/**
+ * @brief Index of the first entry whose key is not below key: the entry
+ *        itself if present, otherwise the child gap that would hold it.
+ */
+size_t slot(const MerkleSearchTree::Node& node, const Digest256& key) {
+    auto it = std::lower_bound(node.entries.begin(), node.entries.end(), key,
+                               [](const MerkleSearchTree::Entry& e, const Digest256& k) { return e.key < k; });
+    return size_t(it - node.entries.begin());
+}
+
+} // namespace
+
+std::string MerkleSearchTree::Node::encode() const {
+    std::string out;
+    out.reserve(12 + entries.size() * 2 * Digest256::kSize + children.size() * Digest256::kSize);
+    out.push_back(char(level));
+    put_varint(out, entries.size());
+    for (const Entry& entry : entries) {
+        out.append(entry.key.data(), Digest256::kSize);
+        out.append(entry.value.data(), Digest256::kSize);
+    }
+    for (const Digest256& child : children) out.append(child.data(), Digest256::kSize);
+    return out;
+}
+
+bool MerkleSearchTree::Node::decode(const char* data, size_t len, Node& out) {
+    const char* p = data;
+    const char* end = data + len;
+    uint64_t count;
+    if (p == end) return false;
+    out.level = uint8_t(*p++);
+    if (!get_varint(p, end, count) || count == 0) return false;
+    // Exact size first: count is untrusted
+    if (count > size_t(end - p) / (3 * Digest256::kSize) ||
+        size_t(end - p) != (3 * count + 1) * Digest256::kSize) {
+        return false;
+    }
+    out.entries.resize(size_t(count));
+    out.children.resize(size_t(count) + 1);
+    for (size_t i = 0; i < count; ++i) {
+        Entry& entry = out.entries[i];
+        get_digest(p, end, entry.key);
+        get_digest(p, end, entry.value);
+        if (level_of(entry.key) != out.level) return false;
+        if (i > 0 && !(out.entries[i - 1].key < entry.key)) return false;
+    }
+    for (Digest256& child : out.children) get_digest(p, end, child);
+    return true;
+}
+
+MerkleSearchTree::MerkleSearchTree(HashAlgorithm algorithm) : engine_(&HashEngine::get(algorithm)) {}
+
+int MerkleSearchTree::level_of(const Digest256& key) {
+    int level = 0;
+    for (size_t i = Digest256::kSize; i-- > 0;) {
+        uint8_t byte = key.bytes[i];
+        if (byte & 0x0F) return level;
+        ++level;
+        if (byte & 0xF0) return level;
+        ++level;
+    }
+    return level;
+}
+
+const MerkleSearchTree::Node* MerkleSearchTree::node(const Digest256& hash) const {
+    auto it = nodes_.find(hash);
+    return it == nodes_.end() ? nullptr : &it->second;
+}
+
+bool MerkleSearchTree::find(const Digest256& key, Digest256* value) const {
+    int level = level_of(key);
+    const Digest256* hash = &root_;
+    while (!hash->is_zero()) {
+        const Node& node = nodes_.at(*hash);
+        if (node.level < level) return false;
+        size_t i = slot(node, key);
+        if (node.level == level) {
+            if (i == node.entries.size() || node.entries[i].key != key) return false;
+            if (value) *value = node.entries[i].value;
+            return true;
+        }
+        hash = &node.children[i];
+    }
+    return false;
+}
+
+void MerkleSearchTree::insert(const Digest256& key, const Digest256& value) {
+    Digest256 current;
+    bool present = find(key, &current);
+    if (present && current == value) return;
+    root_ = insert_at(root_, Entry{key, value}, level_of(key));
+    if (!present) ++size_;
+}
+
+bool MerkleSearchTree::erase(const Digest256& key) {
+    if (!find(key)) return false;
+    root_ = erase_at(root_, key, level_of(key));
+    --size_;
+    return true;
+}
+
+std::vector<MerkleSearchTree::Entry> MerkleSearchTree::entries() const {
+    std::vector<Entry> out;
+    out.reserve(size_);
+    // In-order walk: (node, next child) pairs
+    std::vector<std::pair<const Node*, size_t>> stack;
+    auto descend = [&](const Digest256& hash) {
+        if (!hash.is_zero()) stack.emplace_back(&nodes_.at(hash), 0);
+    };
+    descend(root_);
+    while (!stack.empty()) {
+        auto& top = stack.back();
+        const Node* node = top.first;
+        size_t i = top.second++;
+        if (i == node->children.size()) {
+            stack.pop_back();
+            continue;
+        }
+        if (i > 0) out.push_back(node->entries[i - 1]);
+        descend(node->children[i]);
+    }
+    return out;
+}
+
+std::vector<std::string> MerkleSearchTree::serve(const std::vector<Digest256>& hashes) const {
+    std::vector<std::string> out;
+    out.reserve(hashes.size());
+    for (const Digest256& hash : hashes) {
+        if (const Node* found = node(hash)) out.push_back(found->encode());
+    }
+    return out;
+}
+
+Digest256 MerkleSearchTree::put(Node node) {
+    if (node.entries.empty()) return node.children[0];
+    Digest256 hash = hash_node(node.encode());
+    nodes_.emplace(hash, std::move(node));
+    return hash;
+}
+
+MerkleSearchTree::Node MerkleSearchTree::take(const Digest256& hash) {
+    auto it = nodes_.find(hash);
+    Node node = std::move(it->second);
+    nodes_.erase(it);
+    return node;
+}
+
+Digest256 MerkleSearchTree::insert_at(const Digest256& hash, const Entry& entry, int level) {
+    if (hash.is_zero()) {
+        Node leaf;
+        leaf.level = uint8_t(level);
+        leaf.entries.push_back(entry);
+        leaf.children.resize(2);
+        return put(std::move(leaf));
+    }
+    if (nodes_.at(hash).level < level) {
+        // The new key outranks this subtree: it becomes the root between the two halves
+        auto halves = split(hash, entry.key);
+        Node parent;
+        parent.level = uint8_t(level);
+        parent.entries.push_back(entry);
+        parent.children = {halves.first, halves.second};
+        return put(std::move(parent));
+    }
+    Node node = take(hash);
+    size_t i = slot(node, entry.key);
+    if (node.level > level) {
+        node.children[i] = insert_at(node.children[i], entry, level);
+    } else if (i < node.entries.size() && node.entries[i].key == entry.key) {
+        node.entries[i].value = entry.value;
+    } else {
+        auto halves = split(node.children[i], entry.key);
+        node.entries.insert(node.entries.begin() + i, entry);
+        node.children[i] = halves.first;
+        node.children.insert(node.children.begin() + i + 1, halves.second);
+    }
+    return put(std::move(node));
+}
+
+Digest256 MerkleSearchTree::erase_at(const Digest256& hash, const Digest256& key, int level) {
+    Node node = take(hash);
+    size_t i = slot(node, key);
+    if (node.level > level) {
+        node.children[i] = erase_at(node.children[i], key, level);
+    } else {
+        node.children[i] = merge(node.children[i], node.children[i + 1]);
+        node.entries.erase(node.entries.begin() + i);
+        node.children.erase(node.children.begin() + i + 1);
+    }
+    return put(std::move(node));
+}
+
+std::pair<Digest256, Digest256> MerkleSearchTree::split(const Digest256& hash, const Digest256& key) {
+    if (hash.is_zero()) return {Digest256(), Digest256()};
+    Node left = take(hash);
+    size_t i = slot(left, key);
+    auto halves = split(left.children[i], key);
+    Node right;
+    right.level = left.level;
+    right.entries.assign(left.entries.begin() + i, left.entries.end());
+    right.children.push_back(halves.second);
+    right.children.insert(right.children.end(), left.children.begin() + i + 1, left.children.end());
+    left.entries.resize(i);
+    left.children.resize(i);
+    left.children.push_back(halves.first);
+    return {put(std::move(left)), put(std::move(right))};
+}
+
+Digest256 MerkleSearchTree::merge(const Digest256& left, const Digest256& right) {
+    if (left.is_zero()) return right;
+    if (right.is_zero()) return left;
+    int left_level = nodes_.at(left).level;
+    int right_level = nodes_.at(right).level;
+    if (left_level > right_level) {
+        Node node = take(left);
+        node.children.back() = merge(node.children.back(), right);
+        return put(std::move(node));
+    }
+    if (right_level > left_level) {
+        Node node = take(right);
+        node.children.front() = merge(left, node.children.front());
+        return put(std::move(node));
+    }
+    Node node = take(left);
+    Node tail = take(right);
+    node.children.back() = merge(node.children.back(), tail.children.front());
+    node.entries.insert(node.entries.end(), tail.entries.begin(), tail.entries.end());
+    node.children.insert(node.children.end(), tail.children.begin() + 1, tail.children.end());
+    return put(std::move(node));
+}
+
+MstReconciler::MstReconciler(const MerkleSearchTree& local, const Digest256& remote_root) : local_(local) {
+    if (!remote_root.is_zero() && !local.node(remote_root)) {
+        wanted_.push_back(remote_root);
+        requested_.insert(remote_root);
+    }
+}
+
+bool MstReconciler::receive(const std::vector<std::string>& nodes) {
+    std::vector<Digest256> next;
+    bool ok = true;
+    MerkleSearchTree::Node node;
+    for (const std::string& encoded : nodes) {
+        Digest256 hash = local_.hash_node(encoded);
+        if (!requested_.erase(hash) || !MerkleSearchTree::Node::decode(encoded.data(), encoded.size(), node)) {
+            ok = false;
+            continue;
+        }
+        ++nodes_received_;
+        bytes_received_ += encoded.size();
+        for (const MerkleSearchTree::Entry& entry : node.entries) {
+            Digest256 value;
+            if (!local_.find(entry.key, &value) || value != entry.value) missing_.push_back(entry);
+        }
+        for (const Digest256& child : node.children) {
+            if (!child.is_zero() && !local_.node(child)) next.push_back(child);
+        }
+    }
+    requested_.clear();
+    requested_.insert(next.begin(), next.end());
+    wanted_ = std::move(next);
+    ++rounds_;
+    return ok;
+}
\ No newline at end of file
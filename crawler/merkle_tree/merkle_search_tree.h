@@ -0,0 +1,224 @@
+// merkle_search_tree.h
+// Merkle search tree over a domain's pages, for reconciling crawl results with peers
+// Part of the crawler module for the next-gen search engine
+//
+// Responsibilities:
+// - Maps page keys (URL hashes) to page roots in a history-independent tree
+// - Serves its nodes by hash to peers
+// - Pulls the entries a peer has and this tree lacks, a tree level per round trip
+//
+// Interface:
+//   class MerkleSearchTree {
+//     public:
+//       static Digest256 key_for(const std::string& url);
+//       void insert(const Digest256& key, const Digest256& value);
+//       bool erase(const Digest256& key);
+//       bool find(const Digest256& key, Digest256* value) const;
+//       const Digest256& root() const;
+//       std::vector<std::string> serve(const std::vector<Digest256>& hashes) const;
+//   };
+//   class MstReconciler {
+//     public:
+//       MstReconciler(const MerkleSearchTree& local, const Digest256& remote_root);
+//       const std::vector<Digest256>& wanted() const;
+//       bool receive(const std::vector<std::string>& nodes);
+//       const std::vector<MerkleSearchTree::Entry>& missing() const;
+//   };
+
+#ifndef MERKLE_SEARCH_TREE_H
+#define MERKLE_SEARCH_TREE_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "../common/digest.h"
+#include "../common/hash_engine.h"
+
+/**
+ * @class MerkleSearchTree
+ * @brief Sorted map from 32-byte keys to 32-byte values whose shape depends
+ *        only on its contents (a Merkle search tree).
+ *
+ * Every key has a level: the number of trailing zero nibbles of the key, so
+ * a key is at level l or above with probability 16^-l. A node holds the keys
+ * of one level in order and a child subtree between every two of them (and
+ * before the first and after the last); a subtree holds the keys of its gap
+ * and its root is the node of their highest level. Nodes without keys are
+ * never stored, so the same entries always give the same nodes and the same
+ * root, whatever order they were inserted in. Nodes are addressed by the hash
+ * of their encoding, which covers their children's hashes.
+ *
+ * Two trees therefore share every node whose key range holds the same
+ * entries. A peer that walks the other tree from its root, fetching only
+ * nodes it does not have itself, visits the differing paths and nothing else
+ * (see MstReconciler). Inserts and erases rewrite the O(log n) nodes on the
+ * key's path.
+ *
+ * Node encoding: u8 level, varint key count, count (key, value) pairs
+ *                (64 bytes each), count + 1 child hashes (zero for none).
+ */
+class MerkleSearchTree {
+public:
+    struct Entry {
+        Digest256 key;
+        Digest256 value;
+    };
+
+    struct Node {
+        uint8_t level = 0;
+        std::vector<Entry> entries;        ///< Ascending keys, all of this level
+        std::vector<Digest256> children;   ///< entries.size() + 1; zero digest for an empty gap
+
+        std::string encode() const;
+
+        /**
+         * @return False if the record is truncated, malformed or not a
+         *         canonical node (keys out of order or of another level).
+         */
+        static bool decode(const char* data, size_t len, Node& out);
+    };
+
+    explicit MerkleSearchTree(HashAlgorithm algorithm = HashAlgorithm::kSha256);
+
+    /**
+     * @brief Key of a page: SHA-256 of its URL, whatever the node hash.
+     */
+    static Digest256 key_for(const std::string& url) { return Digest256::of(url); }
+
+    /**
+     * @brief Tree level of a key (trailing zero nibbles).
+     */
+    static int level_of(const Digest256& key);
+
+    /**
+     * @brief Insert a key or replace its value.
+     */
+    void insert(const Digest256& key, const Digest256& value);
+
+    /**
+     * @return False if the key was not present.
+     */
+    bool erase(const Digest256& key);
+
+    /**
+     * @return False if the key is not present; otherwise its value is stored
+     *         in value (if not null).
+     */
+    bool find(const Digest256& key, Digest256* value = nullptr) const;
+
+    size_t size() const { return size_; }
+
+    /**
+     * @brief Hash of the root node (all-zero digest if the tree is empty).
+     */
+    const Digest256& root() const { return root_; }
+
+    /**
+     * @brief A node of the current tree by hash, or null.
+     */
+    const Node* node(const Digest256& hash) const;
+
+    /**
+     * @brief All entries in key order.
+     */
+    std::vector<Entry> entries() const;
+
+    /**
+     * @brief Encodings of the requested nodes, for a peer's MstReconciler.
+     *        Hashes not in the tree (it changed since the peer saw the root)
+     *        are skipped.
+     */
+    std::vector<std::string> serve(const std::vector<Digest256>& hashes) const;
+
+    /**
+     * @brief Node hash of an encoding.
+     */
+    Digest256 hash_node(const std::string& encoded) const { return engine_->hash(encoded); }
+
+private:
+    const HashEngine* engine_;
+    Digest256 root_;
+    size_t size_ = 0;
+    std::unordered_map<Digest256, Node> nodes_;  ///< Nodes of the current tree only
+
+    /**
+     * @brief Store a node and return its hash. A node without keys is not
+     *        stored: its only child takes its place.
+     */
+    Digest256 put(Node node);
+
+    /**
+     * @brief Remove a node from the store, to be rewritten.
+     */
+    Node take(const Digest256& hash);
+
+    Digest256 insert_at(const Digest256& hash, const Entry& entry, int level);
+    Digest256 erase_at(const Digest256& hash, const Digest256& key, int level);
+
+    /**
+     * @brief Split a subtree into the keys below and above key (not in it).
+     */
+    std::pair<Digest256, Digest256> split(const Digest256& hash, const Digest256& key);
+
+    /**
+     * @brief Join two subtrees; every key of left is below every key of right.
+     */
+    Digest256 merge(const Digest256& left, const Digest256& right);
+};
+
+/**
+ * @class MstReconciler
+ * @brief Pulls the entries of a peer's MerkleSearchTree that the local tree
+ *        does not have (or has with another value).
+ *
+ * Each round requests every node in wanted() from the peer (which answers
+ * with MerkleSearchTree::serve) and passes the answers to receive(). A node
+ * whose hash the local tree also has roots an identical subtree and is never
+ * requested, so the walk descends only along differing paths: a tree level
+ * per round trip, and O(d log n) nodes for d differing entries. Nodes are
+ * checked against the hashes that were requested, so a peer cannot inject
+ * entries outside its announced root. The peer runs the same walk against
+ * this tree to get the other direction; both finish in the same number of
+ * rounds.
+ */
+class MstReconciler {
+public:
+    MstReconciler(const MerkleSearchTree& local, const Digest256& remote_root);
+
+    /**
+     * @brief Nodes to request this round; empty once reconciliation is done.
+     */
+    const std::vector<Digest256>& wanted() const { return wanted_; }
+    bool done() const { return wanted_.empty(); }
+
+    /**
+     * @brief Process the peer's answer to wanted() and move to the next round.
+     * @return False if a node was malformed or not requested. Requested nodes
+     *         the peer no longer has are dropped; their subtrees are not
+     *         reconciled this time.
+     */
+    bool receive(const std::vector<std::string>& nodes);
+
+    /**
+     * @brief Remote entries absent from the local tree or with another value.
+     */
+    const std::vector<MerkleSearchTree::Entry>& missing() const { return missing_; }
+
+    size_t rounds() const { return rounds_; }
+    size_t nodes_received() const { return nodes_received_; }
+    size_t bytes_received() const { return bytes_received_; }
+
+private:
+    const MerkleSearchTree& local_;
+    std::vector<Digest256> wanted_;
+    std::unordered_set<Digest256> requested_;
+    std::vector<MerkleSearchTree::Entry> missing_;
+    size_t rounds_ = 0;
+    size_t nodes_received_ = 0;
+    size_t bytes_received_ = 0;
+};
+
+#endif // MERKLE_SEARCH_TREE_H
\ No newline at end of file
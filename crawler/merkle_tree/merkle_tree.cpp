@@ -1,85 +1,473 @@
 #include "merkle_tree.h"
-#include <openssl/sha.h>
-#include <sstream>
-#include <iomanip>
+#include "../common/varint.h"
 #include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+size_t log2_floor(size_t n) {
+    size_t log = 0;
+    while (n >>= 1) ++log;
+    return log;
+}
+
+const uint8_t kRootPrefix = 0x02;
+
+/**
+ * @brief H(0x02 || leaf count as 8 little-endian bytes || top node). The top
+ *        node alone is shared by a tree and the same tree with its odd last
+ *        leaf repeated; the count tells them apart.
+ */
+Digest256 bind_root(const HashEngine& engine, uint64_t leaf_count, const Digest256& top) {
+    uint8_t message[1 + 8 + Digest256::kSize];
+    message[0] = kRootPrefix;
+    for (int i = 0; i < 8; ++i) message[1 + i] = uint8_t(leaf_count >> (8 * i));
+    std::memcpy(message + 9, top.data(), Digest256::kSize);
+    return engine.hash(message, sizeof(message));
+}
+
+} // namespace
 
 /**
- * @brief Helper function to hash two strings (hex-encoded SHA-256) into a parent node.
+ * @brief Construct a Merkle tree from a sequence of block hashes (leaves).
+ *        Leaves are copied once, into their heap slots, and the tree is
+ *        hashed in place.
  */
-std::string MerkleTree::hash_pair(const std::string& left, const std::string& right) {
-    std::string combined = left + right;
-    unsigned char hash[SHA256_DIGEST_LENGTH];
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
-    SHA256_Update(&sha256, combined.c_str(), combined.size());
-    SHA256_Final(hash, &sha256);
-    std::ostringstream oss;
-    for (size_t i = 0; i < SHA256_DIGEST_LENGTH; ++i) {
-        oss << std::hex << std::setw(2) << std::setfill('0') << (int)hash[i];
+MerkleTree::MerkleTree(const std::vector<Digest256>& block_hashes, HashAlgorithm algorithm)
+    : engine_(&HashEngine::get(algorithm)), leaf_count_(block_hashes.size()) {
+    if (leaf_count_ == 0) return;
+    capacity_ = 1;
+    while (capacity_ < leaf_count_) capacity_ <<= 1;
+    nodes_.resize(2 * capacity_);
+    std::copy(block_hashes.begin(), block_hashes.end(), nodes_.begin() + capacity_);
+    build_tree();
+    update_root();
+}
+
+size_t MerkleTree::level_width(size_t depth) const {
+    size_t shift = log2_floor(capacity_) - depth;
+    return (leaf_count_ + (size_t(1) << shift) - 1) >> shift;
+}
+
+void MerkleTree::hash_children(size_t first, size_t count) {
+    const Digest256* children = &nodes_[first];
+    std::vector<Digest256> leaf_hashes;
+    if (first >= capacity_) {
+        // Leaf slots hold block hashes; they enter the tree as H(0x00 || leaf)
+        leaf_hashes.resize(count);
+        engine_->hash_leaves(children, count, leaf_hashes.data());
+        children = leaf_hashes.data();
     }
-    return oss.str();
+    engine_->hash_pairs(children, count / 2, &nodes_[first / 2]);
+    if (count % 2) {
+        // Odd node: duplicate last
+        const Digest256& last = children[count - 1];
+        nodes_[(first + count - 1) / 2] = engine_->hash_pair(last, last);
+    }
+}
+
+Digest256 MerkleTree::tree_node(size_t node) const {
+    return node >= capacity_ ? engine_->hash_leaf(nodes_[node]) : nodes_[node];
 }
 
 /**
- * @brief Build the Merkle tree from the leaves, populating tree_levels_.
- *        Each level is a vector of hashes, with the root at the last level.
+ * @brief Hash the levels bottom-up. With enough leaves, the bottom levels are
+ *        split into 2^k equal subtrees hashed on separate threads (each thread
+ *        writes only its own slice of every level); the top k levels follow
+ *        on the calling thread.
  */
 void MerkleTree::build_tree() {
-    tree_levels_.clear();
-    if (leaves_.empty()) return;
-    tree_levels_.push_back(leaves_);
-    std::vector<std::string> current = leaves_;
-    while (current.size() > 1) {
-        std::vector<std::string> next_level;
-        for (size_t i = 0; i < current.size(); i += 2) {
-            if (i + 1 < current.size()) {
-                // Hash pair of children
-                next_level.push_back(hash_pair(current[i], current[i + 1]));
-            } else {
-                // Odd node: duplicate last
-                next_level.push_back(hash_pair(current[i], current[i]));
-            }
+    const size_t height = log2_floor(capacity_);
+    size_t threads = std::min<size_t>(std::thread::hardware_concurrency(), leaf_count_ / kLeavesPerThread);
+    size_t split = threads > 1 ? log2_floor(threads) : 0;
+    threads = size_t(1) << split;
+
+    auto build_subtree = [this, height, split, threads](size_t part) {
+        for (size_t depth = height; depth > split; --depth) {
+            size_t level = size_t(1) << depth;
+            size_t per_part = level / threads;
+            size_t begin = part * per_part;
+            size_t width = level_width(depth);
+            if (begin >= width) return;
+            hash_children(level + begin, std::min(per_part, width - begin));
         }
-        tree_levels_.push_back(next_level);
-        current = next_level;
+    };
+    std::vector<std::thread> workers;
+    for (size_t part = 1; part < threads; ++part) workers.emplace_back(build_subtree, part);
+    build_subtree(0);
+    for (std::thread& worker : workers) worker.join();
+    for (size_t depth = split; depth > 0; --depth) {
+        hash_children(size_t(1) << depth, level_width(depth));
     }
 }
 
 /**
- * @brief Construct a Merkle tree from a sequence of block hashes (leaves).
- *        Automatically builds the tree structure.
+ * @brief Walk from the leaf to the root, rehashing one parent per level.
  */
-MerkleTree::MerkleTree(const std::vector<std::string>& block_hashes)
-    : leaves_(block_hashes) {
-    build_tree();
+void MerkleTree::update_leaf(size_t index, const Digest256& hash) {
+    if (index >= leaf_count_) throw std::out_of_range("MerkleTree::update_leaf: leaf index out of range");
+    size_t node = capacity_ + index;
+    nodes_[node] = hash;
+    for (size_t depth = log2_floor(capacity_); depth > 0; --depth, node /= 2) {
+        size_t left = node & ~size_t(1);
+        bool has_right = left + 1 - (size_t(1) << depth) < level_width(depth);
+        nodes_[node / 2] = engine_->hash_pair(tree_node(left), tree_node(has_right ? left + 1 : left));
+    }
+    update_root();
+}
+
+void MerkleTree::append_leaves(const std::vector<Digest256>& hashes) {
+    if (hashes.empty()) return;
+    size_t first = leaf_count_;
+    size_t capacity = std::max<size_t>(capacity_, 1);
+    while (capacity < leaf_count_ + hashes.size()) capacity <<= 1;
+    relayout(capacity);
+    leaf_count_ += hashes.size();
+    std::copy(hashes.begin(), hashes.end(), nodes_.begin() + capacity_ + first);
+    rehash_from(first);
+    update_root();
+}
+
+void MerkleTree::remove_leaf(size_t index) {
+    if (index >= leaf_count_) throw std::out_of_range("MerkleTree::remove_leaf: leaf index out of range");
+    auto leaves = nodes_.begin() + capacity_;
+    std::copy(leaves + index + 1, leaves + leaf_count_, leaves + index);
+    --leaf_count_;
+    // The height follows the leaf count: shrink while the leaves fit in half
+    size_t capacity = capacity_;
+    while (capacity > 1 && capacity / 2 >= leaf_count_) capacity /= 2;
+    if (leaf_count_ == 0) {
+        capacity_ = 0;
+        nodes_.clear();
+    } else {
+        relayout(capacity);
+        rehash_from(index);
+    }
+    update_root();
 }
 
 /**
- * @brief Get the Merkle root hash (hex-encoded SHA-256).
- *        Returns empty string if tree is empty.
+ * @brief Per level, the dirty children run from the first changed one (rounded
+ *        down to its pair) to the end of the level. A level that lost its last
+ *        node keeps going upward so the new odd node gets rehashed.
  */
-std::string MerkleTree::root_hash() const {
-    if (tree_levels_.empty()) return "";
-    return tree_levels_.back().front();
+void MerkleTree::rehash_from(size_t first) {
+    for (size_t depth = log2_floor(capacity_); depth > 0; --depth, first /= 2) {
+        size_t begin = first & ~size_t(1);
+        size_t width = level_width(depth);
+        if (begin < width) hash_children((size_t(1) << depth) + begin, width - begin);
+    }
 }
 
 /**
- * @brief Compute the list of updated hashes (leaves) compared to another tree.
- *        Returns the hashes of leaves that differ between the two trees.
- *        (Assumes both trees have the same number/order of leaves.)
+ * @brief A tree of capacity c is the leftmost subtree of one of capacity 2c, so
+ *        growing moves every level k levels down and shrinking moves them up;
+ *        within a level the offsets stay. Levels are moved in the order that
+ *        never overwrites one still to be moved.
  */
-std::vector<std::string> MerkleTree::diff(const MerkleTree& other) const {
-    std::vector<std::string> diffs;
-    size_t n = std::min(leaves_.size(), other.leaves_.size());
-    for (size_t i = 0; i < n; ++i) {
-        if (leaves_[i] != other.leaves_[i]) {
-            diffs.push_back(leaves_[i]);
+void MerkleTree::relayout(size_t capacity) {
+    if (capacity == capacity_) return;
+    if (capacity_ == 0) {
+        capacity_ = capacity;
+        nodes_.assign(2 * capacity_, Digest256());
+        return;
+    }
+    const size_t old_height = log2_floor(capacity_);
+    const size_t height = log2_floor(capacity);
+    if (height > old_height) {
+        nodes_.resize(2 * capacity);
+        const size_t shift = height - old_height;
+        for (size_t depth = old_height + 1; depth-- > 0;) {
+            size_t level = size_t(1) << depth;
+            std::copy(nodes_.begin() + level, nodes_.begin() + 2 * level, nodes_.begin() + (level << shift));
         }
+    } else {
+        const size_t shift = old_height - height;
+        for (size_t depth = shift; depth <= old_height; ++depth) {
+            size_t level = size_t(1) << depth;
+            std::copy(nodes_.begin() + level, nodes_.begin() + level + (level >> shift), nodes_.begin() + (level >> shift));
+        }
+        nodes_.resize(2 * capacity);
+    }
+    capacity_ = capacity;
+}
+
+void MerkleTree::update_root() {
+    if (leaf_count_ == 0) {
+        root_ = Digest256();
+        root_hex_.clear();
+        return;
     }
-    // If this tree has extra leaves, consider them as diffs
-    for (size_t i = n; i < leaves_.size(); ++i) {
-        diffs.push_back(leaves_[i]);
+    root_ = bind_root(*engine_, leaf_count_, tree_node(1));
+    root_hex_.resize(2 * Digest256::kSize);
+    root_.hex(&root_hex_[0]);
+}
+
+/**
+ * @brief Get the Merkle root. Returns the all-zero digest if tree is empty.
+ */
+Digest256 MerkleTree::root() const {
+    return root_;
+}
+
+/**
+ * @brief Skip whole equal subtrees while both positions are aligned to them:
+ *        try the largest subtree both runs start on, halve it on a mismatch,
+ *        and stop at the first differing leaf.
+ */
+size_t MerkleTree::common_prefix(const MerkleTree& base, size_t i, size_t j, size_t limit) const {
+    size_t done = 0;
+    while (done < limit) {
+        size_t a = i + done;
+        size_t b = j + done;
+        size_t height = 0;
+        while ((size_t(2) << height) <= limit - done && !((a | b) & ((size_t(2) << height) - 1))) ++height;
+        while (height > 0 && base.node(a, height) != node(b, height)) --height;
+        if (height == 0 && base.leaf(a) != leaf(b)) break;
+        done += size_t(1) << height;
+    }
+    return done;
+}
+
+size_t MerkleTree::common_suffix(const MerkleTree& base, size_t i, size_t j, size_t limit) const {
+    size_t done = 0;
+    while (done < limit) {
+        size_t a = i - done;
+        size_t b = j - done;
+        size_t height = 0;
+        while ((size_t(2) << height) <= limit - done && !((a | b) & ((size_t(2) << height) - 1))) ++height;
+        while (height > 0 && base.node(a - (size_t(1) << height), height) != node(b - (size_t(1) << height), height)) {
+            --height;
+        }
+        if (height == 0 && base.leaf(a - 1) != leaf(b - 1)) break;
+        done += size_t(1) << height;
+    }
+    return done;
+}
+
+/**
+ * @brief Work list of range pairs. Each is trimmed of its common prefix and
+ *        suffix; what is left is split in two at an anchor, a leaf near the
+ *        middle of the new range that also occurs in the base range, searched
+ *        outward from its expected position. The first candidate sits on a
+ *        subtree boundary, so aligned halves keep skipping whole subtrees. A
+ *        range with no anchor (or with one side empty) becomes a hunk.
+ */
+MerkleDiff MerkleTree::compare(const MerkleTree& base) const {
+    struct Range {
+        size_t a0, a1, b0, b1;
+    };
+    static const size_t kAnchorTries = 8;
+    MerkleDiff result;
+    std::vector<Range> work{{0, base.leaf_count_, 0, leaf_count_}};
+    while (!work.empty()) {
+        Range r = work.back();
+        work.pop_back();
+        size_t skip = common_prefix(base, r.a0, r.b0, std::min(r.a1 - r.a0, r.b1 - r.b0));
+        r.a0 += skip;
+        r.b0 += skip;
+        skip = common_suffix(base, r.a1, r.b1, std::min(r.a1 - r.a0, r.b1 - r.b0));
+        r.a1 -= skip;
+        r.b1 -= skip;
+        if (r.a0 == r.a1 && r.b0 == r.b1) continue;
+        size_t old_len = r.a1 - r.a0;
+        size_t new_len = r.b1 - r.b0;
+        // First candidate: the largest subtree boundary inside the new range
+        size_t middle = new_len / 2;
+        if (new_len > 1) {
+            size_t height = 0;
+            while ((size_t(2) << height) < new_len) ++height;
+            for (;; --height) {
+                size_t boundary = ((r.b0 >> height) + 1) << height;
+                if (boundary < r.b1) {
+                    middle = boundary - r.b0;
+                    break;
+                }
+            }
+        }
+        bool split = false;
+        for (size_t t = 0; t < kAnchorTries && old_len > 0 && !split; ++t) {
+            // Alternate around the first candidate
+            size_t offset = t % 2 ? middle + (t + 1) / 2 : middle - t / 2;
+            if (offset >= new_len) continue;
+            size_t b = r.b0 + offset;
+            // Where b would be if the edits were spread evenly; equal-length ranges stay aligned
+            size_t expected = r.a0 + std::min(old_len - 1, offset * old_len / new_len);
+            for (size_t d = 0; d < old_len && !split; ++d) {
+                for (size_t a : {expected + d, expected - d}) {
+                    if (a < r.a0 || a >= r.a1 || base.leaf(a) != leaf(b)) continue;
+                    work.push_back({a, r.a1, b, r.b1});
+                    work.push_back({r.a0, a, r.b0, b});
+                    split = true;
+                    break;
+                }
+            }
+        }
+        if (!split) result.hunks.push_back({r.a0, old_len, r.b0, new_len});
+    }
+    for (const MerkleDiff::Hunk& hunk : result.hunks) {
+        size_t paired = std::min(hunk.old_count, hunk.new_count);
+        for (size_t k = 0; k < paired; ++k) result.modified.emplace_back(hunk.old_begin + k, hunk.new_begin + k);
+        for (size_t k = paired; k < hunk.new_count; ++k) result.added.push_back(hunk.new_begin + k);
+        for (size_t k = paired; k < hunk.old_count; ++k) result.removed.push_back(hunk.old_begin + k);
+    }
+    return result;
+}
+
+/**
+ * @brief Compute the list of updated hashes (leaves) compared to another tree.
+ *        Returns the hashes of this tree's leaves in the hunks of compare().
+ */
+std::vector<Digest256> MerkleTree::diff(const MerkleTree& other) const {
+    MerkleDiff changes = compare(other);
+    std::vector<Digest256> diffs;
+    for (const MerkleDiff::Hunk& hunk : changes.hunks) {
+        for (size_t k = 0; k < hunk.new_count; ++k) diffs.push_back(leaf(hunk.new_begin + k));
     }
     return diffs;
-} 
\ No newline at end of file
+}
+
+/**
+ * @brief Walk the levels as verify() does, emitting each sibling it will not
+ *        be able to compute.
+ */
+MerkleProof MerkleTree::prove(std::vector<uint64_t> indexes) const {
+    std::sort(indexes.begin(), indexes.end());
+    indexes.erase(std::unique(indexes.begin(), indexes.end()), indexes.end());
+    if (!indexes.empty() && indexes.back() >= leaf_count_) {
+        throw std::out_of_range("MerkleTree::prove: leaf index out of range");
+    }
+    MerkleProof proof;
+    proof.leaf_count = leaf_count_;
+    std::vector<uint64_t> known = indexes;
+    size_t depth = log2_floor(capacity_);
+    for (uint64_t width = leaf_count_; width > 1; width = (width + 1) / 2, --depth) {
+        size_t level = size_t(1) << depth;
+        size_t out = 0;
+        for (size_t j = 0; j < known.size();) {
+            uint64_t pos = known[j];
+            bool pair_known = !(pos & 1) && j + 1 < known.size() && known[j + 1] == pos + 1;
+            uint64_t sibling = pos ^ 1;
+            if (!pair_known && sibling < width) proof.nodes.push_back(tree_node(level + sibling));
+            known[out++] = pos / 2;
+            j += pair_known ? 2 : 1;
+        }
+        known.resize(out);
+    }
+    proof.indexes = std::move(indexes);
+    return proof;
+}
+
+/**
+ * @brief Known nodes live in leaves[0..known); their positions on the current
+ *        level are the distinct values of index >> level, recomputed by a
+ *        cursor over proof.indexes, so nothing besides leaves is written.
+ *        proof.leaf_count is untrusted until the root it is hashed into matches.
+ */
+bool MerkleTree::verify(const Digest256& root, const MerkleProof& proof, Digest256* leaves,
+                        HashAlgorithm algorithm) {
+    const HashEngine& engine = HashEngine::get(algorithm);
+    const std::vector<uint64_t>& indexes = proof.indexes;
+    if (indexes.empty() || proof.leaf_count == 0) return false;
+    for (size_t i = 0; i < indexes.size(); ++i) {
+        if (indexes[i] >= proof.leaf_count || (i > 0 && indexes[i] <= indexes[i - 1])) return false;
+    }
+    size_t known = indexes.size();
+    for (size_t j = 0; j < known; ++j) leaves[j] = engine.hash_leaf(leaves[j]);
+    size_t consumed = 0;
+    unsigned shift = 0;
+    for (uint64_t width = proof.leaf_count; width > 1; width = (width + 1) / 2, ++shift) {
+        size_t cursor = 0;
+        auto next_position = [&] {
+            uint64_t pos = indexes[cursor] >> shift;
+            while (cursor < indexes.size() && indexes[cursor] >> shift == pos) ++cursor;
+            return pos;
+        };
+        size_t out = 0;
+        uint64_t pos = next_position();
+        for (size_t j = 0; j < known;) {
+            bool has_next = j + 1 < known;
+            uint64_t next = has_next ? next_position() : 0;
+            if (!(pos & 1) && has_next && next == pos + 1) {
+                leaves[out++] = engine.hash_pair(leaves[j], leaves[j + 1]);
+                j += 2;
+                pos = j < known ? next_position() : 0;
+                continue;
+            }
+            if (pos + 1 < width || (pos & 1)) {
+                if (consumed == proof.nodes.size()) return false;
+                const Digest256& sibling = proof.nodes[consumed++];
+                leaves[out++] = pos & 1 ? engine.hash_pair(sibling, leaves[j]) : engine.hash_pair(leaves[j], sibling);
+            } else {
+                // Odd node: duplicate last
+                leaves[out++] = engine.hash_pair(leaves[j], leaves[j]);
+            }
+            ++j;
+            pos = next;
+        }
+        known = out;
+    }
+    return consumed == proof.nodes.size() && known == 1 && bind_root(engine, proof.leaf_count, leaves[0]) == root;
+}
+
+bool MerkleTree::verify(const Digest256& root, uint64_t leaf_count, uint64_t index, const Digest256& leaf,
+                        const Digest256* nodes, size_t node_count, HashAlgorithm algorithm) {
+    const HashEngine& engine = HashEngine::get(algorithm);
+    if (index >= leaf_count) return false;
+    Digest256 node = engine.hash_leaf(leaf);
+    size_t consumed = 0;
+    for (uint64_t width = leaf_count; width > 1; width = (width + 1) / 2, index /= 2) {
+        if (index & 1 || index + 1 < width) {
+            if (consumed == node_count) return false;
+            const Digest256& sibling = nodes[consumed++];
+            node = index & 1 ? engine.hash_pair(sibling, node) : engine.hash_pair(node, sibling);
+        } else {
+            node = engine.hash_pair(node, node);
+        }
+    }
+    return consumed == node_count && bind_root(engine, leaf_count, node) == root;
+}
+
+std::string MerkleProof::encode() const {
+    std::string out;
+    out.reserve(16 + indexes.size() * 3 + nodes.size() * Digest256::kSize);
+    put_varint(out, leaf_count);
+    put_varint(out, indexes.size());
+    uint64_t previous = 0;
+    for (uint64_t index : indexes) {
+        put_varint(out, index - previous);
+        previous = index;
+    }
+    put_varint(out, nodes.size());
+    for (const Digest256& node : nodes) out.append(node.data(), Digest256::kSize);
+    return out;
+}
+
+bool MerkleProof::decode(const char* data, size_t len, MerkleProof& out) {
+    const char* p = data;
+    const char* end = data + len;
+    MerkleProof proof;
+    uint64_t count;
+    if (!get_varint(p, end, proof.leaf_count) || !get_varint(p, end, count) || count > uint64_t(end - p)) return false;
+    proof.indexes.resize(size_t(count));
+    uint64_t previous = 0;
+    for (uint64_t& index : proof.indexes) {
+        uint64_t delta;
+        if (!get_varint(p, end, delta)) return false;
+        index = previous + delta;
+        previous = index;
+    }
+    if (!get_varint(p, end, count) || count != uint64_t(end - p) / Digest256::kSize ||
+        uint64_t(end - p) % Digest256::kSize != 0) {
+        return false;
+    }
+    proof.nodes.resize(size_t(count));
+    for (Digest256& node : proof.nodes) {
+        node = Digest256::from_bytes(p);
+        p += Digest256::kSize;
+    }
+    out = std::move(proof);
+    return true;
+}
\ No newline at end of file
@@ -5,21 +5,91 @@
 // Responsibilities:
 // - Constructs a Merkle tree from a sequence of block hashes
 // - Computes root hash
-// - Computes diffs between trees (list of updated hashes)
+// - Updates, appends and removes leaves in place
+// - Computes structural diffs between trees (added, removed and modified leaves)
+// - Generates and verifies inclusion proofs for one or many leaves
 //
-// Planned interface:
+// Interface:
 //   class MerkleTree {
 //     public:
-//       MerkleTree(const std::vector<std::string>& block_hashes);
-//       std::string root_hash() const;
-//       std::vector<std::string> diff(const MerkleTree& other) const;
+//       MerkleTree(const std::vector<Digest256>& block_hashes,
+//                  HashAlgorithm algorithm = HashAlgorithm::kSha256);
+//       Digest256 root() const;
+//       const std::string& root_hash() const;
+//       size_t size() const;
+//       const Digest256& leaf(size_t index) const;
+//       void update_leaf(size_t index, const Digest256& hash);
+//       void append_leaves(const std::vector<Digest256>& hashes);
+//       void remove_leaf(size_t index);
+//       MerkleDiff compare(const MerkleTree& base) const;
+//       std::vector<Digest256> diff(const MerkleTree& other) const;
+//       MerkleProof prove(std::vector<uint64_t> indexes) const;
+//       static bool verify(const Digest256& root, const MerkleProof& proof,
+//                          Digest256* leaves, HashAlgorithm algorithm);
 //   };
 
 #ifndef MERKLE_TREE_H
 #define MERKLE_TREE_H
 
 #include <string>
+#include <utility>
 #include <vector>
+#include "../common/digest.h"
+#include "../common/hash_engine.h"
+
+/**
+ * @struct MerkleDiff
+ * @brief Leaf-level changes from a base tree to a newer one.
+ *
+ * A hunk replaces base leaves [old_begin, old_begin + old_count) with new
+ * leaves [new_begin, new_begin + new_count); leaves outside the hunks are
+ * equal and in the same order. Within a hunk the first min(counts) leaves
+ * pair up as modified and the rest are added or removed.
+ */
+struct MerkleDiff {
+    struct Hunk {
+        size_t old_begin = 0;
+        size_t old_count = 0;
+        size_t new_begin = 0;
+        size_t new_count = 0;
+    };
+
+    std::vector<Hunk> hunks;                          ///< In leaf order
+    std::vector<size_t> added;                        ///< Indexes into the new tree
+    std::vector<size_t> removed;                      ///< Indexes into the base tree
+    std::vector<std::pair<size_t, size_t>> modified;  ///< (base index, new index)
+
+    bool empty() const { return hunks.empty(); }
+};
+
+/**
+ * @struct MerkleProof
+ * @brief Inclusion proof for a set of leaves (a multi-proof; one leaf is the
+ *        ordinary audit path).
+ *
+ * nodes holds only the hashes a verifier cannot compute from the proven
+ * leaves: going up level by level, the sibling of every known node that is
+ * neither known itself nor missing (a last odd node pairs with itself). Leaves
+ * that share ancestors share those nodes, so a batch of k leaves needs far
+ * fewer than k * log n hashes. Sibling leaves are sent as leaf hashes
+ * (H(0x00 || leaf)). leaf_count is checked through the root, which commits
+ * to it.
+ *
+ * Encoding: varint leaf_count, varint index count, indexes as varint deltas,
+ *           varint node count, nodes (32 bytes each).
+ */
+struct MerkleProof {
+    uint64_t leaf_count = 0;
+    std::vector<uint64_t> indexes;  ///< Proven leaves, ascending and distinct
+    std::vector<Digest256> nodes;   ///< In the order verification consumes them
+
+    std::string encode() const;
+
+    /**
+     * @return False if the record is truncated or malformed.
+     */
+    static bool decode(const char* data, size_t len, MerkleProof& out);
+};
 
 /**
  * @class MerkleTree
@@ -27,44 +97,175 @@
  *
  * Constructs a binary Merkle tree from a vector of leaf hashes (block hashes).
  * Supports efficient computation of the root hash and diffs between trees.
+ * Nodes are raw 32-byte digests, hashed with RFC 6962's prefixes so leaves and
+ * internal nodes never collide: a leaf enters the tree as H(0x00 || leaf) and
+ * a parent is H(0x01 || left || right). A level with an odd node count pairs
+ * its last node with itself, which gives a tree and the same tree with its
+ * last leaf repeated the same top node; the root is therefore
+ * H(0x02 || leaf count || top node), so the two differ and a proof cannot
+ * claim another leaf count.
+ *
+ * All nodes live in one array in implicit heap layout: the root is node 1,
+ * the children of node i are 2i and 2i + 1, and the leaves start at the leaf
+ * capacity (the leaf count rounded up to a power of two). Every level is a
+ * contiguous run, so a level is hashed as one HashEngine batch straight into
+ * the level above, and large trees hash disjoint subtrees on several threads.
+ *
+ * Leaves can be updated, appended and removed in place; only the nodes above
+ * the changed leaves are rehashed. A mutated tree has the same nodes as a tree
+ * built from scratch over the same leaves. Mutators are not thread-safe.
  */
 class MerkleTree {
 public:
     /**
      * @brief Construct a Merkle tree from a sequence of block hashes (leaves).
-     * @param block_hashes Vector of leaf hashes (hex-encoded SHA-256).
+     * @param block_hashes Vector of leaf hashes (SHA-256 digests).
+     * @param algorithm Hash for internal nodes; matches the store's block hash.
+     */
+    MerkleTree(const std::vector<Digest256>& block_hashes,
+               HashAlgorithm algorithm = HashAlgorithm::kSha256);
+
+    /**
+     * @brief Get the Merkle root (all-zero digest if the tree is empty).
      */
-    MerkleTree(const std::vector<std::string>& block_hashes);
+    Digest256 root() const;
 
     /**
      * @brief Get the Merkle root hash (hex-encoded SHA-256).
-     * @return The root hash of the tree.
+     * @return The root hash of the tree, or empty string if the tree is empty.
+     *         Kept up to date by every mutation, so reading it never allocates.
+     */
+    const std::string& root_hash() const { return root_hex_; }
+
+    /**
+     * @brief Number of leaves.
+     */
+    size_t size() const { return leaf_count_; }
+
+    const Digest256& leaf(size_t index) const { return nodes_[capacity_ + index]; }
+
+    /**
+     * @brief Replace one leaf and rehash its path to the root: O(log n).
+     * @throws std::out_of_range if index >= size().
+     */
+    void update_leaf(size_t index, const Digest256& hash);
+
+    /**
+     * @brief Append leaves and rehash the nodes above them: O(m + log n) for m
+     *        leaves. Growing past the leaf capacity moves the existing levels
+     *        one subtree down instead of rehashing them.
+     */
+    void append_leaves(const std::vector<Digest256>& hashes);
+
+    /**
+     * @brief Remove one leaf, shifting the leaves after it down by one.
+     *        Every node above a shifted leaf changes, so this costs
+     *        O(n - index + log n); removing the last leaf is O(log n).
+     * @throws std::out_of_range if index >= size().
      */
-    std::string root_hash() const;
+    void remove_leaf(size_t index);
+
+    /**
+     * @brief Structural diff from base to this tree.
+     *
+     * Equal runs are skipped a whole subtree at a time wherever the two trees
+     * line up, so k changes that keep leaf positions cost O(k log n) node
+     * comparisons. After an insertion or deletion the runs are shifted and no
+     * longer share subtrees; they are resynchronised on a matching leaf and
+     * compared leaf by leaf (a digest compare, no hashing). With
+     * content-defined chunking an edit changes only the blocks around it, so
+     * the hunks stay as small as the edit.
+     */
+    MerkleDiff compare(const MerkleTree& base) const;
 
     /**
      * @brief Compute the list of updated hashes (leaves) compared to another tree.
      * @param other The other MerkleTree to compare against.
-     * @return Vector of hashes that differ between the two trees.
+     * @return Hashes of the leaves of this tree that are added or modified
+     *         relative to other.
      */
-    std::vector<std::string> diff(const MerkleTree& other) const;
+    std::vector<Digest256> diff(const MerkleTree& other) const;
+
+    /**
+     * @brief Inclusion proof for the given leaves (sorted and deduplicated).
+     * @throws std::out_of_range if an index is not a leaf.
+     */
+    MerkleProof prove(std::vector<uint64_t> indexes) const;
+
+    /**
+     * @brief Check that leaves sit at proof.indexes under root. Runs in place
+     *        and never allocates, so a peer can check every received batch.
+     * @param leaves Hashes of the proven leaves, in index order; overwritten
+     *        with intermediate nodes.
+     * @param algorithm Hash of the tree that produced the proof.
+     */
+    static bool verify(const Digest256& root, const MerkleProof& proof, Digest256* leaves,
+                       HashAlgorithm algorithm = HashAlgorithm::kSha256);
+
+    /**
+     * @brief Single-leaf form of verify, over a proof's nodes.
+     */
+    static bool verify(const Digest256& root, uint64_t leaf_count, uint64_t index, const Digest256& leaf,
+                       const Digest256* nodes, size_t node_count,
+                       HashAlgorithm algorithm = HashAlgorithm::kSha256);
 
 private:
-    std::vector<std::string> leaves_; ///< Leaf hashes (block hashes)
-    std::vector<std::vector<std::string>> tree_levels_; ///< Each level of the tree, bottom-up
+    static constexpr size_t kLeavesPerThread = 1 << 15; ///< Smallest subtree worth a thread
+
+    const HashEngine* engine_;
+    size_t leaf_count_ = 0;
+    size_t capacity_ = 0;            ///< Leaf capacity, a power of two; leaf i is node capacity_ + i
+    std::vector<Digest256> nodes_;   ///< Implicit heap, 2 * capacity_ nodes; node 0 is unused
+    Digest256 root_;
+    std::string root_hex_;           ///< root() in hex, rewritten in place
 
     /**
-     * @brief Build the tree from the leaves, populating tree_levels_.
+     * @brief Hash every internal node from the leaves up.
      */
     void build_tree();
 
     /**
-     * @brief Compute the hash of two child nodes (internal node hash).
-     * @param left Left child hash.
-     * @param right Right child hash.
-     * @return Parent node hash (hex-encoded SHA-256).
+     * @brief Hash count children starting at node first (even) into their parents.
+     */
+    void hash_children(size_t first, size_t count);
+
+    /**
+     * @brief Rehash the ancestors of leaves first..size() (and of the removed
+     *        leaves past the end), level by level.
      */
-    static std::string hash_pair(const std::string& left, const std::string& right);
+    void rehash_from(size_t first);
+
+    /**
+     * @brief Move the levels to a tree with another leaf capacity (a power
+     *        of two at least size()), keeping their hashes.
+     */
+    void relayout(size_t capacity);
+
+    void update_root();
+
+    /**
+     * @brief Hash of a node as its parent sees it: H(0x00 || leaf) for a
+     *        leaf slot, the stored hash otherwise.
+     */
+    Digest256 tree_node(size_t node) const;
+
+    /**
+     * @brief Nodes on the level at depth that have at least one leaf below them.
+     */
+    size_t level_width(size_t depth) const;
+
+    /**
+     * @brief Node of height h (0 for leaves) whose subtree starts at leaf index.
+     */
+    const Digest256& node(size_t index, size_t height) const { return nodes_[(capacity_ + index) >> height]; }
+
+    /**
+     * @brief Length of the equal run starting at base leaf i and leaf j of
+     *        this tree (ending there, for the suffix), at most limit.
+     */
+    size_t common_prefix(const MerkleTree& base, size_t i, size_t j, size_t limit) const;
+    size_t common_suffix(const MerkleTree& base, size_t i, size_t j, size_t limit) const;
+
 };
 
 #endif // MERKLE_TREE_H 
\ No newline at end of file
@@ -0,0 +1,163 @@
+// File: crawler/p2p_dht/event_loop.cpp
+
+#include "event_loop.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <future>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+namespace p2p_dht {
+
+    EventLoop::EventLoop() {
+        if (pipe(wake_fds_) != 0) throw std::runtime_error("EventLoop: pipe failed");
+        for (int fd : wake_fds_) fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd_ < 0) throw std::runtime_error("EventLoop: epoll_create1 failed");
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = wake_fds_[0];
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fds_[0], &event);
+    }
+
+    EventLoop::~EventLoop() {
+        stop();
+        close(epoll_fd_);
+        close(wake_fds_[0]);
+        close(wake_fds_[1]);
+    }
+
+    void EventLoop::start() {
+        if (running_) return;
+        running_ = true;
+        // run() takes this lock first, so thread_id_ is set before any task runs
+        std::lock_guard<std::mutex> lock(posted_mutex_);
+        stopping_ = false;
+        thread_ = std::thread([this] { run(); });
+        thread_id_ = thread_.get_id();
+    }
+
+    void EventLoop::stop() {
+        if (!running_) return;
+        {
+            std::lock_guard<std::mutex> lock(posted_mutex_);
+            stopping_ = true;
+        }
+        char byte = 0;
+        (void)!write(wake_fds_[1], &byte, 1);
+        thread_.join();
+        running_ = false;
+        thread_id_ = std::thread::id();
+        std::lock_guard<std::mutex> lock(posted_mutex_);
+        posted_.clear();
+    }
+
+    void EventLoop::post(std::function<void()> fn) {
+        {
+            std::lock_guard<std::mutex> lock(posted_mutex_);
+            posted_.push_back(std::move(fn));
+        }
+        char byte = 0;
+        (void)!write(wake_fds_[1], &byte, 1);  // A full pipe already means a pending wakeup
+    }
+
+    void EventLoop::run_sync(const std::function<void()>& fn) {
+        if (in_loop_thread() || !running_) {
+            fn();
+            return;
+        }
+        std::promise<void> done;
+        post([&] {
+            fn();
+            done.set_value();
+        });
+        done.get_future().wait();
+    }
+
+    EventLoop::TimerId EventLoop::call_after(Clock::duration delay, std::function<void()> fn) {
+        TimerId id = next_timer_++;
+        Clock::time_point when = Clock::now() + delay;
+        deadlines_.emplace(when, id);
+        timers_.emplace(id, std::make_pair(when, std::move(fn)));
+        return id;
+    }
+
+    void EventLoop::cancel(TimerId id) {
+        // The deadline entry stays behind and is skipped when it comes due
+        timers_.erase(id);
+    }
+
+    void EventLoop::watch(int fd, std::function<void()> on_readable) {
+        if (watched_.count(fd) == 0) {
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.fd = fd;
+            epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event);
+        }
+        watched_[fd] = std::move(on_readable);
+    }
+
+    void EventLoop::unwatch(int fd) {
+        if (watched_.erase(fd)) epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    }
+
+    void EventLoop::run() {
+        std::vector<epoll_event> events(256);
+        std::vector<int> ready;
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(posted_mutex_);
+                if (stopping_) break;
+            }
+            int timeout_ms = -1;
+            if (!deadlines_.empty()) {
+                auto wait = deadlines_.begin()->first - Clock::now();
+                timeout_ms = int(std::max<int64_t>(0, std::chrono::ceil<std::chrono::milliseconds>(wait).count()));
+            }
+            int n = epoll_wait(epoll_fd_, events.data(), int(events.size()), timeout_ms);
+            ready.clear();
+            for (int i = 0; i < n; ++i) {
+                if (events[i].data.fd == wake_fds_[0]) {
+                    char drain[256];
+                    while (read(wake_fds_[0], drain, sizeof(drain)) > 0) {}
+                } else {
+                    ready.push_back(events[i].data.fd);
+                }
+            }
+            run_posted();
+            // Handlers may unwatch sockets (a node shutting down): look each one up again
+            for (int fd : ready) {
+                auto it = watched_.find(fd);
+                if (it != watched_.end()) {
+                    auto handler = it->second;
+                    handler();
+                }
+            }
+            run_timers();
+        }
+    }
+
+    void EventLoop::run_posted() {
+        std::vector<std::function<void()>> tasks;
+        {
+            std::lock_guard<std::mutex> lock(posted_mutex_);
+            tasks.swap(posted_);
+        }
+        for (auto& task : tasks) task();
+    }
+
+    void EventLoop::run_timers() {
+        Clock::time_point now = Clock::now();
+        while (!deadlines_.empty() && deadlines_.begin()->first <= now) {
+            TimerId id = deadlines_.begin()->second;
+            deadlines_.erase(deadlines_.begin());
+            auto it = timers_.find(id);
+            if (it == timers_.end()) continue;  // Cancelled
+            std::function<void()> fn = std::move(it->second.second);
+            timers_.erase(it);
+            fn();
+        }
+    }
+
+} // namespace p2p_dht
\ No newline at end of file
@@ -0,0 +1,100 @@
+// File: crawler/p2p_dht/event_loop.h
+// single-threaded event loop for DHT sockets and timers
+#ifndef P2P_DHT_EVENT_LOOP_H
+#define P2P_DHT_EVENT_LOOP_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace p2p_dht {
+
+    /**
+     * @class EventLoop
+     * @brief One thread that waits on sockets (epoll) and runs timers and posted tasks.
+     *
+     * Every DHT node that uses a loop keeps its state on the loop thread, so
+     * node internals need no locks; other threads hand work over with post().
+     * Many nodes can share one loop: a thousand nodes on 127.0.0.1 cost one
+     * thread, not a thousand. Callbacks run on the loop thread and must not
+     * block.
+     */
+    class EventLoop {
+    public:
+        using Clock = std::chrono::steady_clock;
+        using TimerId = uint64_t;
+
+        EventLoop();
+        ~EventLoop();
+
+        EventLoop(const EventLoop&) = delete;
+        EventLoop& operator=(const EventLoop&) = delete;
+
+        /**
+         * @brief Start the loop thread (idempotent).
+         */
+        void start();
+
+        /**
+         * @brief Stop and join the loop thread. Tasks posted but not yet run are dropped.
+         */
+        void stop();
+
+        bool in_loop_thread() const { return std::this_thread::get_id() == thread_id_; }
+
+        /**
+         * @brief Run fn on the loop thread. Thread-safe.
+         */
+        void post(std::function<void()> fn);
+
+        /**
+         * @brief Run fn on the loop thread and wait for it (runs inline on the loop thread).
+         */
+        void run_sync(const std::function<void()>& fn);
+
+        /**
+         * @brief Run fn once after delay. Loop thread only.
+         */
+        TimerId call_after(Clock::duration delay, std::function<void()> fn);
+
+        /**
+         * @brief Cancel a timer that has not fired. Loop thread only.
+         */
+        void cancel(TimerId id);
+
+        /**
+         * @brief Call on_readable whenever fd has data. Loop thread only.
+         */
+        void watch(int fd, std::function<void()> on_readable);
+        void unwatch(int fd);
+
+    private:
+        std::thread thread_;
+        std::thread::id thread_id_;
+        int epoll_fd_ = -1;
+        int wake_fds_[2] = {-1, -1};   ///< Self-pipe: post() writes a byte to end epoll_wait()
+        bool running_ = false;
+
+        std::mutex posted_mutex_;
+        std::vector<std::function<void()>> posted_;
+        bool stopping_ = false;
+
+        // Loop-thread state
+        TimerId next_timer_ = 1;
+        std::multimap<Clock::time_point, TimerId> deadlines_;
+        std::unordered_map<TimerId, std::pair<Clock::time_point, std::function<void()>>> timers_;
+        std::map<int, std::function<void()>> watched_;
+
+        void run();
+        void run_posted();
+        void run_timers();
+    };
+
+} // namespace p2p_dht
+
+#endif // P2P_DHT_EVENT_LOOP_H
\ No newline at end of file
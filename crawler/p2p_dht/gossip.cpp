@@ -0,0 +1,403 @@
+// File: crawler/p2p_dht/gossip.cpp
+
+#include "gossip.h"
+#include "../common/hash_mix.h"
+#include "../common/varint.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace p2p_dht {
+
+    namespace {
+
+        void put_string(std::vector<uint8_t>& out, const std::string& value) {
+            put_varint(out, value.size());
+            out.insert(out.end(), value.begin(), value.end());
+        }
+
+        bool get_string(const uint8_t*& p, const uint8_t* end, std::string& value) {
+            uint64_t size;
+            if (!get_varint(p, end, size) || size > uint64_t(end - p)) return false;
+            value.assign(reinterpret_cast<const char*>(p), size_t(size));
+            p += size;
+            return true;
+        }
+
+        int millis_until(std::chrono::steady_clock::time_point when, std::chrono::steady_clock::time_point now) {
+            if (when <= now) return 0;
+            return int(std::chrono::ceil<std::chrono::milliseconds>(when - now).count());
+        }
+
+        /// Queue accounting per message: the data plus its ID and length
+        size_t queued_bytes(const std::vector<uint8_t>& data) { return data.size() + 12; }
+
+    } // namespace
+
+    // ---------------------------------------------------------------- SeenCache
+
+    SeenCache::SeenCache(size_t expected_per_bucket, double false_positive_rate, int buckets, Clock::duration window)
+        : filters_(size_t(std::max(2, buckets))) {
+        double ln2 = std::log(2.0);
+        double bits = -double(std::max<size_t>(1, expected_per_bucket)) * std::log(false_positive_rate) / (ln2 * ln2);
+        bits_ = (size_t(bits) + 63) / 64 * 64;
+        hashes_ = std::max(1, int(std::lround(bits / double(std::max<size_t>(1, expected_per_bucket)) * ln2)));
+        span_ = window / filters_.size();
+    }
+
+    void SeenCache::rotate(Clock::time_point now) {
+        if (filters_[0].empty()) {
+            for (auto& filter : filters_) filter.assign(bits_ / 64, 0);
+            span_start_ = now;
+            return;
+        }
+        if (now - span_start_ >= span_ * int(filters_.size())) {
+            // Idle for a whole window: everything has aged out
+            for (auto& filter : filters_) std::fill(filter.begin(), filter.end(), 0);
+            span_start_ = now;
+            return;
+        }
+        while (now - span_start_ >= span_) {
+            current_ = (current_ + 1) % filters_.size();
+            std::fill(filters_[current_].begin(), filters_[current_].end(), 0);
+            span_start_ += span_;
+        }
+    }
+
+    bool SeenCache::test(const std::vector<uint64_t>& filter, uint64_t id) const {
+        uint64_t h1 = mix64(id);
+        uint64_t h2 = mix64(id ^ 0xC2B2AE3D27D4EB4Full) | 1;
+        for (int i = 0; i < hashes_; ++i) {
+            size_t bit = size_t((h1 + uint64_t(i) * h2) % bits_);
+            if (!(filter[bit / 64] >> (bit % 64) & 1)) return false;
+        }
+        return true;
+    }
+
+    bool SeenCache::contains(uint64_t id, Clock::time_point now) {
+        rotate(now);
+        for (const auto& filter : filters_) {
+            if (test(filter, id)) return true;
+        }
+        return false;
+    }
+
+    bool SeenCache::insert(uint64_t id, Clock::time_point now) {
+        if (contains(id, now)) return false;
+        std::vector<uint64_t>& filter = filters_[current_];
+        uint64_t h1 = mix64(id);
+        uint64_t h2 = mix64(id ^ 0xC2B2AE3D27D4EB4Full) | 1;
+        for (int i = 0; i < hashes_; ++i) {
+            size_t bit = size_t((h1 + uint64_t(i) * h2) % bits_);
+            filter[bit / 64] |= uint64_t(1) << (bit % 64);
+        }
+        return true;
+    }
+
+    size_t SeenCache::memory_bytes() const {
+        size_t bytes = 0;
+        for (const auto& filter : filters_) bytes += filter.size() * sizeof(uint64_t);
+        return bytes;
+    }
+
+    // ---------------------------------------------------------------- GossipRouter
+
+    GossipRouter::GossipRouter(const Digest256& self, const Config& config, Transport transport)
+        : self_(self),
+          config_(config),
+          transport_(std::move(transport)),
+          seen_(config.seen_expected, config.seen_false_positive, config.seen_buckets,
+                std::chrono::seconds(config.seen_window_s)) {
+        std::memcpy(&rng_state_, self.bytes.data(), sizeof(rng_state_));
+        rng_state_ |= 1;
+    }
+
+    uint64_t GossipRouter::random() {
+        rng_state_ ^= rng_state_ >> 12;
+        rng_state_ ^= rng_state_ << 25;
+        rng_state_ ^= rng_state_ >> 27;
+        return rng_state_ * 0x2545F4914F6CDD1Dull;
+    }
+
+    uint64_t GossipRouter::message_id(const std::string& topic, const uint8_t* data, size_t size) {
+        std::string content = topic;
+        content.push_back('\0');
+        content.append(reinterpret_cast<const char*>(data), size);
+        Digest256 digest = Digest256::of(content);
+        uint64_t id;
+        std::memcpy(&id, digest.bytes.data(), sizeof(id));
+        return id;
+    }
+
+    void GossipRouter::subscribe(const std::string& topic, MessageCallback callback) {
+        Topic& state = topics_[topic];
+        state.callback = std::move(callback);
+        if (!state.subscribed) {
+            // Fanout peers we already publish to become the first mesh members
+            state.subscribed = true;
+            for (const Digest256& peer : state.mesh) enqueue_control(peer, kGraft, topic);
+        }
+        refresh_peers(topic);
+    }
+
+    void GossipRouter::refresh_peers(const std::string& topic) {
+        Topic& state = topics_[topic];
+        if (state.looking_up) return;
+        state.looking_up = true;
+        transport_.find_peers(topic, [this, topic](const std::vector<Digest256>& peers) {
+            Topic& state = topics_[topic];
+            state.looking_up = false;
+            state.known.clear();
+            for (const Digest256& peer : peers) {
+                if (peer != self_) state.known.push_back(peer);
+            }
+            maintain(topic, state);
+            for (const auto& message : state.pending) forward(topic, state, message.first, message.second, nullptr, now_);
+            state.pending.clear();
+        });
+    }
+
+    void GossipRouter::maintain(const std::string& topic, Topic& state) {
+        size_t target = state.subscribed ? config_.mesh_low : config_.mesh_degree;
+        if (state.mesh.size() < target) {
+            std::vector<Digest256> candidates;
+            for (const Digest256& peer : state.known) {
+                if (!state.mesh.count(peer)) candidates.push_back(peer);
+            }
+            while (state.mesh.size() < config_.mesh_degree && !candidates.empty()) {
+                size_t pick = size_t(random() % candidates.size());
+                state.mesh.insert(candidates[pick]);
+                if (state.subscribed) {
+                    enqueue_control(candidates[pick], kGraft, topic);
+                    ++stats_.grafts;
+                }
+                candidates[pick] = candidates.back();
+                candidates.pop_back();
+            }
+        }
+        if (state.subscribed && state.mesh.size() > config_.mesh_high) {
+            std::vector<Digest256> members(state.mesh.begin(), state.mesh.end());
+            while (state.mesh.size() > config_.mesh_degree) {
+                size_t pick = size_t(random() % members.size());
+                state.mesh.erase(members[pick]);
+                enqueue_control(members[pick], kPrune, topic);
+                ++stats_.prunes;
+                members[pick] = members.back();
+                members.pop_back();
+            }
+        }
+    }
+
+    void GossipRouter::heartbeat(Clock::time_point now) {
+        now_ = now;
+        for (auto& entry : topics_) {
+            Topic& state = entry.second;
+            if (state.subscribed) {
+                // A mesh short of peers asks again at once (the owner caches lookups)
+                if (state.heartbeats++ % config_.peer_refresh_heartbeats == 0 || state.mesh.size() < config_.mesh_low) {
+                    refresh_peers(entry.first);
+                } else {
+                    maintain(entry.first, state);
+                }
+            } else if (!state.mesh.empty() && now - state.last_publish > std::chrono::seconds(config_.fanout_ttl_s)) {
+                state.mesh.clear();
+            }
+        }
+    }
+
+    void GossipRouter::publish(const std::string& topic, const std::vector<uint8_t>& data, Clock::time_point now) {
+        now_ = now;
+        uint64_t id = message_id(topic, data);
+        if (!seen_.insert(id, now)) {
+            ++stats_.duplicates;
+            return;
+        }
+        ++stats_.published;
+        Topic& state = topics_[topic];
+        state.last_publish = now;
+        auto shared = std::make_shared<const std::vector<uint8_t>>(data);
+        if (state.mesh.empty()) {
+            // Held until the topic's subscribers are known
+            if (state.pending.size() < config_.max_pending) {
+                state.pending.emplace_back(id, shared);
+            } else {
+                ++stats_.dropped;
+            }
+            refresh_peers(topic);
+            return;
+        }
+        forward(topic, state, id, shared, nullptr, now);
+    }
+
+    void GossipRouter::forward(const std::string& topic, Topic& state, uint64_t id,
+                               const std::shared_ptr<const std::vector<uint8_t>>& data, const Digest256* except,
+                               Clock::time_point now) {
+        Queued message{&topics_.find(topic)->first, id, data};
+        for (const Digest256& peer : state.mesh) {
+            if (except && peer == *except) continue;
+            enqueue(peer, message, now);
+            ++stats_.forwarded;
+        }
+    }
+
+    void GossipRouter::enqueue(const Digest256& peer, const Queued& message, Clock::time_point now) {
+        PeerQueue& queue = queues_[peer];
+        if (!queue.ids.emplace(message.id, queued_bytes(*message.data)).second) {
+            ++stats_.coalesced;
+            return;
+        }
+        queue.messages.push_back(message);
+        queue.bytes += queued_bytes(*message.data);
+        while (queue.bytes > config_.max_queue_bytes && !queue.messages.empty()) {
+            // Flow control: the peer cannot keep up, shed the oldest
+            const Queued& oldest = queue.messages.front();
+            if (queue.ids.erase(oldest.id)) {
+                queue.bytes -= queued_bytes(*oldest.data);
+                ++stats_.dropped;
+            }
+            queue.messages.pop_front();
+        }
+        schedule(queue, now);
+    }
+
+    void GossipRouter::enqueue_control(const Digest256& peer, Record type, const std::string& topic) {
+        PeerQueue& queue = queues_[peer];
+        queue.control.emplace_back(type, topic);
+        schedule(queue, now_);
+    }
+
+    void GossipRouter::schedule(const PeerQueue& queue, Clock::time_point now) {
+        transport_.wake(millis_until(queue.next_send, now));
+    }
+
+    int GossipRouter::flush(Clock::time_point now) {
+        now_ = now;
+        int next = -1;
+        auto due_in = [&](int ms) { next = next < 0 ? ms : std::min(next, ms); };
+        std::unordered_set<Digest256> meshed;
+        for (const auto& topic : topics_) meshed.insert(topic.second.mesh.begin(), topic.second.mesh.end());
+        for (auto it = queues_.begin(); it != queues_.end();) {
+            auto current = it++;
+            auto& entry = *current;
+            PeerQueue& queue = entry.second;
+            if (queue.ids.empty() && queue.control.empty()) {
+                // Only coalesced leftovers; a peer no mesh holds any more is forgotten
+                if (!meshed.count(entry.first)) {
+                    queues_.erase(current);
+                } else {
+                    queue.messages.clear();
+                }
+                continue;
+            }
+            if (now < queue.next_send) {
+                due_in(millis_until(queue.next_send, now));
+                continue;
+            }
+            std::vector<uint8_t> frame;
+            for (const auto& control : queue.control) {
+                frame.push_back(control.first);
+                put_string(frame, control.second);
+            }
+            queue.control.clear();
+            // Take messages oldest first up to the frame size, then group them by topic
+            std::map<const std::string*, std::vector<Queued>> by_topic;
+            size_t size = frame.size();
+            while (!queue.messages.empty() && size < config_.max_frame_bytes) {
+                Queued message = std::move(queue.messages.front());
+                queue.messages.pop_front();
+                if (!queue.ids.erase(message.id)) continue;  // Coalesced
+                queue.bytes -= queued_bytes(*message.data);
+                size += queued_bytes(*message.data);
+                by_topic[message.topic].push_back(std::move(message));
+            }
+            for (const auto& group : by_topic) {
+                frame.push_back(kMessages);
+                put_string(frame, *group.first);
+                put_varint(frame, group.second.size());
+                for (const Queued& message : group.second) {
+                    for (int i = 0; i < 8; ++i) frame.push_back(uint8_t(message.id >> (8 * i)));
+                    put_varint(frame, message.data->size());
+                    frame.insert(frame.end(), message.data->begin(), message.data->end());
+                }
+            }
+            if (frame.empty()) continue;
+            transport_.send(entry.first, frame);
+            ++stats_.frames_sent;
+            stats_.frame_bytes += frame.size();
+            queue.next_send = now + std::chrono::milliseconds(config_.flush_interval_ms);
+            if (!queue.ids.empty()) due_in(config_.flush_interval_ms);
+        }
+        stats_.peers = queues_.size();
+        return next;
+    }
+
+    void GossipRouter::handle(const Digest256& peer, const uint8_t* frame, size_t len, Clock::time_point now) {
+        now_ = now;
+        const uint8_t* p = frame;
+        const uint8_t* end = frame + len;
+        std::string topic;
+        while (p < end) {
+            uint8_t type = *p++;
+            if (!get_string(p, end, topic)) return;
+            auto it = topics_.find(topic);
+            bool subscribed = it != topics_.end() && it->second.subscribed;
+            if (type == kGraft) {
+                if (!subscribed) {
+                    enqueue_control(peer, kPrune, topic);
+                    continue;
+                }
+                it->second.mesh.insert(peer);
+                if (std::find(it->second.known.begin(), it->second.known.end(), peer) == it->second.known.end()) {
+                    it->second.known.push_back(peer);
+                }
+                continue;
+            }
+            if (type == kPrune) {
+                if (it != topics_.end()) it->second.mesh.erase(peer);
+                continue;
+            }
+            if (type != kMessages) return;
+            uint64_t count;
+            if (!get_varint(p, end, count)) return;
+            for (uint64_t i = 0; i < count; ++i) {
+                uint64_t claimed = 0, size;
+                if (end - p < 8) return;
+                for (int b = 0; b < 8; ++b) claimed |= uint64_t(p[b]) << (8 * b);
+                p += 8;
+                if (!get_varint(p, end, size) || size > uint64_t(end - p)) return;
+                const uint8_t* data = p;
+                p += size;
+                uint64_t id = message_id(topic, data, size_t(size));
+                if (id != claimed) {
+                    ++stats_.rejected;
+                    continue;
+                }
+                if (!subscribed) continue;  // Neither delivered nor forwarded, so not remembered
+                if (!seen_.insert(id, now)) {
+                    ++stats_.duplicates;
+                    // The peer has it: no need to send it back
+                    auto queue = queues_.find(peer);
+                    if (queue == queues_.end()) continue;
+                    auto queued = queue->second.ids.find(id);
+                    if (queued != queue->second.ids.end()) {
+                        queue->second.bytes -= queued->second;
+                        queue->second.ids.erase(queued);
+                        ++stats_.coalesced;
+                    }
+                    continue;
+                }
+                ++stats_.delivered;
+                auto shared = std::make_shared<const std::vector<uint8_t>>(data, data + size);
+                if (it->second.callback) it->second.callback(peer.hex(), *shared);
+                forward(topic, it->second, id, shared, &peer, now);
+            }
+        }
+    }
+
+    std::vector<Digest256> GossipRouter::mesh(const std::string& topic) const {
+        auto it = topics_.find(topic);
+        if (it == topics_.end()) return {};
+        return std::vector<Digest256>(it->second.mesh.begin(), it->second.mesh.end());
+    }
+
+} // namespace p2p_dht
\ No newline at end of file
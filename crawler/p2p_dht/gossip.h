@@ -0,0 +1,217 @@
+// File: crawler/p2p_dht/gossip.h
+// mesh-based gossip pub/sub with deduplication and per-peer batching
+#ifndef P2P_DHT_GOSSIP_H
+#define P2P_DHT_GOSSIP_H
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "p2p_dht.h"
+#include "../common/digest.h"
+
+namespace p2p_dht {
+
+    /**
+     * @class SeenCache
+     * @brief Time-bucketed Bloom filter of recently seen message IDs.
+     *
+     * The window is split into `buckets` spans, each with its own filter.
+     * IDs go into the current span's filter and are looked up in all of
+     * them. When a span ends, the oldest filter is cleared and reused, so
+     * an ID is remembered for between (buckets - 1) and buckets spans in
+     * fixed memory. False positives drop a message as a duplicate; they
+     * happen at about the configured rate while a span holds no more than
+     * its expected count.
+     */
+    class SeenCache {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        SeenCache(size_t expected_per_bucket, double false_positive_rate, int buckets, Clock::duration window);
+
+        /**
+         * @brief Add id. @return False if it was (probably) seen already.
+         */
+        bool insert(uint64_t id, Clock::time_point now);
+        bool contains(uint64_t id, Clock::time_point now);
+
+        /**
+         * @brief Bytes held by the filters (allocated on first use).
+         */
+        size_t memory_bytes() const;
+
+    private:
+        size_t bits_;
+        int hashes_;
+        Clock::duration span_;
+        std::vector<std::vector<uint64_t>> filters_;
+        size_t current_ = 0;
+        Clock::time_point span_start_;
+
+        void rotate(Clock::time_point now);
+        bool test(const std::vector<uint64_t>& filter, uint64_t id) const;
+    };
+
+    /**
+     * @class GossipRouter
+     * @brief Topic pub/sub over a mesh of peers, independent of the transport.
+     *
+     * Each subscribed topic keeps a mesh of about mesh_degree peers taken
+     * from the topic's subscribers, kept between mesh_low and mesh_high by a
+     * heartbeat with GRAFT and PRUNE messages. A message is delivered once
+     * and forwarded to the mesh, except to the peer it came from. Publishing
+     * to a topic without subscribing sends to up to mesh_degree fanout peers.
+     *
+     * Message IDs are derived from the topic and content, so the same
+     * content published twice within the seen window (two crawlers finding
+     * one link) spreads once. A receiver recomputes the ID and drops a
+     * message that carries another one, so a peer cannot suppress a message
+     * by sending its ID with other content first.
+     *
+     * Nothing is sent per message. Each peer has an outbound queue, and a
+     * peer gets at most one frame per flush_interval_ms. A frame carries
+     * everything queued for that peer up to max_frame_bytes, grouped by
+     * topic, together with pending GRAFT and PRUNE messages. A message is
+     * queued for a peer only once, and it is dropped from the queue if that
+     * peer sends it to us first. The number of frames per peer is therefore
+     * bounded whatever the publish rate; only frame size grows. A queue
+     * beyond max_queue_bytes drops its oldest messages, and the empty queue
+     * of a peer no longer in any mesh is dropped at the next flush.
+     *
+     * Not thread-safe: the owner calls it from one thread (a node's event loop).
+     */
+    class GossipRouter {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        struct Config {
+            size_t mesh_degree = 6;
+            size_t mesh_low = 4;
+            size_t mesh_high = 12;
+            int heartbeat_ms = 1000;
+            int peer_refresh_heartbeats = 10;   ///< Look the subscribers up again this often
+            int fanout_ttl_s = 60;              ///< Forget fanout peers of a topic not published to
+            int flush_interval_ms = 50;         ///< Minimum gap between frames to one peer
+            size_t max_frame_bytes = 64 * 1024;
+            size_t max_queue_bytes = 4 << 20;   ///< Per peer
+            int seen_window_s = 120;
+            int seen_buckets = 4;
+            size_t seen_expected = 20000;       ///< Messages per bucket span
+            double seen_false_positive = 1e-3;
+            size_t max_pending = 1024;          ///< Publishes held while a topic's peers are looked up
+        };
+
+        struct Stats {
+            uint64_t published = 0;
+            uint64_t delivered = 0;
+            uint64_t duplicates = 0;   ///< Messages received or published again
+            uint64_t forwarded = 0;    ///< Message copies queued for peers
+            uint64_t coalesced = 0;    ///< Queued copies dropped because the peer already had them
+            uint64_t dropped = 0;      ///< Queued copies dropped by flow control
+            uint64_t rejected = 0;     ///< Received with an ID that does not match topic and content
+            uint64_t frames_sent = 0;
+            uint64_t frame_bytes = 0;
+            uint64_t grafts = 0;
+            uint64_t prunes = 0;
+            size_t peers = 0;          ///< Peers with an outbound queue
+        };
+
+        /**
+         * @brief What the router needs from its owner.
+         */
+        struct Transport {
+            std::function<void(const Digest256& peer, const std::vector<uint8_t>& frame)> send;
+            /// Look up a topic's subscribers; the callback runs later on the owner's thread
+            std::function<void(const std::string& topic, std::function<void(const std::vector<Digest256>&)>)>
+                find_peers;
+            /// Call flush() after delay_ms (sooner calls replace later ones)
+            std::function<void(int delay_ms)> wake;
+        };
+
+        GossipRouter(const Digest256& self, const Config& config, Transport transport);
+
+        void subscribe(const std::string& topic, MessageCallback callback);
+        void publish(const std::string& topic, const std::vector<uint8_t>& data, Clock::time_point now);
+
+        /**
+         * @brief Process a frame from peer. Subscribers' callbacks get the
+         *        neighbour that forwarded each message as from_peer.
+         */
+        void handle(const Digest256& peer, const uint8_t* frame, size_t len, Clock::time_point now);
+
+        /**
+         * @brief Mesh upkeep: refresh subscribers, graft or prune, expire fanout.
+         */
+        void heartbeat(Clock::time_point now);
+
+        /**
+         * @brief Send the frames that are due.
+         * @return Milliseconds until the next frame is due, or -1 if nothing is queued.
+         */
+        int flush(Clock::time_point now);
+
+        std::vector<Digest256> mesh(const std::string& topic) const;
+        const Stats& stats() const { return stats_; }
+
+        static uint64_t message_id(const std::string& topic, const std::vector<uint8_t>& data) {
+            return message_id(topic, data.data(), data.size());
+        }
+        static uint64_t message_id(const std::string& topic, const uint8_t* data, size_t size);
+
+    private:
+        enum Record : uint8_t { kMessages = 1, kGraft = 2, kPrune = 3 };
+
+        struct Queued {
+            const std::string* topic;  ///< Points into topics_, which never erases
+            uint64_t id;
+            std::shared_ptr<const std::vector<uint8_t>> data;  ///< Shared by every peer it goes to
+        };
+        struct PeerQueue {
+            std::deque<Queued> messages;
+            std::unordered_map<uint64_t, size_t> ids;  ///< Still wanted, with their queued bytes; others are skipped at flush
+            std::vector<std::pair<Record, std::string>> control;
+            size_t bytes = 0;
+            Clock::time_point next_send;
+        };
+        struct Topic {
+            MessageCallback callback;
+            bool subscribed = false;
+            std::vector<Digest256> known;            ///< Subscribers found in the DHT
+            std::unordered_set<Digest256> mesh;      ///< Or the fanout peers, when not subscribed
+            Clock::time_point last_publish;
+            int heartbeats = 0;
+            bool looking_up = false;
+            std::vector<std::pair<uint64_t, std::shared_ptr<const std::vector<uint8_t>>>> pending;
+        };
+
+        Digest256 self_;
+        Config config_;
+        Transport transport_;
+        SeenCache seen_;
+        std::map<std::string, Topic> topics_;
+        std::unordered_map<Digest256, PeerQueue> queues_;
+        Stats stats_;
+        uint64_t rng_state_;
+        Clock::time_point now_;  ///< Time of the latest call, for work done in lookup callbacks
+
+        void refresh_peers(const std::string& topic);
+        void maintain(const std::string& topic, Topic& state);
+        void forward(const std::string& topic, Topic& state, uint64_t id,
+                     const std::shared_ptr<const std::vector<uint8_t>>& data, const Digest256* except,
+                     Clock::time_point now);
+        void enqueue(const Digest256& peer, const Queued& message, Clock::time_point now);
+        void enqueue_control(const Digest256& peer, Record type, const std::string& topic);
+        void schedule(const PeerQueue& queue, Clock::time_point now);
+        uint64_t random();
+    };
+
+} // namespace p2p_dht
+
+#endif // P2P_DHT_GOSSIP_H
\ No newline at end of file
@@ -0,0 +1,900 @@
+// File: crawler/p2p_dht/kademlia.cpp
+
+#include "kademlia.h"
+#include "../common/varint.h"
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <stdexcept>
+
+namespace p2p_dht {
+
+    namespace {
+
+        enum MessageType : uint8_t {
+            kPing = 1,
+            kPong,
+            kFindNode,
+            kNodes,
+            kFindValue,
+            kValues,
+            kStore,
+            kStored,
+            kData,      ///< Direct message fragment
+            kGossip,    ///< GossipRouter frame fragment
+        };
+
+        constexpr size_t kHeaderBytes = 1 + 8 + Digest256::kSize;
+        constexpr size_t kContactBytes = Digest256::kSize + 4 + 2;
+        constexpr size_t kMaxDatagram = 65507;
+        constexpr auto kPeerContactTtl = std::chrono::minutes(10);  ///< Since the last message from the peer
+
+        void put_u64(std::vector<uint8_t>& out, uint64_t value) {
+            for (int i = 0; i < 8; ++i) out.push_back(uint8_t(value >> (8 * i)));
+        }
+
+        uint64_t get_u64(const uint8_t* p) {
+            uint64_t value = 0;
+            for (int i = 0; i < 8; ++i) value |= uint64_t(p[i]) << (8 * i);
+            return value;
+        }
+
+        void put_id(std::vector<uint8_t>& out, const NodeId& id) {
+            out.insert(out.end(), id.bytes.begin(), id.bytes.end());
+        }
+
+        NodeId get_id(const uint8_t* p) {
+            return Digest256::from_bytes(reinterpret_cast<const char*>(p));
+        }
+
+        void put_contact(std::vector<uint8_t>& out, const Contact& contact) {
+            put_id(out, contact.id);
+            for (int shift : {24, 16, 8, 0}) out.push_back(uint8_t(contact.ip >> shift));
+            out.push_back(uint8_t(contact.port >> 8));
+            out.push_back(uint8_t(contact.port));
+        }
+
+        /**
+         * @brief Parse a u8 count and that many contacts, the tail of kNodes and kValues.
+         */
+        bool get_contacts(const uint8_t* p, const uint8_t* end, std::vector<Contact>& out) {
+            if (p == end) return false;
+            size_t count = *p++;
+            if (size_t(end - p) != count * kContactBytes) return false;
+            for (size_t i = 0; i < count; ++i, p += kContactBytes) {
+                Contact contact;
+                contact.id = get_id(p);
+                contact.ip = uint32_t(p[32]) << 24 | uint32_t(p[33]) << 16 | uint32_t(p[34]) << 8 | p[35];
+                contact.port = uint16_t(p[36] << 8 | p[37]);
+                out.push_back(contact);
+            }
+            return true;
+        }
+
+        NodeId random_id(std::mt19937_64& rng) {
+            NodeId id;
+            for (auto& byte : id.bytes) byte = uint8_t(rng());
+            return id;
+        }
+
+        /**
+         * @brief A random ID that shares exactly bits leading bits with self.
+         */
+        NodeId random_id_in_bucket(const NodeId& self, int bits, std::mt19937_64& rng) {
+            NodeId id = random_id(rng);
+            for (int i = 0; i <= bits && i < 256; ++i) {
+                uint8_t mask = uint8_t(0x80 >> (i % 8));
+                bool bit = (self.bytes[i / 8] & mask) != 0;
+                if (i == bits) bit = !bit;
+                id.bytes[i / 8] = bit ? (id.bytes[i / 8] | mask) : (id.bytes[i / 8] & ~mask);
+            }
+            return id;
+        }
+
+    } // namespace
+
+    std::string Contact::address() const {
+        return std::to_string(ip >> 24) + "." + std::to_string((ip >> 16) & 0xFF) + "." +
+               std::to_string((ip >> 8) & 0xFF) + "." + std::to_string(ip & 0xFF) + ":" + std::to_string(port);
+    }
+
+    int common_prefix_bits(const NodeId& a, const NodeId& b) {
+        for (size_t i = 0; i < Digest256::kSize; ++i) {
+            uint8_t x = a.bytes[i] ^ b.bytes[i];
+            if (x) return int(i * 8) + __builtin_clz(x) - 24;
+        }
+        return 256;
+    }
+
+    bool closer_to(const NodeId& target, const NodeId& a, const NodeId& b) {
+        for (size_t i = 0; i < Digest256::kSize; ++i) {
+            uint8_t da = a.bytes[i] ^ target.bytes[i];
+            uint8_t db = b.bytes[i] ^ target.bytes[i];
+            if (da != db) return da < db;
+        }
+        return false;
+    }
+
+    // ---------------------------------------------------------------- RoutingTable
+
+    RoutingTable::RoutingTable(const NodeId& self, size_t k, int max_failures)
+        : self_(self), k_(k), max_failures_(max_failures) {}
+
+    RoutingTable::Seen RoutingTable::seen(const Contact& contact) {
+        int index = common_prefix_bits(self_, contact.id);
+        if (index == 256) return Seen::kSelf;
+        if (size_t(index) >= buckets_.size()) buckets_.resize(index + 1);
+        Bucket& bucket = buckets_[index];
+        for (size_t i = 0; i < bucket.entries.size(); ++i) {
+            if (bucket.entries[i].contact.id == contact.id) {
+                Entry entry = bucket.entries[i];
+                entry.contact = contact;  // It may have moved
+                entry.failures = 0;
+                bucket.entries.erase(bucket.entries.begin() + i);
+                bucket.entries.push_back(entry);
+                return Seen::kRefreshed;
+            }
+        }
+        if (bucket.entries.size() < k_) {
+            bucket.entries.push_back(Entry{contact, 0});
+            ++size_;
+            return Seen::kAdded;
+        }
+        auto& cache = bucket.replacements;
+        cache.erase(std::remove_if(cache.begin(), cache.end(), [&](const Contact& c) { return c.id == contact.id; }),
+                    cache.end());
+        cache.push_back(contact);
+        if (cache.size() > k_) cache.erase(cache.begin());
+        return Seen::kBucketFull;
+    }
+
+    void RoutingTable::failed(const NodeId& id) {
+        int index = common_prefix_bits(self_, id);
+        if (size_t(index) >= buckets_.size()) return;
+        Bucket& bucket = buckets_[index];
+        for (size_t i = 0; i < bucket.entries.size(); ++i) {
+            if (bucket.entries[i].contact.id != id) continue;
+            if (++bucket.entries[i].failures < max_failures_) return;
+            bucket.entries.erase(bucket.entries.begin() + i);
+            --size_;
+            if (!bucket.replacements.empty()) {
+                bucket.entries.push_back(Entry{bucket.replacements.back(), 0});
+                bucket.replacements.pop_back();
+                ++size_;
+            }
+            return;
+        }
+    }
+
+    const Contact* RoutingTable::find(const NodeId& id) const {
+        int index = common_prefix_bits(self_, id);
+        if (size_t(index) >= buckets_.size()) return nullptr;
+        for (const Entry& entry : buckets_[index].entries) {
+            if (entry.contact.id == id) return &entry.contact;
+        }
+        return nullptr;
+    }
+
+    const Contact* RoutingTable::least_recent(const NodeId& id) const {
+        int index = common_prefix_bits(self_, id);
+        if (size_t(index) >= buckets_.size() || buckets_[index].entries.empty()) return nullptr;
+        return &buckets_[index].entries.front().contact;
+    }
+
+    std::vector<Contact> RoutingTable::closest(const NodeId& target, size_t count) const {
+        // The target's own bucket holds the closest contacts, then the buckets
+        // of longer prefixes, then the shorter ones from the nearest outward
+        std::vector<Contact> out;
+        int home = std::min(common_prefix_bits(self_, target), 255);
+        int end = int(buckets_.size());
+        auto take = [&](int index) {
+            if (index >= end) return;
+            for (const Entry& entry : buckets_[index].entries) out.push_back(entry.contact);
+        };
+        take(home);
+        for (int i = home + 1; i < end; ++i) take(i);
+        for (int i = home - 1; i >= 0 && out.size() < count; --i) take(i);
+        size_t n = std::min(count, out.size());
+        std::partial_sort(out.begin(), out.begin() + n, out.end(),
+                          [&](const Contact& a, const Contact& b) { return closer_to(target, a.id, b.id); });
+        out.resize(n);
+        return out;
+    }
+
+    std::vector<int> RoutingTable::occupied_buckets() const {
+        std::vector<int> out;
+        for (int i = 0; i < int(buckets_.size()); ++i) {
+            if (!buckets_[i].entries.empty()) out.push_back(i);
+        }
+        return out;
+    }
+
+    // ---------------------------------------------------------------- KademliaNode
+
+    struct KademliaNode::Lookup {
+        enum State { kNew, kWaiting, kAnswered, kFailed };
+        struct Candidate {
+            Contact contact;
+            int depth;
+            State state;
+            int attempts = 0;
+        };
+
+        NodeId target;
+        bool want_value;
+        LookupCallback done;
+        std::vector<Candidate> candidates;  ///< Closest first
+        std::unordered_set<NodeId> known;
+        std::vector<std::string> values;
+        int value_depth = 0;
+        int inflight = 0;
+        int queries = 0;
+        bool finished = false;
+        Transport::Clock::time_point started;
+
+        Candidate* find(const NodeId& id) {
+            for (Candidate& c : candidates) {
+                if (c.contact.id == id) return &c;
+            }
+            return nullptr;
+        }
+
+        void add(const Contact& contact, int depth) {
+            if (!known.insert(contact.id).second) return;
+            auto it = std::lower_bound(candidates.begin(), candidates.end(), contact.id,
+                                       [&](const Candidate& c, const NodeId& id) { return closer_to(target, c.contact.id, id); });
+            candidates.insert(it, Candidate{contact, depth, kNew});
+        }
+    };
+
+    KademliaNode::KademliaNode(const std::string& listen_addr, int port, const Config& config,
+                               std::shared_ptr<EventLoop> loop, const NodeId* id)
+        : KademliaNode(std::make_shared<UdpTransport>(listen_addr, port, std::move(loop)), config, id) {}
+
+    KademliaNode::KademliaNode(std::shared_ptr<Transport> transport, const Config& config, const NodeId* id)
+        : config_(config),
+          transport_(std::move(transport)),
+          rng_(transport_->random_seed()),
+          self_{id ? *id : random_id(rng_), transport_->ip(), transport_->port()},
+          routing_(self_.id, config.k, config.max_failures),
+          next_txid_(rng_()),
+          alive_(std::make_shared<char>(0)),
+          gossip_(self_.id, config.gossip,
+                  GossipRouter::Transport{
+                      [this](const NodeId& peer, const std::vector<uint8_t>& frame) { send_message(peer, kGossip, frame); },
+                      [this](const std::string& topic, std::function<void(const std::vector<NodeId>&)> done) {
+                          topic_peers(topic, std::move(done));
+                      },
+                      [this](int delay_ms) { gossip_wake(delay_ms); }}) {
+        transport_->run_sync([this] {
+            transport_->set_receiver(
+                [this](const uint8_t* data, size_t len, uint32_t ip, uint16_t port) { handle(data, len, ip, port); });
+            int sweep_s = std::max(1, std::min(60, config_.record_ttl_s / 4));
+            every(std::chrono::seconds(sweep_s), [this] { expire(); });
+            every(std::chrono::seconds(config_.republish_interval_s), [this] {
+                for (const auto& entry : published_) store_at_closest(entry.first.first, entry.first.second);
+            });
+            every(std::chrono::milliseconds(config_.gossip.heartbeat_ms),
+                  [this] { gossip_.heartbeat(transport_->now()); });
+            every(std::chrono::seconds(config_.refresh_interval_s), [this] {
+                for (int bucket : routing_.occupied_buckets()) {
+                    start_lookup(random_id_in_bucket(self_.id, bucket, rng_), false, [](const LookupResult&) {});
+                }
+            });
+        });
+    }
+
+    KademliaNode::~KademliaNode() {
+        transport_->run_sync([this] {
+            alive_.reset();
+            transport_->set_receiver(nullptr);
+            for (Transport::TimerId timer : timers_) transport_->cancel(timer);
+            timers_.clear();
+            pending_.clear();
+        });
+    }
+
+    void KademliaNode::post(std::function<void()> fn) {
+        std::weak_ptr<char> alive = alive_;
+        transport_->post([alive, fn = std::move(fn)] {
+            if (!alive.expired()) fn();
+        });
+    }
+
+    Transport::TimerId KademliaNode::schedule(Transport::Clock::duration delay, std::function<void()> fn) {
+        auto holder = std::make_shared<Transport::TimerId>(0);
+        *holder = transport_->call_after(delay, [this, holder, fn = std::move(fn)] {
+            timers_.erase(*holder);
+            fn();
+        });
+        timers_.insert(*holder);
+        return *holder;
+    }
+
+    void KademliaNode::cancel(Transport::TimerId timer) {
+        transport_->cancel(timer);
+        timers_.erase(timer);
+    }
+
+    void KademliaNode::every(Transport::Clock::duration period, std::function<void()> fn) {
+        schedule(period, [this, period, fn] {
+            fn();
+            every(period, fn);
+        });
+    }
+
+    // ---------------------------------------------------------------- Wire
+
+    std::vector<uint8_t> KademliaNode::header(uint8_t type, uint64_t txid) const {
+        std::vector<uint8_t> out;
+        out.reserve(kHeaderBytes + 64);
+        out.push_back(type);
+        put_u64(out, txid);
+        put_id(out, self_.id);
+        return out;
+    }
+
+    void KademliaNode::send_to(uint32_t ip, uint16_t port, const std::vector<uint8_t>& datagram) {
+        transport_->send(ip, port, datagram.data(), datagram.size());
+    }
+
+    void KademliaNode::request(const Contact& to, bool known_id, uint8_t type, const std::vector<uint8_t>& body,
+                               ReplyCallback on_reply) {
+        uint64_t txid = next_txid_++;
+        std::vector<uint8_t> datagram = header(type, txid);
+        datagram.insert(datagram.end(), body.begin(), body.end());
+        Transport::TimerId timer = schedule(std::chrono::milliseconds(config_.rpc_timeout_ms), [this, txid] {
+            auto it = pending_.find(txid);
+            if (it == pending_.end()) return;
+            Pending pending = std::move(it->second);
+            pending_.erase(it);
+            if (pending.known_id) routing_.failed(pending.to);
+            pending.on_reply(0, nullptr, 0);
+        });
+        pending_.emplace(txid, Pending{std::move(on_reply), timer, to.id, known_id});
+        send_to(to.ip, to.port, datagram);
+    }
+
+    void KademliaNode::heard_from(const Contact& contact) {
+        if (routing_.seen(contact) != RoutingTable::Seen::kBucketFull) return;
+        // Keep the bucket's oldest contact if it still answers; the newcomer waits as a replacement
+        const Contact* oldest = routing_.least_recent(contact.id);
+        if (!oldest || !pinging_.insert(oldest->id).second) return;
+        NodeId id = oldest->id;
+        request(*oldest, true, kPing, {}, [this, id](uint8_t, const uint8_t*, size_t) { pinging_.erase(id); });
+    }
+
+    void KademliaNode::handle(const uint8_t* data, size_t len, uint32_t ip, uint16_t port) {
+        if (len < kHeaderBytes) return;
+        uint8_t type = data[0];
+        uint64_t txid = get_u64(data + 1);
+        Contact from{get_id(data + 9), ip, port};
+        if (from.id == self_.id) return;
+        const uint8_t* body = data + kHeaderBytes;
+        const uint8_t* end = data + len;
+        size_t body_len = len - kHeaderBytes;
+        heard_from(from);
+
+        switch (type) {
+        case kPing:
+            send_to(ip, port, header(kPong, txid));
+            break;
+        case kFindNode:
+        case kFindValue: {
+            if (body_len != Digest256::kSize) return;
+            NodeId target = get_id(body);
+            std::vector<uint8_t> reply = header(type == kFindNode ? kNodes : kValues, txid);
+            if (type == kFindValue) {
+                std::vector<const std::string*> values;
+                size_t bytes = 0;
+                auto it = records_.find(target);
+                if (it != records_.end()) {
+                    auto now = transport_->now();
+                    for (const Record& record : it->second) {
+                        // Leave room for the contacts below
+                        if (record.expires <= now || bytes + record.value.size() + 10 > kMaxDatagram / 2) continue;
+                        values.push_back(&record.value);
+                        bytes += record.value.size() + 10;
+                    }
+                }
+                put_varint(reply, values.size());
+                for (const std::string* value : values) {
+                    put_varint(reply, value->size());
+                    reply.insert(reply.end(), value->begin(), value->end());
+                }
+            }
+            std::vector<Contact> closest = routing_.closest(target, std::min<size_t>(config_.k, 255));
+            reply.push_back(uint8_t(closest.size()));
+            for (const Contact& contact : closest) put_contact(reply, contact);
+            send_to(ip, port, reply);
+            break;
+        }
+        case kStore: {
+            const uint8_t* p = body;
+            uint64_t ttl, size;
+            if (body_len < Digest256::kSize) return;
+            p += Digest256::kSize;
+            if (!get_varint(p, end, ttl) || !get_varint(p, end, size) || size != uint64_t(end - p) ||
+                size > config_.max_value_bytes) {
+                return;
+            }
+            store_local(get_id(body), std::string(reinterpret_cast<const char*>(p), size_t(size)),
+                        int(std::min<uint64_t>(ttl, uint64_t(config_.record_ttl_s))), from.id);
+            send_to(ip, port, header(kStored, txid));
+            break;
+        }
+        case kPong:
+        case kNodes:
+        case kValues:
+        case kStored: {
+            auto it = pending_.find(txid);
+            if (it == pending_.end()) return;
+            if (it->second.known_id && it->second.to != from.id) return;  // Not the node we asked
+            Pending pending = std::move(it->second);
+            pending_.erase(it);
+            cancel(pending.timer);
+            pending.on_reply(type, body, body_len);
+            break;
+        }
+        case kData:
+        case kGossip: {
+            peer_contacts_[from.id] = {transport_->now(), from};
+            const uint8_t* p = body;
+            uint64_t index, count;
+            if (!get_varint(p, end, index) || !get_varint(p, end, count) || index >= count ||
+                count > config_.max_message_bytes / config_.fragment_bytes + 1) {
+                return;
+            }
+            std::string part(reinterpret_cast<const char*>(p), size_t(end - p));
+            if (count == 1) {
+                deliver(type, from.id, part);
+                break;
+            }
+            auto it = partials_.find({from.id, txid});
+            Partial* partial = it != partials_.end() ? &it->second : start_partial(from.id, txid, type, count);
+            if (!partial || partial->type != type || partial->count != count || !partial->parts[index].empty() ||
+                part.empty() || partial_bytes_ + part.size() > config_.max_partial_bytes) {
+                return;
+            }
+            partial->bytes += part.size();
+            partial_bytes_ += part.size();
+            partial->parts[index] = std::move(part);
+            if (++partial->received < partial->count) return;
+            std::string payload;
+            payload.reserve(partial->bytes);
+            for (const std::string& piece : partial->parts) payload += piece;
+            drop_partial(partials_.find({from.id, txid}));
+            deliver(type, from.id, payload);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    // ---------------------------------------------------------------- Lookups
+
+    void KademliaNode::start_lookup(const NodeId& target, bool want_value, LookupCallback done) {
+        auto lookup = std::make_shared<Lookup>();
+        lookup->target = target;
+        lookup->want_value = want_value;
+        lookup->done = std::move(done);
+        lookup->started = transport_->now();
+        for (const Contact& contact : routing_.closest(target, config_.k)) lookup->add(contact, 1);
+        lookup_step(lookup);
+    }
+
+    void KademliaNode::lookup_step(const std::shared_ptr<Lookup>& lookup) {
+        if (lookup->finished) return;
+        size_t considered = 0;
+        bool open = false;
+        for (size_t i = 0; i < lookup->candidates.size() && considered < config_.k; ++i) {
+            Lookup::Candidate& candidate = lookup->candidates[i];
+            if (candidate.state == Lookup::kFailed) continue;
+            ++considered;
+            if (candidate.state == Lookup::kNew && size_t(lookup->inflight) < config_.alpha) {
+                candidate.state = Lookup::kWaiting;
+                ++candidate.attempts;
+                ++lookup->inflight;
+                ++lookup->queries;
+                std::vector<uint8_t> body;
+                put_id(body, lookup->target);
+                NodeId asked = candidate.contact.id;
+                request(candidate.contact, true, lookup->want_value ? kFindValue : kFindNode, body,
+                        [this, lookup, asked](uint8_t type, const uint8_t* data, size_t len) {
+                            --lookup->inflight;
+                            if (lookup->finished) return;
+                            Lookup::Candidate* c = lookup->find(asked);
+                            int depth = c->depth;
+                            std::vector<Contact> contacts;
+                            const uint8_t* p = data;
+                            const uint8_t* end = data + len;
+                            std::vector<std::string> values;
+                            if (type == 0 && c->attempts <= config_.lookup_retries) {
+                                c->state = Lookup::kNew;  // Timed out: a lost datagram is likelier than a dead node
+                                lookup_step(lookup);
+                                return;
+                            }
+                            bool ok = type == (lookup->want_value ? kValues : kNodes);
+                            if (ok && type == kValues) {
+                                uint64_t count, size;
+                                ok = get_varint(p, end, count);
+                                for (uint64_t v = 0; ok && v < count; ++v) {
+                                    ok = get_varint(p, end, size) && size <= uint64_t(end - p);
+                                    if (ok) values.emplace_back(reinterpret_cast<const char*>(p), size_t(size));
+                                    if (ok) p += size;
+                                }
+                            }
+                            ok = ok && get_contacts(p, end, contacts);
+                            c->state = ok ? Lookup::kAnswered : Lookup::kFailed;
+                            if (ok && !values.empty()) {
+                                lookup->values = std::move(values);
+                                lookup->value_depth = depth;
+                                finish_lookup(lookup);
+                                return;
+                            }
+                            for (const Contact& contact : contacts) {
+                                if (contact.id != self_.id) lookup->add(contact, depth + 1);
+                            }
+                            lookup_step(lookup);
+                        });
+            }
+            if (candidate.state == Lookup::kNew || candidate.state == Lookup::kWaiting) open = true;
+        }
+        if (!open) finish_lookup(lookup);
+    }
+
+    void KademliaNode::finish_lookup(const std::shared_ptr<Lookup>& lookup) {
+        lookup->finished = true;
+        LookupResult result;
+        for (const Lookup::Candidate& candidate : lookup->candidates) {
+            if (candidate.state != Lookup::kAnswered) continue;
+            if (result.closest.empty()) result.hops = candidate.depth;
+            result.closest.push_back(candidate.contact);
+            if (result.closest.size() == config_.k) break;
+        }
+        result.values = std::move(lookup->values);
+        if (!result.values.empty()) result.hops = lookup->value_depth;
+        if (lookup->want_value) {
+            // Our own copy, if we are one of the nodes that hold the key
+            auto it = records_.find(lookup->target);
+            if (it != records_.end()) {
+                auto now = transport_->now();
+                for (const Record& record : it->second) {
+                    if (record.expires > now &&
+                        std::find(result.values.begin(), result.values.end(), record.value) == result.values.end()) {
+                        result.values.push_back(record.value);
+                    }
+                }
+            }
+        }
+        result.queries = lookup->queries;
+        result.latency_ms =
+            std::chrono::duration<double, std::milli>(transport_->now() - lookup->started).count();
+        lookup->done(result);
+    }
+
+    void KademliaNode::find_node(const NodeId& target, LookupCallback done) {
+        post([this, target, done = std::move(done)]() mutable { start_lookup(target, false, std::move(done)); });
+    }
+
+    void KademliaNode::find_value(const NodeId& key, LookupCallback done) {
+        post([this, key, done = std::move(done)]() mutable { start_lookup(key, true, std::move(done)); });
+    }
+
+    KademliaNode::LookupResult KademliaNode::lookup_sync(const NodeId& target, bool want_value) {
+        if (transport_->on_executor()) throw std::logic_error("KademliaNode: blocking call on the event loop thread");
+        std::promise<LookupResult> result;
+        post([&] { start_lookup(target, want_value, [&](const LookupResult& r) { result.set_value(r); }); });
+        return result.get_future().get();
+    }
+
+    KademliaNode::LookupResult KademliaNode::find_node_sync(const NodeId& target) {
+        return lookup_sync(target, false);
+    }
+
+    KademliaNode::LookupResult KademliaNode::find_value_sync(const NodeId& key) {
+        return lookup_sync(key, true);
+    }
+
+    // ---------------------------------------------------------------- Records
+
+    void KademliaNode::put(const NodeId& key, const std::string& value, bool republish) {
+        if (value.size() > config_.max_value_bytes) throw std::invalid_argument("KademliaNode::put: value too large");
+        post([this, key, value, republish] {
+            if (republish) published_[{key, value}] = true;
+            store_at_closest(key, value);
+        });
+    }
+
+    void KademliaNode::unput(const NodeId& key, const std::string& value) {
+        post([this, key, value] { published_.erase({key, value}); });
+    }
+
+    void KademliaNode::store_at_closest(const NodeId& key, const std::string& value) {
+        start_lookup(key, false, [this, key, value](const LookupResult& result) {
+            std::vector<uint8_t> body;
+            put_id(body, key);
+            put_varint(body, uint64_t(config_.record_ttl_s));
+            put_varint(body, value.size());
+            body.insert(body.end(), value.begin(), value.end());
+            for (const Contact& contact : result.closest) {
+                request(contact, true, kStore, body, [](uint8_t, const uint8_t*, size_t) {});
+            }
+            // Keep a copy if we are among the k closest ourselves
+            if (result.closest.size() < config_.k || closer_to(key, self_.id, result.closest.back().id)) {
+                store_local(key, value, config_.record_ttl_s, self_.id);
+            }
+        });
+    }
+
+    void KademliaNode::store_local(const NodeId& key, const std::string& value, int ttl_s, const NodeId& origin) {
+        auto expires = transport_->now() + std::chrono::seconds(ttl_s);
+        auto it = records_.find(key);
+        if (it != records_.end()) {
+            for (Record& record : it->second) {
+                if (record.value == value) {
+                    record.expires = std::max(record.expires, expires);
+                    return;
+                }
+            }
+            if (it->second.size() >= config_.max_values_per_key) return;
+        }
+        if (origin != self_.id) {
+            // A new value for another node counts against its sender and the node
+            auto peer = records_by_peer_.find(origin);
+            size_t held = peer == records_by_peer_.end() ? 0 : peer->second;
+            if (remote_records_ >= config_.max_records || held >= config_.max_records_per_peer) return;
+            ++records_by_peer_[origin];
+            ++remote_records_;
+        }
+        records_[key].push_back(Record{value, expires, origin});
+    }
+
+    void KademliaNode::forget_record(const Record& record) {
+        if (record.origin == self_.id) return;
+        auto peer = records_by_peer_.find(record.origin);
+        if (peer != records_by_peer_.end() && --peer->second == 0) records_by_peer_.erase(peer);
+        --remote_records_;
+    }
+
+    KademliaNode::Partial* KademliaNode::start_partial(const NodeId& from, uint64_t txid, uint8_t type,
+                                                       uint64_t count) {
+        // Slots are allocated up front, so they count against the byte budget too
+        size_t slots = size_t(count) * sizeof(std::string);
+        if (partials_.size() >= config_.max_partials || partial_bytes_ + slots > config_.max_partial_bytes) {
+            return nullptr;
+        }
+        size_t from_peer = 0;
+        for (auto it = partials_.lower_bound({from, 0}); it != partials_.end() && it->first.first == from; ++it) {
+            if (++from_peer >= config_.max_partials_per_peer) return nullptr;
+        }
+        Partial& partial = partials_[{from, txid}];
+        partial.type = type;
+        partial.count = uint32_t(count);
+        partial.parts.resize(size_t(count));
+        partial.started = transport_->now();
+        partial_bytes_ += slots;
+        return &partial;
+    }
+
+    void KademliaNode::drop_partial(std::map<std::pair<NodeId, uint64_t>, Partial>::iterator it) {
+        partial_bytes_ -= it->second.bytes + it->second.parts.size() * sizeof(std::string);
+        partials_.erase(it);
+    }
+
+    void KademliaNode::expire() {
+        auto now = transport_->now();
+        for (auto it = records_.begin(); it != records_.end();) {
+            auto& records = it->second;
+            auto expired = std::stable_partition(records.begin(), records.end(),
+                                                 [&](const Record& record) { return record.expires > now; });
+            for (auto record = expired; record != records.end(); ++record) forget_record(*record);
+            records.erase(expired, records.end());
+            it = records.empty() ? records_.erase(it) : std::next(it);
+        }
+        for (auto it = peer_contacts_.begin(); it != peer_contacts_.end();) {
+            it = now - it->second.first > kPeerContactTtl ? peer_contacts_.erase(it) : std::next(it);
+        }
+        // Messages that lost a fragment never complete
+        for (auto it = partials_.begin(); it != partials_.end();) {
+            auto next = std::next(it);
+            if (now - it->second.started > std::chrono::seconds(10)) drop_partial(it);
+            it = next;
+        }
+    }
+
+    // ---------------------------------------------------------------- Messages
+
+    void KademliaNode::send_data(const Contact& to, uint8_t type, const std::vector<uint8_t>& payload) {
+        if (payload.empty() || payload.size() > config_.max_message_bytes) return;
+        size_t count = (payload.size() + config_.fragment_bytes - 1) / config_.fragment_bytes;
+        uint64_t message_id = next_txid_++;
+        for (size_t i = 0; i < count; ++i) {
+            std::vector<uint8_t> datagram = header(type, message_id);
+            put_varint(datagram, i);
+            put_varint(datagram, count);
+            size_t begin = i * config_.fragment_bytes;
+            size_t end = std::min(payload.size(), begin + config_.fragment_bytes);
+            datagram.insert(datagram.end(), payload.begin() + begin, payload.begin() + end);
+            send_to(to.ip, to.port, datagram);
+        }
+    }
+
+    void KademliaNode::send_message(const NodeId& to, uint8_t type, const std::vector<uint8_t>& payload) {
+        if (const Contact* contact = routing_.find(to)) {
+            send_data(*contact, type, payload);
+            return;
+        }
+        // In a large network most mesh peers fall in full buckets
+        auto known = peer_contacts_.find(to);
+        if (known != peer_contacts_.end()) {
+            send_data(known->second.second, type, payload);
+            return;
+        }
+        start_lookup(to, false, [this, to, type, payload](const LookupResult& result) {
+            for (const Contact& contact : result.closest) {
+                if (contact.id != to) continue;
+                peer_contacts_[to] = {transport_->now(), contact};
+                send_data(contact, type, payload);
+            }
+        });
+    }
+
+    void KademliaNode::deliver(uint8_t type, const NodeId& from, const std::string& payload) {
+        if (type == kGossip) {
+            gossip_.handle(from, reinterpret_cast<const uint8_t*>(payload.data()), payload.size(),
+                           transport_->now());
+            return;
+        }
+        if (direct_callback_) direct_callback_(from.hex(), std::vector<uint8_t>(payload.begin(), payload.end()));
+    }
+
+    void KademliaNode::gossip_wake(int delay_ms) {
+        // One timer per node, armed for the earliest frame due
+        auto deadline = transport_->now() + std::chrono::milliseconds(delay_ms);
+        if (gossip_timer_ != 0) {
+            if (gossip_deadline_ <= deadline) return;
+            cancel(gossip_timer_);
+        }
+        gossip_deadline_ = deadline;
+        gossip_timer_ = schedule(std::chrono::milliseconds(delay_ms), [this] {
+            gossip_timer_ = 0;
+            int next = gossip_.flush(transport_->now());
+            if (next >= 0) gossip_wake(next);
+        });
+    }
+
+    void KademliaNode::topic_peers(const std::string& topic, std::function<void(const std::vector<NodeId>&)> done) {
+        auto now = transport_->now();
+        auto cached = topic_peers_.find(topic);
+        if (cached != topic_peers_.end() && cached->second.first > now) {
+            done(cached->second.second);
+            return;
+        }
+        start_lookup(key_for("topic:" + topic), true, [this, topic, done](const LookupResult& result) {
+            std::vector<NodeId> peers;
+            for (const std::string& value : result.values) {
+                if (value.size() != Digest256::kSize) continue;
+                NodeId id = Digest256::from_bytes(value.data());
+                if (id != self_.id) peers.push_back(id);
+            }
+            topic_peers_[topic] = {transport_->now() + std::chrono::seconds(config_.peer_cache_s), peers};
+            done(peers);
+        });
+    }
+
+    // ---------------------------------------------------------------- DHTNode
+
+    void KademliaNode::join(const std::vector<std::string>& bootstrap_peers) {
+        if (transport_->on_executor()) throw std::logic_error("KademliaNode: blocking call on the event loop thread");
+        std::vector<Contact> seeds;
+        for (const std::string& peer : bootstrap_peers) {
+            Contact contact;
+            if (!parse_address(peer, contact.ip, contact.port)) {
+                throw std::invalid_argument("KademliaNode::join: bad address " + peer);
+            }
+            seeds.push_back(contact);
+        }
+        if (seeds.empty()) return;
+        std::promise<void> joined;
+        join_async(seeds, [&joined] { joined.set_value(); });
+        joined.get_future().wait();
+    }
+
+    void KademliaNode::join_async(const std::vector<Contact>& seeds, std::function<void()> done) {
+        if (seeds.empty()) {
+            post(std::move(done));
+            return;
+        }
+        post([this, seeds, done = std::move(done)] {
+            // Ping the seeds (their IDs come back with the answers), then look
+            // ourselves up to meet our neighbours, then fill the farther buckets
+            auto remaining = std::make_shared<size_t>(seeds.size());
+            auto refresh = [this, done] {
+                start_lookup(self_.id, false, [this, done](const LookupResult& result) {
+                    int nearest = result.closest.empty() ? 0 : common_prefix_bits(self_.id, result.closest.front().id);
+                    auto left = std::make_shared<int>(nearest);
+                    if (*left == 0) {
+                        done();
+                        return;
+                    }
+                    for (int bucket = 0; bucket < nearest; ++bucket) {
+                        start_lookup(random_id_in_bucket(self_.id, bucket, rng_), false,
+                                     [left, done](const LookupResult&) {
+                                         if (--*left == 0) done();
+                                     });
+                    }
+                });
+            };
+            for (const Contact& seed : seeds) {
+                request(seed, false, kPing, {}, [remaining, refresh](uint8_t, const uint8_t*, size_t) {
+                    if (--*remaining == 0) refresh();
+                });
+            }
+        });
+    }
+
+    void KademliaNode::publish(const std::string& topic, const std::vector<uint8_t>& data) {
+        post([this, topic, data] { gossip_.publish(topic, data, transport_->now()); });
+    }
+
+    void KademliaNode::subscribe(const std::string& topic, MessageCallback callback) {
+        post([this, topic, callback] {
+            NodeId key = key_for("topic:" + topic);
+            std::string value = self_.id.to_bytes();
+            published_[{key, value}] = true;
+            store_at_closest(key, value);
+            gossip_.subscribe(topic, callback);
+        });
+    }
+
+    std::vector<std::string> KademliaNode::get_peers(const std::string& topic) {
+        if (transport_->on_executor()) throw std::logic_error("KademliaNode: blocking call on the event loop thread");
+        std::promise<std::vector<NodeId>> peers;
+        post([&] { topic_peers(topic, [&](const std::vector<NodeId>& found) { peers.set_value(found); }); });
+        std::vector<std::string> out;
+        for (const NodeId& id : peers.get_future().get()) out.push_back(id.hex());
+        return out;
+    }
+
+    void KademliaNode::send_direct(const std::string& peer_id, const std::vector<uint8_t>& msg) {
+        NodeId to;
+        if (!Digest256::from_hex(peer_id, to)) throw std::invalid_argument("KademliaNode::send_direct: bad peer ID");
+        post([this, to, msg] { send_message(to, kData, msg); });
+    }
+
+    void KademliaNode::on_direct_message(MessageCallback callback) {
+        transport_->run_sync([&] { direct_callback_ = callback; });
+    }
+
+    void KademliaNode::set_encryption(bool enabled) {
+        // Node IDs are not keys, so there is nothing to derive a session key from
+        if (enabled) throw std::logic_error("KademliaNode: encryption is not supported; datagrams are sent in the clear");
+    }
+
+    size_t KademliaNode::routing_table_size() {
+        size_t size = 0;
+        transport_->run_sync([&] { size = routing_.size(); });
+        return size;
+    }
+
+    size_t KademliaNode::stored_for_peers() {
+        size_t count = 0;
+        transport_->run_sync([&] { count = remote_records_; });
+        return count;
+    }
+
+    GossipRouter::Stats KademliaNode::gossip_stats() {
+        GossipRouter::Stats stats;
+        transport_->run_sync([&] { stats = gossip_.stats(); });
+        return stats;
+    }
+
+    std::vector<NodeId> KademliaNode::gossip_mesh(const std::string& topic) {
+        std::vector<NodeId> mesh;
+        transport_->run_sync([&] { mesh = gossip_.mesh(topic); });
+        return mesh;
+    }
+
+} // namespace p2p_dht
\ No newline at end of file
@@ -0,0 +1,320 @@
+// File: crawler/p2p_dht/kademlia.h
+// Kademlia DHT over UDP: k-buckets, parallel lookups, records with TTLs
+#ifndef P2P_DHT_KADEMLIA_H
+#define P2P_DHT_KADEMLIA_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "p2p_dht.h"
+#include "event_loop.h"
+#include "gossip.h"
+#include "transport.h"
+#include "../common/digest.h"
+
+namespace p2p_dht {
+
+    /**
+     * @brief 256-bit node ID and record key; distance is the XOR metric.
+     */
+    using NodeId = Digest256;
+
+    /**
+     * @brief A node and its UDP address (IPv4, host byte order).
+     */
+    struct Contact {
+        NodeId id;
+        uint32_t ip = 0;
+        uint16_t port = 0;
+
+        std::string address() const;
+    };
+
+    /**
+     * @brief Length of the common prefix of a and b in bits (256 if equal):
+     *        the index of the k-bucket b falls in, seen from a.
+     */
+    int common_prefix_bits(const NodeId& a, const NodeId& b);
+
+    /**
+     * @brief Whether a is closer to target than b under XOR.
+     */
+    bool closer_to(const NodeId& target, const NodeId& a, const NodeId& b);
+
+    /**
+     * @class RoutingTable
+     * @brief k-buckets indexed by common prefix length with the local ID.
+     *
+     * Each bucket keeps at most k contacts, least recently seen first. A
+     * contact heard from moves to the back. When a full bucket hears from a
+     * new contact, the newcomer waits in the bucket's replacement cache and the
+     * caller pings the least recently seen contact; only a contact that keeps
+     * failing is replaced, so long-lived nodes are preferred.
+     */
+    class RoutingTable {
+    public:
+        enum class Seen { kAdded, kRefreshed, kBucketFull, kSelf };
+
+        RoutingTable(const NodeId& self, size_t k, int max_failures);
+
+        /**
+         * @brief Record a message from contact. On kBucketFull, least_recent()
+         *        names the contact to ping.
+         */
+        Seen seen(const Contact& contact);
+
+        /**
+         * @brief A request to id timed out. After max_failures in a row it is
+         *        dropped and the newest replacement takes its place.
+         */
+        void failed(const NodeId& id);
+
+        const Contact* find(const NodeId& id) const;
+        const Contact* least_recent(const NodeId& id) const;
+
+        /**
+         * @brief Up to count contacts closest to target, closest first.
+         */
+        std::vector<Contact> closest(const NodeId& target, size_t count) const;
+
+        size_t size() const { return size_; }
+
+        /**
+         * @brief Indexes of buckets that hold contacts.
+         */
+        std::vector<int> occupied_buckets() const;
+
+    private:
+        struct Entry {
+            Contact contact;
+            int failures = 0;
+        };
+        struct Bucket {
+            std::vector<Entry> entries;       ///< Least recently seen first
+            std::vector<Contact> replacements; ///< Newest last
+        };
+
+        NodeId self_;
+        size_t k_;
+        int max_failures_;
+        size_t size_ = 0;
+        std::vector<Bucket> buckets_;  ///< Grown on demand; the deep buckets of a small table stay unallocated
+    };
+
+    /**
+     * @class KademliaNode
+     * @brief DHTNode backed by a Kademlia DHT over a datagram Transport.
+     *
+     * All node state lives on the transport's executor (an EventLoop thread
+     * for UDP); public calls post to it, and the *_sync variants wait for
+     * the result (they must not be called from a message callback, which
+     * runs on the executor). Nodes can share a loop. On a SimNetwork only
+     * the asynchronous calls work, from the thread driving the simulation.
+     *
+     * Lookups are iterative: the alpha closest unqueried contacts are asked
+     * in parallel, and every answer that arrives starts the next request, until
+     * the k closest contacts seen have all answered. Records are stored on the
+     * k nodes closest to their key, expire after their TTL, and the node that
+     * put a record stores it again every republish interval. A key can hold
+     * several values (a topic holds one per subscriber). Values stored for
+     * other nodes are capped per sender and in total, and so are messages
+     * being reassembled from fragments, so unauthenticated datagrams cannot
+     * pin unbounded memory.
+     *
+     * DHTNode mapping: subscribe() stores the node's ID under the topic key
+     * and joins the topic's gossip mesh (GossipRouter); get_peers() looks
+     * that key up; publish() hands the message to the mesh; send_direct()
+     * resolves a peer ID with a node lookup when it is not in the routing
+     * table. Messages larger than a datagram are split into fragments.
+     * Delivery is best effort, like UDP.
+     *
+     * Wire format: u8 type, u64 transaction (or message) ID, sender ID
+     * (32 bytes), then the body of the type; see kademlia.cpp.
+     */
+    class KademliaNode : public DHTNode {
+    public:
+        struct Config {
+            size_t k = 20;                    ///< Bucket size and replication factor
+            size_t alpha = 3;                 ///< Parallel requests per lookup
+            int rpc_timeout_ms = 1000;
+            int lookup_retries = 1;           ///< Extra requests to a contact that times out during a lookup
+            int max_failures = 2;             ///< Timeouts in a row before a contact is dropped
+            int record_ttl_s = 3600;
+            int republish_interval_s = 1800;  ///< Re-put own records; below the TTL
+            int refresh_interval_s = 3600;    ///< Random lookup to keep far buckets fresh
+            int peer_cache_s = 30;            ///< How long get_peers and the gossip mesh reuse a topic lookup
+            size_t max_values_per_key = 256;
+            size_t max_value_bytes = 1024;
+            size_t max_records = 1 << 16;             ///< Values stored for other nodes, all keys together
+            size_t max_records_per_peer = 1024;       ///< Values stored for one sender
+            size_t fragment_bytes = 1200;     ///< Payload per datagram for large messages
+            size_t max_message_bytes = 8 << 20;
+            size_t max_partials = 256;                ///< Messages being reassembled, all senders together
+            size_t max_partials_per_peer = 8;
+            size_t max_partial_bytes = 32 << 20;      ///< Buffered fragments and their slots, all senders
+            GossipRouter::Config gossip;
+        };
+
+        /**
+         * @brief Outcome of a lookup.
+         */
+        struct LookupResult {
+            std::vector<Contact> closest;  ///< Up to k nodes that answered, closest first
+            std::vector<std::string> values;
+            int hops = 0;       ///< Longest chain of referrals to the result
+            int queries = 0;    ///< Requests sent
+            double latency_ms = 0;
+        };
+        using LookupCallback = std::function<void(const LookupResult&)>;
+
+        /**
+         * @param loop Shared event loop; null gives the node a loop of its own.
+         * @param id Node ID; null picks a random one.
+         * @throws std::runtime_error if the socket cannot be bound.
+         */
+        KademliaNode(const std::string& listen_addr, int port, const Config& config,
+                     std::shared_ptr<EventLoop> loop = nullptr, const NodeId* id = nullptr);
+
+        /**
+         * @brief A node on any transport, e.g. a SimTransport. Its random
+         *        choices are seeded from the transport.
+         */
+        KademliaNode(std::shared_ptr<Transport> transport, const Config& config, const NodeId* id = nullptr);
+        ~KademliaNode() override;
+
+        // DHTNode
+        void join(const std::vector<std::string>& bootstrap_peers) override;
+        std::string peer_id() const override { return self_.id.hex(); }
+        void publish(const std::string& topic, const std::vector<uint8_t>& data) override;
+        void subscribe(const std::string& topic, MessageCallback callback) override;
+        std::vector<std::string> get_peers(const std::string& topic) override;
+        void send_direct(const std::string& peer_id, const std::vector<uint8_t>& msg) override;
+        void on_direct_message(MessageCallback callback) override;
+        /**
+         * @throws std::logic_error when enabling: datagrams are never encrypted.
+         */
+        void set_encryption(bool enabled) override;
+
+        /**
+         * @brief Join through seeds without blocking; done runs on the executor.
+         */
+        void join_async(const std::vector<Contact>& seeds, std::function<void()> done);
+
+        const NodeId& id() const { return self_.id; }
+        Contact contact() const { return self_; }
+
+        /**
+         * @brief Key of a name (topic, record): SHA-256 of it.
+         */
+        static NodeId key_for(const std::string& name) { return Digest256::of(name); }
+
+        void find_node(const NodeId& target, LookupCallback done);
+        void find_value(const NodeId& key, LookupCallback done);
+        LookupResult find_node_sync(const NodeId& target);
+        LookupResult find_value_sync(const NodeId& key);
+
+        /**
+         * @brief Store value under key on the k closest nodes (and republish it
+         *        until unput, if republish is set).
+         * @throws std::invalid_argument if value exceeds max_value_bytes.
+         */
+        void put(const NodeId& key, const std::string& value, bool republish = true);
+        void unput(const NodeId& key, const std::string& value);
+
+        size_t routing_table_size();
+        size_t stored_for_peers();  ///< Values held for other nodes' puts
+        GossipRouter::Stats gossip_stats();
+        std::vector<NodeId> gossip_mesh(const std::string& topic);
+
+    private:
+        struct Record {
+            std::string value;
+            Transport::Clock::time_point expires;
+            NodeId origin;  ///< Sender of the kStore; our own ID for our puts
+        };
+        using ReplyCallback = std::function<void(uint8_t type, const uint8_t* body, size_t len)>;
+        struct Pending {
+            ReplyCallback on_reply;  ///< Type 0 and no body on timeout
+            Transport::TimerId timer;
+            NodeId to;
+            bool known_id;  ///< Only a reply from this ID counts (false when pinging an address)
+        };
+        struct Partial {
+            uint8_t type = 0;
+            uint32_t count = 0;
+            uint32_t received = 0;
+            size_t bytes = 0;
+            std::vector<std::string> parts;
+            Transport::Clock::time_point started;
+        };
+        struct Lookup;
+
+        Config config_;
+        std::shared_ptr<Transport> transport_;
+        std::mt19937_64 rng_;
+        Contact self_;
+        RoutingTable routing_;
+        uint64_t next_txid_;
+        std::shared_ptr<char> alive_;  ///< Reset on destruction; tasks still queued on a shared loop check it
+
+        // Executor state
+        std::unordered_map<uint64_t, Pending> pending_;
+        std::unordered_set<Transport::TimerId> timers_;
+        std::unordered_set<NodeId> pinging_;  ///< Bucket heads being checked before eviction
+        std::map<NodeId, std::vector<Record>> records_;
+        size_t remote_records_ = 0;                          ///< Values in records_ stored for other nodes
+        std::unordered_map<NodeId, size_t> records_by_peer_; ///< Their count per sender
+        std::map<std::pair<NodeId, std::string>, bool> published_;  ///< Own puts to republish
+        std::map<std::pair<NodeId, uint64_t>, Partial> partials_;
+        size_t partial_bytes_ = 0;  ///< Fragments and part slots held by partials_
+        std::unordered_map<std::string, std::pair<Transport::Clock::time_point, std::vector<NodeId>>> topic_peers_;
+        /// Addresses of message peers, which need not fit the routing table
+        std::unordered_map<NodeId, std::pair<Transport::Clock::time_point, Contact>> peer_contacts_;
+        MessageCallback direct_callback_;
+        GossipRouter gossip_;
+        Transport::TimerId gossip_timer_ = 0;
+        Transport::Clock::time_point gossip_deadline_;
+
+        void post(std::function<void()> fn);
+        Transport::TimerId schedule(Transport::Clock::duration delay, std::function<void()> fn);
+        void cancel(Transport::TimerId timer);
+        void every(Transport::Clock::duration period, std::function<void()> fn);
+        void handle(const uint8_t* data, size_t len, uint32_t ip, uint16_t port);
+        void send_to(uint32_t ip, uint16_t port, const std::vector<uint8_t>& datagram);
+        std::vector<uint8_t> header(uint8_t type, uint64_t txid) const;
+        void request(const Contact& to, bool known_id, uint8_t type, const std::vector<uint8_t>& body,
+                     ReplyCallback on_reply);
+        void heard_from(const Contact& contact);
+
+        void start_lookup(const NodeId& target, bool want_value, LookupCallback done);
+        void lookup_step(const std::shared_ptr<Lookup>& lookup);
+        void finish_lookup(const std::shared_ptr<Lookup>& lookup);
+
+        void store_at_closest(const NodeId& key, const std::string& value);
+        void store_local(const NodeId& key, const std::string& value, int ttl_s, const NodeId& origin);
+        void forget_record(const Record& record);
+        /**
+         * @brief Start reassembling a message of count fragments, unless the
+         *        sender or the node as a whole is at its limit.
+         */
+        Partial* start_partial(const NodeId& from, uint64_t txid, uint8_t type, uint64_t count);
+        void drop_partial(std::map<std::pair<NodeId, uint64_t>, Partial>::iterator it);
+        void expire();
+        void send_message(const NodeId& to, uint8_t type, const std::vector<uint8_t>& payload);
+        void send_data(const Contact& to, uint8_t type, const std::vector<uint8_t>& payload);
+        void deliver(uint8_t type, const NodeId& from, const std::string& payload);
+        void gossip_wake(int delay_ms);
+        void topic_peers(const std::string& topic, std::function<void(const std::vector<NodeId>&)> done);
+        LookupResult lookup_sync(const NodeId& target, bool want_value);
+    };
+
+} // namespace p2p_dht
+
+#endif // P2P_DHT_KADEMLIA_H
\ No newline at end of file
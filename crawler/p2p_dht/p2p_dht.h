@@ -27,12 +27,18 @@ namespace p2p_dht {
         // Subscribe to a topic (Gossipsub)
         virtual void subscribe(const std::string& topic, MessageCallback callback) = 0;
 
+        // This node's peer ID, as other nodes' get_peers lists it
+        virtual std::string peer_id() const = 0;
+
         // Get a list of peers for a topic
         virtual std::vector<std::string> get_peers(const std::string& topic) = 0;
 
         // Send a direct message to a peer
         virtual void send_direct(const std::string& peer_id, const std::vector<uint8_t>& msg) = 0;
 
+        // Receive direct messages sent to this node
+        virtual void on_direct_message(MessageCallback callback) = 0;
+
         // Enable/disable encryption for all messages
         virtual void set_encryption(bool enabled) = 0;
 
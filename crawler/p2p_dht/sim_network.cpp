@@ -0,0 +1,160 @@
+// File: crawler/p2p_dht/sim_network.cpp
+
+#include "sim_network.h"
+#include "../common/hash_mix.h"
+#include <algorithm>
+
+namespace p2p_dht {
+
+    namespace {
+
+        constexpr uint16_t kSimPort = 4000;
+
+        bool later(const std::pair<Transport::Clock::time_point, uint64_t>& a,
+                   const std::pair<Transport::Clock::time_point, uint64_t>& b) {
+            return a > b;
+        }
+
+    } // namespace
+
+    SimNetwork::SimNetwork(const Config& config) : config_(config), rng_(config.seed) {}
+
+    SimNetwork::~SimNetwork() = default;
+
+    std::shared_ptr<SimTransport> SimNetwork::add_endpoint() {
+        uint32_t ip = next_ip_++;
+        auto transport = std::make_shared<SimTransport>(this, ip, kSimPort);
+        endpoints_[ip] = transport.get();
+        return transport;
+    }
+
+    void SimNetwork::set_latency(double latency_ms, double jitter_ms) {
+        config_.latency_ms = latency_ms;
+        config_.jitter_ms = jitter_ms;
+    }
+
+    void SimNetwork::partition(const std::vector<std::vector<uint32_t>>& groups) {
+        groups_.clear();
+        for (size_t g = 0; g < groups.size(); ++g) {
+            for (uint32_t ip : groups[g]) groups_[ip] = int(g) + 1;
+        }
+    }
+
+    void SimNetwork::heal() {
+        groups_.clear();
+    }
+
+    void SimNetwork::set_online(uint32_t ip, bool online) {
+        if (online) {
+            offline_.erase(ip);
+        } else {
+            offline_.insert(ip);
+        }
+    }
+
+    uint64_t SimNetwork::schedule(Clock::time_point when, std::function<void()> fn) {
+        uint64_t seq = next_seq_++;
+        events_.push_back(Event{std::max(when, now_), seq, std::move(fn)});
+        std::push_heap(events_.begin(), events_.end(), [](const Event& a, const Event& b) {
+            return later({a.when, a.seq}, {b.when, b.seq});
+        });
+        return seq;
+    }
+
+    void SimNetwork::cancel(uint64_t id) {
+        cancelled_.insert(id);
+    }
+
+    bool SimNetwork::run_next(Clock::time_point end) {
+        if (events_.empty() || events_.front().when > end) return false;
+        std::pop_heap(events_.begin(), events_.end(), [](const Event& a, const Event& b) {
+            return later({a.when, a.seq}, {b.when, b.seq});
+        });
+        Event event = std::move(events_.back());
+        events_.pop_back();
+        now_ = event.when;
+        if (cancelled_.erase(event.seq)) return true;
+        ++stats_.events;
+        event.fn();
+        return true;
+    }
+
+    void SimNetwork::run_for(Clock::duration d) {
+        Clock::time_point end = now_ + d;
+        while (run_next(end)) {}
+        now_ = end;
+    }
+
+    bool SimNetwork::run_until(const std::function<bool()>& done, Clock::duration limit) {
+        Clock::time_point end = now_ + limit;
+        while (!done()) {
+            if (!run_next(end)) {
+                now_ = end;
+                return done();
+            }
+        }
+        return true;
+    }
+
+    double SimNetwork::link_latency_ms(uint32_t a, uint32_t b) const {
+        uint64_t pair = uint64_t(std::min(a, b)) << 32 | std::max(a, b);
+        return config_.latency_ms * (0.5 + double(mix64(pair ^ config_.seed) % 1000) / 1000.0);
+    }
+
+    void SimNetwork::transmit(uint32_t from_ip, uint16_t from_port, uint32_t to_ip, uint16_t to_port,
+                              const uint8_t* data, size_t len) {
+        ++stats_.sent;
+        stats_.bytes += len;
+        if (offline_.count(from_ip) || offline_.count(to_ip)) {
+            ++stats_.offline;
+            return;
+        }
+        if (!groups_.empty()) {
+            auto a = groups_.find(from_ip);
+            auto b = groups_.find(to_ip);
+            if ((a == groups_.end() ? 0 : a->second) != (b == groups_.end() ? 0 : b->second)) {
+                ++stats_.partitioned;
+                return;
+            }
+        }
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+        if (config_.loss > 0 && unit(rng_) < config_.loss) {
+            ++stats_.lost;
+            return;
+        }
+        double delay_ms = link_latency_ms(from_ip, to_ip) + config_.jitter_ms * unit(rng_);
+        auto delay = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(delay_ms));
+        schedule(now_ + delay, [this, from_ip, from_port, to_ip, to_port, bytes = std::vector<uint8_t>(data, data + len)] {
+            // Looked up on arrival: the endpoint may have gone or gone offline meanwhile
+            auto it = endpoints_.find(to_ip);
+            if (it == endpoints_.end() || it->second->port_ != to_port || !it->second->receiver_ || offline_.count(to_ip)) {
+                ++stats_.offline;
+                return;
+            }
+            ++stats_.delivered;
+            it->second->receiver_(bytes.data(), bytes.size(), from_ip, from_port);
+        });
+    }
+
+    // ---------------------------------------------------------------- SimTransport
+
+    SimTransport::SimTransport(SimNetwork* network, uint32_t ip, uint16_t port)
+        : network_(network), ip_(ip), port_(port) {}
+
+    SimTransport::~SimTransport() {
+        network_->endpoints_.erase(ip_);
+    }
+
+    void SimTransport::send(uint32_t ip, uint16_t port, const uint8_t* data, size_t len) {
+        network_->transmit(ip_, port_, ip, port, data, len);
+    }
+
+    Transport::TimerId SimTransport::call_after(Clock::duration delay, std::function<void()> fn) {
+        return network_->schedule(network_->now() + delay, std::move(fn));
+    }
+
+    void SimTransport::post(std::function<void()> fn) {
+        network_->schedule(network_->now(), std::move(fn));
+    }
+
+} // namespace p2p_dht
\ No newline at end of file
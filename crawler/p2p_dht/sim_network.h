@@ -0,0 +1,164 @@
+// File: crawler/p2p_dht/sim_network.h
+// deterministic in-process network simulator for DHT nodes
+#ifndef P2P_DHT_SIM_NETWORK_H
+#define P2P_DHT_SIM_NETWORK_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <random>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "transport.h"
+
+namespace p2p_dht {
+
+    class SimTransport;
+
+    /**
+     * @class SimNetwork
+     * @brief A simulated datagram network with a virtual clock.
+     *
+     * Each endpoint gets its own address (10.x.y.z, port 4000). A datagram
+     * arrives after its link's latency plus jitter; it is lost with the
+     * configured probability, or dropped when the endpoints sit in different
+     * partitions or either one is offline. A link's base latency is fixed
+     * per pair: between half and one and a half times latency_ms, derived
+     * from the two addresses.
+     *
+     * Timers, posted tasks and deliveries are events run in time order by
+     * run_for/run_until on the calling thread, and virtual time jumps from
+     * one event to the next. Ties run in the order they were scheduled. All
+     * randomness comes from one generator seeded by Config::seed, so a run
+     * with the same seed and the same calls repeats exactly. The network is
+     * single-threaded: nodes on it must only be called from the thread that
+     * drives it, using their asynchronous API (blocking calls would wait on
+     * events that never run).
+     */
+    class SimNetwork {
+    public:
+        using Clock = Transport::Clock;
+
+        struct Config {
+            uint64_t seed = 1;
+            double latency_ms = 20;  ///< Mean one-way latency of a link
+            double jitter_ms = 5;    ///< Uniform extra delay per datagram
+            double loss = 0;         ///< Probability that a datagram is lost
+        };
+
+        struct Stats {
+            uint64_t sent = 0;
+            uint64_t delivered = 0;
+            uint64_t lost = 0;
+            uint64_t partitioned = 0;  ///< Dropped between partitions
+            uint64_t offline = 0;      ///< Dropped at an offline or missing endpoint
+            uint64_t bytes = 0;
+            uint64_t events = 0;
+        };
+
+        explicit SimNetwork(const Config& config);
+        ~SimNetwork();
+
+        SimNetwork(const SimNetwork&) = delete;
+        SimNetwork& operator=(const SimNetwork&) = delete;
+
+        /**
+         * @brief A transport at a new address. The network must outlive it.
+         */
+        std::shared_ptr<SimTransport> add_endpoint();
+
+        Clock::time_point now() const { return now_; }
+
+        /**
+         * @brief Run events for d of virtual time.
+         */
+        void run_for(Clock::duration d);
+
+        /**
+         * @brief Run events until done() holds or limit of virtual time passes.
+         * @return done() at the end.
+         */
+        bool run_until(const std::function<bool()>& done, Clock::duration limit);
+
+        void set_loss(double loss) { config_.loss = loss; }
+        void set_latency(double latency_ms, double jitter_ms);
+
+        /**
+         * @brief Split the network: datagrams only flow within a group.
+         *        Addresses in no group form one more group together.
+         */
+        void partition(const std::vector<std::vector<uint32_t>>& groups);
+        void heal();
+
+        /**
+         * @brief Take an endpoint off the network (it keeps running, but
+         *        nothing reaches it or leaves it) or bring it back.
+         */
+        void set_online(uint32_t ip, bool online);
+
+        const Stats& stats() const { return stats_; }
+        uint64_t next_random() { return rng_(); }
+
+    private:
+        friend class SimTransport;
+
+        struct Event {
+            Clock::time_point when;
+            uint64_t seq;
+            std::function<void()> fn;
+        };
+
+        Config config_;
+        std::mt19937_64 rng_;
+        Clock::time_point now_;
+        uint64_t next_seq_ = 1;
+        std::vector<Event> events_;  ///< Min-heap on (when, seq)
+        std::unordered_set<uint64_t> cancelled_;
+        std::unordered_map<uint32_t, SimTransport*> endpoints_;
+        std::unordered_map<uint32_t, int> groups_;
+        std::unordered_set<uint32_t> offline_;
+        uint32_t next_ip_ = (10u << 24) + 1;
+        Stats stats_;
+
+        uint64_t schedule(Clock::time_point when, std::function<void()> fn);
+        void cancel(uint64_t id);
+        bool run_next(Clock::time_point end);
+        void transmit(uint32_t from_ip, uint16_t from_port, uint32_t to_ip, uint16_t to_port, const uint8_t* data,
+                      size_t len);
+        double link_latency_ms(uint32_t a, uint32_t b) const;
+    };
+
+    /**
+     * @class SimTransport
+     * @brief Transport for one endpoint of a SimNetwork.
+     */
+    class SimTransport : public Transport {
+    public:
+        SimTransport(SimNetwork* network, uint32_t ip, uint16_t port);
+        ~SimTransport() override;
+
+        uint32_t ip() const override { return ip_; }
+        uint16_t port() const override { return port_; }
+        void send(uint32_t ip, uint16_t port, const uint8_t* data, size_t len) override;
+        void set_receiver(Receiver receiver) override { receiver_ = std::move(receiver); }
+        Clock::time_point now() const override { return network_->now(); }
+        TimerId call_after(Clock::duration delay, std::function<void()> fn) override;
+        void cancel(TimerId id) override { network_->cancel(id); }
+        void post(std::function<void()> fn) override;
+        void run_sync(const std::function<void()>& fn) override { fn(); }
+        bool on_executor() const override { return true; }
+        uint64_t random_seed() override { return network_->next_random(); }
+
+    private:
+        friend class SimNetwork;
+
+        SimNetwork* network_;
+        uint32_t ip_;
+        uint16_t port_;
+        Receiver receiver_;
+    };
+
+} // namespace p2p_dht
+
+#endif // P2P_DHT_SIM_NETWORK_H
\ No newline at end of file
@@ -0,0 +1,126 @@
+// File: crawler/p2p_dht/transport.cpp
+
+#include "transport.h"
+#include <arpa/inet.h>
+#include <cstdlib>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <random>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace p2p_dht {
+
+    namespace {
+
+        constexpr size_t kMaxDatagram = 65507;
+
+    } // namespace
+
+    bool parse_address(const std::string& address, uint32_t& ip, uint16_t& port) {
+        size_t colon = address.rfind(':');
+        if (colon == std::string::npos) return false;
+        int value = std::atoi(address.c_str() + colon + 1);
+        if (value <= 0 || value > 65535) return false;
+        addrinfo hints{};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+        addrinfo* info = nullptr;
+        if (getaddrinfo(address.substr(0, colon).c_str(), nullptr, &hints, &info) != 0 || !info) return false;
+        ip = ntohl(reinterpret_cast<sockaddr_in*>(info->ai_addr)->sin_addr.s_addr);
+        freeaddrinfo(info);
+        port = uint16_t(value);
+        return true;
+    }
+
+    UdpTransport::UdpTransport(const std::string& listen_addr, int port, std::shared_ptr<EventLoop> loop)
+        : loop_(loop ? loop : std::make_shared<EventLoop>()), owns_loop_(!loop) {
+        uint16_t unused = 0;
+        if (!parse_address(listen_addr + ":1", ip_, unused)) {
+            throw std::runtime_error("UdpTransport: bad listen address " + listen_addr);
+        }
+        fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd_ < 0) throw std::runtime_error("UdpTransport: socket failed");
+        fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) | O_NONBLOCK);
+        int buffer = 4 << 20;
+        setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(ip_);
+        addr.sin_port = htons(uint16_t(port));
+        socklen_t addr_len = sizeof(addr);
+        if (bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+            getsockname(fd_, reinterpret_cast<sockaddr*>(&addr), &addr_len) != 0) {
+            close(fd_);
+            throw std::runtime_error("UdpTransport: cannot bind " + listen_addr + ":" + std::to_string(port));
+        }
+        port_ = ntohs(addr.sin_port);
+        if (ip_ == 0) ip_ = INADDR_LOOPBACK;  // Wildcard bind: advertise loopback locally
+        loop_->start();
+    }
+
+    UdpTransport::~UdpTransport() {
+        loop_->run_sync([this] { loop_->unwatch(fd_); });
+        if (owns_loop_) loop_->stop();
+        close(fd_);
+    }
+
+    void UdpTransport::send(uint32_t ip, uint16_t port, const uint8_t* data, size_t len) {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(ip);
+        addr.sin_port = htons(port);
+        // A full socket buffer drops the datagram, as the network would
+        sendto(fd_, data, len, MSG_DONTWAIT, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    }
+
+    void UdpTransport::set_receiver(Receiver receiver) {
+        run_sync([&] {
+            receiver_ = std::move(receiver);
+            if (receiver_) {
+                loop_->watch(fd_, [this] { on_readable(); });
+            } else {
+                loop_->unwatch(fd_);
+            }
+        });
+    }
+
+    void UdpTransport::on_readable() {
+        uint8_t buffer[kMaxDatagram];
+        while (receiver_) {
+            sockaddr_in from{};
+            socklen_t from_len = sizeof(from);
+            ssize_t n = recvfrom(fd_, buffer, sizeof(buffer), 0, reinterpret_cast<sockaddr*>(&from), &from_len);
+            if (n < 0) break;  // EAGAIN: drained
+            receiver_(buffer, size_t(n), ntohl(from.sin_addr.s_addr), ntohs(from.sin_port));
+        }
+    }
+
+    Transport::TimerId UdpTransport::call_after(Clock::duration delay, std::function<void()> fn) {
+        return loop_->call_after(delay, std::move(fn));
+    }
+
+    void UdpTransport::cancel(TimerId id) {
+        loop_->cancel(id);
+    }
+
+    void UdpTransport::post(std::function<void()> fn) {
+        loop_->post(std::move(fn));
+    }
+
+    void UdpTransport::run_sync(const std::function<void()>& fn) {
+        loop_->run_sync(fn);
+    }
+
+    bool UdpTransport::on_executor() const {
+        return loop_->in_loop_thread();
+    }
+
+    uint64_t UdpTransport::random_seed() {
+        std::random_device device;
+        return uint64_t(device()) << 32 | device();
+    }
+
+} // namespace p2p_dht
\ No newline at end of file
@@ -0,0 +1,121 @@
+// File: crawler/p2p_dht/transport.h
+// datagram transport, clock and executor under a DHT node
+#ifndef P2P_DHT_TRANSPORT_H
+#define P2P_DHT_TRANSPORT_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include "event_loop.h"
+
+namespace p2p_dht {
+
+    /**
+     * @class Transport
+     * @brief Everything a KademliaNode needs from the outside world.
+     *
+     * The transport delivers datagrams and owns the node's clock and
+     * executor. Node state is touched only on the executor, so timers,
+     * posted tasks and received datagrams never run concurrently. A
+     * UdpTransport uses a real socket and an EventLoop thread. A
+     * SimTransport (sim_network.h) uses a simulated network and a virtual
+     * clock; its executor is whichever thread drives the simulation.
+     */
+    class Transport {
+    public:
+        using Clock = std::chrono::steady_clock;
+        using TimerId = uint64_t;
+        /// Datagram from ip:port (IPv4, host byte order)
+        using Receiver = std::function<void(const uint8_t* data, size_t len, uint32_t ip, uint16_t port)>;
+
+        virtual ~Transport() = default;
+
+        /**
+         * @brief Own address as peers see it.
+         */
+        virtual uint32_t ip() const = 0;
+        virtual uint16_t port() const = 0;
+
+        /**
+         * @brief Send one datagram, best effort. Executor only.
+         */
+        virtual void send(uint32_t ip, uint16_t port, const uint8_t* data, size_t len) = 0;
+
+        /**
+         * @brief Start delivering datagrams to receiver on the executor; null stops delivery.
+         */
+        virtual void set_receiver(Receiver receiver) = 0;
+
+        virtual Clock::time_point now() const = 0;
+        virtual TimerId call_after(Clock::duration delay, std::function<void()> fn) = 0;
+        virtual void cancel(TimerId id) = 0;
+
+        /**
+         * @brief Run fn on the executor. Thread-safe.
+         */
+        virtual void post(std::function<void()> fn) = 0;
+
+        /**
+         * @brief Run fn on the executor and wait; inline when already on it.
+         */
+        virtual void run_sync(const std::function<void()>& fn) = 0;
+
+        /**
+         * @brief Whether the caller is on the executor, where blocking on the node would deadlock.
+         */
+        virtual bool on_executor() const = 0;
+
+        /**
+         * @brief Seed for the node's random choices (IDs, transaction IDs, refresh targets).
+         */
+        virtual uint64_t random_seed() = 0;
+    };
+
+    /**
+     * @class UdpTransport
+     * @brief Transport over a nonblocking UDP socket watched by an EventLoop.
+     */
+    class UdpTransport : public Transport {
+    public:
+        /**
+         * @param port 0 picks a free port.
+         * @param loop Shared event loop; null gives the transport a loop of its own.
+         * @throws std::runtime_error if the address is bad or the socket cannot be bound.
+         */
+        UdpTransport(const std::string& listen_addr, int port, std::shared_ptr<EventLoop> loop = nullptr);
+        ~UdpTransport() override;
+
+        uint32_t ip() const override { return ip_; }
+        uint16_t port() const override { return port_; }
+        void send(uint32_t ip, uint16_t port, const uint8_t* data, size_t len) override;
+        void set_receiver(Receiver receiver) override;
+        Clock::time_point now() const override { return Clock::now(); }
+        TimerId call_after(Clock::duration delay, std::function<void()> fn) override;
+        void cancel(TimerId id) override;
+        void post(std::function<void()> fn) override;
+        void run_sync(const std::function<void()>& fn) override;
+        bool on_executor() const override;
+        uint64_t random_seed() override;
+
+    private:
+        std::shared_ptr<EventLoop> loop_;
+        bool owns_loop_;
+        int fd_ = -1;
+        uint32_t ip_ = 0;
+        uint16_t port_ = 0;
+        Receiver receiver_;
+
+        void on_readable();
+    };
+
+    /**
+     * @brief Resolve "host:port" to an IPv4 address (host byte order).
+     */
+    bool parse_address(const std::string& address, uint32_t& ip, uint16_t& port);
+
+} // namespace p2p_dht
+
+#endif // P2P_DHT_TRANSPORT_H
\ No newline at end of file
@@ -80,8 +80,12 @@ void InvertedIndex::remove_document(const std::string& doc_id) {
 }
 
 /**
- * @brief Apply incremental updates to the index (placeholder for Merkle diff logic).
+ * @brief Apply incremental updates to the index: tokens from the changed
+ *        blocks of a page (decoded from a crawler diff packet) are added to
+ *        the page's postings. Postings of tokens that only occurred in removed
+ *        blocks stay until the page is reindexed in full, since a diff does
+ *        not say whether another block still contains them.
  */
-void InvertedIndex::apply_diff(const std::vector<std::string>& updated_tokens) {
-    // TODO: Implement efficient incremental update using Merkle diffs
+void InvertedIndex::apply_diff(const std::string& doc_id, const std::vector<std::string>& updated_tokens) {
+    add_document(doc_id, updated_tokens);
 } 
\ No newline at end of file
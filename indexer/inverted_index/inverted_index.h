@@ -13,8 +13,8 @@ public:
     void add_document(const std::string& doc_id, const std::vector<std::string>& tokens);
     std::vector<std::string> lookup(const std::string& token) const;
     void remove_document(const std::string& doc_id);
-    // Incremental update support
-    void apply_diff(const std::vector<std::string>& updated_tokens);
+    // Incremental update support: add postings for tokens from a page's changed blocks
+    void apply_diff(const std::string& doc_id, const std::vector<std::string>& updated_tokens);
     // Expose db_ for search_service.cpp (not best practice, but for demo)
     std::unique_ptr<leveldb::DB>& get_db() { return db_; }
 
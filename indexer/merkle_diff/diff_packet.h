@@ -0,0 +1,8 @@
+#include "../../crawler/common/diff_wire.h"
+
+/**
+ * @brief A crawler diff packet (version 1), as published on the "diffs" topic.
+ *        The indexer decodes it with the crawler's own decoder, so the two
+ *        sides cannot drift apart; see DiffWire for the layout.
+ */
+using PageDiff = DiffWire;
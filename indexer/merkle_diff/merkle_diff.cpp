@@ -1,4 +1,9 @@
 #include "merkle_diff.h"
+#include "diff_packet.h"
+#include "../inverted_index/inverted_index.h"
+#include "../stemmer/stemmer.h"
+#include "../tokenizer/tokenizer.h"
+#include <cstring>
 #include <vector>
 #include <string>
 #include <unordered_set>
@@ -17,4 +22,50 @@ std::vector<std::string> MerkleDiff::compute_diff(const std::vector<std::string>
     }
     return diff;
     // TODO: Optimize for large sets, support deletions, and Merkle tree-based diffs
-} 
\ No newline at end of file
+} 
+
+namespace {
+
+/**
+ * @brief Text of an HTML fragment: drops tags, including a tag cut off at
+ *        either end of the block.
+ */
+std::string strip_markup(const char* data, size_t len) {
+    std::string text;
+    text.reserve(len);
+    const char* first_open = static_cast<const char*>(std::memchr(data, '<', len));
+    const char* first_close = static_cast<const char*>(std::memchr(data, '>', len));
+    bool in_tag = first_close && (!first_open || first_close < first_open);
+    for (size_t i = 0; i < len; ++i) {
+        if (data[i] == '<') {
+            in_tag = true;
+        } else if (data[i] == '>') {
+            if (in_tag) text.push_back(' ');
+            in_tag = false;
+        } else if (!in_tag) {
+            text.push_back(data[i]);
+        }
+    }
+    return text;
+}
+
+} // namespace
+
+/**
+ * @brief Tokenize and stem the inline blocks of every added or modified range.
+ */
+bool MerkleDiff::apply_packet(const uint8_t* data, size_t len, InvertedIndex& index) {
+    PageDiff diff;
+    if (!PageDiff::decode(data, len, diff)) return false;
+    Tokenizer tokenizer;
+    Stemmer stemmer;
+    std::vector<std::string> tokens;
+    for (const PageDiff::Leaf& leaf : diff.leaves) {
+        if (!leaf.block) continue;
+        for (const auto& token : tokenizer.tokenize(strip_markup(leaf.block, leaf.block_len))) {
+            tokens.push_back(stemmer.stem(token));
+        }
+    }
+    if (!tokens.empty()) index.apply_diff(diff.url, tokens);
+    return true;
+}
\ No newline at end of file
@@ -1,6 +1,9 @@
+#include <cstdint>
 #include <vector>
 #include <string>
 
+class InvertedIndex;
+
 /**
  * @class MerkleDiff
  * @brief Computes and applies Merkle diffs for index updates.
@@ -8,4 +11,13 @@
 class MerkleDiff {
 public:
     static std::vector<std::string> compute_diff(const std::vector<std::string>& old_tokens, const std::vector<std::string>& new_tokens);
+
+    /**
+     * @brief Decode a crawler diff packet (PageDiff) and index the text of its
+     *        inline blocks under the packet's URL via InvertedIndex::apply_diff.
+     *        Blocks sent by hash only are skipped; they are picked up when the
+     *        page is next indexed in full.
+     * @return False if the packet does not decode.
+     */
+    static bool apply_packet(const uint8_t* data, size_t len, InvertedIndex& index);
 }; 
\ No newline at end of file
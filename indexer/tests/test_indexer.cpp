@@ -8,6 +8,7 @@
 #include "../stemmer/stemmer.h"
 #include "../inverted_index/inverted_index.h"
 #include "../merkle_diff/merkle_diff.h"
+#include "../merkle_diff/diff_packet.h"
 #include <string>
 #include <vector>
 
@@ -31,6 +32,13 @@ TEST_CASE("Full pipeline: tokenize, stem, index, lookup", "[indexer]") {
     }
 }
 
+TEST_CASE("Tokenizer: UTF-8 punctuation and case folding", "[indexer]") {
+    Tokenizer tokenizer;
+    auto tokens = tokenizer.tokenize("\xc2\xab" "CAF\xc3\x89\xc2\xbb \xe2\x80\x9cQuoted\xe2\x80\x9d, \xd0\x9f\xd0\xb8\xd1\x80 \xe6\x97\xa5\xe6\x9c\xac\xe3\x80\x82");
+    std::vector<std::string> expected = {"caf\xc3\xa9", "quoted", "\xd0\xbf\xd0\xb8\xd1\x80", "\xe6\x97\xa5\xe6\x9c\xac"};
+    REQUIRE(tokens == expected);
+}
+
 TEST_CASE("Index diffing and incremental update", "[indexer]") {
     std::vector<std::string> old_tokens = {"run", "easy"};
     std::vector<std::string> new_tokens = {"run", "easier", "fast"};
@@ -40,4 +48,62 @@ TEST_CASE("Index diffing and incremental update", "[indexer]") {
     REQUIRE(std::find(diff.begin(), diff.end(), "fast") != diff.end());
 }
 
+TEST_CASE("Diff packets: decode and apply to the index", "[indexer]") {
+    // Version 1 packet for one hunk replacing base leaf 1 with two new leaves,
+    // the first sent inline
+    const std::string block = "ss=\"x\">Quick brown <b>foxes</b> jumped</p><di";
+    std::vector<uint8_t> packet = {PageDiff::kVersion, 0};
+    std::string url = "http://example.com/fox";
+    packet.push_back(uint8_t(url.size()));
+    packet.insert(packet.end(), url.begin(), url.end());
+    packet.insert(packet.end(), 2 * PageDiff::kHashSize, 0xAB); // Roots
+    for (uint8_t v : {3, 4, 1, 1, 1, 2}) packet.push_back(v);   // Leaf counts, 1 hunk: gap, old, new counts
+    packet.insert(packet.end(), PageDiff::kHashSize, 0x01);
+    packet.push_back(uint8_t(block.size() + 1));
+    packet.insert(packet.end(), block.begin(), block.end());
+    packet.insert(packet.end(), PageDiff::kHashSize, 0x02);
+    packet.push_back(0);
+
+    PageDiff diff;
+    REQUIRE(PageDiff::decode(packet.data(), packet.size(), diff));
+    REQUIRE(diff.url == url);
+    REQUIRE(diff.hunks.size() == 1);
+    REQUIRE(diff.hunks[0].old_begin == 1);
+    REQUIRE(diff.hunks[0].new_begin == 1);
+    REQUIRE(diff.leaves.size() == 2);
+    REQUIRE(std::string(diff.leaves[0].block, diff.leaves[0].block_len) == block);
+    REQUIRE(diff.leaves[1].block == nullptr);
+    REQUIRE_FALSE(PageDiff::decode(packet.data(), packet.size() - 1, diff));
+
+    // Leaf counts past the limit, or varints with bits past the 64th, are
+    // rejected before any hunk arithmetic
+    auto with_counts = [&](const std::vector<uint8_t>& counts, uint64_t old_count) {
+        std::vector<uint8_t> bad(packet.begin(), packet.begin() + 2 + 1 + url.size() + 2 * PageDiff::kHashSize);
+        bad.insert(bad.end(), counts.begin(), counts.end());
+        bad.insert(bad.end(), {1, 0});  // 1 hunk: gap
+        put_varint(bad, old_count);
+        bad.push_back(0);
+        return bad;
+    };
+    std::vector<uint8_t> counts;
+    put_varint(counts, uint64_t(1) << 63);
+    counts.push_back(0);
+    std::vector<uint8_t> bad = with_counts(counts, uint64_t(1) << 63);
+    REQUIRE_FALSE(PageDiff::decode(bad.data(), bad.size(), diff));
+    counts.assign(9, 0x80);  // Zero, were the 10th byte's high bits dropped
+    counts.insert(counts.end(), {0x02, 0});
+    bad = with_counts(counts, 0);
+    REQUIRE_FALSE(PageDiff::decode(bad.data(), bad.size(), diff));
+
+    InvertedIndex index("test_index_diff_db");
+    REQUIRE(MerkleDiff::apply_packet(packet.data(), packet.size(), index));
+    Stemmer stemmer;
+    for (const char* word : {"quick", "foxes", "jumped"}) {
+        auto docs = index.lookup(stemmer.stem(word));
+        REQUIRE(std::find(docs.begin(), docs.end(), url) != docs.end());
+    }
+    REQUIRE(index.lookup("di").empty()); // Markup cut at the block edges is not text
+    REQUIRE(index.lookup("x").empty());
+}
+
 // Add more tests for batch processing, language detection, and metadata as needed. 
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include <algorithm>
 #include <cctype>
 #include <sstream>
+#include <cstdint>
 
 /**
  * @brief Construct a Tokenizer for a given language (default: English).
@@ -14,16 +15,81 @@ Tokenizer::Tokenizer(const std::string& language) {
     // (Not used in this basic implementation)
 }
 
+namespace {
+
+/**
+ * @brief Decode the UTF-8 code point at text[i]; n receives its length.
+ *        Invalid bytes decode as themselves with length 1.
+ */
+uint32_t decode_at(const std::string& text, size_t i, size_t& n) {
+    unsigned char c = static_cast<unsigned char>(text[i]);
+    n = c < 0xC0 ? 1 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4;
+    if (n == 1 || i + n > text.size()) {
+        n = 1;
+        return c;
+    }
+    uint32_t cp = c & (0x3F >> (n - 1));
+    for (size_t k = 1; k < n; ++k) cp = (cp << 6) | (static_cast<unsigned char>(text[i + k]) & 0x3F);
+    return cp;
+}
+
+void append_utf8(std::string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+/**
+ * @brief ASCII punctuation plus the common non-ASCII quotes, dashes and CJK marks.
+ */
+bool is_punct(uint32_t cp) {
+    if (cp < 0x80) return std::ispunct(static_cast<int>(cp)) != 0;
+    return cp == 0xA1 || cp == 0xAB || cp == 0xB7 || cp == 0xBB || cp == 0xBF
+        || (cp >= 0x2000 && cp <= 0x206F)   // General Punctuation
+        || (cp >= 0x3000 && cp <= 0x303F)   // CJK Symbols and Punctuation
+        || (cp >= 0xFF01 && cp <= 0xFF0F);  // Fullwidth ASCII punctuation
+}
+
+/**
+ * @brief Lowercase ASCII, Latin-1, Greek and Cyrillic capitals.
+ */
+uint32_t to_lower(uint32_t cp) {
+    if (cp >= 'A' && cp <= 'Z') return cp + 0x20;
+    if (cp < 0xC0) return cp;
+    if (cp <= 0xDE && cp != 0xD7) return cp + 0x20;
+    if (cp >= 0x391 && cp <= 0x3A9 && cp != 0x3A2) return cp + 0x20;
+    if (cp >= 0x410 && cp <= 0x42F) return cp + 0x20;
+    if (cp >= 0x400 && cp <= 0x40F) return cp + 0x50;
+    return cp;
+}
+
+} // namespace
+
 /**
  * @brief Tokenize input text into normalized tokens (words).
  *        Basic implementation: split on whitespace, strip punctuation, lowercase.
+ *        Input is UTF-8; classification does not depend on the C locale.
  */
 std::vector<std::string> Tokenizer::tokenize(const std::string& text) const {
     std::vector<std::string> tokens;
-    std::istringstream iss(text);
-    std::string word;
-    while (iss >> word) {
-        std::string norm = normalize(word);
+    size_t i = 0;
+    while (i < text.size()) {
+        while (i < text.size() && is_space(text[i])) ++i;
+        size_t start = i;
+        while (i < text.size() && !is_space(text[i])) ++i;
+        if (i == start) break;
+        std::string norm = normalize(text.substr(start, i - start));
         if (!norm.empty()) tokens.push_back(norm);
     }
     return tokens;
@@ -34,12 +100,24 @@ std::vector<std::string> Tokenizer::tokenize(const std::string& text) const {
  */
 std::string Tokenizer::normalize(const std::string& token) const {
     std::string result;
-    // Remove leading/trailing punctuation
-    size_t start = 0, end = token.size();
-    while (start < end && std::ispunct(static_cast<unsigned char>(token[start]))) ++start;
-    while (end > start && std::ispunct(static_cast<unsigned char>(token[end-1]))) --end;
-    for (size_t i = start; i < end; ++i) {
-        result += std::tolower(static_cast<unsigned char>(token[i]));
+    // Remove leading/trailing punctuation (whole code points, so UTF-8 is never split)
+    size_t start = 0, end = token.size(), n = 0;
+    while (start < end && is_punct(decode_at(token, start, n))) start += n;
+    while (end > start) {
+        size_t cp_start = end - 1;
+        while (cp_start > start && (static_cast<unsigned char>(token[cp_start]) & 0xC0) == 0x80) --cp_start;
+        if (!is_punct(decode_at(token, cp_start, n)) || cp_start + n != end) break;
+        end = cp_start;
+    }
+    for (size_t i = start; i < end; i += n) {
+        uint32_t cp = decode_at(token, i, n);
+        if (n == 1 && cp >= 0x80) {
+            result += token[i]; // stray byte: keep as is
+        } else if (cp >= 0x800 && n == 4) {
+            result.append(token, i, n); // outside the cased ranges
+        } else {
+            append_utf8(result, to_lower(cp));
+        }
     }
     return result;
 } 
\ No newline at end of file
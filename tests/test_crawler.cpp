@@ -6,11 +6,30 @@
 #include <catch2/catch.hpp>
 #include "../crawler/content_store/content_store.h"
 #include "../crawler/merkle_tree/merkle_tree.h"
+#include "../crawler/merkle_tree/diff_packet.h"
+#include "../crawler/merkle_tree/merkle_search_tree.h"
 #include "../crawler/crawler/crawler.h"
+#include "../crawler/crawler/charset.h"
+#include "../crawler/crawler/html_extractor.h"
+#include "../crawler/p2p_dht/kademlia.h"
+#include "../crawler/p2p_dht/sim_network.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
 #include <string>
+#include <thread>
+#include <unordered_set>
 #include <vector>
+#include <zlib.h>
 
 TEST_CASE("ContentStore: chunking and round-trip storage", "[content_store]") {
+    std::filesystem::remove_all("test_db");
     ContentStore store("test_db");
     std::string data = "abcdefghijklmnopqrstuvwxyz0123456789";
     auto blocks = ContentStore::chunk_data(data, 8);
@@ -19,15 +38,754 @@ TEST_CASE("ContentStore: chunking and round-trip storage", "[content_store]") {
     REQUIRE(blocks == retrieved);
 }
 
+TEST_CASE("ContentStore: content-defined chunking survives insertions", "[content_store]") {
+    std::mt19937 rng(3);
+    std::string page;
+    for (int i = 0; i < 200000; ++i) page.push_back(char('a' + rng() % 26));
+    auto blocks = ContentStore::chunk_content(page);
+    std::string joined;
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        if (i + 1 < blocks.size()) REQUIRE(blocks[i].size() >= 1024);
+        REQUIRE(blocks[i].size() <= 16384);
+        joined += blocks[i];
+    }
+    REQUIRE(joined == page);
+    REQUIRE(blocks.size() > 200000 / 8192);
+    REQUIRE(blocks.size() < 200000 / 2048);
+
+    std::string edited = page;
+    edited.insert(100000, "<p>a new paragraph</p>");
+    auto edited_blocks = ContentStore::chunk_content(edited);
+    std::unordered_set<std::string> before(blocks.begin(), blocks.end());
+    size_t fresh = 0;
+    for (const auto& block : edited_blocks) fresh += before.count(block) == 0;
+    REQUIRE(fresh <= 2);
+}
+
+TEST_CASE("ContentStore: batched page writes with manifest", "[content_store]") {
+    std::filesystem::remove_all("test_db_pages");
+    ContentStore store("test_db_pages");
+    std::vector<std::string> blocks = {"alpha", "beta", "alpha", "gamma"};
+    auto hashes = store.hash_blocks(blocks);
+    store.store_page("http://example.com/", blocks, hashes, "manifest-v1");
+    REQUIRE(store.get_manifest("http://example.com/") == "manifest-v1");
+    REQUIRE(store.get_blocks(hashes) == blocks);
+    REQUIRE(store.stats().blocks_deduplicated >= 1); // "alpha" twice in one page
+
+    // Concurrent writers share group commits; every block is readable afterwards
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 4; ++t) {
+        workers.emplace_back([&store, t] {
+            for (int i = 0; i < 50; ++i) {
+                store.store_blocks({"block-" + std::to_string(t) + "-" + std::to_string(i), "shared"});
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    REQUIRE(store.get_block(ContentStore::digest("block-3-49")) == "block-3-49");
+    ContentStore::Stats stats = store.stats();
+    REQUIRE(stats.group_commits <= stats.batches);
+    REQUIRE(stats.blocks_written >= 4 * 50);
+}
+
+TEST_CASE("ContentStore: compressed blocks with trained dictionary", "[content_store]") {
+    ContentStore::Config config;
+    config.compress_blocks = true;
+    config.compression.training_samples = 200;
+    config.compression.dictionary_bytes = 16 * 1024;
+    std::vector<std::string> blocks;
+    for (int i = 0; i < 600; ++i) {
+        std::string html;
+        for (int row = 0; html.size() < 4096; ++row) {
+            html += "<tr class=\"listing\"><td><a href=\"/item/" + std::to_string(i * 31 + row) + "\">Item " +
+                    std::to_string(row * 7 + i) + "</a></td><td class=\"price\">" + std::to_string(i % 97) +
+                    ".99</td></tr>\n";
+        }
+        blocks.push_back(html.substr(0, 4096));
+    }
+    std::filesystem::remove_all("test_db_zstd");
+    std::vector<Digest256> hashes;
+    {
+        ContentStore store("test_db_zstd", config);
+        std::vector<std::string> first(blocks.begin(), blocks.begin() + 300);
+        hashes = store.store_blocks(first);
+        // Training runs in the background once 200 blocks were sampled
+        for (int i = 0; i < 500 && store.stats().dictionaries == 0; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        REQUIRE(store.stats().dictionaries == 1);
+        std::vector<std::string> rest(blocks.begin() + 300, blocks.end());
+        for (const auto& hash : store.store_blocks(rest)) hashes.push_back(hash);
+        REQUIRE(store.get_blocks(hashes) == blocks);
+        ContentStore::Stats stats = store.stats();
+        REQUIRE(stats.block_bytes == 600 * 4096);
+        REQUIRE(stats.stored_bytes * 4 < stats.block_bytes);
+    }
+    // Dictionaries are reloaded on open; the block format is fixed at creation
+    ContentStore reopened("test_db_zstd", config);
+    REQUIRE(reopened.get_block(hashes.back()) == blocks.back());
+    REQUIRE(reopened.stats().dictionaries == 1);
+    REQUIRE_THROWS_AS(ContentStore("test_db_zstd"), std::runtime_error);
+}
+
+TEST_CASE("PackStore: rotation, reopen and index rebuild", "[content_store]") {
+    std::filesystem::remove_all("test_packs");
+    PackStore::Config config;
+    config.max_pack_bytes = 64 * 1024;
+    config.initial_index_slots = 16;
+    std::vector<std::string> values;
+    std::vector<Digest256> hashes;
+    for (int i = 0; i < 200; ++i) {
+        values.push_back(std::string(1000 + i, char('a' + i % 26)) + std::to_string(i));
+        hashes.push_back(Digest256::of(values.back()));
+    }
+    std::vector<PackStore::Record> records;
+    for (size_t i = 0; i < values.size(); ++i) records.push_back({&hashes[i], &values[i]});
+    {
+        PackStore packs("test_packs", config);
+        packs.append(records);
+        packs.append(records); // Already present: nothing appended
+        PackStore::Stats stats = packs.stats();
+        REQUIRE(stats.records == 200);
+        REQUIRE(stats.packs > 2);
+        REQUIRE(stats.index_slots >= 256);
+        std::string value;
+        REQUIRE(packs.get(hashes[123], value));
+        REQUIRE(value == values[123]);
+        REQUIRE_FALSE(packs.contains(Digest256::of("missing")));
+    }
+    {
+        PackStore packs("test_packs", config);
+        REQUIRE_FALSE(packs.stats().rebuilt);
+        std::string value;
+        REQUIRE(packs.get(hashes.front(), value));
+        REQUIRE(value == values.front());
+    }
+    // A lost index and a torn append, as after a crash
+    std::filesystem::remove("test_packs/index.dat");
+    size_t last = 1;
+    while (std::filesystem::exists("test_packs/pack-00000" + std::to_string(last + 1) + ".dat")) ++last;
+    std::ofstream("test_packs/pack-00000" + std::to_string(last) + ".dat", std::ios::app) << "torn";
+    PackStore packs("test_packs", config);
+    REQUIRE(packs.stats().rebuilt);
+    REQUIRE(packs.stats().records == 200);
+    for (size_t i = 0; i < values.size(); i += 17) {
+        std::string value;
+        REQUIRE(packs.get(hashes[i], value));
+        REQUIRE(value == values[i]);
+    }
+}
+
+TEST_CASE("ContentStore: blocks in pack files", "[content_store]") {
+    std::filesystem::remove_all("test_db_packs");
+    ContentStore::Config config;
+    config.block_storage = ContentStore::BlockStorage::kPackFiles;
+    config.compress_blocks = true;
+    std::string page(20000, 'p');
+    for (size_t i = 0; i < page.size(); i += 7) page[i] = char('a' + i % 13);
+    std::vector<std::string> blocks = ContentStore::chunk_data(page);
+    std::vector<Digest256> hashes;
+    {
+        ContentStore store("test_db_packs", config);
+        hashes = store.hash_blocks(blocks);
+        store.store_page("http://example.com/", blocks, hashes, "manifest");
+        REQUIRE(store.get_blocks(hashes) == blocks);
+        REQUIRE(store.stats().pack_files == 1);
+    }
+    ContentStore reopened("test_db_packs", config);
+    REQUIRE(reopened.get_blocks(hashes) == blocks);
+    REQUIRE(reopened.get_manifest("http://example.com/") == "manifest");
+    config.block_storage = ContentStore::BlockStorage::kLevelDb;
+    REQUIRE_THROWS_AS(ContentStore("test_db_packs", config), std::runtime_error);
+}
+
+TEST_CASE("ContentStore: deduplication survives a reopen", "[content_store]") {
+    for (auto storage : {ContentStore::BlockStorage::kLevelDb, ContentStore::BlockStorage::kPackFiles}) {
+        const std::string path = storage == ContentStore::BlockStorage::kLevelDb ? "test_db_reopen" : "test_db_reopen_packs";
+        std::filesystem::remove_all(path);
+        ContentStore::Config config;
+        config.block_storage = storage;
+        std::vector<std::string> blocks;
+        for (int i = 0; i < 50; ++i) blocks.push_back("stored before the restart " + std::to_string(i));
+        ContentStore(path, config).store_blocks(blocks);
+        ContentStore reopened(path, config);
+        reopened.store_blocks(blocks);
+        REQUIRE(reopened.stats().blocks_written == 0);
+        REQUIRE(reopened.stats().blocks_deduplicated == blocks.size());
+    }
+}
+
+TEST_CASE("PageManifest: delta round-trip", "[content_store]") {
+    PageManifest base;
+    base.version = 3;
+    for (int i = 0; i < 50; ++i) base.blocks.push_back(Digest256::of(std::to_string(i)));
+    PageManifest next = base;
+    next.version = 4;
+    next.root = Digest256::of("root");
+    next.blocks[10] = Digest256::of("edited");
+    next.blocks.insert(next.blocks.begin() + 20, Digest256::of("inserted"));
+    next.blocks.erase(next.blocks.begin() + 40, next.blocks.begin() + 45);
+    next.blocks.push_back(base.blocks[0]);
+    std::string delta = next.encode_delta(base);
+    // Two literal hashes plus a few copy runs
+    REQUIRE(delta.size() < 3 * Digest256::kSize + 64);
+    PageManifest rebuilt;
+    REQUIRE(PageManifest::apply_delta(base, delta.data(), delta.size(), rebuilt));
+    REQUIRE(rebuilt.version == 4);
+    REQUIRE(rebuilt.root == next.root);
+    REQUIRE(rebuilt.blocks == next.blocks);
+    std::string full = next.encode();
+    REQUIRE(PageManifest::decode(full.data(), full.size(), rebuilt));
+    REQUIRE(rebuilt.blocks == next.blocks);
+    REQUIRE_FALSE(PageManifest::decode(full.data(), full.size() - 1, rebuilt));
+    REQUIRE_FALSE(PageManifest::apply_delta(PageManifest(), delta.data(), delta.size(), rebuilt));
+}
+
+TEST_CASE("ContentStore: versioned page manifests", "[content_store]") {
+    std::filesystem::remove_all("test_db_versions");
+    ContentStore::Config config;
+    config.max_page_versions = 3;
+    ContentStore store("test_db_versions", config);
+    const std::string url = "http://example.com/versioned";
+    std::vector<std::vector<Digest256>> versions;
+    for (int v = 1; v <= 5; ++v) {
+        std::vector<std::string> blocks = {"header", "body " + std::to_string(v), "footer"};
+        std::vector<Digest256> hashes = store.hash_blocks(blocks);
+        PageManifest previous;
+        PageManifest current = store.store_page_version(url, blocks, hashes, Digest256::of(std::to_string(v)), &previous);
+        REQUIRE(current.version == uint64_t(v));
+        REQUIRE(previous.version == uint64_t(v - 1));
+        if (v > 1) REQUIRE(previous.blocks == versions.back());
+        versions.push_back(hashes);
+    }
+    // An unchanged page writes nothing
+    std::vector<std::string> same = {"header", "body 5", "footer"};
+    REQUIRE(store.store_page_version(url, same, versions.back(), Digest256::of("5")).version == 5);
+    REQUIRE(store.stats().pages_unchanged == 1);
+
+    PageManifest manifest;
+    REQUIRE(store.get_page(url, manifest));
+    REQUIRE(manifest.version == 5);
+    REQUIRE(store.get_page(url, 3, manifest));
+    REQUIRE(manifest.blocks == versions[2]);
+    REQUIRE(manifest.root == Digest256::of("3"));
+    REQUIRE_FALSE(store.get_page(url, 2, manifest)); // Beyond max_page_versions
+    REQUIRE_FALSE(store.get_page("http://example.com/never", manifest));
+}
+
+TEST_CASE("ContentStore: garbage collection keeps referenced blocks", "[content_store]") {
+    for (auto storage : {ContentStore::BlockStorage::kLevelDb, ContentStore::BlockStorage::kPackFiles}) {
+        const std::string path = storage == ContentStore::BlockStorage::kLevelDb ? "test_db_gc" : "test_db_gc_packs";
+        std::filesystem::remove_all(path);
+        ContentStore::Config config;
+        config.block_storage = storage;
+        config.packs.max_pack_bytes = 16 * 1024;
+        config.max_page_versions = 2;
+        config.gc_keys_per_sec = 0;
+        ContentStore store(path, config);
+        std::vector<std::vector<Digest256>> versions;
+        for (int v = 0; v < 4; ++v) {
+            std::vector<std::string> blocks;
+            for (int i = 0; i < 8; ++i) blocks.push_back(std::string(1000, char('a' + i)) + std::to_string(v * (i % 2)));
+            std::vector<Digest256> hashes = store.hash_blocks(blocks);
+            store.store_page_version("http://example.com/gc", blocks, hashes, Digest256::of(std::to_string(v)));
+            versions.push_back(hashes);
+        }
+        Digest256 orphan = store.store_block(std::string(1000, 'z'));
+        REQUIRE(store.get_block(orphan).size() == 1000); // Cached; reclaiming must drop it
+
+        ContentStore::GcReport report = store.collect_garbage();
+        // Versions 1 and 2 were dropped: their 4 odd blocks each, plus the orphan
+        REQUIRE(report.manifests_marked == 2);
+        REQUIRE(report.blocks_reclaimed == 9);
+        REQUIRE(report.bytes_reclaimed > 9 * 1000);
+        REQUIRE(store.get_block(orphan).empty());
+        REQUIRE(store.get_block(versions[1][1]).empty());
+        PageManifest previous;
+        REQUIRE(store.get_page("http://example.com/gc", 3, previous));
+        for (const Digest256& hash : previous.blocks) REQUIRE_FALSE(store.get_block(hash).empty());
+        for (const Digest256& hash : versions[3]) REQUIRE_FALSE(store.get_block(hash).empty());
+        if (storage == ContentStore::BlockStorage::kPackFiles) REQUIRE(report.pack_bytes_freed > 0);
+        REQUIRE(store.collect_garbage().blocks_reclaimed == 0);
+        REQUIRE(store.stats().gc_cycles == 2);
+    }
+}
+
+TEST_CASE("ContentStore: garbage collection keeps store_page blocks", "[content_store]") {
+    std::filesystem::remove_all("test_db_gc_manifest");
+    ContentStore::Config config;
+    config.gc_keys_per_sec = 0;
+    ContentStore store("test_db_gc_manifest", config);
+    std::vector<std::string> blocks = {std::string(1000, 'm') + "1", std::string(1000, 'm') + "2"};
+    std::vector<Digest256> hashes = store.hash_blocks(blocks);
+    store.store_page("http://example.com/manifest", blocks, hashes, "manifest-v1");
+    Digest256 orphan = store.store_block(std::string(1000, 'o'));
+
+    ContentStore::GcReport report = store.collect_garbage();
+    REQUIRE(report.manifests_marked == 1);
+    REQUIRE(report.blocks_reclaimed == 1);
+    REQUIRE(store.get_block(orphan).empty());
+    REQUIRE(store.get_manifest("http://example.com/manifest") == "manifest-v1");
+    for (size_t i = 0; i < blocks.size(); ++i) REQUIRE(store.get_block(hashes[i]) == blocks[i]);
+}
+
+TEST_CASE("BlockCache: CLOCK eviction within the byte budget", "[content_store]") {
+    BlockCache cache(4 * 1000, 1);
+    std::vector<Digest256> hashes;
+    for (int i = 0; i < 6; ++i) {
+        hashes.push_back(Digest256::of(std::to_string(i)));
+        if (i == 4) REQUIRE(cache.lookup(hashes[0])); // Second chance for block 0
+        cache.insert(hashes[i], std::make_shared<const std::string>(1000, char('a' + i)));
+    }
+    BlockCache::BlockRef pinned = cache.lookup(hashes[0]);
+    REQUIRE(pinned);
+    REQUIRE(*pinned == std::string(1000, 'a'));
+    REQUIRE_FALSE(cache.lookup(hashes[1]));
+    BlockCache::Stats stats = cache.stats();
+    REQUIRE(stats.entries == 4);
+    REQUIRE(stats.bytes == 4000);
+    REQUIRE(stats.evictions == 2);
+    cache.insert(Digest256::of("huge"), std::make_shared<const std::string>(5000, 'x'));
+    REQUIRE_FALSE(cache.lookup(Digest256::of("huge")));
+}
+
+TEST_CASE("ContentStore: cached parallel multi-get", "[content_store]") {
+    ContentStore::Config config;
+    config.read_threads = 3;
+    std::filesystem::remove_all("test_db_multiget");
+    ContentStore store("test_db_multiget", config);
+    std::vector<std::string> blocks;
+    for (int i = 0; i < 64; ++i) blocks.push_back("block " + std::to_string(i) + std::string(i * 10, '.'));
+    std::vector<Digest256> hashes = store.store_blocks(blocks);
+    hashes.push_back(Digest256::of("never stored"));
+    std::vector<ContentStore::BlockRef> refs = store.get_block_refs(hashes);
+    REQUIRE(refs.size() == 65);
+    REQUIRE_FALSE(refs.back());
+    for (size_t i = 0; i < blocks.size(); ++i) REQUIRE(*refs[i] == blocks[i]);
+    REQUIRE(store.stats().cache_misses == 65);
+    // Second read is served from the cache, sharing the same strings
+    REQUIRE(store.get_block_ref(hashes[7]) == refs[7]);
+    hashes.pop_back();
+    REQUIRE(store.get_blocks(hashes) == blocks);
+    REQUIRE(store.stats().cache_hits == 65);
+
+    ThreadPool pool(3);
+    std::vector<int> squares(1000);
+    pool.parallel_for(squares.size(), [&](size_t i) { squares[i] = int(i * i); });
+    REQUIRE(squares[999] == 999 * 999);
+    REQUIRE_THROWS_AS(pool.parallel_for(10, [](size_t i) { if (i == 5) throw std::runtime_error("x"); }),
+                      std::runtime_error);
+}
+
+TEST_CASE("Digest256: hex round-trip and ordering", "[digest]") {
+    Digest256 empty = Digest256::of("");
+    REQUIRE(empty.hex() == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    REQUIRE(ContentStore::sha256("") == empty.hex());
+    Digest256 parsed;
+    REQUIRE(Digest256::from_hex(empty.hex(), parsed));
+    REQUIRE(parsed == empty);
+    REQUIRE(Digest256::from_bytes(empty.to_bytes().data()) == empty);
+    REQUIRE_FALSE(Digest256::from_hex("xyz", parsed));
+    REQUIRE(Digest256().is_zero());
+    REQUIRE((Digest256() < empty) != (empty < Digest256()));
+}
+
+TEST_CASE("HashEngine: backends agree with reference vectors", "[digest]") {
+    std::vector<std::string> inputs = {"", "abc", std::string(55, 'a'), std::string(56, 'a'), std::string(4096, 'z')};
+    for (int i = 0; i < 20; ++i) inputs.push_back(std::string(i * 211, char('a' + i)));
+    HashEngine generic(HashAlgorithm::kSha256, HashEngine::Backend::kGeneric);
+    std::vector<Digest256> expected = generic.hash_many(inputs);
+    REQUIRE(expected[0].hex() == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    REQUIRE(expected[1].hex() == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    for (auto backend : {HashEngine::Backend::kAvx2, HashEngine::Backend::kShaNi}) {
+        if (!HashEngine::supported(backend)) continue;
+        HashEngine engine(HashAlgorithm::kSha256, backend);
+        REQUIRE(engine.hash_many(inputs) == expected);
+        REQUIRE(engine.hash(inputs[4]) == expected[4]);
+    }
+
+    HashEngine blake3(HashAlgorithm::kBlake3);
+    std::vector<Digest256> b3 = blake3.hash_many(inputs);
+    REQUIRE(b3[0].hex() == "af1349b9f5f9a1a6a0404dea36dcc9499bcb25c9adc112b7cc9a93cae41f3262");
+    REQUIRE(b3[1].hex() == "6437b3ac38465133ffb63b75273a8db548c558465d79db03fd359c6cd5bd9d85");
+    for (size_t i = 0; i < inputs.size(); ++i) REQUIRE(b3[i] == blake3.hash(inputs[i]));
+
+    // A store keeps the algorithm it was created with
+    ContentStore::Config config;
+    config.hash_algorithm = HashAlgorithm::kBlake3;
+    std::filesystem::remove_all("test_db_blake3");
+    { ContentStore store("test_db_blake3", config); }
+    REQUIRE_THROWS_AS(ContentStore("test_db_blake3"), std::runtime_error);
+}
+
 TEST_CASE("MerkleTree: root hash and diff", "[merkle_tree]") {
-    std::vector<std::string> hashes1 = {"a", "b", "c"};
-    std::vector<std::string> hashes2 = {"a", "x", "c"};
+    std::vector<Digest256> hashes1 = {Digest256::of("a"), Digest256::of("b"), Digest256::of("c")};
+    std::vector<Digest256> hashes2 = {Digest256::of("a"), Digest256::of("x"), Digest256::of("c")};
     MerkleTree tree1(hashes1);
     MerkleTree tree2(hashes2);
     REQUIRE(tree1.root_hash() != tree2.root_hash());
+    REQUIRE(tree1.root_hash() == tree1.root().hex());
+    REQUIRE(MerkleTree({}).root_hash().empty());
     auto diff = tree2.diff(tree1);
     REQUIRE(diff.size() == 1);
-    REQUIRE(diff[0] == "x");
+    REQUIRE(diff[0] == Digest256::of("x"));
+}
+
+TEST_CASE("MerkleTree: structural diff with insertions and deletions", "[merkle_tree]") {
+    std::vector<Digest256> base;
+    for (int i = 0; i < 1000; ++i) base.push_back(Digest256::of("block" + std::to_string(i)));
+
+    std::vector<Digest256> edited = base;
+    edited.insert(edited.begin() + 300, Digest256::of("inserted"));
+    edited.erase(edited.begin() + 700);
+    edited[900] = Digest256::of("modified");
+    MerkleDiff diff = MerkleTree(edited).compare(MerkleTree(base));
+    REQUIRE(diff.hunks.size() == 3);
+    REQUIRE(diff.added == std::vector<size_t>{300});
+    REQUIRE(diff.removed == std::vector<size_t>{699});
+    REQUIRE(diff.modified.size() == 1);
+    REQUIRE(diff.modified[0] == std::make_pair(size_t(900), size_t(900)));
+    REQUIRE(MerkleTree(base).compare(MerkleTree(base)).empty());
+
+    // Applying the hunks to the base always rebuilds the new leaves
+    std::mt19937 rng(11);
+    for (int round = 0; round < 200; ++round) {
+        std::vector<Digest256> next = base;
+        for (int edit = rng() % 6; edit > 0; --edit) {
+            size_t at = rng() % (next.size() + 1);
+            Digest256 fresh = Digest256::of(std::to_string(round) + "/" + std::to_string(edit));
+            switch (rng() % 3) {
+            case 0: next.insert(next.begin() + at, fresh); break;
+            case 1: if (at < next.size()) next.erase(next.begin() + at); break;
+            default: if (at < next.size()) next[at] = fresh; break;
+            }
+        }
+        MerkleTree tree(next);
+        MerkleDiff changes = tree.compare(MerkleTree(base));
+        std::vector<Digest256> rebuilt;
+        size_t cursor = 0;
+        for (const MerkleDiff::Hunk& hunk : changes.hunks) {
+            REQUIRE(hunk.old_begin >= cursor);
+            rebuilt.insert(rebuilt.end(), base.begin() + cursor, base.begin() + hunk.old_begin);
+            rebuilt.insert(rebuilt.end(), next.begin() + hunk.new_begin, next.begin() + hunk.new_begin + hunk.new_count);
+            cursor = hunk.old_begin + hunk.old_count;
+        }
+        rebuilt.insert(rebuilt.end(), base.begin() + cursor, base.end());
+        REQUIRE(rebuilt == next);
+        REQUIRE(changes.added.size() + changes.modified.size() <= 5);
+    }
+}
+
+TEST_CASE("DiffPacket: encode and decode a page diff", "[merkle_tree]") {
+    std::vector<std::string> old_blocks, new_blocks;
+    for (int i = 0; i < 40; ++i) old_blocks.push_back("block " + std::to_string(i) + std::string(i * 100, 'x'));
+    new_blocks = old_blocks;
+    new_blocks.insert(new_blocks.begin() + 5, "inserted");
+    new_blocks[30] = std::string(5000, 'y'); // Too large to inline
+    new_blocks.pop_back();
+    MerkleTree old_tree(HashEngine::get(HashAlgorithm::kSha256).hash_many(old_blocks));
+    MerkleTree new_tree(HashEngine::get(HashAlgorithm::kSha256).hash_many(new_blocks));
+    MerkleDiff diff = new_tree.compare(old_tree);
+
+    std::vector<uint8_t> packet;
+    DiffPacket::encode("http://example.com/a", old_tree, new_tree, diff, &new_blocks, 2048, HashAlgorithm::kSha256,
+                       packet);
+    DiffPacket decoded;
+    REQUIRE(DiffPacket::decode(packet.data(), packet.size(), decoded));
+    REQUIRE(decoded.url == "http://example.com/a");
+    REQUIRE(decoded.old_root == old_tree.root());
+    REQUIRE(decoded.new_root == new_tree.root());
+    REQUIRE(decoded.new_leaf_count == new_blocks.size());
+    REQUIRE(decoded.hunks.size() == diff.hunks.size());
+    for (size_t h = 0; h < diff.hunks.size(); ++h) {
+        REQUIRE(decoded.hunks[h].old_begin == diff.hunks[h].old_begin);
+        REQUIRE(decoded.hunks[h].new_begin == diff.hunks[h].new_begin);
+        for (uint64_t k = 0; k < decoded.hunks[h].new_count; ++k) {
+            const DiffPacket::Leaf& leaf = decoded.leaves[decoded.hunks[h].first_leaf + k];
+            const std::string& block = new_blocks[decoded.hunks[h].new_begin + k];
+            REQUIRE(leaf.hash == new_tree.leaf(decoded.hunks[h].new_begin + k));
+            if (block.size() <= 2048) {
+                REQUIRE(std::string(leaf.block, leaf.block_len) == block);
+            } else {
+                REQUIRE(leaf.block == nullptr);
+            }
+        }
+    }
+    // Truncation, trailing bytes and a future version are rejected
+    REQUIRE_FALSE(DiffPacket::decode(packet.data(), packet.size() - 1, decoded));
+    packet.push_back(0);
+    REQUIRE_FALSE(DiffPacket::decode(packet.data(), packet.size(), decoded));
+    packet.pop_back();
+    packet[0] = DiffPacket::kVersion + 1;
+    REQUIRE_FALSE(DiffPacket::decode(packet.data(), packet.size(), decoded));
+}
+
+TEST_CASE("MerkleTree: inclusion proofs and multi-proofs", "[merkle_tree]") {
+    std::mt19937 rng(5);
+    for (size_t n : {1, 2, 3, 7, 8, 33, 1000}) {
+        std::vector<Digest256> leaves;
+        for (size_t i = 0; i < n; ++i) leaves.push_back(Digest256::of("proof" + std::to_string(i)));
+        MerkleTree tree(leaves);
+        for (size_t i = 0; i < n; ++i) {
+            MerkleProof proof = tree.prove({i});
+            REQUIRE(MerkleTree::verify(tree.root(), n, i, leaves[i], proof.nodes.data(), proof.nodes.size()));
+            REQUIRE_FALSE(MerkleTree::verify(tree.root(), n, i, Digest256::of("forged"), proof.nodes.data(),
+                                             proof.nodes.size()));
+            if (n > 1) {
+                REQUIRE_FALSE(MerkleTree::verify(tree.root(), n, (i + 1) % n, leaves[i], proof.nodes.data(),
+                                                 proof.nodes.size()));
+            }
+        }
+        std::vector<uint64_t> batch;
+        for (size_t i = 0; i < n; ++i) {
+            if (rng() % 4 == 0) batch.push_back(i);
+        }
+        batch.push_back(n - 1);
+        MerkleProof proof = tree.prove(batch);
+        std::string wire = proof.encode();
+        MerkleProof received;
+        REQUIRE(MerkleProof::decode(wire.data(), wire.size(), received));
+        REQUIRE_FALSE(MerkleProof::decode(wire.data(), wire.size() - 1, received));
+        std::vector<Digest256> claimed;
+        for (uint64_t index : received.indexes) claimed.push_back(leaves[index]);
+        std::vector<Digest256> scratch = claimed;
+        REQUIRE(MerkleTree::verify(tree.root(), received, scratch.data()));
+        scratch = claimed;
+        scratch[0] = Digest256::of("forged");
+        REQUIRE_FALSE(MerkleTree::verify(tree.root(), received, scratch.data()));
+        if (n == 1000) REQUIRE(proof.nodes.size() < received.indexes.size() * 10 / 2);
+    }
+    REQUIRE_THROWS_AS(MerkleTree({Digest256()}).prove({1}), std::out_of_range);
+}
+
+TEST_CASE("MerkleTree: proofs that lie about the leaf count or the level fail", "[merkle_tree]") {
+    const HashEngine& engine = HashEngine::get(HashAlgorithm::kSha256);
+    std::vector<Digest256> leaves{Digest256::of("a"), Digest256::of("b"), Digest256::of("c")};
+    MerkleTree tree(leaves);
+
+    // Leaf c repeated as index 3 of a claimed 4-leaf tree: same top node as
+    // the 3-leaf tree, which pairs its odd last leaf with itself
+    MerkleProof honest = tree.prove({2});
+    REQUIRE(honest.nodes.size() == 1);
+    MerkleProof forged;
+    forged.leaf_count = 4;
+    forged.indexes = {3};
+    forged.nodes = {engine.hash_leaf(leaves[2]), honest.nodes[0]};
+    Digest256 scratch = leaves[2];
+    REQUIRE_FALSE(MerkleTree::verify(tree.root(), forged, &scratch));
+    REQUIRE_FALSE(MerkleTree::verify(tree.root(), 4, 3, leaves[2], forged.nodes.data(), forged.nodes.size()));
+    // The proof itself is sound for the tree that really has four leaves
+    MerkleTree four({leaves[0], leaves[1], leaves[2], leaves[2]});
+    REQUIRE(four.root() != tree.root());
+    scratch = leaves[2];
+    REQUIRE(MerkleTree::verify(four.root(), forged, &scratch));
+
+    // An internal node passed off as a leaf of a shorter tree
+    leaves.push_back(Digest256::of("d"));
+    MerkleTree full(leaves);
+    Digest256 left = full.prove({2}).nodes[1];   // Parent of a and b
+    Digest256 right = full.prove({0}).nodes[1];  // Parent of c and d
+    REQUIRE(engine.hash_pair(left, right) != full.root());
+    REQUIRE_FALSE(MerkleTree::verify(full.root(), 2, 0, left, &right, 1));
+    REQUIRE_FALSE(MerkleTree::verify(full.root(), 4, 0, left, &right, 1));
+    MerkleProof shorter;
+    shorter.leaf_count = 2;
+    shorter.indexes = {0};
+    shorter.nodes = {right};
+    scratch = left;
+    REQUIRE_FALSE(MerkleTree::verify(full.root(), shorter, &scratch));
+}
+
+TEST_CASE("MerkleTree: flat layout matches level-by-level hashing", "[merkle_tree]") {
+    const HashEngine& engine = HashEngine::get(HashAlgorithm::kSha256);
+    for (size_t n : {1, 2, 3, 5, 8, 13, 64, 100, 1000, 70001}) {
+        std::vector<Digest256> leaves;
+        for (size_t i = 0; i < n; ++i) leaves.push_back(Digest256::of(std::to_string(i)));
+        std::vector<Digest256> level;
+        for (const Digest256& leaf : leaves) level.push_back(engine.hash_leaf(leaf));
+        while (level.size() > 1) {
+            std::vector<Digest256> next;
+            for (size_t i = 0; i < level.size(); i += 2) {
+                next.push_back(engine.hash_pair(level[i], level[i + 1 < level.size() ? i + 1 : i]));
+            }
+            level.swap(next);
+        }
+        // Root: H(0x02 || leaf count, 8 bytes little-endian || top node)
+        std::string bound(1, '\x02');
+        for (int i = 0; i < 8; ++i) bound.push_back(char(uint64_t(n) >> (8 * i)));
+        bound.append(level[0].data(), Digest256::kSize);
+        MerkleTree tree(leaves);
+        REQUIRE(tree.size() == n);
+        REQUIRE(tree.root() == engine.hash(bound));
+        REQUIRE(tree.leaf(n - 1) == leaves.back());
+    }
+}
+
+TEST_CASE("MerkleTree: incremental updates match a rebuild", "[merkle_tree]") {
+    std::vector<Digest256> leaves;
+    MerkleTree tree(leaves);
+    std::mt19937 rng(7);
+    for (int step = 0; step < 600; ++step) {
+        Digest256 hash = Digest256::of("leaf" + std::to_string(step));
+        int op = leaves.empty() ? 0 : int(rng() % 3);
+        if (op == 0) {
+            std::vector<Digest256> batch(1 + rng() % (step % 50 == 0 ? 40 : 3), hash);
+            leaves.insert(leaves.end(), batch.begin(), batch.end());
+            tree.append_leaves(batch);
+        } else if (op == 1) {
+            size_t index = rng() % leaves.size();
+            leaves[index] = hash;
+            tree.update_leaf(index, hash);
+        } else {
+            size_t index = rng() % leaves.size();
+            leaves.erase(leaves.begin() + index);
+            tree.remove_leaf(index);
+        }
+        MerkleTree rebuilt(leaves);
+        REQUIRE(tree.size() == leaves.size());
+        REQUIRE(tree.root() == rebuilt.root());
+        REQUIRE(tree.root_hash() == rebuilt.root_hash());
+    }
+    while (!leaves.empty()) {
+        leaves.pop_back();
+        tree.remove_leaf(leaves.size());
+        REQUIRE(tree.root() == MerkleTree(leaves).root());
+    }
+    REQUIRE(tree.root_hash().empty());
+    REQUIRE_THROWS_AS(tree.update_leaf(0, Digest256()), std::out_of_range);
+}
+
+TEST_CASE("MerkleSearchTree: history independence and reconciliation", "[merkle_tree]") {
+    std::vector<MerkleSearchTree::Entry> pages;
+    for (int i = 0; i < 3000; ++i) {
+        std::string url = "http://example.com/page" + std::to_string(i);
+        pages.push_back({MerkleSearchTree::key_for(url), Digest256::of("root" + std::to_string(i))});
+    }
+    // Insert order does not change the tree; erasing restores the smaller tree
+    MerkleSearchTree forward, shuffled, partial;
+    for (const auto& page : pages) forward.insert(page.key, page.value);
+    std::vector<MerkleSearchTree::Entry> order = pages;
+    std::mt19937 rng(11);
+    std::shuffle(order.begin(), order.end(), rng);
+    for (const auto& page : order) shuffled.insert(page.key, page.value);
+    for (size_t i = 0; i < 2000; ++i) partial.insert(pages[i].key, pages[i].value);
+    REQUIRE(forward.size() == pages.size());
+    REQUIRE(shuffled.root() == forward.root());
+    for (size_t i = 2000; i < pages.size(); ++i) REQUIRE(shuffled.erase(pages[i].key));
+    REQUIRE(shuffled.root() == partial.root());
+    REQUIRE_FALSE(shuffled.erase(pages[2500].key));
+    auto sorted = forward.entries();
+    REQUIRE(sorted.size() == pages.size());
+    REQUIRE(std::is_sorted(sorted.begin(), sorted.end(),
+                           [](const MerkleSearchTree::Entry& a, const MerkleSearchTree::Entry& b) { return a.key < b.key; }));
+    Digest256 value;
+    REQUIRE(forward.find(pages[42].key, &value));
+    REQUIRE(value == pages[42].value);
+    REQUIRE_FALSE(partial.find(pages[2042].key));
+
+    // Two peers that differ in a handful of pages
+    MerkleSearchTree mine, theirs;
+    for (size_t i = 0; i < pages.size(); ++i) {
+        mine.insert(pages[i].key, pages[i].value);
+        theirs.insert(pages[i].key, pages[i].value);
+    }
+    std::vector<Digest256> expected;
+    for (size_t i : {5, 700, 1900, 2999}) {
+        theirs.insert(pages[i].key, Digest256::of("refetched" + std::to_string(i)));
+        expected.push_back(pages[i].key);
+    }
+    for (int i = 0; i < 3; ++i) {
+        Digest256 key = MerkleSearchTree::key_for("http://example.com/new" + std::to_string(i));
+        theirs.insert(key, Digest256::of("new"));
+        expected.push_back(key);
+    }
+    mine.erase(pages[1234].key); // Their copy is missing from mine
+    expected.push_back(pages[1234].key);
+    theirs.erase(pages[77].key); // Not their business: pull is one-way
+
+    MstReconciler sync(mine, theirs.root());
+    while (!sync.done()) REQUIRE(sync.receive(theirs.serve(sync.wanted())));
+    std::vector<Digest256> got;
+    for (const auto& entry : sync.missing()) got.push_back(entry.key);
+    std::sort(got.begin(), got.end());
+    std::sort(expected.begin(), expected.end());
+    REQUIRE(got == expected);
+    REQUIRE(sync.rounds() <= 6);
+    REQUIRE(sync.nodes_received() < 60);  // The full tree has ~200 nodes
+
+    // Identical trees need no round trip; forged or unrequested nodes are rejected
+    REQUIRE(MstReconciler(shuffled, partial.root()).done());
+    MstReconciler forged(partial, theirs.root());
+    std::vector<std::string> answer = theirs.serve(forged.wanted());
+    REQUIRE(answer.size() == 1);
+    answer[0][answer[0].size() - 1] ^= 1;
+    REQUIRE_FALSE(forged.receive(answer));
+    MerkleSearchTree::Node node;
+    std::string encoded = theirs.node(theirs.root())->encode();
+    REQUIRE(MerkleSearchTree::Node::decode(encoded.data(), encoded.size(), node));
+    REQUIRE_FALSE(MerkleSearchTree::Node::decode(encoded.data(), encoded.size() - 1, node));
+}
+
+TEST_CASE("DomainSync: a peer pulls the pages it has not crawled", "[crawler]") {
+    auto url = [](int i) { return "http://example.com/page" + std::to_string(i); };
+    auto root = [](int i) { return Digest256::of("root" + std::to_string(i)); };
+    DomainSync owner, taker;
+    for (int i = 0; i < 2000; ++i) {
+        owner.record("example.com", url(i), root(i));
+        if (i % 100 != 0) taker.record("example.com", url(i), root(i));
+    }
+    taker.record("example.com", url(7), Digest256::of("stale"));
+    taker.record("other.org", "http://other.org/", root(0));
+
+    // Runs an exchange until one side has nothing to say, or up to a message of type stop
+    auto exchange = [](std::vector<uint8_t> message, DomainSync& from, DomainSync& to,
+                       std::vector<std::string>& learned, uint8_t stop) {
+        bool forward = true;
+        while (!message.empty() && message[0] != stop) {
+            std::vector<std::string> ignored;
+            message = forward ? to.handle("from", message.data(), message.size(), learned)
+                              : from.handle("to", message.data(), message.size(), ignored);
+            forward = !forward;
+        }
+        return message;
+    };
+    std::vector<std::string> learned;
+    REQUIRE(exchange(owner.announce("example.com"), owner, taker, learned, 0).empty());
+    REQUIRE(learned.size() == 21);
+    REQUIRE(std::count(learned.begin(), learned.end(), url(7)) == 1);
+    REQUIRE(taker.tree("example.com").root() == owner.tree("example.com").root());
+    REQUIRE(taker.urls("example.com", {MerkleSearchTree::key_for(url(100))}) == std::vector<std::string>{url(100)});
+    REQUIRE(taker.stats().rounds <= 5);
+    REQUIRE(taker.stats().nodes_received < 100);  // The tree has ~130 nodes
+    REQUIRE(taker.domains().size() == 2);
+
+    // Equal roots: the announcement is the whole exchange
+    std::vector<uint8_t> again = owner.announce("example.com");
+    REQUIRE(taker.handle("owner", again.data(), again.size(), learned).empty());
+
+    // A page with another root than the announced tree's is not taken
+    DomainSync late, liar;
+    late.record("example.com", url(1), root(1));
+    liar.record("example.com", url(0), Digest256::of("forged"));
+    std::vector<uint8_t> get_pages = exchange(owner.announce("example.com"), owner, late, learned, DomainSync::kGetPages);
+    REQUIRE(get_pages[0] == DomainSync::kGetPages);
+    std::vector<std::string> ignored;
+    std::vector<uint8_t> pages = liar.handle("late", get_pages.data(), get_pages.size(), ignored);
+    learned.clear();
+    REQUIRE(late.handle("from", pages.data(), pages.size(), learned).empty());
+    REQUIRE(learned.empty());
+    REQUIRE(late.stats().pages_rejected == 1);
+
+    // A host the node holds nothing of is ignored, unless it adopts the host
+    DomainSync stranger;
+    learned.clear();
+    REQUIRE(exchange(owner.announce("example.com"), owner, stranger, learned, 0).empty());
+    REQUIRE(learned.empty());
+    REQUIRE(stranger.domains().empty());
+    stranger.set_adopt([](const std::string& domain) { return domain == "example.com"; });
+    REQUIRE(exchange(owner.announce("example.com"), owner, stranger, learned, 0).empty());
+    REQUIRE(learned.size() == 2000);
+    REQUIRE(stranger.tree("example.com").root() == owner.tree("example.com").root());
 }
 
 TEST_CASE("Crawler: URL normalization", "[crawler]") {
@@ -41,6 +799,7 @@ TEST_CASE("Crawler: robots.txt parsing and enforcement", "[crawler]") {
     RobotsRules rules;
     rules.disallow = {"/private"};
     rules.allow = {"/private/open"};
+    std::filesystem::remove_all("test_db");
     Crawler crawler("test_db", nullptr);
     std::string url1 = "http://example.com/private/page";
     std::string url2 = "http://example.com/private/open/page";
@@ -48,4 +807,857 @@ TEST_CASE("Crawler: robots.txt parsing and enforcement", "[crawler]") {
     REQUIRE(crawler.is_allowed_by_rules(url2, rules));
 }
 
+TEST_CASE("HostRateLimiter: additive increase, multiplicative decrease", "[crawler]") {
+    HostRateLimiter::Config config;
+    config.initial_interval_ms = 0;
+    config.min_interval_ms = 0;
+    config.max_connections_per_host = 4;
+    HostRateLimiter limiter(config);
+    HostRateLimiter::Outcome ok;
+    ok.http_status = 200;
+    ok.latency_ms = 5;
+    for (int i = 0; i < 20; ++i) {
+        limiter.acquire("fast.example");
+        limiter.release("fast.example", ok);
+    }
+    REQUIRE(limiter.snapshot().front().window == Approx(4.0));
+
+    HostRateLimiter::Outcome throttled;
+    throttled.http_status = 429;
+    throttled.latency_ms = 5;
+    throttled.retry_after_s = 30;
+    limiter.acquire("fast.example");
+    limiter.release("fast.example", throttled);
+    REQUIRE(limiter.snapshot().front().window == Approx(2.0));
+    REQUIRE(limiter.ready_in("fast.example") > std::chrono::seconds(29));
+    REQUIRE(limiter.ready_in("other.example") == std::chrono::steady_clock::duration::zero());
+}
+
+TEST_CASE("Crawler: extension pre-filter keeps binaries out of the frontier", "[crawler]") {
+    std::filesystem::remove_all("test_db");
+    Crawler crawler("test_db", nullptr);
+    REQUIRE(crawler.has_blocked_extension("http://example.com/report.PDF"));
+    REQUIRE(crawler.has_blocked_extension("http://example.com/img/logo.png?v=3"));
+    REQUIRE(!crawler.has_blocked_extension("http://example.com/page.html"));
+    REQUIRE(!crawler.has_blocked_extension("http://example.com/v1.2/docs"));
+    REQUIRE(!crawler.has_blocked_extension("http://example.com"));
+    FetchFilter filter;
+    REQUIRE(filter.allows_content_type("text/html"));
+    REQUIRE(!filter.allows_content_type("application/pdf"));
+}
+
+TEST_CASE("Iblt: folding and peeling a set difference", "[crawler]") {
+    Iblt mine(10), theirs(10);
+    for (uint64_t key = 1; key <= 20000; ++key) {
+        mine.insert(key * 0x9E3779B97F4A7C15ull);
+        theirs.insert(key * 0x9E3779B97F4A7C15ull);
+    }
+    std::vector<uint64_t> only_mine = {11, 22, 33}, only_theirs;
+    for (uint64_t key : only_mine) mine.insert(key);
+    for (uint64_t key = 100; key < 160; ++key) {
+        theirs.insert(key);
+        only_theirs.push_back(key);
+    }
+    // A folded table equals one built at the smaller size
+    Iblt small(6);
+    for (uint64_t key : only_mine) small.insert(key);
+    Iblt folded(10);
+    for (uint64_t key : only_mine) folded.insert(key);
+    std::vector<uint8_t> a, b;
+    small.encode(a);
+    folded.fold(6).encode(b);
+    REQUIRE(a == b);
+    REQUIRE(a.size() == small.size() * Iblt::kCellBytes);
+
+    Iblt diff = mine.fold(6);
+    diff.subtract(theirs.fold(6));
+    std::vector<uint64_t> positive, negative;
+    REQUIRE(diff.peel(positive, negative));
+    std::sort(positive.begin(), positive.end());
+    std::sort(negative.begin(), negative.end());
+    REQUIRE(positive == only_mine);
+    REQUIRE(negative == only_theirs);
+    // Too small for 63 keys
+    Iblt tiny = mine.fold(3);
+    tiny.subtract(theirs.fold(3));
+    positive.clear();
+    negative.clear();
+    REQUIRE_FALSE(tiny.peel(positive, negative));
+    REQUIRE_THROWS_AS(mine.fold(11), std::invalid_argument);
+}
+
+namespace {
+
+/**
+ * @brief Delivers direct messages straight to another in-process node.
+ */
+class LoopbackNode : public p2p_dht::DHTNode {
+public:
+    std::string id;
+    LoopbackNode* peer = nullptr;
+    p2p_dht::MessageCallback on_direct;
+    size_t bytes_sent = 0;
+
+    void join(const std::vector<std::string>&) override {}
+    std::string peer_id() const override { return id; }
+    void publish(const std::string&, const std::vector<uint8_t>& data) override { bytes_sent += data.size(); }
+    void subscribe(const std::string&, p2p_dht::MessageCallback) override {}
+    std::vector<std::string> get_peers(const std::string&) override { return {peer->id}; }
+    void send_direct(const std::string&, const std::vector<uint8_t>& msg) override {
+        bytes_sent += msg.size();
+        if (peer->on_direct) peer->on_direct(id, msg);
+    }
+    void on_direct_message(p2p_dht::MessageCallback callback) override { on_direct = callback; }
+    void set_encryption(bool) override {}
+};
+
+} // namespace
+
+TEST_CASE("Crawler: seen URLs are reconciled through sketches", "[crawler]") {
+    auto node_a = std::make_shared<LoopbackNode>();
+    auto node_b = std::make_shared<LoopbackNode>();
+    node_a->id = "a";
+    node_b->id = "b";
+    node_a->peer = node_b.get();
+    node_b->peer = node_a.get();
+    std::filesystem::remove_all("test_db_sync_a");
+    std::filesystem::remove_all("test_db_sync_b");
+    Crawler a("test_db_sync_a", node_a);
+    Crawler b("test_db_sync_b", node_b);
+    // run_concurrent installs the handlers; with an empty frontier it returns at once
+    a.set_url_sync_interval(0);
+    b.set_url_sync_interval(0);
+    a.run_concurrent(1);
+    b.run_concurrent(1);
+    for (int i = 0; i < 5000; ++i) {
+        std::string url = "http://host" + std::to_string(i % 50) + ".example.com/p" + std::to_string(i);
+        a.dht_publish_url(url);
+        b.dht_publish_url(url);
+    }
+    for (int i = 0; i < 40; ++i) a.dht_publish_url("http://a.example.com/" + std::to_string(i));
+    for (int i = 0; i < 25; ++i) b.dht_publish_url("http://b.example.com/" + std::to_string(i));
+
+    a.sync_seen_urls();
+    REQUIRE(a.url_sync_stats().urls_learned == 25);
+    REQUIRE(b.url_sync_stats().urls_learned == 40);
+    // Far less than the 5,065 URLs themselves
+    REQUIRE(node_a->bytes_sent + node_b->bytes_sent < 8000);
+
+    // Nothing new: one small sketch and no reply
+    size_t before = node_a->bytes_sent + node_b->bytes_sent;
+    b.sync_seen_urls();
+    REQUIRE(b.url_sync_stats().urls_learned == 40);
+    REQUIRE(node_a->bytes_sent + node_b->bytes_sent - before < 3000);
+
+    // A difference larger than the first guess takes a larger sketch, not a failure
+    for (int i = 0; i < 3000; ++i) b.dht_publish_url("http://c.example.com/" + std::to_string(i));
+    a.sync_seen_urls();
+    REQUIRE(a.url_sync_stats().urls_learned == 3025);
+    REQUIRE(a.url_sync_stats().decode_failures + b.url_sync_stats().decode_failures >= 1);
+}
+
+TEST_CASE("HostRing: balanced ownership, minimal movement", "[crawler]") {
+    auto hosts_of = [](const HostRing& ring) {
+        std::map<std::string, std::string> owners;
+        for (int h = 0; h < 20000; ++h) {
+            std::string host = "host" + std::to_string(h) + ".example.com";
+            owners[host] = ring.owner(host);
+        }
+        return owners;
+    };
+    HostRing ring;
+    REQUIRE(ring.owner("example.com").empty());
+    REQUIRE(ring.set_members({"d", "b", "a", "c"}));
+    REQUIRE_FALSE(ring.set_members({"a", "b", "c", "d", "a"}));
+    auto four = hosts_of(ring);
+    std::map<std::string, int> load;
+    for (const auto& entry : four) ++load[entry.second];
+    REQUIRE(load.size() == 4);
+    for (const auto& entry : load) {
+        REQUIRE(entry.second > 5000 * 0.75);
+        REQUIRE(entry.second < 5000 * 1.3);
+    }
+
+    // A fifth member takes about a fifth of the hosts, and only hosts move to it
+    ring.set_members({"a", "b", "c", "d", "e"});
+    auto five = hosts_of(ring);
+    int moved = 0;
+    for (const auto& entry : five) {
+        if (entry.second == four[entry.first]) continue;
+        REQUIRE(entry.second == "e");
+        ++moved;
+    }
+    REQUIRE(moved > 4000 * 0.75);
+    REQUIRE(moved < 4000 * 1.3);
+    // When it leaves, every host returns to its previous owner
+    ring.set_members({"a", "b", "c", "d"});
+    REQUIRE(hosts_of(ring) == four);
+}
+
+namespace {
+
+/**
+ * @brief In-process crawl node: direct messages go straight to the addressed
+ *        node, and every node on the bus is a topic peer.
+ */
+class BusNode : public p2p_dht::DHTNode {
+public:
+    BusNode(std::map<std::string, BusNode*>& bus, const std::string& id) : bus_(bus), id_(id) { bus_[id_] = this; }
+    ~BusNode() override { bus_.erase(id_); }
+
+    p2p_dht::MessageCallback on_direct;
+    size_t messages = 0;
+
+    void join(const std::vector<std::string>&) override {}
+    std::string peer_id() const override { return id_; }
+    void publish(const std::string&, const std::vector<uint8_t>&) override {}
+    void subscribe(const std::string&, p2p_dht::MessageCallback) override {}
+    std::vector<std::string> get_peers(const std::string&) override {
+        std::vector<std::string> peers;
+        for (const auto& entry : bus_) {
+            if (entry.first != id_) peers.push_back(entry.first);
+        }
+        return peers;
+    }
+    void send_direct(const std::string& peer_id, const std::vector<uint8_t>& msg) override {
+        ++messages;
+        auto it = bus_.find(peer_id);
+        if (it != bus_.end() && it->second->on_direct) it->second->on_direct(id_, msg);
+    }
+    void on_direct_message(p2p_dht::MessageCallback callback) override { on_direct = callback; }
+    void set_encryption(bool) override {}
+
+private:
+    std::map<std::string, BusNode*>& bus_;
+    std::string id_;
+};
+
+} // namespace
+
+TEST_CASE("Crawler: hosts are owned by one node, URLs routed in batches", "[crawler]") {
+    std::map<std::string, BusNode*> bus;
+    std::vector<std::shared_ptr<BusNode>> nodes;
+    std::vector<std::unique_ptr<Crawler>> crawlers;
+    auto start = [&](size_t i) {
+        nodes.push_back(std::make_shared<BusNode>(bus, "node" + std::to_string(i)));
+        std::filesystem::remove_all("test_db_shard_" + std::to_string(i));
+        crawlers.push_back(std::make_unique<Crawler>("test_db_shard_" + std::to_string(i), nodes.back()));
+        crawlers.back()->set_url_sync_interval(0);
+        // Installs the message handler and lists the members; the frontier is empty
+        crawlers.back()->run_concurrent(1);
+    };
+    for (size_t i = 0; i < 3; ++i) start(i);
+    for (auto& crawler : crawlers) crawler->refresh_shards();
+
+    std::vector<std::string> urls;
+    for (int i = 0; i < 3000; ++i) {
+        urls.push_back("http://host" + std::to_string(i % 300) + ".example.com/p" + std::to_string(i));
+    }
+    auto expected = [&](size_t i) {
+        size_t n = 0;
+        for (const std::string& url : urls) n += crawlers[0]->host_owner(url.substr(7, url.find('/', 7) - 7)) == nodes[i]->peer_id();
+        return n;
+    };
+    auto total = [&] {
+        size_t n = 0;
+        for (auto& crawler : crawlers) n += crawler->frontier_size();
+        return n;
+    };
+
+    // Every node agrees on the owners; node 0 keeps its own hosts and routes the rest
+    for (int h = 0; h < 300; ++h) {
+        std::string host = "host" + std::to_string(h) + ".example.com";
+        REQUIRE(crawlers[1]->host_owner(host) == crawlers[0]->host_owner(host));
+        REQUIRE(crawlers[2]->host_owner(host) == crawlers[0]->host_owner(host));
+    }
+    for (const std::string& url : urls) crawlers[0]->add_url(url);
+    crawlers[0]->flush_url_batches();
+    REQUIRE(total() == urls.size());
+    for (size_t i = 0; i < 3; ++i) {
+        REQUIRE(crawlers[i]->frontier_size() == expected(i));
+        REQUIRE(expected(i) > 600);
+    }
+    CrawlShards::Stats routed = crawlers[0]->shard_stats();
+    REQUIRE(routed.urls_routed == urls.size() - expected(0));
+    REQUIRE(routed.batches_sent <= 8);
+    REQUIRE(nodes[0]->messages == routed.batches_sent);
+
+    // The same links found elsewhere do not enqueue anything twice
+    for (const std::string& url : urls) crawlers[1]->add_url(url);
+    crawlers[1]->flush_url_batches();
+    REQUIRE(total() == urls.size());
+
+    // A fourth node joins: the others hand it its hosts' URLs, and nothing else moves
+    start(3);
+    for (size_t i = 0; i < 3; ++i) crawlers[i]->refresh_shards();
+    REQUIRE(total() == urls.size());
+    uint64_t handed_off = 0;
+    for (size_t i = 0; i < 4; ++i) {
+        REQUIRE(crawlers[i]->frontier_size() == expected(i));
+        REQUIRE(crawlers[i]->shard_stats().members == 4);
+        handed_off += crawlers[i]->shard_stats().urls_handed_off;
+    }
+    REQUIRE(handed_off == expected(3));
+    REQUIRE(expected(3) > 450);
+
+    // It leaves: its URLs go back to the previous owners, which enqueue them again
+    crawlers[3]->leave_shards();
+    REQUIRE(crawlers[3]->frontier_size() == 0);
+    crawlers.pop_back();
+    nodes.pop_back();
+    for (auto& crawler : crawlers) crawler->refresh_shards();
+    REQUIRE(total() == urls.size());
+    for (size_t i = 0; i < 3; ++i) REQUIRE(crawlers[i]->frontier_size() == expected(i));
+
+    // A node whose view is stale sends a URL to the wrong node, which passes it on once
+    std::string host = "host0.example.com";
+    for (int h = 1; crawlers[0]->host_owner(host) == "node0"; ++h) host = "host" + std::to_string(h) + ".example.com";
+    size_t owner = crawlers[0]->host_owner(host) == "node1" ? 1 : 2;
+    size_t wrong = 3 - owner;
+    nodes[0]->send_direct(nodes[wrong]->peer_id(),
+                          CrawlShards::encode(CrawlShards::kForwardable, {{"http://" + host + "/fresh", 0.5}}));
+    REQUIRE(crawlers[owner]->frontier_size() == expected(owner) + 1);
+    REQUIRE(crawlers[wrong]->shard_stats().urls_forwarded == 1);
+}
+
+TEST_CASE("CrawlShards: URL batches round-trip, malformed ones are rejected", "[crawler]") {
+    std::vector<uint8_t> message = CrawlShards::encode(CrawlShards::kForwardable,
+                                                       {{"http://a.example.com/", 1.0}, {"http://b.example.com/x", 0.0}});
+    uint8_t flags = 0;
+    std::vector<CrawlShards::Url> urls;
+    REQUIRE(CrawlShards::decode(message.data(), message.size(), flags, urls));
+    REQUIRE(flags == CrawlShards::kForwardable);
+    REQUIRE(urls.size() == 2);
+    REQUIRE(urls[1].url == "http://b.example.com/x");
+    REQUIRE(urls[0].priority == 1.0);
+    for (size_t len = 0; len < message.size(); ++len) {
+        urls.clear();
+        REQUIRE_FALSE(CrawlShards::decode(message.data(), len, flags, urls));
+    }
+    // A URL length of 2^64 - 1 must not wrap the bounds check
+    std::vector<uint8_t> huge = {CrawlShards::kUrlBatch, 0, 1};
+    huge.insert(huge.end(), 9, 0xFF);
+    huge.push_back(0x01);
+    huge.insert(huge.end(), {'h', 't', 't', 'p'});
+    urls.clear();
+    REQUIRE_FALSE(CrawlShards::decode(huge.data(), huge.size(), flags, urls));
+}
+
+TEST_CASE("KademliaNode: lookups, records and messages on localhost", "[p2p_dht]") {
+    using p2p_dht::KademliaNode;
+    auto eventually = [](const std::function<bool()>& done) {
+        for (int i = 0; i < 300 && !done(); ++i) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        return done();
+    };
+    std::mutex mutex;
+    std::vector<std::string> deliveries;
+    std::vector<uint8_t> direct;
+
+    auto loop = std::make_shared<p2p_dht::EventLoop>();
+    KademliaNode::Config config;
+    config.k = 8;
+    config.rpc_timeout_ms = 300;
+    config.peer_cache_s = 0;
+    std::vector<std::shared_ptr<KademliaNode>> nodes;
+    for (int i = 0; i < 40; ++i) {
+        nodes.push_back(std::make_shared<KademliaNode>("127.0.0.1", 0, config, loop));
+        if (i > 0) nodes.back()->join({nodes[i / 2]->contact().address()});
+    }
+    for (auto& node : nodes) REQUIRE(node->routing_table_size() >= 4);
+    REQUIRE_THROWS_AS(nodes[0]->set_encryption(true), std::logic_error);
+    nodes[0]->set_encryption(false);
+
+    // Lookups converge on the exact node
+    for (int i = 0; i < 40; ++i) {
+        const auto& target = nodes[(i * 7 + 3) % 40]->id();
+        if (target == nodes[i]->id()) continue;
+        KademliaNode::LookupResult result = nodes[i]->find_node_sync(target);
+        REQUIRE_FALSE(result.closest.empty());
+        REQUIRE(result.closest.front().id == target);
+        REQUIRE(result.hops >= 1);
+        REQUIRE(result.queries >= 1);
+    }
+
+    // Several values under one key, found from anywhere
+    auto key = KademliaNode::key_for("record");
+    nodes[5]->put(key, "value-1");
+    nodes[9]->put(key, "value-2");
+    REQUIRE(eventually([&] { return nodes[30]->find_value_sync(key).values.size() == 2; }));
+    REQUIRE(nodes[0]->find_value_sync(KademliaNode::key_for("nothing")).values.empty());
+    REQUIRE_THROWS_AS(nodes[5]->put(key, std::string(config.max_value_bytes + 1, 'x')), std::invalid_argument);
+
+    // Topics: subscribers are found through the DHT and receive what is published
+    for (int i : {3, 17}) {
+        nodes[i]->subscribe("pages", [&, i](const std::string& from, const std::vector<uint8_t>& data) {
+            std::lock_guard<std::mutex> lock(mutex);
+            deliveries.push_back(std::to_string(i) + ":" + from + ":" + std::string(data.begin(), data.end()));
+        });
+    }
+    REQUIRE(eventually([&] { return nodes[25]->get_peers("pages").size() == 2; }));
+    nodes[25]->publish("pages", {'h', 'i'});
+    REQUIRE(eventually([&] {
+        std::lock_guard<std::mutex> lock(mutex);
+        return deliveries.size() == 2;
+    }));
+    std::sort(deliveries.begin(), deliveries.end());
+    // from is the neighbour that passed it on: the publisher or the other subscriber
+    REQUIRE(deliveries[0].substr(deliveries[0].size() - 3) == ":hi");
+    REQUIRE(deliveries[0].rfind("17:", 0) == 0);
+    REQUIRE(deliveries[1].rfind("3:", 0) == 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    REQUIRE(deliveries.size() == 2);
+
+    // Direct messages larger than a datagram arrive whole
+    std::vector<uint8_t> large(100000);
+    for (size_t i = 0; i < large.size(); ++i) large[i] = uint8_t(i * 31);
+    nodes[0]->on_direct_message([&](const std::string&, const std::vector<uint8_t>& data) {
+        std::lock_guard<std::mutex> lock(mutex);
+        direct = data;
+    });
+    nodes[39]->send_direct(nodes[0]->id().hex(), large);
+    REQUIRE(eventually([&] {
+        std::lock_guard<std::mutex> lock(mutex);
+        return direct == large;
+    }));
+    REQUIRE_THROWS_AS(nodes[39]->send_direct("not-an-id", large), std::invalid_argument);
+
+    // Records expire with the TTL of the node that stored them
+    KademliaNode::Config short_lived = config;
+    short_lived.record_ttl_s = 1;
+    auto temporary = std::make_shared<KademliaNode>("127.0.0.1", 0, short_lived, loop);
+    temporary->join({nodes[0]->contact().address()});
+    auto gone = KademliaNode::key_for("gone");
+    temporary->put(gone, "soon", false);
+    REQUIRE(eventually([&] { return nodes[1]->find_value_sync(gone).values.size() == 1; }));
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    REQUIRE(nodes[1]->find_value_sync(gone).values.empty());
+}
+
+TEST_CASE("SeenCache: time-bucketed deduplication", "[p2p_dht]") {
+    p2p_dht::SeenCache seen(1000, 1e-3, 4, std::chrono::seconds(4));
+    auto t0 = std::chrono::steady_clock::now();
+    for (uint64_t id = 0; id < 1000; ++id) REQUIRE(seen.insert(id, t0));
+    for (uint64_t id = 0; id < 1000; ++id) REQUIRE_FALSE(seen.insert(id, t0));
+    size_t false_positives = 0;
+    for (uint64_t id = 1000; id < 101000; ++id) false_positives += seen.contains(id, t0) ? 1 : 0;
+    REQUIRE(false_positives < 300);
+    // Remembered for three spans, forgotten once its span is reused
+    REQUIRE(seen.contains(7, t0 + std::chrono::milliseconds(3900)));
+    REQUIRE_FALSE(seen.contains(7, t0 + std::chrono::milliseconds(4100)));
+    REQUIRE(seen.memory_bytes() < 4 * 2048);
+}
+
+TEST_CASE("GossipRouter: every subscriber once, frames per peer bounded", "[p2p_dht]") {
+    using p2p_dht::GossipRouter;
+    const size_t kNodes = 30;
+    struct Frame {
+        size_t from, to;
+        std::vector<uint8_t> data;
+    };
+    std::vector<Digest256> ids;
+    std::unordered_map<Digest256, size_t> index;
+    std::vector<std::unique_ptr<GossipRouter>> routers;
+    std::vector<Frame> inflight;
+    std::vector<Digest256> subscribed;
+    std::vector<std::vector<std::string>> received(kNodes);
+    std::map<std::pair<size_t, size_t>, int> frames_this_second;
+    int max_frames_per_link = 0;
+    for (size_t i = 0; i < kNodes; ++i) {
+        ids.push_back(Digest256::of("node" + std::to_string(i)));
+        index[ids[i]] = i;
+    }
+    for (size_t i = 0; i < kNodes; ++i) {
+        GossipRouter::Transport transport;
+        transport.send = [&, i](const Digest256& peer, const std::vector<uint8_t>& frame) {
+            size_t to = index.at(peer);
+            inflight.push_back(Frame{i, to, frame});
+            max_frames_per_link = std::max(max_frames_per_link, ++frames_this_second[{i, to}]);
+        };
+        transport.find_peers = [&](const std::string&, std::function<void(const std::vector<Digest256>&)> done) {
+            done(subscribed);
+        };
+        transport.wake = [](int) {};
+        routers.push_back(std::make_unique<GossipRouter>(ids[i], GossipRouter::Config(), transport));
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    auto deliver_all = [&](std::chrono::steady_clock::time_point now) {
+        while (!inflight.empty()) {
+            std::vector<Frame> frames;
+            frames.swap(inflight);
+            for (const Frame& frame : frames) routers[frame.to]->handle(ids[frame.from], frame.data.data(), frame.data.size(), now);
+            for (auto& router : routers) router->flush(now);
+        }
+    };
+    for (size_t i = 0; i < kNodes; ++i) {
+        routers[i]->subscribe("urls", [&, i](const std::string&, const std::vector<uint8_t>& data) {
+            received[i].emplace_back(data.begin(), data.end());
+        });
+        subscribed.push_back(ids[i]);
+    }
+    for (int beat = 1; beat <= 3; ++beat) {
+        auto now = t0 + std::chrono::seconds(beat);
+        for (auto& router : routers) router->heartbeat(now);
+        for (auto& router : routers) router->flush(now);
+        deliver_all(now);
+    }
+    for (auto& router : routers) {
+        REQUIRE(router->mesh("urls").size() >= 4);
+        REQUIRE(router->mesh("urls").size() <= 12);
+    }
+
+    // 4,000 messages a second from three publishers for one (virtual) second
+    max_frames_per_link = 0;
+    auto start = t0 + std::chrono::seconds(4);
+    for (int ms = 0; ms < 1500; ++ms) {
+        auto now = start + std::chrono::milliseconds(ms);
+        if (ms % 1000 == 0) frames_this_second.clear();
+        if (ms < 1000) {
+            for (int k = 0; k < 4; ++k) {
+                std::string url = "http://example.com/" + std::to_string(ms * 4 + k);
+                routers[(ms * 4 + k) % 3]->publish("urls", std::vector<uint8_t>(url.begin(), url.end()), now);
+            }
+        }
+        for (auto& router : routers) router->flush(now);
+        deliver_all(now);
+    }
+    // The same URL published again is suppressed at the source
+    std::string again = "http://example.com/1";
+    routers[5]->publish("urls", std::vector<uint8_t>(again.begin(), again.end()), start + std::chrono::seconds(2));
+    REQUIRE(routers[5]->stats().duplicates >= 1);
+
+    for (size_t i = 0; i < kNodes; ++i) {
+        std::unordered_set<std::string> unique(received[i].begin(), received[i].end());
+        REQUIRE(unique.size() == received[i].size());
+        REQUIRE(received[i].size() == (i < 3 ? 4000 - 4000 / 3 - (i < 4000 % 3 ? 1 : 0) : 4000));
+    }
+    // 50 ms flush interval: at most 20 frames per peer per second (plus the first)
+    REQUIRE(max_frames_per_link <= 21);
+    uint64_t frames = 0, forwarded = 0;
+    for (auto& router : routers) {
+        frames += router->stats().frames_sent;
+        forwarded += router->stats().forwarded;
+    }
+    REQUIRE(frames * 20 < forwarded);
+
+    // A message claiming another message's ID is dropped and does not suppress it
+    std::string next = "http://example.com/next";
+    std::vector<uint8_t> next_data(next.begin(), next.end());
+    uint64_t next_id = GossipRouter::message_id("urls", next_data);
+    std::vector<uint8_t> forged = {1, 4, 'u', 'r', 'l', 's', 1};
+    for (int b = 0; b < 8; ++b) forged.push_back(uint8_t(next_id >> (8 * b)));
+    forged.insert(forged.end(), {4, 'j', 'u', 'n', 'k'});
+    auto later = start + std::chrono::seconds(3);
+    routers[7]->handle(ids[8], forged.data(), forged.size(), later);
+    REQUIRE(routers[7]->stats().rejected == 1);
+    size_t before = received[7].size();
+    routers[0]->publish("urls", next_data, later);
+    for (int ms = 0; ms < 500; ms += 50) {
+        for (auto& router : routers) router->flush(later + std::chrono::milliseconds(ms));
+        deliver_all(later + std::chrono::milliseconds(ms));
+    }
+    REQUIRE(received[7].size() == before + 1);
+    REQUIRE(received[7].back() == next);
+}
+
+TEST_CASE("GossipRouter: no state kept for departed peers or foreign topics", "[p2p_dht]") {
+    using p2p_dht::GossipRouter;
+    Digest256 self = Digest256::of("self"), peer = Digest256::of("peer");
+    std::vector<std::vector<uint8_t>> sent;
+    GossipRouter::Transport transport;
+    transport.send = [&](const Digest256&, const std::vector<uint8_t>& frame) { sent.push_back(frame); };
+    transport.find_peers = [](const std::string&, std::function<void(const std::vector<Digest256>&)> done) { done({}); };
+    transport.wake = [](int) {};
+    GossipRouter router(self, GossipRouter::Config(), transport);
+    auto now = std::chrono::steady_clock::now();
+
+    // A GRAFT for a topic we do not subscribe to is answered with a PRUNE,
+    // after which the peer's queue goes away
+    std::vector<uint8_t> graft = {2, 4, 'u', 'r', 'l', 's'};
+    router.handle(peer, graft.data(), graft.size(), now);
+    router.flush(now);
+    REQUIRE(sent.size() == 1);
+    REQUIRE(sent[0][0] == 3);
+    router.flush(now + std::chrono::seconds(1));
+    REQUIRE(router.stats().peers == 0);
+
+    // A message on a topic we neither deliver nor forward is not remembered,
+    // so it is delivered once we subscribe
+    std::string url = "http://example.com/";
+    std::vector<uint8_t> data(url.begin(), url.end());
+    uint64_t id = GossipRouter::message_id("urls", data);
+    std::vector<uint8_t> frame = {1, 4, 'u', 'r', 'l', 's', 1};
+    for (int b = 0; b < 8; ++b) frame.push_back(uint8_t(id >> (8 * b)));
+    frame.push_back(uint8_t(data.size()));
+    frame.insert(frame.end(), data.begin(), data.end());
+    router.handle(peer, frame.data(), frame.size(), now);
+    std::vector<std::string> received;
+    router.subscribe("urls", [&](const std::string&, const std::vector<uint8_t>& message) {
+        received.emplace_back(message.begin(), message.end());
+    });
+    router.handle(peer, frame.data(), frame.size(), now);
+    REQUIRE(received == std::vector<std::string>{url});
+    REQUIRE(router.stats().duplicates == 0);
+}
+
+TEST_CASE("KademliaNode: stored values and reassembly are bounded per peer", "[p2p_dht]") {
+    using p2p_dht::KademliaNode;
+    using p2p_dht::SimNetwork;
+    SimNetwork network(SimNetwork::Config{});
+    KademliaNode::Config config;
+    config.max_records_per_peer = 3;
+    config.max_partial_bytes = 64 << 10;
+    auto node = std::make_shared<KademliaNode>(network.add_endpoint(), config);
+    auto peer = std::make_shared<KademliaNode>(network.add_endpoint(), KademliaNode::Config());
+    bool joined = false;
+    peer->join_async({node->contact()}, [&] { joined = true; });
+    REQUIRE(network.run_until([&] { return joined; }, std::chrono::seconds(60)));
+
+    // Only the first values a peer stores are kept
+    for (int i = 0; i < 10; ++i) peer->put(KademliaNode::key_for("key" + std::to_string(i)), "value", false);
+    network.run_for(std::chrono::seconds(5));
+    REQUIRE(node->stored_for_peers() == 3);
+
+    // A message larger than the reassembly budget is dropped; the budget
+    // comes back once its partial expires
+    std::vector<size_t> received;
+    node->on_direct_message([&](const std::string&, const std::vector<uint8_t>& data) { received.push_back(data.size()); });
+    peer->send_direct(node->id().hex(), std::vector<uint8_t>(20000, 'a'));
+    network.run_for(std::chrono::seconds(5));
+    peer->send_direct(node->id().hex(), std::vector<uint8_t>(200000, 'b'));
+    network.run_for(std::chrono::seconds(5));
+    REQUIRE(received == std::vector<size_t>{20000});
+    network.run_for(std::chrono::seconds(60));
+    peer->send_direct(node->id().hex(), std::vector<uint8_t>(30000, 'c'));
+    network.run_for(std::chrono::seconds(5));
+    REQUIRE(received == std::vector<size_t>{20000, 30000});
+}
+
+TEST_CASE("SimNetwork: deterministic Kademlia under loss, partitions and churn", "[p2p_dht]") {
+    using p2p_dht::KademliaNode;
+    using p2p_dht::SimNetwork;
+    const size_t kNodes = 300;
+    struct Sim {
+        std::unique_ptr<SimNetwork> network;
+        std::vector<std::shared_ptr<KademliaNode>> nodes;
+    };
+    KademliaNode::Config config;
+    config.k = 8;
+    config.rpc_timeout_ms = 500;
+    auto build = [&](uint64_t seed) {
+        Sim sim;
+        SimNetwork::Config net;
+        net.seed = seed;
+        sim.network = std::make_unique<SimNetwork>(net);
+        std::mt19937_64 rng(seed);
+        for (size_t i = 0; i < kNodes; ++i) {
+            sim.nodes.push_back(std::make_shared<KademliaNode>(sim.network->add_endpoint(), config));
+            if (i == 0) continue;
+            bool joined = false;
+            sim.nodes[i]->join_async({sim.nodes[rng() % i]->contact()}, [&] { joined = true; });
+            REQUIRE(sim.network->run_until([&] { return joined; }, std::chrono::seconds(60)));
+        }
+        return sim;
+    };
+    auto lookup = [](Sim& sim, size_t from, const p2p_dht::NodeId& target) {
+        KademliaNode::LookupResult out;
+        bool done = false;
+        sim.nodes[from]->find_node(target, [&](const KademliaNode::LookupResult& result) {
+            out = result;
+            done = true;
+        });
+        sim.network->run_until([&] { return done; }, std::chrono::seconds(60));
+        return out;
+    };
+    auto found = [&](Sim& sim, size_t from, size_t to) {
+        KademliaNode::LookupResult result = lookup(sim, from, sim.nodes[to]->id());
+        return !result.closest.empty() && result.closest.front().id == sim.nodes[to]->id();
+    };
+
+    Sim sim = build(7);
+    for (auto& node : sim.nodes) REQUIRE(node->routing_table_size() >= 8);
+    double virtual_ms = 0;
+    for (size_t i = 0; i < 100; ++i) {
+        size_t to = (i * 37 + 11) % kNodes;
+        if (to == i) continue;
+        KademliaNode::LookupResult result = lookup(sim, i, sim.nodes[to]->id());
+        REQUIRE(result.closest.front().id == sim.nodes[to]->id());
+        virtual_ms += result.latency_ms;
+    }
+    // Latency is virtual: a few round trips of 10..30 ms links
+    REQUIRE(virtual_ms / 100 > 20);
+    REQUIRE(virtual_ms / 100 < 1000);
+
+    // The same seed repeats the run exactly; another seed does not
+    {
+        Sim again = build(7);
+        Sim other = build(8);
+        for (size_t i = 0; i < 100; ++i) {
+            size_t to = (i * 37 + 11) % kNodes;
+            if (to != i) lookup(again, i, again.nodes[to]->id());
+        }
+        REQUIRE(again.network->stats().sent == sim.network->stats().sent);
+        REQUIRE(again.network->stats().events == sim.network->stats().events);
+        REQUIRE(again.network->now() == sim.network->now());
+        for (size_t i = 0; i < kNodes; ++i) REQUIRE(again.nodes[i]->id() == sim.nodes[i]->id());
+        REQUIRE(other.nodes[1]->id() != sim.nodes[1]->id());
+    }
+
+    // 10% loss: retries through other contacts still find nearly every node
+    sim.network->set_loss(0.1);
+    int exact = 0;
+    for (size_t i = 0; i < 50; ++i) exact += found(sim, i, (i * 53 + 101) % kNodes);
+    REQUIRE(exact >= 45);
+    REQUIRE(sim.network->stats().lost > 0);
+    sim.network->set_loss(0);
+
+    // A partition hides the other half until it heals
+    std::vector<uint32_t> left, right;
+    for (size_t i = 0; i < kNodes; ++i) (i < kNodes / 2 ? left : right).push_back(sim.nodes[i]->contact().ip);
+    sim.network->partition({left, right});
+    REQUIRE_FALSE(found(sim, 0, kNodes - 1));
+    REQUIRE(found(sim, 0, kNodes / 2 - 1));
+    REQUIRE(sim.network->stats().partitioned > 0);
+    sim.network->heal();
+    REQUIRE(found(sim, 1, kNodes - 1));
+
+    // Churn: a fifth of the nodes leave without notice
+    for (size_t i = 0; i < kNodes; i += 5) sim.nodes[i].reset();
+    sim.network->run_for(std::chrono::seconds(1));
+    exact = 0;
+    int tried = 0;
+    for (size_t i = 1; i < kNodes; i += 5) {
+        size_t to = (i * 31 + 2) % kNodes;
+        if (!sim.nodes[to] || to == i) continue;
+        ++tried;
+        exact += found(sim, i, to);
+    }
+    REQUIRE(tried > 40);
+    REQUIRE(exact == tried);
+    REQUIRE(sim.network->stats().offline > 0);
+}
+
+TEST_CASE("SitemapParser: streaming urlset and sitemap index", "[crawler]") {
+    std::vector<SitemapEntry> entries;
+    SitemapParser parser([&](const SitemapEntry& e) { entries.push_back(e); });
+    std::string xml = "<?xml version=\"1.0\"?><urlset>"
+                      "<url><loc>http://example.com/a?x=1&amp;y=2</loc><lastmod>2020-01-01</lastmod>"
+                      "<changefreq>daily</changefreq><priority>0.9</priority></url>"
+                      "<url><loc>http://example.com/b</loc></url></urlset>";
+    // Feed in small chunks to exercise tag boundaries split across reads
+    for (size_t i = 0; i < xml.size(); i += 5) {
+        REQUIRE(parser.feed(xml.data() + i, std::min<size_t>(5, xml.size() - i)));
+    }
+    REQUIRE(entries.size() == 2);
+    REQUIRE(entries[0].loc == "http://example.com/a?x=1&y=2");
+    REQUIRE(entries[0].changefreq == "daily");
+    REQUIRE(entries[0].priority == Approx(0.9));
+    REQUIRE(entries[1].priority_hint(std::time(nullptr)) == Approx(0.5));
+
+    entries.clear();
+    SitemapParser index([&](const SitemapEntry& e) { entries.push_back(e); });
+    std::string idx = "<sitemapindex><sitemap><loc>http://example.com/s1.xml.gz</loc></sitemap></sitemapindex>";
+    index.feed(idx.data(), idx.size());
+    REQUIRE(entries.size() == 1);
+    REQUIRE(entries[0].is_index);
+}
+
+static std::string gzip(const std::string& data) {
+    z_stream zs{};
+    REQUIRE(deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+    std::string out(deflateBound(&zs, data.size()), '\0');
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    zs.avail_in = static_cast<uInt>(data.size());
+    zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    zs.avail_out = static_cast<uInt>(out.size());
+    REQUIRE(deflate(&zs, Z_FINISH) == Z_STREAM_END);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return out;
+}
+
+TEST_CASE("SitemapParser: gzipped sitemap fed in small chunks", "[crawler]") {
+    // Padding compresses so well that a few input bytes fill the inflate window
+    std::string xml = "<urlset>";
+    for (int i = 0; i < 200; ++i) {
+        xml += "<url><loc>http://example.com/" + std::to_string(i) + "</loc></url>";
+        xml += "<!--" + std::string(5000, ' ') + "-->";
+    }
+    xml += "<url><loc>http://example.com/last</loc></url></urlset>";
+    std::string gz = gzip(xml);
+    REQUIRE(gz.size() < xml.size() / 50);
+
+    std::vector<std::string> locs;
+    SitemapParser parser([&](const SitemapEntry& e) { locs.push_back(e.loc); });
+    for (size_t i = 0; i < gz.size(); i += 7) {
+        REQUIRE(parser.feed(gz.data() + i, std::min<size_t>(7, gz.size() - i)));
+    }
+    REQUIRE(parser.finish());
+    REQUIRE(locs.size() == 201);
+    REQUIRE(locs.back() == "http://example.com/last");
+
+    // A truncated stream keeps the records before the cut but fails finish()
+    locs.clear();
+    SitemapParser truncated([&](const SitemapEntry& e) { locs.push_back(e.loc); });
+    REQUIRE(truncated.feed(gz.data(), gz.size() / 2));
+    REQUIRE_FALSE(truncated.finish());
+    REQUIRE(!locs.empty());
+    REQUIRE(locs.size() < 201);
+}
+
+TEST_CASE("HtmlExtractor: main content, title and headings", "[crawler]") {
+    std::string html = "<html><head><title>Caf&eacute; &amp; Bar</title><script>var s = '<p>x</p>';</script></head>"
+                       "<body><nav><a href=\"/\">Home</a> <a href=\"/menu\">Our full menu today</a></nav>"
+                       "<h1>Opening hours</h1>"
+                       "<p>We are open every day from eight in the morning until late at night.</p>"
+                       "<div class=\"footer-links\"><p>Privacy policy terms of service and the cookie settings page</p></div>"
+                       "</body></html>";
+    ExtractedDocument doc = HtmlExtractor().extract(html);
+    REQUIRE(doc.title == "Caf\xC3\xA9 & Bar");
+    REQUIRE(doc.headings == std::vector<std::string>{"Opening hours"});
+    REQUIRE(doc.body == "We are open every day from eight in the morning until late at night.");
+    REQUIRE(HtmlExtractor::decode_entity("#x41") == "A");
+    REQUIRE(HtmlExtractor::decode_entity("bogus").empty());
+}
+
+TEST_CASE("Charset: detection order and streaming UTF-8 transcoding", "[crawler]") {
+    // Header label wins over <meta>; aliases map to the web supersets
+    std::string meta = "<html><head><meta charset=\"euc-jp\"></head>";
+    REQUIRE(CharsetDetector::detect("Shift_JIS", meta.data(), meta.size()).charset == "CP932");
+    REQUIRE(CharsetDetector::detect("", meta.data(), meta.size()).charset == "EUC-JP");
+    REQUIRE(CharsetDetector::charset_from_content_type("text/html; Charset=\"ISO-8859-1\"") == "ISO-8859-1");
+    REQUIRE(CharsetDetector::canonical_name("latin1") == "WINDOWS-1252");
+
+    // Shift_JIS "\xe3\x81\x93\xe3\x82\x93\xe3\x81\xab\xe3\x81\xa1\xe3\x81\xaf" (konnichiwa), fed one byte at a time
+    std::string sjis = "<p>\x82\xb1\x82\xf1\x82\xc9\x82\xbf\x82\xcd</p>";
+    CharsetDetection detected = CharsetDetector::detect("", sjis.data(), sjis.size());
+    REQUIRE(detected.charset == "CP932");
+    Utf8Transcoder transcoder(detected);
+    std::string out;
+    for (char c : sjis) transcoder.feed(&c, 1, out);
+    transcoder.finish(out);
+    REQUIRE(out == "<p>\xe3\x81\x93\xe3\x82\x93\xe3\x81\xab\xe3\x81\xa1\xe3\x81\xaf</p>");
+
+    // Undeclared ASCII prefix: UTF-8 until the first invalid byte, then windows-1252
+    std::string prefix(64, 'a');
+    Utf8Transcoder fallback(CharsetDetector::detect("", prefix.data(), prefix.size()));
+    std::string latin;
+    fallback.feed(prefix.data(), prefix.size(), latin);
+    fallback.feed("caf\xe9 \x93q\x94", 8, latin);
+    fallback.finish(latin);
+    REQUIRE(fallback.charset() == "WINDOWS-1252");
+    REQUIRE(latin == prefix + "caf\xc3\xa9 \xe2\x80\x9cq\xe2\x80\x9d");
+
+    // Declared UTF-8: invalid bytes become U+FFFD, split sequences survive chunking
+    Utf8Transcoder utf8(CharsetDetector::detect("utf-8", "", 0));
+    std::string text;
+    utf8.feed("ok\xc3", 3, text);
+    utf8.feed("\xa9\xff", 2, text);
+    utf8.finish(text);
+    REQUIRE(text == "ok\xc3\xa9\xef\xbf\xbd");
+    REQUIRE(utf8.replacements() == 1);
+    REQUIRE(Utf8Transcoder::ascii_prefix(prefix.data(), prefix.size()) == 64);
+    REQUIRE(!Utf8Transcoder::is_valid_utf8("\xed\xa0\x80", 3)); // surrogate
+}
+
 // Add more integration tests for DHT, concurrency, and full crawl pipeline as needed. 
\ No newline at end of file